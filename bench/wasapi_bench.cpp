@@ -0,0 +1,427 @@
+// Throughput benchmarks for the conversion and output paths.
+//
+// Every case pushes the same amount of audio through one component in
+// packets of each size of the sweep, which spans what --chunk-duration lets
+// WASAPI hand over at once, and reports input frames per second, ns per
+// frame and the multiple of real time. Conversion, mixing and resampling run
+// through the same StageChain the capture pipeline builds; output cases cover
+// the writer queue, raw file writes and the WAV sink; loudness metering runs
+// with every kernel set this CPU supports. Each case keeps its
+// best of several repeats. --json prints the results as one JSON document so
+// runs can be compared between releases.
+//
+// Usage: wasapi_bench [--seconds <s>] [--repeat <n>] [--packet-ms <list>] [--filter <text>] [--json]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "async_output.h"
+#include "audio_stages.h"
+#include "loudness_meter.h"
+#include "raw_output.h"
+#include "simd_arch.h"
+#include "wav_file_writer.h"
+
+namespace {
+
+struct Options {
+    double seconds = 10.0;  // audio per case
+    int repeat = 3;
+    std::vector<double> packetMs = {1, 10, 50, 100, 200};
+    std::string filter;
+    bool json = false;
+};
+
+struct Result {
+    std::string group;
+    std::string name;
+    std::string detail;  // stages or sink, with the kernels chosen
+    uint32_t sampleRate = 0;
+    uint32_t packetFrames = 0;
+    uint64_t frames = 0;
+    double seconds = 0.0;  // best repeat
+};
+
+AudioFormat Format(uint32_t rate, uint32_t channels, SampleType type) {
+    AudioFormat format;
+    format.sampleRate = rate;
+    format.channels = channels;
+    format.type = type;
+    return format;
+}
+
+// One second of a tone per channel in `format`, used round-robin as input
+std::vector<uint8_t> MakeSignal(const AudioFormat& format) {
+    const double kPi = 3.14159265358979323846;
+    std::vector<float> samples((size_t)format.sampleRate * format.channels);
+    for (uint32_t i = 0; i < format.sampleRate; i++) {
+        for (uint32_t c = 0; c < format.channels; c++) {
+            samples[(size_t)i * format.channels + c] =
+                0.5f * (float)std::sin(2 * kPi * 220.0 * (c + 1) * i / format.sampleRate);
+        }
+    }
+    std::vector<uint8_t> bytes(samples.size() * BytesPerSample(format.type));
+    for (size_t i = 0; i < samples.size(); i++) {
+        float v = samples[i];
+        switch (format.type) {
+            case SampleType::Float32: memcpy(&bytes[i * 4], &v, 4); break;
+            case SampleType::Int16: {
+                int16_t s = (int16_t)std::lround(v * 32767.0f);
+                memcpy(&bytes[i * 2], &s, 2);
+                break;
+            }
+            case SampleType::Int24: {
+                int32_t s = (int32_t)std::lround(v * 8388607.0f);
+                bytes[i * 3] = (uint8_t)s;
+                bytes[i * 3 + 1] = (uint8_t)(s >> 8);
+                bytes[i * 3 + 2] = (uint8_t)(s >> 16);
+                break;
+            }
+            case SampleType::Int32: {
+                int32_t s = (int32_t)std::lround(v * 2147483647.0);
+                memcpy(&bytes[i * 4], &s, 4);
+                break;
+            }
+        }
+    }
+    return bytes;
+}
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : options(options) {}
+
+    // Run `packet(offsetFrames, frames)` over options.seconds of audio for
+    // every packet size. `setup` runs untimed before each repeat; `finish`
+    // (draining, closing) is timed with it. Either may be empty.
+    void Run(const std::string& group, const std::string& name, const std::string& detail, uint32_t sampleRate,
+             const std::function<void()>& setup, const std::function<void(size_t, uint32_t)>& packet,
+             const std::function<void()>& finish) {
+        std::string label = group + " " + name;
+        if (!options.filter.empty() && label.find(options.filter) == std::string::npos) return;
+
+        uint64_t total = (uint64_t)(options.seconds * sampleRate);
+        for (double ms : options.packetMs) {
+            uint32_t packetFrames = std::max<uint32_t>(1, (uint32_t)std::lround(ms * sampleRate / 1000.0));
+            Result result;
+            result.group = group;
+            result.name = name;
+            result.detail = detail;
+            result.sampleRate = sampleRate;
+            result.packetFrames = packetFrames;
+            result.frames = total;
+            result.seconds = 1e30;
+            for (int r = 0; r < options.repeat; r++) {
+                if (setup) setup();
+                auto start = std::chrono::steady_clock::now();
+                size_t offset = 0;
+                for (uint64_t done = 0; done < total;) {
+                    uint32_t frames = (uint32_t)std::min<uint64_t>(packetFrames, total - done);
+                    // The input buffer holds one second
+                    if (offset + frames > sampleRate) offset = 0;
+                    packet(offset, frames);
+                    offset += frames;
+                    done += frames;
+                }
+                // Draining queues and closing files is part of the work
+                if (finish) finish();
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                result.seconds = std::min(result.seconds, elapsed);
+            }
+            Report(result);
+            results.push_back(result);
+        }
+    }
+
+    void PrintJson() const {
+        printf("{\n  \"benchmark\": \"wasapi_bench\",\n  \"version\": 1,\n");
+        printf("  \"cpu\": {\"sse2\": %s, \"avx2\": %s, \"neon\": %s},\n", CpuSupportsSse2() ? "true" : "false",
+               CpuSupportsAvx2() ? "true" : "false", CpuSupportsNeon() ? "true" : "false");
+        printf("  \"audio_seconds\": %g,\n  \"repeat\": %d,\n  \"results\": [\n", options.seconds, options.repeat);
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            printf("    {\"group\": \"%s\", \"name\": \"%s\", \"detail\": \"%s\", \"sample_rate\": %u, "
+                   "\"packet_frames\": %u, \"packet_ms\": %.3f, \"frames\": %llu, \"seconds\": %.6f, "
+                   "\"frames_per_sec\": %.1f, \"ns_per_frame\": %.3f, \"realtime\": %.1f}%s\n",
+                   r.group.c_str(), r.name.c_str(), Escape(r.detail).c_str(), r.sampleRate, r.packetFrames,
+                   r.packetFrames * 1000.0 / r.sampleRate, (unsigned long long)r.frames, r.seconds,
+                   r.frames / r.seconds, r.seconds * 1e9 / r.frames, r.frames / (double)r.sampleRate / r.seconds,
+                   i + 1 < results.size() ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+
+private:
+    const Options& options;
+    std::vector<Result> results;
+    std::string lastGroup;
+
+    void Report(const Result& r) {
+        // Progress goes to stderr so --json output stays clean
+        FILE* out = options.json ? stderr : stdout;
+        if (r.group != lastGroup) {
+            fprintf(out, "\n%-10s %-28s %9s %12s %10s %10s\n", r.group.c_str(), "case", "packet", "Mframes/s",
+                    "ns/frame", "realtime");
+            lastGroup = r.group;
+        }
+        fprintf(out, "%-10s %-28s %6.1f ms %12.2f %10.2f %9.0fx\n", "", r.name.c_str(),
+                r.packetFrames * 1000.0 / r.sampleRate, r.frames / r.seconds / 1e6, r.seconds * 1e9 / r.frames,
+                r.frames / (double)r.sampleRate / r.seconds);
+        fflush(out);
+    }
+
+    static std::string Escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '\n') {
+                escaped += "; ";
+            } else {
+                if (c == '"' || c == '\\') escaped += '\\';
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+};
+
+// Input format -> output format through a StageChain, with audio or with
+// silent views
+void BenchChain(Bench& bench, const std::string& group, const std::string& name, const AudioFormat& in,
+                const AudioFormat& out, bool silent, uint32_t maxPacketFrames) {
+    StageChain chain;
+    std::string error;
+    if (!chain.Build(in, out, StageChain::Options(), &error)) {
+        fprintf(stderr, "Skipping %s %s: %s\n", group.c_str(), name.c_str(), error.c_str());
+        return;
+    }
+    chain.Reserve(maxPacketFrames);
+    std::vector<uint8_t> signal = MakeSignal(in);
+    const uint32_t blockAlign = in.BlockAlign();
+    uint64_t checksum = 0;
+
+    bench.Run(group, name, chain.Describe(), in.sampleRate, nullptr,
+              [&](size_t offset, uint32_t frames) {
+                  AudioView view;
+                  view.data = silent ? nullptr : signal.data() + offset * blockAlign;
+                  view.frames = frames;
+                  AudioView result = chain.Process(view);
+                  checksum += result.frames + (result.data ? result.data[0] : 0);
+              },
+              nullptr);
+    // Keep the work observable
+    if (checksum == 1) printf(" ");
+}
+
+// Loudness and true-peak metering of `format` with each available kernel set
+void BenchMeter(Bench& bench, const AudioFormat& format) {
+    std::vector<uint8_t> signal = MakeSignal(format);
+    const uint32_t blockAlign = format.BlockAlign();
+    for (const MeterKernels* kernels : GetAvailableMeterKernels()) {
+        LoudnessMeter meter;
+        std::string error;
+        if (!meter.Initialize(format, kernels, &error)) {
+            fprintf(stderr, "Skipping meter: %s\n", error.c_str());
+            return;
+        }
+        std::string name = std::to_string(format.channels) + "ch " + SampleTypeName(format.type) + " " + kernels->name;
+        std::string detail = std::to_string(meter.TruePeakFactor()) + "x true peak, " + kernels->name;
+        bench.Run("meter", name, detail, format.sampleRate, nullptr,
+                  [&](size_t offset, uint32_t frames) {
+                      AudioView view;
+                      view.data = signal.data() + offset * blockAlign;
+                      view.frames = frames;
+                      meter.Process(view);
+                  },
+                  nullptr);
+    }
+}
+
+std::string TempPath(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void BenchOutputs(Bench& bench, const AudioFormat& format) {
+    std::vector<uint8_t> signal = MakeSignal(format);
+    const uint32_t blockAlign = format.BlockAlign();
+    std::string detail = std::to_string(format.sampleRate) + " Hz " + std::to_string(format.channels) + " ch " +
+                         SampleTypeName(format.type);
+
+    // Copy into the writer queue and drain it into a sink that discards
+    {
+        std::unique_ptr<AsyncOutput> queue;
+        bench.Run("output", "queue", detail, format.sampleRate,
+                  [&] {
+                      queue = std::make_unique<AsyncOutput>();
+                      queue->Start((size_t)format.BytesPerSecond() * 2,
+                                   [](const uint8_t*, size_t, const uint8_t*, size_t) { return true; });
+                  },
+                  [&](size_t offset, uint32_t frames) {
+                      while (!queue->Write(signal.data() + offset * blockAlign, (size_t)frames * blockAlign)) {
+                          std::this_thread::yield();
+                      }
+                  },
+                  [&] { queue->Stop(); });
+    }
+
+    // Unbuffered writes to a file, as stdout redirected to a file gets them
+    {
+        std::string path = TempPath("wasapi_bench_raw.pcm");
+        int fd = -1;
+        RawOutput output;
+        bench.Run("output", "raw file", detail, format.sampleRate,
+                  [&] {
+#ifdef _WIN32
+                      fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+                      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+                      output = RawOutput();
+                      output.OpenDescriptor(fd);
+                  },
+                  [&](size_t offset, uint32_t frames) {
+                      output.Write(signal.data() + offset * blockAlign, (size_t)frames * blockAlign);
+                  },
+                  [&] {
+#ifdef _WIN32
+                      _close(fd);
+#else
+                      close(fd);
+#endif
+                  });
+        std::remove(path.c_str());
+    }
+
+    // The memory-mapped WAV sink
+    {
+        std::string path = TempPath("wasapi_bench.wav");
+        WavFileWriter writer;
+        bench.Run("output", "wav file", detail, format.sampleRate,
+                  [&] {
+                      WavFormat wav;
+                      wav.sampleRate = format.sampleRate;
+                      wav.channels = (uint16_t)format.channels;
+                      wav.bitsPerSample = (uint16_t)format.BitsPerSample();
+                      wav.blockAlign = (uint16_t)blockAlign;
+                      std::string error;
+                      if (!writer.Open(path, wav, &error)) fprintf(stderr, "%s\n", error.c_str());
+                  },
+                  [&](size_t offset, uint32_t frames) {
+                      writer.Write(signal.data() + offset * blockAlign, (size_t)frames * blockAlign);
+                  },
+                  [&] { writer.Close(); });
+        std::remove(path.c_str());
+    }
+}
+
+bool ParseList(const char* text, std::vector<double>& values) {
+    values.clear();
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        double value = atof(list.substr(start, end - start).c_str());
+        if (value <= 0.0) return false;
+        values.push_back(value);
+        start = end + 1;
+    }
+    return !values.empty();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--seconds" && i + 1 < argc) {
+            options.seconds = atof(argv[++i]);
+            ok = options.seconds > 0.0;
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = atoi(argv[++i]);
+            ok = options.repeat > 0;
+        } else if (arg == "--packet-ms" && i + 1 < argc) {
+            ok = ParseList(argv[++i], options.packetMs);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--json") {
+            options.json = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr,
+                    "Usage: wasapi_bench [--seconds <s>] [--repeat <n>] [--packet-ms <list>] [--filter <text>] "
+                    "[--json]\n"
+                    "  --seconds <s>       Audio pushed through each case (default: 10)\n"
+                    "  --repeat <n>        Runs per case, the fastest is kept (default: 3)\n"
+                    "  --packet-ms <list>  Packet sizes to sweep (default: 1,10,50,100,200)\n"
+                    "  --filter <text>     Only cases whose \"group name\" contains this\n"
+                    "  --json              Print the results as JSON on stdout\n");
+            return 1;
+        }
+    }
+
+    uint32_t maxPacketFrames = 0;
+    for (double ms : options.packetMs) {
+        maxPacketFrames = std::max(maxPacketFrames, (uint32_t)std::lround(ms * 48000 / 1000.0) + 1);
+    }
+
+    Bench bench(options);
+    const AudioFormat f32 = Format(48000, 2, SampleType::Float32);
+
+    // Sample type conversion, the usual shared-mode float mix to integer
+    BenchChain(bench, "convert", "f32le->s16le", f32, Format(48000, 2, SampleType::Int16), false, maxPacketFrames);
+    BenchChain(bench, "convert", "f32le->s24le", f32, Format(48000, 2, SampleType::Int24), false, maxPacketFrames);
+    BenchChain(bench, "convert", "s16le->f32le", Format(48000, 2, SampleType::Int16), f32, false, maxPacketFrames);
+    BenchChain(bench, "convert", "s32le->s16le", Format(48000, 2, SampleType::Int32),
+               Format(48000, 2, SampleType::Int16), false, maxPacketFrames);
+
+    // Channel mixing in float
+    BenchChain(bench, "mix", "2->1 f32le", f32, Format(48000, 1, SampleType::Float32), false, maxPacketFrames);
+    BenchChain(bench, "mix", "8->2 f32le", Format(48000, 8, SampleType::Float32), f32, false, maxPacketFrames);
+
+    // Rate conversion at the common ratios
+    BenchChain(bench, "resample", "48000->44100 f32le", f32, Format(44100, 2, SampleType::Float32), false,
+               maxPacketFrames);
+    BenchChain(bench, "resample", "48000->16000 f32le", f32, Format(16000, 2, SampleType::Float32), false,
+               maxPacketFrames);
+    BenchChain(bench, "resample", "44100->48000 f32le", Format(44100, 2, SampleType::Float32), f32, false,
+               maxPacketFrames);
+    BenchChain(bench, "resample", "48000->16000 mono s16le", f32, Format(16000, 1, SampleType::Int16), false,
+               maxPacketFrames);
+
+    // Silent packets: skipped by conversion, fed through the resampler
+    BenchChain(bench, "silence", "f32le->s16le", f32, Format(48000, 2, SampleType::Int16), true, maxPacketFrames);
+    BenchChain(bench, "silence", "48000->44100 s16le", f32, Format(44100, 2, SampleType::Int16), true,
+               maxPacketFrames);
+
+    // Loudness metering of the output, in float and after encoding
+    BenchMeter(bench, f32);
+    BenchMeter(bench, Format(48000, 2, SampleType::Int16));
+    BenchMeter(bench, Format(48000, 6, SampleType::Float32));
+
+    BenchOutputs(bench, Format(48000, 2, SampleType::Int16));
+
+    if (options.json) bench.PrintJson();
+    return 0;
+}
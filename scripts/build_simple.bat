@@ -6,7 +6,7 @@ echo Building WASAPI Capture with cl.exe...
 REM Navigate to project root
 cd /d "%~dp0.."
 
-cl.exe /EHsc /O2 /std:c++17 src\wasapi_capture.cpp ole32.lib psapi.lib /Fe:wasapi_capture.exe
+cl.exe /EHsc /O2 /std:c++17 /Isrc src\*.cpp ole32.lib psapi.lib ws2_32.lib avrt.lib /Fe:wasapi_capture.exe
 
 if %ERRORLEVEL% EQU 0 (
     echo.
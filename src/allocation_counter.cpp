@@ -0,0 +1,145 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef AUDIO_COUNT_ALLOCATIONS
+
+namespace {
+
+thread_local uint64_t threadAllocations = 0;
+std::atomic<uint64_t> totalAllocations{0};
+std::atomic<uint64_t> liveBytes{0};
+std::atomic<uint64_t> peakBytes{0};
+
+// Each block starts with its size, in a header as large as the alignment
+// the caller was promised
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+
+void Count(size_t size) {
+    threadAllocations++;
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void* Allocate(size_t size, size_t alignment) {
+    size_t header = alignment > kHeaderSize ? alignment : kHeaderSize;
+    void* block = nullptr;
+#ifdef _WIN32
+    block = alignment > kHeaderSize ? _aligned_malloc(size + header, alignment) : std::malloc(size + header);
+#else
+    if (alignment > kHeaderSize) {
+        if (posix_memalign(&block, alignment, size + header) != 0) block = nullptr;
+    } else {
+        block = std::malloc(size + header);
+    }
+#endif
+    if (!block) return nullptr;
+    Count(size);
+    uint8_t* user = (uint8_t*)block + header;
+    ((size_t*)user)[-1] = size;
+    return user;
+}
+
+void Free(void* pointer, size_t alignment) {
+    if (!pointer) return;
+    size_t header = alignment > kHeaderSize ? alignment : kHeaderSize;
+    liveBytes.fetch_sub(((size_t*)pointer)[-1], std::memory_order_relaxed);
+    void* block = (uint8_t*)pointer - header;
+#ifdef _WIN32
+    if (alignment > kHeaderSize) {
+        _aligned_free(block);
+        return;
+    }
+#endif
+    std::free(block);
+}
+
+void* AllocateOrThrow(size_t size, size_t alignment) {
+    if (size == 0) size = 1;
+    for (;;) {
+        void* pointer = Allocate(size, alignment);
+        if (pointer) return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size ? size : 1, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size ? size : 1, 0); }
+void operator delete(void* pointer) noexcept { Free(pointer, 0); }
+void operator delete[](void* pointer) noexcept { Free(pointer, 0); }
+void operator delete(void* pointer, size_t) noexcept { Free(pointer, 0); }
+void operator delete[](void* pointer, size_t) noexcept { Free(pointer, 0); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Free(pointer, 0); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Free(pointer, 0); }
+
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return Allocate(size ? size : 1, (size_t)alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return Allocate(size ? size : 1, (size_t)alignment);
+}
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { Free(pointer, (size_t)alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { Free(pointer, (size_t)alignment); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { Free(pointer, (size_t)alignment); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept {
+    Free(pointer, (size_t)alignment);
+}
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    Free(pointer, (size_t)alignment);
+}
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    Free(pointer, (size_t)alignment);
+}
+
+bool AllocationCountingEnabled() { return true; }
+uint64_t ThreadHeapAllocations() { return threadAllocations; }
+uint64_t HeapAllocations() { return totalAllocations.load(std::memory_order_relaxed); }
+uint64_t PeakHeapBytes() { return peakBytes.load(std::memory_order_relaxed); }
+
+#else
+
+bool AllocationCountingEnabled() { return false; }
+uint64_t ThreadHeapAllocations() { return 0; }
+uint64_t HeapAllocations() { return 0; }
+uint64_t PeakHeapBytes() { return 0; }
+
+#endif
+
+uint64_t PeakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;  // bytes
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;  // kilobytes
+#endif
+#endif
+}
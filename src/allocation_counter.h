@@ -0,0 +1,31 @@
+#pragma once
+
+// Heap accounting for the capture path.
+//
+// Built with -DAUDIO_COUNT_ALLOCATIONS=ON, allocation_counter.cpp replaces
+// the global operator new and delete with versions that count every
+// allocation, per thread and in total, and track the peak number of live
+// heap bytes. The pipeline uses this to check that nothing on the capture
+// path allocates once it has warmed up: every buffer is sized when the
+// pipeline starts, so a steady-state allocation is a regression. Normal
+// builds keep the standard allocator, and the counts read as zero.
+//
+// PeakResidentBytes() is available in every build and reports the most
+// physical memory the process has used so far.
+
+#include <cstdint>
+
+// True when allocations are being counted
+bool AllocationCountingEnabled();
+
+// operator new calls made by the calling thread so far
+uint64_t ThreadHeapAllocations();
+
+// operator new calls made by all threads so far
+uint64_t HeapAllocations();
+
+// Most heap bytes live at once
+uint64_t PeakHeapBytes();
+
+// Peak working set / resident set size of the process; 0 if unknown
+uint64_t PeakResidentBytes();
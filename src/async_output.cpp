@@ -0,0 +1,200 @@
+#include "async_output.h"
+
+#include "allocation_counter.h"
+#include "realtime_thread.h"
+
+AsyncOutput::~AsyncOutput() {
+    Stop();
+}
+
+void AsyncOutput::SetCoalescing(size_t thresholdBytes, std::chrono::milliseconds latency) {
+    coalesceBytes = thresholdBytes;
+    maxLatency = latency.count() > 0 ? latency : std::chrono::milliseconds(0);
+}
+
+void AsyncOutput::SetLatencyHistograms(LatencyHistogram* writeHistogram, LatencyHistogram* endToEndHistogram) {
+    writeTimes = writeHistogram;
+    endToEnd = endToEndHistogram;
+}
+
+bool AsyncOutput::Start(size_t capacityBytes, WriteFunction writeFunction) {
+    if (running.load() || !writeFunction || !ring.Initialize(capacityBytes)) {
+        return false;
+    }
+    // A threshold the ring can never reach would leave only the deadline
+    if (coalesceBytes > ring.Capacity() / 2) coalesceBytes = ring.Capacity() / 2;
+    sink = std::move(writeFunction);
+    failed.store(false);
+    sinkCalls.store(0, std::memory_order_relaxed);
+    sinkNanoseconds.store(0, std::memory_order_relaxed);
+    markHead.store(0, std::memory_order_relaxed);
+    markTail.store(0, std::memory_order_relaxed);
+    lastMarkPosition = 0;
+    running.store(true, std::memory_order_release);
+    realtimeActive = false;
+    realtimeSettled = false;
+    realtimeStatus.clear();
+    steadyRequested.store(false, std::memory_order_relaxed);
+    steadyAllocations = 0;
+    writer = std::thread(&AsyncOutput::Run, this);
+    if (realtime) {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeup.wait(lock, [this] { return realtimeSettled; });
+    }
+    return true;
+}
+
+bool AsyncOutput::Write(const void* data, size_t size) {
+    return Write(data, size, nullptr, 0);
+}
+
+bool AsyncOutput::Write(const void* header, size_t headerSize, const void* data, size_t dataSize,
+                        size_t padding) {
+    size_t size = headerSize + dataSize + padding;
+    if (size == 0) return true;
+    if (failed.load(std::memory_order_relaxed)) return false;
+    bool ok = ring.Write(header, headerSize, data, dataSize, padding);
+    // Only pay for the mutex when the writer is actually asleep
+    if (writerWaiting.load(std::memory_order_acquire)) {
+        if (maxLatency.count() == 0) {
+            Wake();
+        } else {
+            // While coalescing the writer only needs to hear about the first
+            // pending packet (to start its deadline) and the threshold
+            size_t used = ring.Used();
+            if (used <= size || used >= coalesceBytes) Wake();
+        }
+    }
+    return ok;
+}
+
+void AsyncOutput::Mark(uint64_t timeNs) {
+    if (!endToEnd) return;
+    // Nothing queued since the last mark: it is already covered
+    uint64_t position = ring.WrittenBytes();
+    if (position == lastMarkPosition) return;
+    uint64_t head = markHead.load(std::memory_order_relaxed);
+    if (head - markTail.load(std::memory_order_acquire) >= kMaxMarks) return;
+    marks[head % kMaxMarks] = LatencyMark{position, timeNs};
+    markHead.store(head + 1, std::memory_order_release);
+    lastMarkPosition = position;
+}
+
+void AsyncOutput::Wake() {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeup.notify_one();
+}
+
+void AsyncOutput::Stop() {
+    if (!writer.joinable()) return;
+    running.store(false, std::memory_order_release);
+    Wake();
+    writer.join();
+}
+
+void AsyncOutput::Run() {
+    using Clock = std::chrono::steady_clock;
+    RealtimeThread scheduling;
+    if (realtime) {
+        std::string error;
+        bool active = scheduling.Enter(RealtimeThread::Role::Writer, &error);
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        realtimeActive = active;
+        realtimeStatus = active ? scheduling.Description() : error;
+        realtimeSettled = true;
+        wakeup.notify_all();
+    }
+    const auto idleWait = std::chrono::milliseconds(realtime ? 1 : 5);
+    bool pending = false;
+    Clock::time_point pendingSince;
+    uint64_t consumed = 0;     // queue position after the last sink call
+    uint64_t lastWriteNs = 0;  // when it returned
+    bool steady = false;
+    uint64_t steadyBase = 0;   // thread allocations at MarkSteady()
+
+    for (;;) {
+        if (!steady && steadyRequested.load(std::memory_order_acquire)) {
+            steady = true;
+            steadyBase = ThreadHeapAllocations();
+        }
+        // The producer marks a packet after queueing it, so the mark can
+        // arrive after the sink call that wrote it
+        if (endToEnd) RetireMarks(consumed, lastWriteNs);
+
+        const uint8_t* first;
+        const uint8_t* second;
+        size_t firstLength;
+        size_t secondLength;
+        size_t available = ring.Peek(&first, &firstLength, &second, &secondLength);
+
+        if (available == 0) {
+            pending = false;
+            if (!running.load(std::memory_order_acquire)) {
+                // Re-check after observing the stop flag so nothing queued
+                // just before Stop() is lost
+                if (ring.Empty()) break;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            writerWaiting.store(true, std::memory_order_release);
+            // The timeout covers the window between the producer's write and
+            // its check of writerWaiting
+            if (ring.Empty() && running.load(std::memory_order_acquire)) {
+                wakeup.wait_for(lock, idleWait);
+            }
+            writerWaiting.store(false, std::memory_order_release);
+            continue;
+        }
+
+        if (maxLatency.count() > 0 && available < coalesceBytes &&
+            running.load(std::memory_order_acquire) && !failed.load(std::memory_order_relaxed)) {
+            Clock::time_point now = Clock::now();
+            if (!pending) {
+                pending = true;
+                pendingSince = now;
+            }
+            Clock::time_point deadline = pendingSince + maxLatency;
+            if (now < deadline) {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                writerWaiting.store(true, std::memory_order_release);
+                if (ring.Used() < coalesceBytes && running.load(std::memory_order_acquire)) {
+                    wakeup.wait_until(lock, deadline);
+                }
+                writerWaiting.store(false, std::memory_order_release);
+                continue;
+            }
+        }
+
+        if (!failed.load(std::memory_order_relaxed)) {
+            sinkCalls.fetch_add(1, std::memory_order_relaxed);
+            uint64_t start = LatencyClockNs();
+            if (!sink(first, firstLength, second, secondLength)) {
+                failed.store(true, std::memory_order_release);
+            }
+            lastWriteNs = LatencyClockNs();
+            sinkNanoseconds.store(sinkNanoseconds.load(std::memory_order_relaxed) + (lastWriteNs - start),
+                                  std::memory_order_relaxed);
+            if (writeTimes) writeTimes->Record(lastWriteNs - start);
+        }
+        // After a sink failure keep draining so the producer never blocks
+        ring.Consume(available);
+        consumed += available;
+        if (endToEnd) RetireMarks(consumed, lastWriteNs);
+        pending = false;
+    }
+    if (steady) steadyAllocations = ThreadHeapAllocations() - steadyBase;
+}
+
+// Every mark up to `position` reached the sink by `writtenNs`; lost
+// writes are not counted
+void AsyncOutput::RetireMarks(uint64_t position, uint64_t writtenNs) {
+    uint64_t tail = markTail.load(std::memory_order_relaxed);
+    uint64_t head = markHead.load(std::memory_order_acquire);
+    bool record = !failed.load(std::memory_order_relaxed);
+    while (tail != head && marks[tail % kMaxMarks].position <= position) {
+        const LatencyMark& mark = marks[tail % kMaxMarks];
+        if (record && writtenNs >= mark.timeNs) endToEnd->Record(writtenNs - mark.timeNs);
+        tail++;
+    }
+    markTail.store(tail, std::memory_order_release);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+// Decouples the capture thread from output writes.
+//
+// The capture thread copies each packet into a lock-free SPSC ring and
+// returns immediately; a dedicated writer thread drains the ring into the
+// sink. A slow consumer therefore fills the ring (and eventually causes
+// counted overruns) instead of stalling the audio device buffer.
+//
+// With coalescing enabled the ring doubles as the batching buffer: the writer
+// holds off until a byte threshold is queued or the oldest queued byte has
+// waited the latency budget, then hands both ring segments to the sink in one
+// vectored call.
+//
+// For latency statistics the producer can Mark() the queue after a packet;
+// the writer then records how long after the mark the sink call carrying
+// the marked bytes returned, next to the duration of every sink call.
+//
+// In real-time mode (--low-latency) the writer thread runs with real-time
+// priority (realtime_thread.h) and re-checks an idle ring every millisecond
+// instead of every 5, which bounds how long a packet can wait for a writer
+// that missed its wakeup.
+//
+// When allocations are counted (allocation_counter.h) the writer thread
+// reports how many it made after MarkSteady(), i.e. once the pipeline has
+// warmed up.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "latency_stats.h"
+#include "spsc_ring.h"
+
+class AsyncOutput {
+public:
+    // Writes up to two contiguous blocks (second may be empty) to the final
+    // destination, in order; return false on a fatal error
+    using WriteFunction = std::function<bool(const uint8_t* first, size_t firstSize,
+                                             const uint8_t* second, size_t secondSize)>;
+
+    AsyncOutput() {}
+    ~AsyncOutput();
+
+    AsyncOutput(const AsyncOutput&) = delete;
+    AsyncOutput& operator=(const AsyncOutput&) = delete;
+
+    // Batch writes until `thresholdBytes` are queued or `maxLatency` has passed
+    // since the oldest pending byte arrived. Zero latency (the default) writes
+    // as soon as data is available. Call before Start().
+    void SetCoalescing(size_t thresholdBytes, std::chrono::milliseconds maxLatency);
+
+    // Record every sink call's duration into `writeTimes` and the time from
+    // each Mark() to the sink call that wrote its bytes into `endToEnd`;
+    // either may be null. Call before Start().
+    void SetLatencyHistograms(LatencyHistogram* writeTimes, LatencyHistogram* endToEnd);
+
+    // Give the writer thread real-time priority. Start() then returns once
+    // the thread has tried, so RealtimeStatus() is settled. Call before Start().
+    void SetRealtime(bool enabled) { realtime = enabled; }
+
+    bool Start(size_t capacityBytes, WriteFunction sink);
+
+    // Producer side: copy into the ring. Returns false if the data was
+    // dropped because the ring is full or the sink has failed.
+    bool Write(const void* data, size_t size);
+
+    // Queue a header, its payload and `padding` zero bytes together so a
+    // consumer never sees one without the other
+    bool Write(const void* header, size_t headerSize, const void* data, size_t size,
+               size_t padding = 0);
+
+    // Producer side: everything queued so far was captured at `timeNs`
+    // (LatencyClockNs()). Marks beyond what the writer has caught up with
+    // are dropped, so this never blocks either.
+    void Mark(uint64_t timeNs);
+
+    // Producer side: warm-up is over; heap allocations the writer makes
+    // from now on count as SteadyAllocations()
+    void MarkSteady() { steadyRequested.store(true, std::memory_order_release); }
+
+    // Drain everything still queued, then stop the writer thread
+    void Stop();
+
+    bool Failed() const { return failed.load(std::memory_order_acquire); }
+    // After Start() in real-time mode: whether the writer got real-time
+    // priority, and how it is scheduled or why it is not
+    bool RealtimeActive() const { return realtimeActive; }
+    const std::string& RealtimeStatus() const { return realtimeStatus; }
+    // After Stop(): allocations on the writer thread since MarkSteady()
+    uint64_t SteadyAllocations() const { return steadyAllocations; }
+    const SpscByteRing& Ring() const { return ring; }
+    uint64_t SinkCalls() const { return sinkCalls.load(std::memory_order_relaxed); }
+    // Time the writer has spent inside the sink, i.e. blocked on the consumer
+    uint64_t SinkNanoseconds() const { return sinkNanoseconds.load(std::memory_order_relaxed); }
+
+private:
+    SpscByteRing ring;
+    WriteFunction sink;
+    std::thread writer;
+    size_t coalesceBytes = 0;
+    std::chrono::milliseconds maxLatency{0};
+    std::atomic<uint64_t> sinkCalls{0};
+    std::atomic<uint64_t> sinkNanoseconds{0};
+
+    // Real-time mode; the status is written by the writer thread before
+    // Start() returns
+    bool realtime = false;
+    bool realtimeActive = false;
+    bool realtimeSettled = false;  // guarded by wakeMutex
+    std::string realtimeStatus;
+
+    std::atomic<bool> steadyRequested{false};
+    uint64_t steadyAllocations = 0;  // written by the writer thread as it exits
+
+    // Latency marks: a small SPSC queue of (queue position, capture time)
+    static constexpr size_t kMaxMarks = 256;
+    struct LatencyMark {
+        uint64_t position;
+        uint64_t timeNs;
+    };
+    LatencyHistogram* writeTimes = nullptr;
+    LatencyHistogram* endToEnd = nullptr;
+    LatencyMark marks[kMaxMarks];
+    std::atomic<uint64_t> markHead{0};
+    std::atomic<uint64_t> markTail{0};
+    uint64_t lastMarkPosition = 0;  // producer only
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> writerWaiting{false};
+    std::mutex wakeMutex;
+    std::condition_variable wakeup;
+
+    void Run();
+    void Wake();
+    void RetireMarks(uint64_t position, uint64_t writtenNs);
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+// Portable description of interleaved PCM sample formats
+
+#include <cstddef>
+#include <cstdint>
+
+enum class SampleType {
+    Int16,    // signed 16-bit little endian
+    Int24,    // signed 24-bit packed little endian (3 bytes per sample)
+    Int32,    // signed 32-bit little endian
+    Float32   // IEEE float, nominal range [-1.0, 1.0]
+};
+
+inline size_t BytesPerSample(SampleType type) {
+    switch (type) {
+        case SampleType::Int16:   return 2;
+        case SampleType::Int24:   return 3;
+        case SampleType::Int32:   return 4;
+        case SampleType::Float32: return 4;
+    }
+    return 0;
+}
+
+inline const char* SampleTypeName(SampleType type) {
+    switch (type) {
+        case SampleType::Int16:   return "s16le";
+        case SampleType::Int24:   return "s24le";
+        case SampleType::Int32:   return "s32le";
+        case SampleType::Float32: return "f32le";
+    }
+    return "unknown";
+}
+
+// Interleaved PCM stream layout, the portable counterpart of WAVEFORMATEX
+struct AudioFormat {
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    SampleType type = SampleType::Float32;
+    uint32_t channelMask = 0;  // SPEAKER_* bits, 0 when unknown
+
+    uint32_t BitsPerSample() const { return (uint32_t)BytesPerSample(type) * 8; }
+    uint32_t BlockAlign() const { return channels * (uint32_t)BytesPerSample(type); }
+    uint32_t BytesPerSecond() const { return sampleRate * BlockAlign(); }
+};
@@ -0,0 +1,557 @@
+#include "audio_stages.h"
+
+#include <algorithm>
+
+#include "channel_mixer.h"
+#include "sample_converter.h"
+
+namespace {
+
+// Sample type -> float32
+class DecodeStage : public AudioStage {
+public:
+    DecodeStage(SampleType type, uint32_t channels) : channels(channels) {
+        converter.Initialize(type, SampleType::Float32);
+    }
+
+    const char* Name() const override { return "decode"; }
+
+    std::string Describe() const override {
+        return std::string(SampleTypeName(converter.InputType())) + "->float (" + converter.KernelName() + ")";
+    }
+
+    void Reserve(size_t maxFrames) override { Grow(maxFrames); }
+
+    AudioView Process(const AudioView& input) override {
+        if (input.IsSilent()) return input;
+        Grow(input.frames);
+        converter.ToFloat(input.data, buffer.data(), input.frames * channels);
+        return AudioView{reinterpret_cast<const uint8_t*>(buffer.data()), input.frames};
+    }
+
+private:
+    SampleConverter converter;
+    uint32_t channels;
+    std::vector<float> buffer;
+
+    void Grow(size_t frames) {
+        if (buffer.size() < frames * channels) buffer.resize(frames * channels);
+    }
+};
+
+// Float32 channel matrix
+class MixStage : public AudioStage {
+public:
+    bool Initialize(uint32_t inChannels, uint32_t outChannels, const std::vector<float>& matrix) {
+        return mixer.Initialize(inChannels, outChannels, matrix);
+    }
+
+    const char* Name() const override { return "mix"; }
+
+    std::string Describe() const override {
+        // The matrix follows on its own lines
+        std::string text = "mix " + std::to_string(mixer.InputChannels()) + "->" +
+                           std::to_string(mixer.OutputChannels()) + " (" + mixer.KernelName() + ")\n" +
+                           mixer.Describe();
+        text.pop_back();
+        return text;
+    }
+
+    void Reserve(size_t maxFrames) override { Grow(maxFrames); }
+
+    AudioView Process(const AudioView& input) override {
+        if (input.IsSilent()) return input;
+        Grow(input.frames);
+        mixer.Process(reinterpret_cast<const float*>(input.data), buffer.data(), input.frames);
+        return AudioView{reinterpret_cast<const uint8_t*>(buffer.data()), input.frames};
+    }
+
+private:
+    ChannelMixer mixer;
+    std::vector<float> buffer;
+
+    void Grow(size_t frames) {
+        if (buffer.size() < frames * mixer.OutputChannels()) buffer.resize(frames * mixer.OutputChannels());
+    }
+};
+
+// Float32 polyphase rate conversion
+class ResampleStage : public AudioStage {
+public:
+    bool Initialize(uint32_t inputRate, uint32_t outputRate, uint32_t numChannels,
+                    PolyphaseResampler::Quality quality, bool variableRatio) {
+        channels = numChannels;
+        outputPerInput = (double)outputRate / inputRate;
+        if (!engine.Initialize(inputRate, outputRate, numChannels, quality, variableRatio)) return false;
+        silentInput.assign(kSilenceChunkFrames * channels, 0.0f);
+        return true;
+    }
+
+    const char* Name() const override { return "resample"; }
+
+    std::string Describe() const override {
+        return "resample " + std::to_string(engine.UpFactor()) + "/" + std::to_string(engine.DownFactor()) +
+               " (" + std::to_string(engine.Taps()) + " taps" +
+               (engine.IsVariableRatio() ? ", drift corrected)" : ")");
+    }
+
+    size_t MaxOutputFrames(size_t inputFrames) const override {
+        // Silence is fed in chunks, each of which may round up
+        size_t chunks = inputFrames / kSilenceChunkFrames + 1;
+        return engine.MaxOutputFrames(inputFrames) + chunks;
+    }
+
+    void Reserve(size_t maxFrames) override {
+        size_t frames = std::max(MaxOutputFrames(maxFrames), engine.MaxOutputFrames(engine.Taps()));
+        Grow(frames);
+    }
+
+    AudioView Process(const AudioView& input) override {
+        if (!input.IsSilent()) {
+            Grow(MaxOutputFrames(input.frames));
+            size_t produced = engine.Process(reinterpret_cast<const float*>(input.data), input.frames,
+                                             buffer.data(), buffer.size() / channels);
+            return AudioView{reinterpret_cast<const uint8_t*>(buffer.data()), produced};
+        }
+
+        // Zeros still run through the filter so the tail of preceding audio
+        // rings out and the frame count follows the output rate exactly
+        Grow(MaxOutputFrames(input.frames));
+        size_t produced = 0;
+        size_t remaining = input.frames;
+        while (remaining > 0) {
+            size_t chunk = remaining < kSilenceChunkFrames ? remaining : kSilenceChunkFrames;
+            produced += engine.Process(silentInput.data(), chunk, buffer.data() + produced * channels,
+                                       buffer.size() / channels - produced);
+            remaining -= chunk;
+        }
+        // Once the tail has died away the output is silence again, which
+        // keeps it exact even when the encoder dithers
+        if (std::all_of(buffer.begin(), buffer.begin() + produced * channels, [](float v) { return v == 0.0f; })) {
+            return AudioView{nullptr, produced};
+        }
+        return AudioView{reinterpret_cast<const uint8_t*>(buffer.data()), produced};
+    }
+
+    AudioView Flush() override {
+        Grow(engine.MaxOutputFrames(engine.Taps()));
+        size_t produced = engine.Flush(buffer.data(), buffer.size() / channels);
+        return AudioView{reinterpret_cast<const uint8_t*>(buffer.data()), produced};
+    }
+
+    double LatencyFrames() const override { return engine.LatencyFrames() * outputPerInput; }
+
+    bool ChangesRate() const override { return true; }
+
+    bool AdjustRate(double scale) override {
+        engine.SetRatioScale(scale);
+        return engine.IsVariableRatio();
+    }
+
+private:
+    static constexpr size_t kSilenceChunkFrames = 1024;
+
+    PolyphaseResampler engine;
+    uint32_t channels = 0;
+    double outputPerInput = 1.0;
+    std::vector<float> buffer;
+    std::vector<float> silentInput;
+
+    void Grow(size_t frames) {
+        if (buffer.size() < frames * channels) buffer.resize(frames * channels);
+    }
+};
+
+// Float32 -> sample type (with optional dither), or a direct conversion
+// between two sample types when no float stage precedes it
+class EncodeStage : public AudioStage {
+public:
+    EncodeStage(SampleType input, SampleType output, uint32_t channels, bool dither)
+        : channels(channels), outputBytes(BytesPerSample(output)) {
+        converter.Initialize(input, output, dither);
+    }
+
+    const char* Name() const override { return "encode"; }
+
+    std::string Describe() const override {
+        SampleType input = converter.InputType();
+        return std::string(input == SampleType::Float32 ? "float" : SampleTypeName(input)) + "->" +
+               SampleTypeName(converter.OutputType()) + " (" + converter.KernelName() + ")";
+    }
+
+    void Reserve(size_t maxFrames) override { Grow(maxFrames); }
+
+    AudioView Process(const AudioView& input) override {
+        if (input.IsSilent()) return input;
+        Grow(input.frames);
+        converter.Convert(input.data, buffer.data(), input.frames * channels);
+        return AudioView{buffer.data(), input.frames};
+    }
+
+private:
+    SampleConverter converter;
+    uint32_t channels;
+    size_t outputBytes;
+    std::vector<uint8_t> buffer;
+
+    void Grow(size_t frames) {
+        if (buffer.size() < frames * channels * outputBytes) buffer.resize(frames * channels * outputBytes);
+    }
+};
+
+// What one stage does. Two equal specs fed the same input produce the
+// same output, so branches of a StageGraph can share the stage.
+struct StageSpec {
+    enum class Kind { Decode, Mix, Resample, Encode };
+    Kind kind = Kind::Encode;
+    SampleType inputType = SampleType::Float32;  // decode, encode
+    SampleType outputType = SampleType::Float32;
+    uint32_t inputChannels = 0;                  // mix
+    uint32_t channels = 0;                       // output channels of every stage
+    std::vector<float> matrix;                   // mix
+    uint32_t inputRate = 0;                      // resample
+    uint32_t outputRate = 0;
+    PolyphaseResampler::Quality quality = PolyphaseResampler::Quality::High;
+    bool variableRate = false;
+    bool dither = false;                         // encode
+
+    bool operator==(const StageSpec& other) const {
+        return kind == other.kind && inputType == other.inputType && outputType == other.outputType &&
+               inputChannels == other.inputChannels && channels == other.channels && matrix == other.matrix &&
+               inputRate == other.inputRate && outputRate == other.outputRate && quality == other.quality &&
+               variableRate == other.variableRate && dither == other.dither;
+    }
+};
+
+// The stages that turn `input` into `output`, in order
+bool PlanStages(const AudioFormat& input, const AudioFormat& output, const StageChain::Options& options,
+                std::vector<StageSpec>& specs, std::string* error) {
+    specs.clear();
+
+    if (input.channels == 0 || output.channels == 0 || output.channels > PolyphaseResampler::kMaxChannels) {
+        if (error) {
+            *error = "Unsupported channel configuration: " + std::to_string(input.channels) + " -> " +
+                     std::to_string(output.channels);
+        }
+        return false;
+    }
+
+    bool mixing = !options.mixMatrix.empty() || input.channels != output.channels;
+    bool resampling = input.sampleRate != output.sampleRate || options.variableRate;
+
+    StageSpec spec;
+    if (!mixing && !resampling) {
+        // Only the sample type can differ: one pass, no float round trip
+        if (input.type != output.type) {
+            spec.kind = StageSpec::Kind::Encode;
+            spec.inputType = input.type;
+            spec.outputType = output.type;
+            spec.channels = output.channels;
+            spec.dither = options.dither;
+            specs.push_back(spec);
+        }
+        return true;
+    }
+
+    if (input.type != SampleType::Float32) {
+        spec = StageSpec();
+        spec.kind = StageSpec::Kind::Decode;
+        spec.inputType = input.type;
+        spec.channels = input.channels;
+        specs.push_back(spec);
+    }
+
+    // Mix first so every later stage runs on the output channel count
+    if (mixing) {
+        spec = StageSpec();
+        spec.kind = StageSpec::Kind::Mix;
+        spec.inputChannels = input.channels;
+        spec.channels = output.channels;
+        spec.matrix = options.mixMatrix;
+        if (spec.matrix.empty() &&
+            !ChannelMixer::BuildMatrix(input.channelMask, input.channels, output.channelMask, output.channels,
+                                       spec.matrix, options.mixNormalize)) {
+            if (error) {
+                *error = "Cannot build mixing matrix for " + std::to_string(input.channels) + " -> " +
+                         std::to_string(output.channels) + " channels";
+            }
+            return false;
+        }
+        specs.push_back(spec);
+    }
+
+    if (resampling) {
+        spec = StageSpec();
+        spec.kind = StageSpec::Kind::Resample;
+        spec.channels = output.channels;
+        spec.inputRate = input.sampleRate;
+        spec.outputRate = output.sampleRate;
+        spec.quality = options.quality;
+        spec.variableRate = options.variableRate;
+        specs.push_back(spec);
+    }
+
+    if (output.type != SampleType::Float32) {
+        spec = StageSpec();
+        spec.kind = StageSpec::Kind::Encode;
+        spec.outputType = output.type;
+        spec.channels = output.channels;
+        spec.dither = options.dither;
+        specs.push_back(spec);
+    }
+    return true;
+}
+
+std::unique_ptr<AudioStage> CreateStage(const StageSpec& spec, std::string* error) {
+    switch (spec.kind) {
+        case StageSpec::Kind::Decode:
+            return std::make_unique<DecodeStage>(spec.inputType, spec.channels);
+        case StageSpec::Kind::Mix: {
+            auto mix = std::make_unique<MixStage>();
+            if (!mix->Initialize(spec.inputChannels, spec.channels, spec.matrix)) {
+                if (error) {
+                    *error = "Invalid mixing matrix for " + std::to_string(spec.inputChannels) + " -> " +
+                             std::to_string(spec.channels) + " channels";
+                }
+                return nullptr;
+            }
+            return mix;
+        }
+        case StageSpec::Kind::Resample: {
+            auto resample = std::make_unique<ResampleStage>();
+            if (!resample->Initialize(spec.inputRate, spec.outputRate, spec.channels, spec.quality,
+                                      spec.variableRate)) {
+                if (error) {
+                    *error = "Failed to initialize polyphase resampler: " + std::to_string(spec.inputRate) +
+                             "Hz -> " + std::to_string(spec.outputRate) + "Hz";
+                }
+                return nullptr;
+            }
+            return resample;
+        }
+        case StageSpec::Kind::Encode:
+            return std::make_unique<EncodeStage>(spec.inputType, spec.outputType, spec.channels, spec.dither);
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+bool StageChain::Build(const AudioFormat& input, const AudioFormat& output, const Options& options,
+                       std::string* error) {
+    stages.clear();
+    std::vector<StageSpec> specs;
+    if (!PlanStages(input, output, options, specs, error)) return false;
+    for (const StageSpec& spec : specs) {
+        std::unique_ptr<AudioStage> stage = CreateStage(spec, error);
+        if (!stage) {
+            stages.clear();
+            return false;
+        }
+        stages.push_back(std::move(stage));
+    }
+    return true;
+}
+
+void StageChain::Reserve(size_t maxInputFrames) {
+    size_t frames = maxInputFrames;
+    for (auto& stage : stages) {
+        stage->Reserve(frames);
+        frames = stage->MaxOutputFrames(frames);
+    }
+}
+
+void StageChain::Flush(const std::function<void(const AudioView&)>& emit) {
+    for (size_t i = 0; i < stages.size(); i++) {
+        AudioView view = stages[i]->Flush();
+        if (view.frames == 0) continue;
+        for (size_t j = i + 1; j < stages.size(); j++) {
+            view = stages[j]->Process(view);
+        }
+        emit(view);
+    }
+}
+
+bool StageChain::ChangesRate() const {
+    for (const auto& stage : stages) {
+        if (stage->ChangesRate()) return true;
+    }
+    return false;
+}
+
+void StageChain::AdjustRate(double scale) {
+    for (auto& stage : stages) {
+        if (stage->AdjustRate(scale)) return;
+    }
+}
+
+double StageChain::LatencyOutputFrames() const {
+    double latency = 0.0;
+    for (const auto& stage : stages) {
+        latency += stage->LatencyFrames();
+    }
+    return latency;
+}
+
+std::string StageChain::Describe() const {
+    if (stages.empty()) return "passthrough";
+    std::string text;
+    for (const auto& stage : stages) {
+        if (!text.empty()) text += "\n";
+        text += stage->Describe();
+    }
+    return text;
+}
+
+bool StageGraph::Build(const AudioFormat& inputFormat, const std::vector<AudioFormat>& outputs,
+                       const std::vector<StageChain::Options>& options, std::string* error) {
+    stages.clear();
+    parents.clear();
+    branchMasks.clear();
+    leaves.clear();
+    views.clear();
+    if (outputs.empty() || outputs.size() > kMaxBranches || options.size() != outputs.size()) {
+        if (error) *error = "Between 1 and " + std::to_string(kMaxBranches) + " output formats are supported";
+        return false;
+    }
+
+    std::vector<StageSpec> built;  // spec of every stage so far
+    std::vector<StageSpec> specs;
+    for (size_t branch = 0; branch < outputs.size(); branch++) {
+        if (!PlanStages(inputFormat, outputs[branch], options[branch], specs, error)) return false;
+        // Follow the stages an earlier branch already has, then add the rest
+        int parent = -1;
+        for (const StageSpec& spec : specs) {
+            int found = -1;
+            for (size_t i = 0; i < stages.size(); i++) {
+                if (parents[i] == parent && built[i] == spec) {
+                    found = (int)i;
+                    break;
+                }
+            }
+            if (found < 0) {
+                std::unique_ptr<AudioStage> stage = CreateStage(spec, error);
+                if (!stage) return false;
+                stages.push_back(std::move(stage));
+                parents.push_back(parent);
+                branchMasks.push_back(0);
+                built.push_back(spec);
+                found = (int)stages.size() - 1;
+            }
+            branchMasks[(size_t)found] |= (uint64_t)1 << branch;
+            parent = found;
+        }
+        leaves.push_back(parent);
+    }
+    views.resize(stages.size());
+    return true;
+}
+
+void StageGraph::Reserve(size_t maxInputFrames) {
+    std::vector<size_t> frames(stages.size());
+    for (size_t i = 0; i < stages.size(); i++) {
+        size_t in = parents[i] < 0 ? maxInputFrames : frames[(size_t)parents[i]];
+        stages[i]->Reserve(in);
+        frames[i] = stages[i]->MaxOutputFrames(in);
+    }
+}
+
+void StageGraph::Process(const AudioView& view) {
+    input = view;
+    for (size_t i = 0; i < stages.size(); i++) {
+        views[i] = stages[i]->Process(parents[i] < 0 ? input : views[(size_t)parents[i]]);
+    }
+}
+
+void StageGraph::Process(const AudioView& view, LatencyHistogram* const* stageTimes) {
+    input = view;
+    uint64_t start = LatencyClockNs();
+    for (size_t i = 0; i < stages.size(); i++) {
+        views[i] = stages[i]->Process(parents[i] < 0 ? input : views[(size_t)parents[i]]);
+        uint64_t end = LatencyClockNs();
+        stageTimes[i]->Record(end - start);
+        start = end;
+    }
+}
+
+bool StageGraph::Below(size_t stage, size_t ancestor) const {
+    for (int i = parents[stage]; i >= 0; i = parents[(size_t)i]) {
+        if ((size_t)i == ancestor) return true;
+    }
+    return false;
+}
+
+void StageGraph::Flush(const std::function<void(size_t, const AudioView&)>& emit) {
+    for (size_t i = 0; i < stages.size(); i++) {
+        AudioView tail = stages[i]->Flush();
+        if (tail.frames == 0) continue;
+        views[i] = tail;
+        for (size_t j = i + 1; j < stages.size(); j++) {
+            if (Below(j, i)) views[j] = stages[j]->Process(views[(size_t)parents[j]]);
+        }
+        for (size_t branch = 0; branch < leaves.size(); branch++) {
+            if (branchMasks[i] & ((uint64_t)1 << branch)) emit(branch, views[(size_t)leaves[branch]]);
+        }
+    }
+}
+
+bool StageGraph::ChangesRate(size_t branch) const {
+    for (int i = leaves[branch]; i >= 0; i = parents[(size_t)i]) {
+        if (stages[(size_t)i]->ChangesRate()) return true;
+    }
+    return false;
+}
+
+void StageGraph::AdjustRate(double scale) {
+    for (auto& stage : stages) {
+        stage->AdjustRate(scale);
+    }
+}
+
+double StageGraph::LatencyOutputFrames(size_t branch) const {
+    double latency = 0.0;
+    for (int i = leaves[branch]; i >= 0; i = parents[(size_t)i]) {
+        latency += stages[(size_t)i]->LatencyFrames();
+    }
+    return latency;
+}
+
+std::string StageGraph::Describe(const std::vector<std::string>& branchNames) const {
+    const uint64_t all = leaves.size() >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << leaves.size()) - 1;
+    auto add = [](std::string& text, const std::string& indent, const std::string& lines) {
+        size_t start = 0;
+        while (start < lines.size()) {
+            size_t end = lines.find('\n', start);
+            if (end == std::string::npos) end = lines.size();
+            if (!text.empty()) text += "\n";
+            text += indent + lines.substr(start, end - start);
+            start = end + 1;
+        }
+    };
+
+    std::string text;
+    for (size_t i = 0; i < stages.size(); i++) {
+        if (branchMasks[i] == all) add(text, "", stages[i]->Describe());
+    }
+    if (leaves.size() == 1) return text.empty() ? "passthrough" : text;
+
+    for (size_t branch = 0; branch < leaves.size(); branch++) {
+        add(text, "", branchNames[branch] + ":");
+        bool any = false;
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (branchMasks[i] == all || !(branchMasks[i] & ((uint64_t)1 << branch))) continue;
+            std::string shared;
+            for (size_t other = 0; other < leaves.size(); other++) {
+                if (other == branch || !(branchMasks[i] & ((uint64_t)1 << other))) continue;
+                shared += (shared.empty() ? " (shared with " : ", ") + branchNames[other];
+            }
+            // Mark the first line; a mixing matrix follows on its own lines
+            std::string lines = stages[i]->Describe();
+            if (!shared.empty()) lines.insert(std::min(lines.find('\n'), lines.size()), shared + ")");
+            add(text, "  ", lines);
+            any = true;
+        }
+        if (!any) add(text, "  ", "no further conversion");
+    }
+    return text;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+// Typed processing stages between a capture source and the output framing.
+//
+// A StageChain is assembled once from the negotiated input and output
+// formats and holds only the stages that change something: decoding to
+// float, channel mixing, rate conversion and encoding to the output sample
+// type, or a single direct conversion when only the sample type differs.
+// Identical formats give an empty chain and packets pass through untouched.
+//
+// Stages hand each other views of buffers they own, sized once by
+// Reserve(), so a packet is never copied between stages. A view without data
+// stands for digital silence, which every stage except the resampler passes
+// on without touching a sample.
+//
+// A StageGraph turns one input into several output formats. Each format is
+// a branch planned exactly like a StageChain, and branches share the
+// leading stages they have in common, so the input is decoded to float
+// once, downmixed once when the channel counts agree, and only the stages
+// where the formats diverge run per branch.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_format.h"
+#include "latency_stats.h"
+#include "polyphase_resampler.h"
+
+struct AudioView {
+    const uint8_t* data = nullptr;  // nullptr: `frames` frames of digital silence
+    size_t frames = 0;
+
+    bool IsSilent() const { return data == nullptr; }
+};
+
+class AudioStage {
+public:
+    virtual ~AudioStage() {}
+
+    // Description for the startup log, e.g. "resample 147/160 (64 taps)"
+    virtual std::string Describe() const = 0;
+
+    // Short name for latency statistics, e.g. "resample"
+    virtual const char* Name() const = 0;
+
+    // Upper bound on the output of one call with `inputFrames` frames
+    virtual size_t MaxOutputFrames(size_t inputFrames) const { return inputFrames; }
+
+    // Size internal buffers for inputs of up to `maxFrames` frames
+    virtual void Reserve(size_t maxFrames) = 0;
+
+    // The returned view stays valid until the next call on this stage
+    virtual AudioView Process(const AudioView& input) = 0;
+
+    // Emit frames still held back at the end of the stream
+    virtual AudioView Flush() { return AudioView(); }
+
+    // Delay added by this stage, in its output frames
+    virtual double LatencyFrames() const { return 0.0; }
+
+    virtual bool ChangesRate() const { return false; }
+
+    // Scale the output rate by `scale` (close to 1) for drift correction;
+    // false if the stage cannot
+    virtual bool AdjustRate(double) { return false; }
+};
+
+class StageChain {
+public:
+    struct Options {
+        PolyphaseResampler::Quality quality = PolyphaseResampler::Quality::High;
+        bool dither = false;
+        std::vector<float> mixMatrix;  // output x input; empty selects the standard matrix
+        bool mixNormalize = false;     // scale the standard matrix so no output can clip
+        bool variableRate = false;     // always resample, with an adjustable ratio (AdjustRate())
+    };
+
+    // Assemble the stages that turn `input` into `output`
+    bool Build(const AudioFormat& input, const AudioFormat& output, const Options& options,
+               std::string* error);
+
+    // Preallocate every stage for packets of up to `maxInputFrames` frames
+    void Reserve(size_t maxInputFrames);
+
+    AudioView Process(const AudioView& input) {
+        AudioView view = input;
+        for (auto& stage : stages) {
+            view = stage->Process(view);
+        }
+        return view;
+    }
+
+    // Process() that records each stage's time into `stageTimes`, one
+    // histogram per stage in chain order
+    AudioView Process(const AudioView& input, LatencyHistogram* const* stageTimes) {
+        AudioView view = input;
+        uint64_t start = LatencyClockNs();
+        for (size_t i = 0; i < stages.size(); i++) {
+            view = stages[i]->Process(view);
+            uint64_t end = LatencyClockNs();
+            stageTimes[i]->Record(end - start);
+            start = end;
+        }
+        return view;
+    }
+
+    // Push each stage's held-back frames through the stages after it
+    void Flush(const std::function<void(const AudioView&)>& emit);
+
+    bool Empty() const { return stages.empty(); }
+    size_t Size() const { return stages.size(); }
+    const AudioStage& Stage(size_t index) const { return *stages[index]; }
+    bool ChangesRate() const;
+    // Scale the resampling ratio; needs Options::variableRate
+    void AdjustRate(double scale);
+    double LatencyOutputFrames() const;
+    std::string Describe() const;  // one stage per line
+
+private:
+    std::vector<std::unique_ptr<AudioStage>> stages;
+};
+
+class StageGraph {
+public:
+    // Plan a branch per output format, with its own options (the mixing
+    // matrix differs per channel count), and share their common prefixes
+    bool Build(const AudioFormat& input, const std::vector<AudioFormat>& outputs,
+               const std::vector<StageChain::Options>& options, std::string* error);
+
+    // Preallocate every stage for packets of up to `maxInputFrames` frames
+    void Reserve(size_t maxInputFrames);
+
+    // Run `input` through every stage once; Output() then has each branch's
+    // view, valid until the next call
+    void Process(const AudioView& input);
+
+    // Process() that records each stage's time, one histogram per stage
+    void Process(const AudioView& input, LatencyHistogram* const* stageTimes);
+
+    const AudioView& Output(size_t branch) const {
+        return leaves[branch] < 0 ? input : views[(size_t)leaves[branch]];
+    }
+
+    // Push each stage's held-back frames through the stages below it; each
+    // branch they reach gets emit(branch, view)
+    void Flush(const std::function<void(size_t, const AudioView&)>& emit);
+
+    size_t Branches() const { return leaves.size(); }
+    size_t Size() const { return stages.size(); }
+    const AudioStage& Stage(size_t index) const { return *stages[index]; }
+    // Branches fed by the stage at `index`, as a bit mask
+    uint64_t StageBranches(size_t index) const { return branchMasks[index]; }
+    bool ChangesRate(size_t branch) const;
+    // Scale every resampler's ratio; needs Options::variableRate
+    void AdjustRate(double scale);
+    double LatencyOutputFrames(size_t branch) const;
+    // Shared stages first, then the stages of each branch under its name
+    std::string Describe(const std::vector<std::string>& branchNames) const;
+
+    // Branches are tracked in a 64-bit mask
+    static constexpr size_t kMaxBranches = 64;
+
+private:
+    // In processing order: a stage always comes after its parent
+    std::vector<std::unique_ptr<AudioStage>> stages;
+    std::vector<int> parents;          // index of the stage feeding each stage; -1 for the input
+    std::vector<uint64_t> branchMasks;
+    std::vector<int> leaves;           // last stage of each branch; -1 passes the input through
+    std::vector<AudioView> views;      // each stage's latest output
+    AudioView input;
+
+    bool Below(size_t stage, size_t ancestor) const;
+};
@@ -0,0 +1,1096 @@
+#include "capture_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#include "allocation_counter.h"
+#include "channel_mixer.h"
+#include "stream_records.h"
+
+namespace {
+
+// Integer PCM for an explicit --bit-depth
+SampleType IntegerType(int bits) {
+    switch (bits) {
+        case 16: return SampleType::Int16;
+        case 24: return SampleType::Int24;
+    }
+    return SampleType::Int32;
+}
+
+bool IsSharedMemoryTarget(const std::string& target) {
+    return target.compare(0, 4, "shm:") == 0;
+}
+
+// Capture-thread counters have a single writer, so no atomic
+// read-modify-write is needed
+void Add(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Zero samples are all-zero bytes in every supported format, so silence
+// never needs a per-packet buffer
+const uint8_t kZeroBlock[64 * 1024] = {};
+
+}  // namespace
+
+CapturePipeline::CapturePipeline() {}
+
+CapturePipeline::~CapturePipeline() {}
+
+bool CapturePipeline::ValidateOutputs(const Config& config, std::string* error) {
+    size_t stdoutTargets = config.outputs.empty() ? 1 : 0;
+    size_t socketTargets = 0;
+    size_t sharedMemoryTargets = 0;
+    for (size_t i = 0; i < config.outputs.size(); i++) {
+        if (config.outputs[i] == "-") stdoutTargets++;
+        if (StreamServerSink::IsSocketTarget(config.outputs[i])) socketTargets++;
+        if (IsSharedMemoryTarget(config.outputs[i])) sharedMemoryTargets++;
+        for (size_t j = 0; j < i; j++) {
+            if (config.outputs[j] == config.outputs[i]) {
+                *error = "output '" + config.outputs[i] + "' given more than once";
+                return false;
+            }
+        }
+    }
+    // A WAV file holds plain PCM only; the containers apply to stdout,
+    // sockets and shared memory, FLAC to stdout alone
+    if ((config.framed || config.silenceMarkers) && stdoutTargets + socketTargets + sharedMemoryTargets == 0) {
+        *error = "--framed and --silence-markers apply to stdout, sockets and shared memory; add --output - to keep "
+                 "stdout";
+        return false;
+    }
+    if (config.flac && stdoutTargets == 0) {
+        *error = "--flac applies to stdout; add --output - to keep it";
+        return false;
+    }
+    // FLAC is its own container
+    if (config.flac && (config.framed || config.silenceMarkers)) {
+        *error = "--flac cannot be combined with --framed or --silence-markers";
+        return false;
+    }
+    // Clients join mid-stream and need the stream header and packet
+    // boundaries to find their way in
+    if (socketTargets > 0 && !config.framed) {
+        *error = "socket outputs serve the --framed stream; add --framed";
+        return false;
+    }
+    // Batching holds packets back on purpose
+    if (config.lowLatency && config.maxOutputLatencyMs > 0) {
+        *error = "--max-output-latency-ms batches writes and cannot be combined with --low-latency";
+        return false;
+    }
+    if (config.frameAlign && config.frameFrames == 0 && config.frameMs <= 0.0) {
+        *error = "--frame-align needs --frame-size";
+        return false;
+    }
+    if (socketTargets > 0 && config.maxClientLagMs <= 0) {
+        *error = "--max-client-lag-ms must be positive";
+        return false;
+    }
+    return true;
+}
+
+bool CapturePipeline::ParseFormatSpec(const std::string& text, FormatSpec& spec) {
+    spec = FormatSpec();
+    int* fields[] = {&spec.sampleRate, &spec.channels, &spec.bitDepth};
+    size_t start = 0;
+    for (size_t i = 0; i < 3; i++) {
+        size_t end = text.find(':', start);
+        if (end == std::string::npos) end = text.size();
+        std::string field = text.substr(start, end - start);
+        if (!field.empty()) {
+            char* parsed = nullptr;
+            long value = strtol(field.c_str(), &parsed, 10);
+            if (*parsed != '\0' || value <= 0 || value > 192000) return false;
+            *fields[i] = (int)value;
+        }
+        if (end == text.size()) break;
+        if (i == 2) return false;  // more than three fields
+        start = end + 1;
+    }
+    if (spec.sampleRate != 0 && (spec.sampleRate < 8000 || spec.sampleRate > 192000)) return false;
+    if (spec.channels > 8) return false;
+    if (spec.bitDepth != 0 && spec.bitDepth != 16 && spec.bitDepth != 24 && spec.bitDepth != 32) return false;
+    return !spec.Empty();
+}
+
+// The output format for `spec`, filling its unset fields from the main
+// format; like the main format it stays the device format when nothing
+// changes
+AudioFormat CapturePipeline::ResolveFormat(const FormatSpec& spec) const {
+    int mainChannels = (config.channels > 0) ? config.channels : (int)inputFormat.channels;
+    int targetSampleRate = spec.sampleRate > 0   ? spec.sampleRate
+                           : config.sampleRate > 0 ? config.sampleRate
+                                                   : (int)inputFormat.sampleRate;
+    int targetChannels = spec.channels > 0 ? spec.channels : mainChannels;
+    int targetBitDepth = spec.bitDepth > 0   ? spec.bitDepth
+                         : config.bitDepth > 0 ? config.bitDepth
+                                               : (int)inputFormat.BitsPerSample();
+    // --mix-matrix is written for the main channel count
+    bool mixing = !config.mixMatrixText.empty() && targetChannels == mainChannels;
+
+    AudioFormat format = inputFormat;
+    if ((targetSampleRate != (int)inputFormat.sampleRate) || (targetChannels != (int)inputFormat.channels) ||
+        (targetBitDepth != (int)inputFormat.BitsPerSample()) || mixing) {
+        // Converted output is standard integer PCM without a speaker mask
+        format.sampleRate = (uint32_t)targetSampleRate;
+        format.channels = (uint32_t)targetChannels;
+        format.type = IntegerType(targetBitDepth);
+        format.channelMask = 0;
+    }
+    return format;
+}
+
+bool CapturePipeline::Initialize(const Config& newConfig, const AudioFormat& format) {
+    config = newConfig;
+    inputFormat = format;
+    branches.clear();
+    targetBranches.clear();
+
+    // Check if we need format conversion
+    int targetSampleRate = (config.sampleRate > 0) ? config.sampleRate : (int)inputFormat.sampleRate;
+    int targetChannels = (config.channels > 0) ? config.channels : (int)inputFormat.channels;
+    int targetBitDepth = (config.bitDepth > 0) ? config.bitDepth : (int)inputFormat.BitsPerSample();
+
+    // Validate parameters
+    if (config.sampleRate > 0 && (config.sampleRate < 8000 || config.sampleRate > 192000)) {
+        std::cerr << "\nERROR: Invalid sample rate: " << config.sampleRate << std::endl;
+        std::cerr << "Valid range: 8000 - 192000 Hz" << std::endl;
+        std::cerr << "Common values: 44100, 48000" << std::endl;
+        return false;
+    }
+
+    if (config.channels > 0 && (config.channels < 1 || config.channels > 8)) {
+        std::cerr << "\nERROR: Invalid channel count: " << config.channels << std::endl;
+        std::cerr << "Valid range: 1 - 8 channels" << std::endl;
+        std::cerr << "Common values: 1 (mono), 2 (stereo)" << std::endl;
+        return false;
+    }
+
+    if (config.bitDepth > 0 && (config.bitDepth != 16 && config.bitDepth != 24 && config.bitDepth != 32)) {
+        std::cerr << "\nERROR: Invalid bit depth: " << config.bitDepth << std::endl;
+        std::cerr << "Valid values: 16, 24, 32 bits" << std::endl;
+        return false;
+    }
+
+    // Outputs asking for the same format share a branch
+    std::vector<std::string> targets = config.outputs;
+    if (targets.empty()) targets.push_back("-");
+    bool mainFormatUsed = false;
+    for (size_t i = 0; i < targets.size(); i++) {
+        FormatSpec spec = i < config.outputFormats.size() ? config.outputFormats[i] : FormatSpec();
+        AudioFormat target = ResolveFormat(spec);
+        if (spec.Empty()) mainFormatUsed = true;
+        size_t index = 0;
+        while (index < branches.size() &&
+               !(branches[index].format.sampleRate == target.sampleRate &&
+                 branches[index].format.channels == target.channels && branches[index].format.type == target.type &&
+                 branches[index].format.channelMask == target.channelMask)) {
+            index++;
+        }
+        if (index == branches.size()) {
+            Branch branch;
+            branch.format = target;
+            branch.name = std::to_string(target.sampleRate) + "Hz, " + std::to_string(target.channels) +
+                          " channels, " + std::to_string(target.BitsPerSample()) + " bits";
+            branches.push_back(std::move(branch));
+        }
+        targetBranches.push_back(index);
+    }
+    if (branches.size() > StageGraph::kMaxBranches) {
+        std::cerr << "\nERROR: At most " << StageGraph::kMaxBranches << " different output formats" << std::endl;
+        return false;
+    }
+
+    bool converting = (targetSampleRate != (int)inputFormat.sampleRate) ||
+                      (targetChannels != (int)inputFormat.channels) ||
+                      (targetBitDepth != (int)inputFormat.BitsPerSample()) ||
+                      !config.mixMatrixText.empty();
+
+    if (branches.size() > 1) {
+        std::cerr << "Output formats:" << std::endl;
+        for (size_t b = 0; b < branches.size(); b++) {
+            std::cerr << "  " << branches[b].name << ":";
+            for (size_t i = 0; i < targets.size(); i++) {
+                if (targetBranches[i] == b) std::cerr << " " << (targets[i] == "-" ? "stdout" : targets[i]);
+            }
+            std::cerr << std::endl;
+        }
+    } else if (converting && mainFormatUsed) {
+        std::cerr << "Format conversion required:" << std::endl;
+        std::cerr << "  Input:  " << inputFormat.sampleRate << "Hz, "
+                  << inputFormat.channels << " channels, " << inputFormat.BitsPerSample() << " bits" << std::endl;
+        std::cerr << "  Output: " << targetSampleRate << "Hz, "
+                  << targetChannels << " channels, " << targetBitDepth << " bits" << std::endl;
+    }
+
+    std::vector<AudioFormat> formats;
+    std::vector<StageChain::Options> options;
+    std::vector<std::string> names;
+    for (const Branch& branch : branches) {
+        StageChain::Options branchOptions;
+        branchOptions.quality = config.resampleQuality;
+        branchOptions.dither = config.dither;
+        branchOptions.mixNormalize = config.mixNormalize;
+        branchOptions.variableRate = config.driftCorrection;
+        if (!config.mixMatrixText.empty() && (int)branch.format.channels == targetChannels) {
+            std::string error;
+            if (!ChannelMixer::ParseMatrix(config.mixMatrixText, inputFormat.channels, targetChannels,
+                                           branchOptions.mixMatrix, &error)) {
+                std::cerr << "\nERROR: Invalid mixing matrix: " << error << std::endl;
+                std::cerr << "Format: rows separated by ';', coefficients by ','" << std::endl;
+                std::cerr << "Example (stereo to mono): --mix-matrix \"0.5,0.5\"" << std::endl;
+                return false;
+            }
+        }
+        formats.push_back(branch.format);
+        options.push_back(branchOptions);
+        names.push_back(branch.name);
+    }
+
+    std::string error;
+    if (!stages.Build(inputFormat, formats, options, &error)) {
+        std::cerr << "Error: " << error << std::endl;
+        std::cerr << "Failed to initialize processing stages" << std::endl;
+        return false;
+    }
+    if (stages.Size() == 0) {
+        std::cerr << "No format conversion needed, using device format" << std::endl;
+    } else {
+        std::cerr << "Processing stages:" << std::endl;
+        std::string text = stages.Describe(names);
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) end = text.size();
+            std::cerr << "  " << text.substr(start, end - start) << std::endl;
+            start = end + 1;
+        }
+    }
+
+    for (Branch& branch : branches) {
+        branch.frameFrames = config.frameFrames;
+        if (config.frameMs > 0.0) {
+            // Every frame must be the same length, so the duration has to
+            // come out at a whole number of frames
+            double frames = config.frameMs * branch.format.sampleRate / 1000.0;
+            if (frames < 0.5 || std::fabs(frames - std::round(frames)) > 1e-6) {
+                std::cerr << "\nERROR: --frame-size " << config.frameMs << "ms is not a whole number of frames at "
+                          << branch.format.sampleRate << " Hz" << std::endl;
+                std::cerr << "Give the size in frames instead, e.g. --frame-size "
+                          << std::max(1L, std::lround(frames)) << std::endl;
+                return false;
+            }
+            branch.frameFrames = (uint32_t)std::lround(frames);
+        }
+        if (branch.frameFrames == 0) continue;
+        FrameBlocker::Config blockerConfig;
+        blockerConfig.frameFrames = branch.frameFrames;
+        blockerConfig.output = branch.format;
+        blockerConfig.deviceRate = inputFormat.sampleRate;
+        blockerConfig.alignToDevice = config.frameAlign;
+        if (!branch.blocker.Initialize(blockerConfig, &error)) {
+            std::cerr << "\nERROR: Invalid --frame-size: " << error << std::endl;
+            return false;
+        }
+        char ms[32];
+        snprintf(ms, sizeof(ms), "%.4g", branch.frameFrames * 1000.0 / branch.format.sampleRate);
+        std::cerr << "Re-blocking into " << branch.frameFrames << "-frame packets (" << ms << " ms)"
+                  << (config.frameAlign ? ", aligned to the device position" : "")
+                  << (branches.size() > 1 ? " for " + branch.name : std::string()) << std::endl;
+    }
+    return true;
+}
+
+void CapturePipeline::Run(CaptureSource& source, const std::atomic<bool>& running) {
+    // The thread that waits on the source is the capture thread
+    RealtimeThread scheduling;
+    if (config.lowLatency) {
+        std::string error;
+        if (scheduling.Enter(RealtimeThread::Role::Capture, &error)) {
+            std::cerr << "Capture thread: " << scheduling.Description() << std::endl;
+        } else {
+            std::cerr << "Warning: Capture thread stays at normal priority: " << error << std::endl;
+        }
+    }
+
+    while (running) {
+        if (CheckOutputs()) {
+            std::cerr << "Output closed by consumer, stopping capture" << std::endl;
+            break;
+        }
+
+        if (!source.IsRealtime()) {
+            // Nothing paces the source, so wait for the slowest live writer
+            // to catch up rather than overrunning its ring
+            for (const Output& out : outputs) {
+                if (!out.queue) continue;
+                const SpscByteRing& ring = out.queue->Ring();
+                if (ring.Used() <= ring.Capacity() / 2) continue;
+                uint64_t throttleStart = LatencyClockNs();
+                while (running && !out.queue->Failed() && ring.Used() > ring.Capacity() / 2) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                Add(counters.throttledNs, LatencyClockNs() - throttleStart);
+            }
+        }
+
+        uint64_t start = latencyStats ? LatencyClockNs() : 0;
+        CaptureSource::WaitResult result = source.Wait(kWaitTimeoutMs);
+        if (result == CaptureSource::WaitResult::Timeout) {
+            // No audio data for a while, continue waiting
+            continue;
+        }
+        if (result == CaptureSource::WaitResult::EndOfStream) {
+            std::cerr << "End of " << source.Name() << " input" << std::endl;
+            break;
+        }
+        if (result == CaptureSource::WaitResult::Failed) {
+            std::cerr << "Wait failed" << std::endl;
+            break;
+        }
+
+        if (latencyStats) {
+            uint64_t end = LatencyClockNs();
+            timers.wait->Record(end - start);
+            start = end;
+        }
+
+        // Process all available packets
+        CapturePacket packet;
+        while (source.NextPacket(packet)) {
+            if (latencyStats) {
+                packetTimeNs = LatencyClockNs();
+                timers.acquire->Record(packetTimeNs - start);
+            }
+            ProcessPacket(packet);
+            if (!steady) CheckWarmup();
+            // Output was only copied into the ring, so the source buffer is
+            // released without waiting for the consumer
+            if (latencyStats) start = LatencyClockNs();
+            source.ReleasePacket();
+            if (latencyStats) {
+                uint64_t end = LatencyClockNs();
+                timers.release->Record(end - start);
+                start = end;
+            }
+        }
+    }
+
+    if (steady) captureAllocations = ThreadHeapAllocations() - steadyBase;
+}
+
+// Once warm-up is over, start counting allocations on every thread of the
+// capture path
+void CapturePipeline::CheckWarmup() {
+    if (!AllocationCountingEnabled() ||
+        counters.framesCaptured.load(std::memory_order_relaxed) < inputFormat.sampleRate * kWarmupSeconds) {
+        return;
+    }
+    steady = true;
+    steadyBase = ThreadHeapAllocations();
+    for (Output& out : outputs) {
+        if (out.queue) out.queue->MarkSteady();
+    }
+}
+
+void CapturePipeline::ProcessPacket(const CapturePacket& packet) {
+    // A jump in the device position is audio the source never delivered
+    if (counters.packets.load(std::memory_order_relaxed) > 0 && packet.devicePosition > nextDevicePosition) {
+        Add(counters.framesLost, packet.devicePosition - nextDevicePosition);
+    }
+    nextDevicePosition = packet.devicePosition + packet.frames;
+    Add(counters.packets, 1);
+    Add(counters.framesCaptured, packet.frames);
+    if (packet.flags & records::kFlagSilent) Add(counters.silentFrames, packet.frames);
+    if (packet.flags & records::kFlagDiscontinuity) Add(counters.discontinuities, 1);
+    if (packet.flags & records::kFlagTimestampError) Add(counters.timestampErrors, 1);
+    lastPacket = packet;
+    if (trace) trace->Record(packet, latencyStats ? packetTimeNs : LatencyClockNs());
+    if (config.driftCorrection) {
+        drift.Update(packet.devicePosition, packet.timestamp, packet.frames,
+                     !(packet.flags & records::kFlagTimestampError));
+        stages.AdjustRate(drift.RateScale());
+        driftPpm.store(drift.DriftPpm(), std::memory_order_relaxed);
+    }
+
+    AudioView input;
+    if (!(packet.flags & records::kFlagSilent)) input.data = packet.data;
+    input.frames = packet.frames;
+    if (!latencyStats) {
+        stages.Process(input);
+        if (loudness) loudness->Process(stages.Output(0));
+        for (size_t b = 0; b < branches.size(); b++) {
+            EmitView(b, packet, stages.Output(b));
+        }
+        return;
+    }
+
+    stages.Process(input, timers.stages.data());
+    uint64_t start = LatencyClockNs();
+    if (loudness) {
+        loudness->Process(stages.Output(0));
+        uint64_t end = LatencyClockNs();
+        timers.loudness->Record(end - start);
+        start = end;
+    }
+    for (size_t b = 0; b < branches.size(); b++) {
+        EmitView(b, packet, stages.Output(b));
+    }
+    timers.queue->Record(LatencyClockNs() - start);
+    for (Output& out : outputs) {
+        if (out.queue) out.queue->Mark(packetTimeNs);
+    }
+}
+
+// Converted audio on its way out, cut into --frame-size frames if asked
+void CapturePipeline::EmitView(size_t b, const CapturePacket& packet, const AudioView& view) {
+    Branch& branch = branches[b];
+    if (branch.frameFrames == 0) {
+        WriteView(b, packet, view);
+        return;
+    }
+    branch.blocker.Push(packet, view);
+    CapturePacket framePacket;
+    AudioView frame;
+    while (branch.blocker.Next(framePacket, frame)) {
+        WriteView(b, framePacket, frame);
+    }
+}
+
+void CapturePipeline::WriteView(size_t b, const CapturePacket& packet, const AudioView& view) {
+    if (b == 0) Add(counters.framesEmitted, view.frames);
+    if (view.IsSilent()) {
+        WriteSilence(b, packet, view.frames);
+    } else {
+        WriteAudio(b, packet, view.data, view.frames * branches[b].format.BlockAlign());
+    }
+}
+
+void CapturePipeline::WriteSilence(size_t b, const CapturePacket& packet, uint64_t frames) {
+    const Branch& branch = branches[b];
+    const uint32_t blockAlign = branch.format.BlockAlign();
+    // Whole frames per write so a dropped chunk cannot misalign the stream,
+    // and a whole --frame-size frame per write however large it is
+    const uint8_t* zeros = branch.frameZeros.empty() ? kZeroBlock : branch.frameZeros.data();
+    const uint32_t chunkFrames =
+        (uint32_t)((branch.frameZeros.empty() ? sizeof(kZeroBlock) : branch.frameZeros.size()) / blockAlign);
+
+    if (config.silenceMarkers) {
+        // Records replace the zeros on stdout only; files still need them
+        QueueSilence(b, packet, frames);
+        for (uint64_t left = frames; branch.hasPcmOutput && left > 0;) {
+            uint32_t count = left < chunkFrames ? (uint32_t)left : chunkFrames;
+            WritePcm(b, zeros, (size_t)count * blockAlign);
+            left -= count;
+        }
+        return;
+    }
+
+    // Later chunks carry the position and time of their first frame, in
+    // device frames like FrameBlocker's, and none of the one-shot flags
+    CapturePacket chunk = packet;
+    const double deviceFramesPerFrame = (double)inputFormat.sampleRate / branch.format.sampleRate;
+    for (uint64_t offset = 0; offset < frames;) {
+        uint32_t count = frames - offset < chunkFrames ? (uint32_t)(frames - offset) : chunkFrames;
+        WriteAudio(b, chunk, zeros, (size_t)count * blockAlign);
+        offset += count;
+        chunk.devicePosition = packet.devicePosition + (uint64_t)std::llround(offset * deviceFramesPerFrame);
+        chunk.timestamp = packet.timestamp + (uint64_t)std::llround((double)offset * records::kTimestampFrequency /
+                                                                    branch.format.sampleRate);
+        chunk.flags &= ~records::kFlagDiscontinuity;
+    }
+}
+
+void CapturePipeline::WriteAudio(size_t b, const CapturePacket& packet, const uint8_t* data, size_t size) {
+    if (size == 0) return;
+    const Branch& branch = branches[b];
+    if (branch.hasPcmOutput) {
+        WritePcm(b, data, size);
+    }
+    if (!branch.hasStreamOutput) return;
+
+    if (config.framed) {
+        FlushSilence(b);
+        WritePacket(b, packet, packet.flags, data, size, size / branch.format.BlockAlign());
+        return;
+    }
+    if (!config.silenceMarkers) {
+        WriteStream(b, data, size);
+        return;
+    }
+    FlushSilence(b);
+    uint8_t header[records::kHeaderSize];
+    records::WriteHeader(header, records::kAudioTag, (uint32_t)size);
+    WriteStream(b, header, sizeof(header), data, size);
+}
+
+// Merge consecutive silent packets into one record, but report at least
+// once per second so consumers see the stream clock advance
+void CapturePipeline::QueueSilence(size_t b, const CapturePacket& packet, uint64_t frames) {
+    // A merged run reports the first packet's timestamps and every flag
+    Branch& branch = branches[b];
+    if (!branch.hasStreamOutput) return;
+    if (branch.pendingSilenceFrames == 0) {
+        branch.silenceStart = packet;
+    } else {
+        branch.silenceStart.flags |= packet.flags;
+    }
+    branch.pendingSilenceFrames += frames;
+    branch.suppressedSilenceFrames += frames;
+    if (branch.pendingSilenceFrames >= branch.format.sampleRate) {
+        FlushSilence(b);
+    }
+}
+
+void CapturePipeline::FlushSilence(size_t b) {
+    Branch& branch = branches[b];
+    while (branch.pendingSilenceFrames > 0) {
+        uint32_t frames =
+            branch.pendingSilenceFrames > UINT32_MAX ? UINT32_MAX : (uint32_t)branch.pendingSilenceFrames;
+        if (config.framed) {
+            WritePacket(b, branch.silenceStart, branch.silenceStart.flags | records::kFlagSilent, nullptr, 0, frames);
+        } else {
+            uint8_t header[records::kHeaderSize];
+            records::WriteHeader(header, records::kSilenceTag, frames);
+            WriteStream(b, header, sizeof(header));
+        }
+        branch.pendingSilenceFrames -= frames;
+    }
+}
+
+// One --framed packet; the stream position advances even when a ring
+// drops it, so consumers can size the gap
+void CapturePipeline::WritePacket(size_t b, const CapturePacket& packet, uint32_t flags, const uint8_t* data,
+                                  size_t size, uint64_t frames) {
+    Branch& branch = branches[b];
+    records::PacketHeader header = {};
+    header.magic = records::kPacketMagic;
+    header.devicePosition = packet.devicePosition;
+    header.timestamp = packet.timestamp;
+    header.streamPosition = branch.streamFramePosition;
+    header.frames = (uint32_t)frames;
+    header.payloadBytes = (uint32_t)size;
+    branch.streamFramePosition += frames;
+
+    // Each consumer learns about its own drops only
+    for (Output& out : outputs) {
+        if (!out.stream || out.branch != b) continue;
+        header.flags = flags | out.pendingPacketFlags;
+        if (Enqueue(out, &header, sizeof(header), data, size, records::PaddingFor(size))) {
+            out.pendingPacketFlags = 0;
+        } else {
+            out.pendingPacketFlags |= records::kFlagOutputDropped;
+        }
+    }
+}
+
+void CapturePipeline::WriteStreamHeader(size_t b) {
+    const Branch& branch = branches[b];
+    records::StreamHeader header = {};
+    header.magic = records::kStreamMagic;
+    header.version = records::kStreamVersion;
+    header.headerSize = sizeof(header);
+    header.sampleRate = branch.format.sampleRate;
+    header.channels = (uint16_t)branch.format.channels;
+    header.bitsPerSample = (uint16_t)branch.format.BitsPerSample();
+    header.blockAlign = (uint16_t)branch.format.BlockAlign();
+    header.sampleFormat = branch.format.type == SampleType::Float32 ? records::kSampleFormatFloat
+                                                                    : records::kSampleFormatPcm;
+    header.channelMask = branch.format.channelMask;
+    header.deviceSampleRate = inputFormat.sampleRate;
+    header.latencyFrames = (uint32_t)std::lround(stages.LatencyOutputFrames(b));
+    header.packetHeaderSize = sizeof(records::PacketHeader);
+    header.packetFrames = branch.frameFrames;
+    header.timestampFrequency = records::kTimestampFrequency;
+    WriteStream(b, &header, sizeof(header));
+}
+
+void CapturePipeline::Finish() {
+    if (outputs.empty()) return;
+    CapturePacket tail = lastPacket;
+    tail.flags = records::kFlagFlush;
+    stages.Flush([&](size_t b, const AudioView& view) {
+        if (b == 0 && loudness) loudness->Process(view);
+        EmitView(b, tail, view);
+    });
+    for (size_t b = 0; b < branches.size(); b++) {
+        CapturePacket framePacket;
+        AudioView frame;
+        if (branches[b].frameFrames > 0 && branches[b].blocker.Flush(framePacket, frame)) {
+            WriteView(b, framePacket, frame);
+        }
+        FlushSilence(b);
+    }
+    if (config.driftCorrection) {
+        char ppm[32];
+        snprintf(ppm, sizeof(ppm), "%+.2f", drift.DriftPpm());
+        std::cerr << "Clock drift: device " << ppm << " ppm against the host clock, corrected ("
+                  << drift.Resyncs() << " resyncs)" << std::endl;
+    }
+    StopOutputs();
+}
+
+bool CapturePipeline::Start(uint32_t sourceBufferFrames) {
+    // Queue capacity for each output format
+    std::vector<size_t> capacities;
+    for (Branch& branch : branches) {
+        const AudioFormat& format = branch.format;
+        size_t capacity = (size_t)format.BytesPerSecond() * config.outputBufferMs / 1000;
+        // Always hold several source buffers so one late write never drops data
+        size_t minimum = (size_t)sourceBufferFrames * format.BlockAlign() * 4;
+        if (capacity < minimum) capacity = minimum;
+        // ... and several whole frames
+        size_t frameBytes = (size_t)branch.frameFrames * format.BlockAlign();
+        if (capacity < frameBytes * 4) capacity = frameBytes * 4;
+        capacities.push_back(capacity);
+
+        branch.frameZeros.clear();
+        if (frameBytes > sizeof(kZeroBlock)) branch.frameZeros.assign(frameBytes, 0);
+        branch.pendingSilenceFrames = 0;
+        branch.suppressedSilenceFrames = 0;
+        branch.streamFramePosition = 0;
+        branch.hasStreamOutput = false;
+        branch.hasPcmOutput = false;
+    }
+
+    // Largest packet the source can hand over, so no stage grows its
+    // buffers on the capture path
+    stages.Reserve(sourceBufferFrames);
+
+    metrics.reset();
+    outputs.clear();
+    latencyStats.reset();
+    loudness.reset();
+    for (std::atomic<uint64_t>* counter :
+         {&counters.packets, &counters.framesCaptured, &counters.silentFrames, &counters.discontinuities,
+          &counters.framesLost, &counters.timestampErrors, &counters.framesEmitted, &counters.throttledNs}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    nextDevicePosition = 0;
+    steady = false;
+    captureAllocations = 0;
+    steadyStateAllocations = 0;
+    drift.Reset(inputFormat.sampleRate, records::kTimestampFrequency);
+    driftPpm.store(0.0, std::memory_order_relaxed);
+    startTimeSeconds = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    timers = LatencyTimers();
+
+    if (config.loudnessIntervalMs > 0) {
+        loudness = std::make_unique<LoudnessMeter>();
+        std::string error;
+        if (!loudness->Initialize(branches[0].format, nullptr, &error)) {
+            std::cerr << "\nERROR: " << error << std::endl;
+            loudness.reset();
+            return false;
+        }
+    }
+    if (config.statsIntervalMs > 0) {
+        latencyStats = std::make_unique<LatencyStats>();
+        timers.wait = latencyStats->Add("wait");
+        timers.acquire = latencyStats->Add("acquire");
+        for (size_t i = 0; i < stages.Size(); i++) {
+            // Stages of a single format are named after it
+            std::string name = stages.Stage(i).Name();
+            uint64_t mask = stages.StageBranches(i);
+            if (branches.size() > 1 && mask != ((uint64_t)1 << branches.size()) - 1) {
+                size_t b = 0;
+                while (!(mask & ((uint64_t)1 << b))) b++;
+                const AudioFormat& format = branches[b].format;
+                name += " " + std::to_string(format.sampleRate) + "/" + std::to_string(format.channels) + "/" +
+                        std::to_string(format.BitsPerSample());
+            }
+            timers.stages.push_back(latencyStats->Add(name));
+        }
+        if (loudness) timers.loudness = latencyStats->Add("loudness");
+        timers.queue = latencyStats->Add("queue");
+        timers.release = latencyStats->Add("release");
+    }
+
+    trace.reset();
+    if (!config.traceFile.empty()) {
+        trace = std::make_unique<CaptureTraceWriter>();
+        std::string error;
+        if (!trace->Open(config.traceFile, inputFormat, sourceBufferFrames, config.outputBufferMs, &error)) {
+            std::cerr << error << std::endl;
+            trace.reset();
+            return false;
+        }
+        std::cerr << "Recording capture trace to " << config.traceFile << std::endl;
+    }
+
+    std::vector<std::string> targets = config.outputs;
+    if (targets.empty()) targets.push_back("-");
+    for (size_t i = 0; i < targets.size(); i++) {
+        const std::string& target = targets[i];
+        Output out;
+        out.branch = targetBranches[i];
+        Branch& branch = branches[out.branch];
+        size_t capacity = capacities[out.branch];
+        if (target == "-" && config.flac) {
+            out.sink = std::make_unique<FlacSink>(config.flacLevel, config.flacBlockSize);
+        } else if (target == "-") {
+            out.sink = std::make_unique<StdoutSink>();
+            out.stream = true;
+        } else if (StreamServerSink::IsSocketTarget(target)) {
+            StreamServerSink::Options options;
+            options.maxLagMs = config.maxClientLagMs;
+            options.skipLagging = config.skipLaggingClients;
+            out.sink = std::make_unique<StreamServerSink>(target, options);
+            out.stream = true;
+        } else if (IsSharedMemoryTarget(target)) {
+            // Carries exactly what stdout would, in a ring as large as a queue
+            uint32_t container = config.framed           ? shmring::kContainerFramed
+                                 : config.silenceMarkers ? shmring::kContainerRecords
+                                                         : shmring::kContainerRaw;
+            out.sink = std::make_unique<SharedMemorySink>(target.substr(4), container, capacity);
+            out.stream = true;
+        } else {
+            out.sink = std::make_unique<WavSink>(target);
+        }
+
+        std::string error;
+        if (!out.sink->Open(branch.format, &error)) {
+            std::cerr << error << std::endl;
+            outputs.clear();
+            return false;
+        }
+
+        (out.stream ? branch.hasStreamOutput : branch.hasPcmOutput) = true;
+        out.name = out.sink->Name();
+        if (out.sink->IsInline()) {
+            outputs.push_back(std::move(out));
+            continue;
+        }
+
+        OutputSink* sink = out.sink.get();
+        out.queue = std::make_unique<AsyncOutput>();
+        out.queue->SetCoalescing(kCoalesceBytes, std::chrono::milliseconds(config.maxOutputLatencyMs));
+        out.queue->SetRealtime(config.lowLatency);
+        if (latencyStats) {
+            out.queue->SetLatencyHistograms(latencyStats->Add("write " + out.sink->Name()),
+                                            latencyStats->Add("end-to-end " + out.sink->Name()));
+        }
+        if (!out.queue->Start(capacity, [sink](const uint8_t* first, size_t firstSize, const uint8_t* second,
+                                               size_t secondSize) {
+                return sink->Write(first, firstSize, second, secondSize);
+            })) {
+            std::cerr << "Failed to start output writer thread" << std::endl;
+            outputs.clear();
+            return false;
+        }
+        outputs.push_back(std::move(out));
+    }
+
+    size_t queued = 0;
+    const AsyncOutput* firstQueue = nullptr;
+    for (const Output& out : outputs) {
+        if (!out.queue) continue;
+        if (!firstQueue) firstQueue = out.queue.get();
+        queued++;
+    }
+    if (firstQueue) {
+        // Sized per format, so several formats share the duration only
+        if (branches.size() > 1) {
+            std::cerr << "Output buffer: " << config.outputBufferMs << " ms";
+        } else {
+            std::cerr << "Output buffer: " << firstQueue->Ring().Capacity() / 1024 << " KB";
+        }
+        if (queued > 1) {
+            std::cerr << " for each of " << queued << " outputs";
+        }
+        if (config.maxOutputLatencyMs > 0) {
+            std::cerr << ", coalescing writes up to " << config.maxOutputLatencyMs << " ms / "
+                      << kCoalesceBytes / 1024 << " KB";
+        }
+        std::cerr << std::endl;
+    }
+    if (config.lowLatency) {
+        // The slowest format
+        double seconds = 0.0;
+        for (size_t b = 0; b < branches.size(); b++) {
+            seconds = std::max(seconds, stages.LatencyOutputFrames(b) / branches[b].format.sampleRate);
+        }
+        char latency[32];
+        snprintf(latency, sizeof(latency), "%.2f", seconds * 1000.0);
+        std::cerr << "Low-latency mode: every packet is written as soon as it is queued, conversion adds "
+                  << latency << " ms" << std::endl;
+        for (const Output& out : outputs) {
+            if (!out.queue) continue;
+            if (out.queue->RealtimeActive()) {
+                std::cerr << "  Output " << out.sink->Name() << " writer: " << out.queue->RealtimeStatus() << std::endl;
+            } else {
+                std::cerr << "Warning: Output " << out.sink->Name()
+                          << " writer stays at normal priority: " << out.queue->RealtimeStatus() << std::endl;
+            }
+        }
+    }
+    if (config.framed) {
+        std::cerr << "Framed output enabled: stream header plus timestamped packet headers"
+                  << (config.silenceMarkers ? ", silent spans as empty packets" : "") << std::endl;
+        for (size_t b = 0; b < branches.size(); b++) {
+            if (branches[b].hasStreamOutput) WriteStreamHeader(b);
+        }
+    } else if (config.silenceMarkers) {
+        std::cerr << "Silence markers enabled: output is 'PCM '/'SILN' records, not raw PCM" << std::endl;
+    }
+    if (!config.metricsFile.empty() || !config.metricsListen.empty()) {
+        metrics = std::make_unique<MetricsExporter>();
+        std::string error;
+        if (!metrics->Start(config.metricsFile, config.metricsListen, [this] { return RenderMetrics(); }, &error)) {
+            std::cerr << error << std::endl;
+            metrics.reset();
+            outputs.clear();
+            return false;
+        }
+    }
+    if (config.lowLatency) {
+        // Last, so the rings, buffers and writer stacks are all resident
+        std::string error;
+        if (!RealtimeThread::LockMemory(&error)) {
+            std::cerr << "Warning: Memory not locked: " << error << std::endl;
+        }
+    }
+    if (latencyStats) {
+        std::cerr << "Latency statistics every " << config.statsIntervalMs << " ms"
+                  << (config.statsJson ? " as JSON lines" : "") << std::endl;
+        latencyStats->Start(std::chrono::milliseconds(config.statsIntervalMs),
+                            config.statsJson ? LatencyStats::Format::Json : LatencyStats::Format::Text);
+    }
+    if (loudness) {
+        std::cerr << "Loudness of " << branches[0].name << " every " << config.loudnessIntervalMs << " ms"
+                  << (config.loudnessJson ? " as JSON lines" : "") << " (";
+        if (loudness->TruePeakFactor() > 1) {
+            std::cerr << loudness->TruePeakFactor() << "x true peak, ";
+        } else {
+            std::cerr << "true peak at the sample rate, ";
+        }
+        std::cerr << loudness->KernelName() << ")" << std::endl;
+        loudness->Start(std::chrono::milliseconds(config.loudnessIntervalMs),
+                        config.loudnessJson ? LoudnessMeter::Format::Json : LoudnessMeter::Format::Text);
+    }
+    return true;
+}
+
+bool CapturePipeline::OutputFailed() const {
+    for (const Output& out : outputs) {
+        if (!out.queue || !out.queue->Failed()) return false;
+    }
+    return !outputs.empty();
+}
+
+// Report outputs that died since the last check; true once none is left
+bool CapturePipeline::CheckOutputs() {
+    bool allFailed = true;
+    for (Output& out : outputs) {
+        if (!out.queue || !out.queue->Failed()) {
+            allFailed = false;
+        } else if (!out.failureReported && outputs.size() > 1) {
+            std::cerr << "Warning: Output " << out.name << " closed, continuing with the others"
+                      << std::endl;
+            out.failureReported = true;
+        }
+    }
+    return allFailed;
+}
+
+void CapturePipeline::WritePcm(size_t b, const uint8_t* data, size_t size) {
+    for (Output& out : outputs) {
+        if (!out.stream && out.branch == b) Enqueue(out, data, size, nullptr, 0);
+    }
+}
+
+void CapturePipeline::WriteStream(size_t b, const void* header, size_t headerSize, const void* data, size_t size) {
+    for (Output& out : outputs) {
+        if (out.stream && out.branch == b) Enqueue(out, header, headerSize, data, size);
+    }
+}
+
+bool CapturePipeline::Enqueue(Output& out, const void* header, size_t headerSize, const void* data, size_t size,
+                              size_t padding) {
+    if (!out.queue) {
+        // Inline sinks never refuse data
+        out.sink->WriteRecord(header, headerSize, data, size, padding);
+        return true;
+    }
+    if (out.queue->Write(header, headerSize, data, size, padding)) {
+        return true;
+    }
+    if (!out.overrunReported && !out.queue->Failed()) {
+        std::cerr << "Warning: Output " << out.name
+                  << " too slow, dropping audio (output buffer full)" << std::endl;
+        out.overrunReported = true;
+    }
+    return false;
+}
+
+void CapturePipeline::StopOutputs() {
+    std::string allocations;
+    steadyStateAllocations = captureAllocations;
+    if (steady) allocations = "capture " + std::to_string(captureAllocations);
+    for (Output& out : outputs) {
+        if (out.queue) {
+            out.queue->Stop();
+            if (steady) {
+                steadyStateAllocations += out.queue->SteadyAllocations();
+                allocations += ", " + out.sink->Name() + " writer " + std::to_string(out.queue->SteadyAllocations());
+            }
+            const SpscByteRing& ring = out.queue->Ring();
+            std::cerr << "Output " << out.sink->Name() << ": " << ring.WrittenBytes() << " bytes queued, peak "
+                      << ring.HighWaterBytes() / 1024 << " KB, "
+                      << ring.Overruns() << " overruns (" << ring.DroppedBytes() << " bytes dropped)" << std::endl;
+        }
+
+        // The writer thread has exited, so the sink is ours now
+        out.sink->Close();
+    }
+    if (trace) {
+        trace->Close();
+        std::cerr << "Trace " << trace->Path() << ": " << trace->Packets() << " packets, " << trace->Bytes() / 1024
+                  << " KB, " << trace->DroppedPackets() << " dropped" << std::endl;
+        trace.reset();
+    }
+    if (metrics) {
+        // Final values, including the drained queues
+        metrics->Stop();
+        metrics.reset();
+    }
+    if (latencyStats) {
+        // The writers are done, so the summary covers everything
+        latencyStats->Stop();
+        latencyStats.reset();
+    }
+    if (loudness) {
+        loudness->Stop();
+        loudness.reset();
+    }
+    if (config.silenceMarkers) {
+        for (const Branch& branch : branches) {
+            if (!branch.hasStreamOutput) continue;
+            std::cerr << "Silence markers: " << branch.suppressedSilenceFrames << " silent frames sent as records"
+                      << (branches.size() > 1 ? " (" + branch.name + ")" : std::string()) << std::endl;
+        }
+    }
+    if (steady) {
+        std::cerr << "Heap allocations after warm-up: " << allocations << std::endl;
+        if (steadyStateAllocations > 0) {
+            std::cerr << "ERROR: The capture path allocated " << steadyStateAllocations
+                      << " times after warm-up; every buffer should be sized by Start()" << std::endl;
+        }
+    }
+    char peak[64];
+    snprintf(peak, sizeof(peak), "Peak memory: %.1f MB resident", PeakResidentBytes() / 1048576.0);
+    std::cerr << peak;
+    if (AllocationCountingEnabled()) {
+        snprintf(peak, sizeof(peak), ", %.1f MB heap", PeakHeapBytes() / 1048576.0);
+        std::cerr << peak;
+    }
+    std::cerr << std::endl;
+    outputs.clear();
+}
+
+std::string CapturePipeline::RenderMetrics() const {
+    MetricsText text;
+    text.Family("wasapi_capture_info", "gauge", "Output formats of the running capture, one sample each");
+    for (const Branch& branch : branches) {
+        text.Sample("wasapi_capture_info", (uint64_t)1,
+                    MetricsText::Label("sample_rate", std::to_string(branch.format.sampleRate)) + "," +
+                        MetricsText::Label("channels", std::to_string(branch.format.channels)) + "," +
+                        MetricsText::Label("format", SampleTypeName(branch.format.type)) + "," +
+                        MetricsText::Label("device_sample_rate", std::to_string(inputFormat.sampleRate)));
+    }
+    text.Family("wasapi_capture_start_time_seconds", "gauge", "Unix time the capture started");
+    text.Sample("wasapi_capture_start_time_seconds", startTimeSeconds);
+
+    struct {
+        const char* name;
+        const char* help;
+        const std::atomic<uint64_t>& counter;
+    } const totals[] = {
+        {"wasapi_capture_packets_total", "Packets received from the source", counters.packets},
+        {"wasapi_capture_frames_captured_total", "Frames received from the source", counters.framesCaptured},
+        {"wasapi_capture_silent_frames_total", "Source frames flagged silent", counters.silentFrames},
+        {"wasapi_capture_discontinuities_total", "Packets flagged with a data discontinuity", counters.discontinuities},
+        {"wasapi_capture_frames_lost_total", "Source frames skipped by the device position", counters.framesLost},
+        {"wasapi_capture_timestamp_errors_total", "Packets flagged with a timestamp error", counters.timestampErrors},
+        {"wasapi_capture_frames_emitted_total", "Frames produced at the first output format's rate, silence included",
+         counters.framesEmitted},
+    };
+    for (const auto& total : totals) {
+        text.Family(total.name, "counter", total.help);
+        text.Sample(total.name, total.counter.load(std::memory_order_relaxed));
+    }
+
+    // Frames taken in but not yet emitted, at the first output rate: the
+    // resampler's history and look-ahead
+    double captured = (double)counters.framesCaptured.load(std::memory_order_relaxed) *
+                      branches[0].format.sampleRate / inputFormat.sampleRate;
+    double buffered = captured - (double)counters.framesEmitted.load(std::memory_order_relaxed);
+    text.Family("wasapi_capture_stage_buffered_frames", "gauge", "Output frames held inside the conversion stages");
+    text.Sample("wasapi_capture_stage_buffered_frames", buffered > 0.0 ? std::floor(buffered) : 0.0);
+    if (config.driftCorrection) {
+        text.Family("wasapi_capture_clock_drift_ppm", "gauge",
+                    "Estimated device clock deviation from its nominal rate, in ppm of host time");
+        text.Sample("wasapi_capture_clock_drift_ppm", driftPpm.load(std::memory_order_relaxed));
+    }
+    if (loudness) {
+        // Readings that do not exist yet (-infinity) are left out
+        const struct {
+            const char* window;
+            double value;
+        } readings[] = {{"momentary", loudness->MomentaryLufs()},
+                        {"short_term", loudness->ShortTermLufs()},
+                        {"integrated", loudness->IntegratedLufs()}};
+        text.Family("wasapi_capture_loudness_lufs", "gauge", "EBU R128 loudness of the first output format");
+        for (const auto& reading : readings) {
+            if (std::isfinite(reading.value)) {
+                text.Sample("wasapi_capture_loudness_lufs", reading.value,
+                            MetricsText::Label("window", reading.window));
+            }
+        }
+        double samplePeak = loudness->SamplePeakDb();
+        double truePeak = loudness->TruePeakDb();
+        text.Family("wasapi_capture_peak_dbfs", "gauge", "Highest sample and true peak of the first output format");
+        if (std::isfinite(samplePeak)) {
+            text.Sample("wasapi_capture_peak_dbfs", samplePeak, MetricsText::Label("kind", "sample"));
+        }
+        if (std::isfinite(truePeak)) {
+            text.Sample("wasapi_capture_peak_dbfs", truePeak, MetricsText::Label("kind", "true"));
+        }
+    }
+    text.Family("wasapi_capture_throttled_seconds_total", "counter",
+                "Time a non-real-time source waited for the outputs to drain");
+    text.Sample("wasapi_capture_throttled_seconds_total",
+                counters.throttledNs.load(std::memory_order_relaxed) / 1e9);
+
+    text.Family("wasapi_capture_output_up", "gauge", "1 while the output accepts data");
+    for (const Output& out : outputs) {
+        text.Sample("wasapi_capture_output_up", (uint64_t)(out.queue && out.queue->Failed() ? 0 : 1),
+                    MetricsText::Label("output", out.sink->Name()));
+    }
+    // Inline sinks have no queue and never block
+    auto queueFamily = [&](const char* name, const char* type, const char* help, auto value) {
+        text.Family(name, type, help);
+        for (const Output& out : outputs) {
+            if (out.queue) text.Sample(name, value(*out.queue), MetricsText::Label("output", out.sink->Name()));
+        }
+    };
+    queueFamily("wasapi_capture_output_bytes_total", "counter", "Bytes queued for the output",
+                [](const AsyncOutput& queue) { return queue.Ring().WrittenBytes(); });
+    queueFamily("wasapi_capture_output_dropped_bytes_total", "counter", "Bytes dropped on a full output queue",
+                [](const AsyncOutput& queue) { return queue.Ring().DroppedBytes(); });
+    queueFamily("wasapi_capture_output_overruns_total", "counter", "Writes dropped on a full output queue",
+                [](const AsyncOutput& queue) { return queue.Ring().Overruns(); });
+    queueFamily("wasapi_capture_output_queued_bytes", "gauge", "Bytes waiting in the output queue",
+                [](const AsyncOutput& queue) { return (uint64_t)queue.Ring().Used(); });
+    queueFamily("wasapi_capture_output_queue_capacity_bytes", "gauge", "Size of the output queue",
+                [](const AsyncOutput& queue) { return (uint64_t)queue.Ring().Capacity(); });
+    queueFamily("wasapi_capture_output_write_seconds_total", "counter",
+                "Time the output writer spent blocked on the consumer",
+                [](const AsyncOutput& queue) { return queue.SinkNanoseconds() / 1e9; });
+    return text.Text();
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+// Everything between a capture source and the output.
+//
+// Initialize() negotiates the output format from the source format and the
+// requested rate, channel count and bit depth, and assembles the stages for
+// it (see audio_stages.h); outputs with formats of their own are branches of
+// one stage graph. Each packet runs through the graph, is framed per format
+// as raw PCM, silence records or timestamped packets, and is fanned out to
+// stdout, WAV files, socket servers and shared-memory rings. Nothing here
+// depends on WASAPI, so the capture front end and the replay tool share it.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_output.h"
+#include "audio_format.h"
+#include "audio_stages.h"
+#include "capture_source.h"
+#include "capture_trace.h"
+#include "clock_drift.h"
+#include "flac_encoder.h"
+#include "frame_blocker.h"
+#include "latency_stats.h"
+#include "loudness_meter.h"
+#include "metrics_exporter.h"
+#include "output_sink.h"
+#include "polyphase_resampler.h"
+#include "realtime_thread.h"
+#include "stream_server.h"
+
+class CapturePipeline {
+public:
+    // An output's own format; 0 keeps the value of the main format
+    // (--sample-rate, --channels, --bit-depth)
+    struct FormatSpec {
+        int sampleRate = 0;
+        int channels = 0;
+        int bitDepth = 0;
+
+        bool Empty() const { return sampleRate == 0 && channels == 0 && bitDepth == 0; }
+    };
+
+    struct Config {
+        int sampleRate = 0;  // 0 keeps the source rate
+        int channels = 0;    // 0 keeps the source channel count
+        int bitDepth = 0;    // 0 keeps the source bit depth
+        PolyphaseResampler::Quality resampleQuality = PolyphaseResampler::Quality::High;
+        bool dither = false;
+        std::string mixMatrixText;
+        bool mixNormalize = false;         // scale the standard downmix down instead of clamping it
+        int outputBufferMs = 2000;
+        int maxOutputLatencyMs = 0;
+        bool silenceMarkers = false;
+        bool framed = false;
+        std::vector<std::string> outputs;  // WAV paths, "-" for stdout, tcp:/unix: to serve, shm:name; empty: stdout
+        std::vector<FormatSpec> outputFormats;  // --output-format by index into `outputs`; missing: main format
+        int maxClientLagMs = 1000;         // socket clients further behind are dropped or skipped
+        bool skipLaggingClients = false;
+        bool flac = false;                 // stdout carries a FLAC stream
+        int flacLevel = FlacEncoder::kDefaultLevel;
+        int flacBlockSize = FlacEncoder::kDefaultBlockSize;
+        int statsIntervalMs = 0;           // latency report period; 0 disables the statistics
+        bool statsJson = false;            // report as JSON lines instead of text
+        int loudnessIntervalMs = 0;        // loudness report period; 0 disables metering
+        bool loudnessJson = false;         // report loudness as JSON lines instead of text
+        std::string metricsFile;           // rewritten with Prometheus text every second
+        std::string metricsListen;         // "[host:]port" serving /metrics over HTTP
+        std::string traceFile;             // record every source packet here (capture_trace.h)
+        bool driftCorrection = false;      // resample to hold the output rate against the host clock
+        bool lowLatency = false;           // real-time threads, locked memory, no write batching
+        uint32_t frameFrames = 0;          // --frame-size in output frames; 0 keeps the packet sizes
+        double frameMs = 0.0;              // --frame-size in milliseconds, converted by Initialize()
+        bool frameAlign = false;           // frame boundaries on multiples of the frame length in device frames
+    };
+
+    // --low-latency runs the capture thread and the writers at real-time
+    // priority with locked memory and unbatched writes. This is its
+    // --output-buffer-ms when none is given: audio older than this is
+    // dropped and counted rather than delivered late
+    static constexpr int kLowLatencyOutputBufferMs = 100;
+
+    // How long Run() waits on a quiet source before checking `running` again
+    static constexpr uint32_t kWaitTimeoutMs = 2000;
+
+    // Source audio after which the capture path must not allocate: Start()
+    // sizes every buffer on the way
+    static constexpr double kWarmupSeconds = 2.0;
+
+    CapturePipeline();
+    ~CapturePipeline();
+
+    CapturePipeline(const CapturePipeline&) = delete;
+    CapturePipeline& operator=(const CapturePipeline&) = delete;
+
+    // Check the output list against the container options
+    static bool ValidateOutputs(const Config& config, std::string* error);
+
+    // Parse --output-format "<rate>[:<channels>[:<bits>]]"; empty fields
+    // keep the main format's value
+    static bool ParseFormatSpec(const std::string& text, FormatSpec& spec);
+
+    // Choose the output format and build the conversion stages; problems
+    // are reported on stderr
+    bool Initialize(const Config& config, const AudioFormat& inputFormat);
+
+    // Open the sinks and start their writer threads; `sourceBufferFrames` is
+    // the largest burst the source can deliver at once
+    bool Start(uint32_t sourceBufferFrames);
+
+    // Pump packets from `source` until it ends, every output has failed or
+    // `running` is cleared
+    void Run(CaptureSource& source, const std::atomic<bool>& running);
+
+    // Run one captured packet through the stage chain into the output
+    void ProcessPacket(const CapturePacket& packet);
+
+    // Drain the resampler tail and pending silence, then stop the writers
+    // and report peak memory
+    void Finish();
+
+    // True once every output has failed
+    bool OutputFailed() const;
+    // After Finish(), in builds that count allocations: heap allocations
+    // on the capture thread and the writers after warm-up (0 otherwise)
+    uint64_t SteadyStateAllocations() const { return steadyStateAllocations; }
+    const AudioFormat& InputFormat() const { return inputFormat; }
+    // Distinct output formats, in the order the outputs first use them
+    size_t OutputFormatCount() const { return branches.size(); }
+    const AudioFormat& OutputFormat(size_t index = 0) const { return branches[index].format; }
+
+private:
+    Config config;
+    AudioFormat inputFormat;
+
+    // One output format: a branch of the stage graph with its own framing
+    // state
+    struct Branch {
+        AudioFormat format;
+        std::string name;                  // for the log, e.g. "16000Hz, 1 channels, 16 bits"
+        // --frame-size re-blocks the audio into frames of exactly this many
+        // output frames (frame_blocker.h); unused when 0
+        uint32_t frameFrames = 0;
+        FrameBlocker blocker;
+        std::vector<uint8_t> frameZeros;   // one silent frame, when larger than the shared zero block
+        bool hasStreamOutput = false;
+        bool hasPcmOutput = false;
+        // Silence not yet reported as a record (--silence-markers only)
+        uint64_t pendingSilenceFrames = 0;
+        uint64_t suppressedSilenceFrames = 0;
+        CapturePacket silenceStart;
+        // --framed state
+        uint64_t streamFramePosition = 0;
+    };
+    std::vector<Branch> branches;
+    std::vector<size_t> targetBranches;    // branch of each output target
+
+    StageGraph stages;
+
+    // --stats-interval latency histograms for every step (source wait,
+    // borrowing the packet, each stage, queueing, each sink write) and for
+    // borrow-to-dequeue; null when disabled. Declared before the outputs so
+    // their writer threads are gone before the histograms.
+    std::unique_ptr<LatencyStats> latencyStats;
+    struct LatencyTimers {
+        LatencyHistogram* wait = nullptr;
+        LatencyHistogram* acquire = nullptr;
+        std::vector<LatencyHistogram*> stages;  // one per stage
+        LatencyHistogram* loudness = nullptr;
+        LatencyHistogram* queue = nullptr;
+        LatencyHistogram* release = nullptr;
+    };
+    LatencyTimers timers;
+    uint64_t packetTimeNs = 0;  // when the current packet was borrowed
+
+    // --loudness-interval: EBU R128 loudness and sample and true peak of the
+    // first output format (loudness_meter.h); null when disabled
+    std::unique_ptr<LoudnessMeter> loudness;
+
+    // One destination. Sinks that can block get their own bounded queue and
+    // writer thread, so a stalled consumer only loses its own data; inline
+    // sinks (shared-memory rings) never block and are written directly
+    struct Output {
+        std::unique_ptr<OutputSink> sink;  // written by the writer thread
+        std::string name;                  // sink->Name(), kept for warnings on the capture thread
+        size_t branch = 0;                 // index into `branches`
+        std::unique_ptr<AsyncOutput> queue;  // null for inline sinks
+        bool stream = false;               // gets the record/framed container; else plain PCM
+        bool overrunReported = false;
+        bool failureReported = false;
+        uint32_t pendingPacketFlags = 0;   // --framed: drops to report in the next header
+    };
+    std::vector<Output> outputs;
+
+    // Coalesced writes are flushed once this much audio is queued, even
+    // before the latency budget runs out
+    static constexpr size_t kCoalesceBytes = 64 * 1024;
+
+    // --record-trace: every source packet, unconverted, for the replay
+    // tool; null when disabled
+    std::unique_ptr<CaptureTraceWriter> trace;
+
+    CapturePacket lastPacket;
+
+    // Written by the capture thread only, read by the metrics exporter
+    // (--metrics-file, --metrics-listen)
+    struct Counters {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> framesCaptured{0};   // source frames
+        std::atomic<uint64_t> silentFrames{0};     // source frames flagged silent
+        std::atomic<uint64_t> discontinuities{0};
+        std::atomic<uint64_t> framesLost{0};       // gaps in the device position
+        std::atomic<uint64_t> timestampErrors{0};
+        std::atomic<uint64_t> framesEmitted{0};    // frames of the first output format, silence included
+        std::atomic<uint64_t> throttledNs{0};      // a non-real-time source waiting for the outputs
+    };
+    Counters counters;
+    uint64_t nextDevicePosition = 0;
+    double startTimeSeconds = 0.0;  // Unix time
+
+    // Builds that count allocations (allocation_counter.h): thread
+    // allocations when warm-up ended
+    bool steady = false;
+    uint64_t steadyBase = 0;
+    uint64_t captureAllocations = 0;
+    uint64_t steadyStateAllocations = 0;
+
+    // --drift-correction measures the device clock against the packet
+    // timestamps and steers the resampling ratio (clock_drift.h)
+    ClockDriftEstimator drift;
+    std::atomic<double> driftPpm{0.0};  // latest estimate, for the metrics
+
+    // Declared after the outputs so it stops reading them before they go
+    std::unique_ptr<MetricsExporter> metrics;
+
+    AudioFormat ResolveFormat(const FormatSpec& spec) const;
+    void EmitView(size_t branch, const CapturePacket& packet, const AudioView& view);
+    void WriteView(size_t branch, const CapturePacket& packet, const AudioView& view);
+    void WriteSilence(size_t branch, const CapturePacket& packet, uint64_t frames);
+    void WriteAudio(size_t branch, const CapturePacket& packet, const uint8_t* data, size_t size);
+    void QueueSilence(size_t branch, const CapturePacket& packet, uint64_t frames);
+    void FlushSilence(size_t branch);
+    void WritePacket(size_t branch, const CapturePacket& packet, uint32_t flags, const uint8_t* data, size_t size,
+                     uint64_t frames);
+    void WriteStreamHeader(size_t branch);
+    void WritePcm(size_t branch, const uint8_t* data, size_t size);
+    void WriteStream(size_t branch, const void* header, size_t headerSize, const void* data = nullptr,
+                     size_t size = 0);
+    bool Enqueue(Output& output, const void* header, size_t headerSize, const void* data, size_t size,
+                 size_t padding = 0);
+    bool CheckOutputs();
+    void CheckWarmup();
+    void StopOutputs();
+    std::string RenderMetrics() const;
+};
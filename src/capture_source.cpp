@@ -0,0 +1,60 @@
+#include "capture_source.h"
+
+#include <cmath>
+#include <thread>
+
+bool PacedSource::Start(std::string* error) {
+    if (Format().sampleRate == 0 || Format().channels == 0 || packetFrames == 0) {
+        if (error) *error = std::string(Name()) + " source is not configured";
+        return false;
+    }
+    startTime = Clock::now();
+    position = 0;
+    deliveredSinceWait = 0;
+    packetsDelivered = 0;
+    finished = false;
+    return true;
+}
+
+PacedSource::Clock::time_point PacedSource::DueTime(uint64_t framePosition) const {
+    std::chrono::duration<double> offset(startOffsetSeconds + (double)framePosition / ActualRate());
+    return startTime + std::chrono::duration_cast<Clock::duration>(offset);
+}
+
+CaptureSource::WaitResult PacedSource::Wait(uint32_t timeoutMs) {
+    if (finished) return WaitResult::EndOfStream;
+    deliveredSinceWait = 0;
+    if (!realtime) return WaitResult::Ready;
+
+    // A packet is available once its last frame has been "captured"
+    Clock::time_point due = DueTime(position + packetFrames);
+    Clock::time_point limit = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    if (due > limit) {
+        std::this_thread::sleep_until(limit);
+        return WaitResult::Timeout;
+    }
+    std::this_thread::sleep_until(due);
+    return WaitResult::Ready;
+}
+
+bool PacedSource::NextPacket(CapturePacket& packet) {
+    if (finished || deliveredSinceWait >= kMaxPacketsPerWait) return false;
+    if (realtime && DueTime(position + packetFrames) > Clock::now()) return false;
+
+    packet = CapturePacket();
+    if (!Produce(packet)) {
+        finished = true;
+        return false;
+    }
+    // Produce() may have skipped ahead to model lost frames
+    packet.devicePosition = position;
+    if (clockSkewPpm == 0.0 && startOffsetSeconds == 0.0) {
+        packet.timestamp = position * 10000000 / Format().sampleRate;
+    } else {
+        packet.timestamp = (uint64_t)std::llround((startOffsetSeconds + position / ActualRate()) * 1e7);
+    }
+    position += packet.frames;
+    deliveredSinceWait++;
+    packetsDelivered++;
+    return true;
+}
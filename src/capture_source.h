@@ -0,0 +1,104 @@
+#pragma once
+
+// Where captured audio comes from.
+//
+// A capture source hands out packets the way IAudioCaptureClient does:
+// Wait() blocks until data is due, NextPacket() borrows the next packet and
+// ReleasePacket() gives it back. WASAPI loopback is one implementation; the
+// file replayer and the synthetic generator below run anywhere, so the whole
+// conversion and output pipeline can be exercised without an audio device.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "audio_format.h"
+
+struct CapturePacket {
+    const uint8_t* data = nullptr;  // interleaved frames in the source format
+    uint32_t frames = 0;
+    uint32_t flags = 0;             // records::kFlag* bits (same values as AUDCLNT_BUFFERFLAGS_*)
+    uint64_t devicePosition = 0;    // source frame position of the first frame
+    uint64_t timestamp = 0;         // capture time in 100 ns units
+};
+
+class CaptureSource {
+public:
+    enum class WaitResult {
+        Ready,        // packets may be pending
+        Timeout,      // nothing arrived in time; wait again
+        EndOfStream,  // the source is exhausted
+        Failed
+    };
+
+    virtual ~CaptureSource() {}
+
+    virtual const char* Name() const = 0;
+    virtual const AudioFormat& Format() const = 0;
+
+    // Largest burst the source can deliver between two waits; sizes the
+    // output buffer
+    virtual uint32_t BufferFrames() const = 0;
+
+    // False for sources that run ahead of the wall clock; the pipeline then
+    // throttles them to the output instead of dropping audio
+    virtual bool IsRealtime() const { return true; }
+
+    virtual bool Start(std::string* error) = 0;
+    virtual void Stop() = 0;
+
+    virtual WaitResult Wait(uint32_t timeoutMs) = 0;
+
+    // Borrow the next pending packet; false when none is pending. The data
+    // stays valid until ReleasePacket().
+    virtual bool NextPacket(CapturePacket& packet) = 0;
+    virtual void ReleasePacket() = 0;
+};
+
+// Base for sources that produce packets on their own clock: either paced
+// against the wall clock like a device, or as fast as the consumer drains
+// them. Timestamps follow the frame position, so replays are deterministic.
+// A clock skew makes the source run that many ppm off its nominal rate in
+// host time, both in its pacing and in its timestamps. A start offset makes
+// the first frame due that long after Start(), with timestamps to match, as
+// if the device had been opened later than its neighbours.
+class PacedSource : public CaptureSource {
+public:
+    uint32_t BufferFrames() const override { return packetFrames * kMaxPacketsPerWait; }
+    bool IsRealtime() const override { return realtime; }
+
+    bool Start(std::string* error) override;
+    void Stop() override {}
+    WaitResult Wait(uint32_t timeoutMs) override;
+    bool NextPacket(CapturePacket& packet) override;
+    void ReleasePacket() override {}
+
+    uint64_t PacketsDelivered() const { return packetsDelivered; }
+
+protected:
+    // Real-time sources catch up with at most this many packets per wait
+    static constexpr uint32_t kMaxPacketsPerWait = 16;
+
+    uint32_t packetFrames = 480;
+    bool realtime = true;
+    uint64_t position = 0;  // next frame position; subclasses may skip ahead
+    double clockSkewPpm = 0.0;
+    double startOffsetSeconds = 0.0;
+
+    // Fill `packet` with up to packetFrames frames (data, frames, flags);
+    // false once the source is exhausted
+    virtual bool Produce(CapturePacket& packet) = 0;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point startTime;
+    uint32_t deliveredSinceWait = 0;
+    uint64_t packetsDelivered = 0;
+    bool finished = false;
+
+    Clock::time_point DueTime(uint64_t framePosition) const;
+    // Frames per second of host time
+    double ActualRate() const { return Format().sampleRate * (1.0 + clockSkewPpm * 1e-6); }
+};
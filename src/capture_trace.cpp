@@ -0,0 +1,112 @@
+#include "capture_trace.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+bool CaptureTraceWriter::Open(const std::string& newPath, const AudioFormat& newFormat, uint32_t bufferFrames,
+                              int bufferMs, std::string* error) {
+    Close();
+    path = newPath;
+    format = newFormat;
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        if (error) *error = "Cannot create trace '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    trace::TraceHeader header = {};
+    header.magic = trace::kFileMagic;
+    header.version = trace::kVersion;
+    header.headerSize = sizeof(header);
+    header.sampleRate = format.sampleRate;
+    header.channels = (uint16_t)format.channels;
+    header.bitsPerSample = (uint16_t)format.BitsPerSample();
+    header.blockAlign = (uint16_t)format.BlockAlign();
+    header.sampleFormat = format.type == SampleType::Float32 ? records::kSampleFormatFloat
+                                                             : records::kSampleFormatPcm;
+    header.channelMask = format.channelMask;
+    header.bufferFrames = bufferFrames;
+    header.packetHeaderSize = sizeof(trace::TracePacket);
+    header.timestampFrequency = records::kTimestampFrequency;
+    header.startTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    if (fwrite(&header, 1, sizeof(header), file) != sizeof(header)) {
+        if (error) *error = "Cannot write trace '" + path + "': " + strerror(errno);
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    size_t capacity = (size_t)format.BytesPerSecond() * bufferMs / 1000;
+    size_t minimum = ((size_t)bufferFrames * format.BlockAlign() + sizeof(trace::TracePacket) + 8) * 4;
+    if (capacity < minimum) capacity = minimum;
+
+    firstArrivalNs = 0;
+    packets = 0;
+    droppedPackets = 0;
+    bytes = sizeof(header);
+    pendingFlags = 0;
+    overrunReported = false;
+    writeFailed = false;
+    FILE* out = file;
+    std::atomic<bool>* failed = &writeFailed;
+    queue = std::make_unique<AsyncOutput>();
+    if (!queue->Start(capacity, [out, failed](const uint8_t* first, size_t firstSize, const uint8_t* second,
+                                              size_t secondSize) {
+            bool ok = fwrite(first, 1, firstSize, out) == firstSize &&
+                      (secondSize == 0 || fwrite(second, 1, secondSize, out) == secondSize);
+            if (!ok) failed->store(true);
+            return ok;
+        })) {
+        if (error) *error = "Failed to start trace writer thread";
+        queue.reset();
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void CaptureTraceWriter::Record(const CapturePacket& packet, uint64_t arrivalNs) {
+    if (!queue) return;
+    if (packets + droppedPackets == 0) firstArrivalNs = arrivalNs;
+
+    trace::TracePacket header = {};
+    header.magic = trace::kPacketMagic;
+    header.flags = packet.flags | pendingFlags;
+    header.devicePosition = packet.devicePosition;
+    header.timestamp = packet.timestamp;
+    header.arrivalNs = arrivalNs - firstArrivalNs;
+    header.frames = packet.frames;
+    const bool silent = (packet.flags & records::kFlagSilent) || !packet.data;
+    header.payloadBytes = silent ? 0 : packet.frames * format.BlockAlign();
+
+    const size_t padding = records::PaddingFor(header.payloadBytes);
+    if (queue->Write(&header, sizeof(header), packet.data, header.payloadBytes, padding)) {
+        pendingFlags = 0;
+        packets++;
+        bytes += sizeof(header) + header.payloadBytes + padding;
+        return;
+    }
+    pendingFlags = trace::kFlagTraceDropped;
+    droppedPackets++;
+    if (!overrunReported && !queue->Failed()) {
+        std::cerr << "Warning: Trace " << path << " too slow, dropping packets" << std::endl;
+        overrunReported = true;
+    }
+}
+
+bool CaptureTraceWriter::Close() {
+    if (!file) return true;
+    if (queue) {
+        queue->Stop();
+        queue.reset();
+    }
+    bool ok = fclose(file) == 0 && !writeFailed.load();
+    file = nullptr;
+    if (!ok) std::cerr << "Warning: Failed to write trace " << path << std::endl;
+    return ok && droppedPackets == 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Capture traces (--record-trace).
+//
+// A trace keeps the packet sequence exactly as the source handed it over,
+// before any conversion: every packet's raw bytes, frame count, flags,
+// device position and QPC timestamp, plus when the capture thread received
+// it. TraceReplaySource (trace_replay_source.h) feeds a trace back through
+// the pipeline on any platform, so a glitch seen in the field can be
+// reproduced bit for bit and real traffic can be used as a benchmark.
+//
+// File layout: one TraceHeader, then per packet a TracePacket followed by
+// its payload, zero padded to a multiple of 8 bytes. Packets flagged silent
+// carry no payload (their buffer contents are undefined). All fields are
+// little-endian and naturally aligned.
+//
+// The recorder copies each packet into its own queue and writes the file on
+// a separate thread, like the outputs, so a slow disk drops trace packets
+// (flagged in the next record) rather than stalling the capture.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "async_output.h"
+#include "audio_format.h"
+#include "capture_source.h"
+#include "stream_records.h"
+
+namespace trace {
+
+constexpr uint32_t kFileMagic = records::MakeTag('W', 'A', 'C', 'T');
+constexpr uint32_t kPacketMagic = records::MakeTag('T', 'P', 'K', 'T');
+constexpr uint16_t kVersion = 1;
+
+// Set on the first packet recorded after the trace queue overflowed; the
+// device positions show how much is missing
+constexpr uint32_t kFlagTraceDropped = 0x1000;
+
+struct TraceHeader {
+    uint32_t magic;               // kFileMagic
+    uint16_t version;             // kVersion
+    uint16_t headerSize;          // sizeof(TraceHeader)
+    uint32_t sampleRate;          // source format
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    uint16_t blockAlign;
+    uint16_t sampleFormat;        // records::kSampleFormatPcm / kSampleFormatFloat
+    uint32_t channelMask;         // SPEAKER_* bits, 0 if unknown
+    uint32_t bufferFrames;        // largest burst the source delivers at once
+    uint32_t packetHeaderSize;    // sizeof(TracePacket)
+    uint64_t timestampFrequency;  // unit of TracePacket::timestamp (records::kTimestampFrequency)
+    uint64_t startTime;           // Unix time the recording started, in ns
+};
+
+struct TracePacket {
+    uint32_t magic;           // kPacketMagic
+    uint32_t flags;           // records::kFlag* device bits, kFlagTraceDropped
+    uint64_t devicePosition;  // source frame position of the first frame
+    uint64_t timestamp;       // QPC time of the packet, timestampFrequency units
+    uint64_t arrivalNs;       // when the capture thread received it, ns after the first packet
+    uint32_t frames;
+    uint32_t payloadBytes;    // frames * blockAlign, or 0 for a silent packet
+};
+
+static_assert(sizeof(TraceHeader) == 48, "TraceHeader layout is part of the file format");
+static_assert(sizeof(TracePacket) == 40, "TracePacket layout is part of the file format");
+
+}  // namespace trace
+
+class CaptureTraceWriter {
+public:
+    CaptureTraceWriter() {}
+    ~CaptureTraceWriter() { Close(); }
+
+    CaptureTraceWriter(const CaptureTraceWriter&) = delete;
+    CaptureTraceWriter& operator=(const CaptureTraceWriter&) = delete;
+
+    // Create `path` and start the writer thread; the queue holds
+    // `bufferMs` of source audio but never less than a few source buffers
+    bool Open(const std::string& path, const AudioFormat& format, uint32_t bufferFrames, int bufferMs,
+              std::string* error);
+
+    // Capture thread: append one packet received at `arrivalNs`
+    // (LatencyClockNs()). Never blocks.
+    void Record(const CapturePacket& packet, uint64_t arrivalNs);
+
+    // Drain the queue and close the file; false if anything was lost
+    bool Close();
+
+    const std::string& Path() const { return path; }
+    uint64_t Packets() const { return packets; }
+    uint64_t DroppedPackets() const { return droppedPackets; }
+    uint64_t Bytes() const { return bytes; }  // file size once closed
+
+private:
+    std::string path;
+    FILE* file = nullptr;
+    std::unique_ptr<AsyncOutput> queue;
+    AudioFormat format;
+    uint64_t firstArrivalNs = 0;
+    uint64_t packets = 0;
+    uint64_t droppedPackets = 0;
+    uint64_t bytes = 0;
+    uint32_t pendingFlags = 0;
+    bool overrunReported = false;
+    std::atomic<bool> writeFailed{false};
+};
@@ -0,0 +1,295 @@
+#include "channel_mixer.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "simd_arch.h"
+
+namespace {
+
+const float kMinus3dB = 0.70710678f;
+
+void MixScalar(const float* in, float* out, size_t frames,
+               const float* matrix, uint32_t inChannels, uint32_t outChannels) {
+    uint32_t stride = inChannels > ChannelMixer::kMatrixStride ? inChannels : ChannelMixer::kMatrixStride;
+    for (size_t f = 0; f < frames; f++) {
+        const float* frame = in + f * inChannels;
+        float* dst = out + f * outChannels;
+        for (uint32_t o = 0; o < outChannels; o++) {
+            const float* row = matrix + o * stride;
+            float acc = 0.0f;
+            for (uint32_t c = 0; c < inChannels; c++) {
+                acc += row[c] * frame[c];
+            }
+            dst[o] = acc;
+        }
+    }
+}
+
+// Speaker positions in channel order (lowest mask bit first). Channels beyond
+// the mask get position 0 ("unknown").
+std::vector<uint32_t> Positions(uint32_t mask, uint32_t channels) {
+    std::vector<uint32_t> positions;
+    for (uint32_t bit = 0; bit < 32 && positions.size() < channels; bit++) {
+        if (mask & (1u << bit)) positions.push_back(1u << bit);
+    }
+    while (positions.size() < channels) positions.push_back(0);
+    return positions;
+}
+
+int IndexOf(const std::vector<uint32_t>& positions, uint32_t position) {
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (positions[i] == position) return (int)i;
+    }
+    return -1;
+}
+
+// Fold every input position onto the output positions, mapping matches
+// directly and sending missing speakers to their nearest neighbors.
+void FoldPositions(const std::vector<uint32_t>& in, const std::vector<uint32_t>& out,
+                   std::vector<float>& matrix) {
+    size_t inChannels = in.size();
+    matrix.assign(out.size() * inChannels, 0.0f);
+
+    auto add = [&](uint32_t target, size_t column, float gain) {
+        int row = IndexOf(out, target);
+        if (row < 0) return false;
+        matrix[row * inChannels + column] += gain;
+        return true;
+    };
+    auto addPair = [&](uint32_t left, uint32_t right, size_t column, float gain) {
+        if (IndexOf(out, left) < 0 || IndexOf(out, right) < 0) return false;
+        add(left, column, gain);
+        add(right, column, gain);
+        return true;
+    };
+
+    for (size_t i = 0; i < inChannels; i++) {
+        uint32_t p = in[i];
+        if (p == 0) {
+            // Unknown position: keep it in the same slot if there is one
+            if (i < out.size()) matrix[i * inChannels + i] = 1.0f;
+            continue;
+        }
+        if (add(p, i, 1.0f)) continue;
+
+        switch (p) {
+            case speaker::FrontCenter:
+                addPair(speaker::FrontLeft, speaker::FrontRight, i, kMinus3dB);
+                break;
+            case speaker::LowFrequency:
+                // LFE is dropped when the output has no LFE channel
+                break;
+            case speaker::BackLeft:
+                if (!add(speaker::SideLeft, i, 1.0f)) add(speaker::FrontLeft, i, kMinus3dB);
+                break;
+            case speaker::BackRight:
+                if (!add(speaker::SideRight, i, 1.0f)) add(speaker::FrontRight, i, kMinus3dB);
+                break;
+            case speaker::SideLeft:
+                if (!add(speaker::BackLeft, i, 1.0f)) add(speaker::FrontLeft, i, kMinus3dB);
+                break;
+            case speaker::SideRight:
+                if (!add(speaker::BackRight, i, 1.0f)) add(speaker::FrontRight, i, kMinus3dB);
+                break;
+            case speaker::BackCenter:
+                if (!addPair(speaker::BackLeft, speaker::BackRight, i, kMinus3dB) &&
+                    !addPair(speaker::SideLeft, speaker::SideRight, i, kMinus3dB)) {
+                    addPair(speaker::FrontLeft, speaker::FrontRight, i, 0.5f);
+                }
+                break;
+            case speaker::FrontLeftOfCenter:
+                add(speaker::FrontLeft, i, 1.0f);
+                break;
+            case speaker::FrontRightOfCenter:
+                add(speaker::FrontRight, i, 1.0f);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+}  // namespace
+
+const MixKernels& GetScalarMixKernels() {
+    static const MixKernels kernels = { "scalar", MixScalar };
+    return kernels;
+}
+
+std::vector<const MixKernels*> GetAvailableMixKernels() {
+    std::vector<const MixKernels*> result;
+    if (CpuSupportsAvx2() && GetAvx2MixKernels()) result.push_back(GetAvx2MixKernels());
+    if (CpuSupportsSse2() && GetSse2MixKernels()) result.push_back(GetSse2MixKernels());
+    if (CpuSupportsNeon() && GetNeonMixKernels()) result.push_back(GetNeonMixKernels());
+    result.push_back(&GetScalarMixKernels());
+    return result;
+}
+
+const MixKernels& GetMixKernels() {
+    static const MixKernels* selected = GetAvailableMixKernels().front();
+    return *selected;
+}
+
+uint32_t ChannelMixer::DefaultChannelMask(uint32_t channels) {
+    switch (channels) {
+        case 1: return speaker::Mono;
+        case 2: return speaker::Stereo;
+        case 3: return speaker::Stereo | speaker::FrontCenter;
+        case 4: return speaker::Quad;
+        case 5: return speaker::Quad | speaker::FrontCenter;
+        case 6: return speaker::Surround51;
+        case 7: return speaker::Surround51 | speaker::BackCenter;
+        case 8: return speaker::Surround71;
+    }
+    return 0;
+}
+
+bool ChannelMixer::BuildMatrix(uint32_t inputMask, uint32_t inChannels,
+                               uint32_t outputMask, uint32_t outChannels,
+                               std::vector<float>& matrix, bool normalize) {
+    if (inChannels == 0 || outChannels == 0 || inChannels > kMaxChannels || outChannels > kMaxChannels) {
+        return false;
+    }
+    if (inputMask == 0) inputMask = DefaultChannelMask(inChannels);
+    if (outputMask == 0) outputMask = DefaultChannelMask(outChannels);
+
+    std::vector<uint32_t> in = Positions(inputMask, inChannels);
+    std::vector<uint32_t> out = Positions(outputMask, outChannels);
+
+    if (inChannels == 1) {
+        // Mono source feeds every front speaker (or the first channel)
+        matrix.assign(outChannels, 0.0f);
+        bool any = false;
+        for (uint32_t o = 0; o < outChannels; o++) {
+            if (out[o] == speaker::FrontLeft || out[o] == speaker::FrontRight || out[o] == speaker::FrontCenter) {
+                matrix[o] = 1.0f;
+                any = true;
+            }
+        }
+        if (!any) matrix[0] = 1.0f;
+        return true;
+    }
+
+    if (outChannels == 1) {
+        // Mono output is the average of the stereo downmix
+        std::vector<float> stereo;
+        FoldPositions(in, Positions(speaker::Stereo, 2), stereo);
+        matrix.assign(inChannels, 0.0f);
+        for (uint32_t c = 0; c < inChannels; c++) {
+            matrix[c] = 0.5f * (stereo[c] + stereo[inChannels + c]);
+        }
+    } else {
+        FoldPositions(in, out, matrix);
+    }
+
+    if (!normalize) return true;
+
+    // Scale so that no output can exceed full scale
+    float maxGain = 0.0f;
+    for (uint32_t o = 0; o < outChannels; o++) {
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < inChannels; c++) sum += std::fabs(matrix[o * inChannels + c]);
+        if (sum > maxGain) maxGain = sum;
+    }
+    if (maxGain > 1.0f) {
+        for (float& m : matrix) m /= maxGain;
+    }
+    return true;
+}
+
+bool ChannelMixer::ParseMatrix(const std::string& text, uint32_t inChannels, uint32_t outChannels,
+                               std::vector<float>& matrix, std::string* error) {
+    matrix.clear();
+    std::stringstream rows(text);
+    std::string row;
+    uint32_t rowCount = 0;
+
+    while (std::getline(rows, row, ';')) {
+        std::stringstream values(row);
+        std::string value;
+        uint32_t columnCount = 0;
+        while (std::getline(values, value, ',')) {
+            char* end = nullptr;
+            float v = std::strtof(value.c_str(), &end);
+            if (value.empty() || end == value.c_str() || *end != '\0' || !std::isfinite(v)) {
+                if (error) *error = "invalid coefficient '" + value + "' in row " + std::to_string(rowCount + 1);
+                return false;
+            }
+            matrix.push_back(v);
+            columnCount++;
+        }
+        if (columnCount != inChannels) {
+            if (error) {
+                *error = "row " + std::to_string(rowCount + 1) + " has " + std::to_string(columnCount) +
+                         " coefficients, expected " + std::to_string(inChannels) + " (one per input channel)";
+            }
+            return false;
+        }
+        rowCount++;
+    }
+
+    if (rowCount != outChannels) {
+        if (error) {
+            *error = "matrix has " + std::to_string(rowCount) + " rows, expected " +
+                     std::to_string(outChannels) + " (one per output channel)";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ChannelMixer::Initialize(uint32_t inChannels, uint32_t outChannels, const std::vector<float>& matrix,
+                              const MixKernels* kernelSet) {
+    if (inChannels == 0 || outChannels == 0 || inChannels > kMaxChannels || outChannels > kMaxChannels ||
+        matrix.size() != (size_t)inChannels * outChannels) {
+        return false;
+    }
+
+    inputChannels = inChannels;
+    outputChannels = outChannels;
+    stride = inChannels > kMatrixStride ? inChannels : kMatrixStride;
+    kernels = (inChannels > kMatrixStride) ? &GetScalarMixKernels()
+                                           : (kernelSet ? kernelSet : &GetMixKernels());
+
+    padded.assign((size_t)outChannels * stride, 0.0f);
+    clampedOutputs.clear();
+    for (uint32_t o = 0; o < outChannels; o++) {
+        memcpy(&padded[o * stride], &matrix[o * inChannels], inChannels * sizeof(float));
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < inChannels; c++) sum += std::fabs(matrix[o * inChannels + c]);
+        if (sum > 1.0f) clampedOutputs.push_back(o);
+    }
+    return true;
+}
+
+void ChannelMixer::Process(const float* in, float* out, size_t frames) const {
+    kernels->Mix(in, out, frames, padded.data(), inputChannels, outputChannels);
+    // Full-scale inputs on several channels at once would clip; hold those
+    // rows at full scale instead of turning every downmix down
+    for (uint32_t o : clampedOutputs) {
+        float* sample = out + o;
+        for (size_t f = 0; f < frames; f++, sample += outputChannels) {
+            *sample = *sample > 1.0f ? 1.0f : (*sample < -1.0f ? -1.0f : *sample);
+        }
+    }
+}
+
+std::string ChannelMixer::Describe() const {
+    std::ostringstream text;
+    for (uint32_t o = 0; o < outputChannels; o++) {
+        text << "  out" << o << " =";
+        bool first = true;
+        for (uint32_t c = 0; c < inputChannels; c++) {
+            float m = padded[o * stride + c];
+            if (m == 0.0f) continue;
+            text << (first ? " " : " + ") << m << "*in" << c;
+            first = false;
+        }
+        if (first) text << " 0";
+        text << "\n";
+    }
+    return text.str();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Channel mixing matrix stage for interleaved float frames.
+//
+// Builds standard downmix matrices (7.1 / 5.1 / quad -> stereo -> mono) from a
+// WAVEFORMATEXTENSIBLE style channel mask, or accepts a user-supplied matrix.
+// The matrix is applied in one pass by a SIMD kernel selected at startup.
+// Outputs whose row can sum past full scale are clamped to it afterwards.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Speaker position bits, identical to the SPEAKER_* values in mmreg.h
+namespace speaker {
+constexpr uint32_t FrontLeft = 0x1;
+constexpr uint32_t FrontRight = 0x2;
+constexpr uint32_t FrontCenter = 0x4;
+constexpr uint32_t LowFrequency = 0x8;
+constexpr uint32_t BackLeft = 0x10;
+constexpr uint32_t BackRight = 0x20;
+constexpr uint32_t FrontLeftOfCenter = 0x40;
+constexpr uint32_t FrontRightOfCenter = 0x80;
+constexpr uint32_t BackCenter = 0x100;
+constexpr uint32_t SideLeft = 0x200;
+constexpr uint32_t SideRight = 0x400;
+
+constexpr uint32_t Mono = FrontCenter;
+constexpr uint32_t Stereo = FrontLeft | FrontRight;
+constexpr uint32_t Quad = FrontLeft | FrontRight | BackLeft | BackRight;
+constexpr uint32_t Surround51 = FrontLeft | FrontRight | FrontCenter | LowFrequency | BackLeft | BackRight;
+constexpr uint32_t Surround71 = Surround51 | SideLeft | SideRight;
+}
+
+// Mixing kernel table; `matrix` is row-major [outChannels][kMatrixStride]
+struct MixKernels {
+    const char* name;
+    void (*Mix)(const float* in, float* out, size_t frames,
+                const float* matrix, uint32_t inChannels, uint32_t outChannels);
+};
+
+const MixKernels& GetMixKernels();
+std::vector<const MixKernels*> GetAvailableMixKernels();
+const MixKernels& GetScalarMixKernels();
+const MixKernels* GetSse2MixKernels();
+const MixKernels* GetAvx2MixKernels();
+const MixKernels* GetNeonMixKernels();
+
+class ChannelMixer {
+public:
+    // SIMD kernels handle up to 8 input channels; wider inputs use scalar code
+    static constexpr uint32_t kMatrixStride = 8;
+    static constexpr uint32_t kMaxChannels = 32;
+
+    // Default speaker mask for a channel count when the device reports none
+    static uint32_t DefaultChannelMask(uint32_t channels);
+
+    // Build a standard downmix/upmix matrix (row-major, outChannels x inChannels)
+    // with the ITU-R BS.775 gains. With `normalize` the rows are scaled down
+    // together so no output can exceed full scale (--mix-normalize).
+    static bool BuildMatrix(uint32_t inputMask, uint32_t inChannels,
+                            uint32_t outputMask, uint32_t outChannels,
+                            std::vector<float>& matrix, bool normalize = false);
+
+    // Parse "a,b,c;d,e,f" (rows = output channels, columns = input channels)
+    static bool ParseMatrix(const std::string& text, uint32_t inChannels, uint32_t outChannels,
+                            std::vector<float>& matrix, std::string* error);
+
+    bool Initialize(uint32_t inChannels, uint32_t outChannels, const std::vector<float>& matrix,
+                    const MixKernels* kernels = nullptr);
+
+    // Mix `frames` interleaved frames; out must hold frames * OutputChannels() floats
+    void Process(const float* in, float* out, size_t frames) const;
+
+    uint32_t InputChannels() const { return inputChannels; }
+    uint32_t OutputChannels() const { return outputChannels; }
+    const char* KernelName() const { return kernels ? kernels->name : "none"; }
+    std::string Describe() const;
+
+private:
+    const MixKernels* kernels = nullptr;
+    uint32_t inputChannels = 0;
+    uint32_t outputChannels = 0;
+    std::vector<float> padded;  // [outputChannels][stride], zero padded
+    uint32_t stride = kMatrixStride;
+    std::vector<uint32_t> clampedOutputs;  // rows whose gains sum past 1
+};
@@ -0,0 +1,77 @@
+#include "channel_mixer.h"
+#include "simd_arch.h"
+
+// Built with AVX2 code generation enabled (see CMakeLists.txt); only called
+// after CpuSupportsAvx2() confirms the instructions are available.
+
+#if defined(AUDIO_ARCH_X86)
+#include <immintrin.h>
+
+namespace {
+
+// Horizontal sums of eight vectors, result lane k = sum of p[k]
+inline __m256 ReduceEight(const __m256* p) {
+    __m256 t0 = _mm256_hadd_ps(p[0], p[1]);
+    __m256 t1 = _mm256_hadd_ps(p[2], p[3]);
+    __m256 t2 = _mm256_hadd_ps(p[4], p[5]);
+    __m256 t3 = _mm256_hadd_ps(p[6], p[7]);
+    __m256 u0 = _mm256_hadd_ps(t0, t1);
+    __m256 u1 = _mm256_hadd_ps(t2, t3);
+    __m256 lo = _mm256_permute2f128_ps(u0, u1, 0x20);
+    __m256 hi = _mm256_permute2f128_ps(u0, u1, 0x31);
+    return _mm256_add_ps(lo, hi);
+}
+
+// Every output sample is the dot product of one (zero padded) input frame
+// with one matrix row. Eight consecutive output samples are computed per
+// iteration and reduced together, whatever the output channel count.
+void MixAvx2(const float* in, float* out, size_t frames,
+             const float* matrix, uint32_t inChannels, uint32_t outChannels) {
+    const uint32_t stride = ChannelMixer::kMatrixStride;
+    alignas(32) int32_t laneMask[8];
+    for (uint32_t c = 0; c < 8; c++) laneMask[c] = c < inChannels ? -1 : 0;
+    const __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(laneMask));
+
+    size_t total = frames * outChannels;
+    size_t j = 0;
+    size_t f = 0;
+    uint32_t o = 0;
+    __m256 frame = frames ? _mm256_maskload_ps(in, mask) : _mm256_setzero_ps();
+
+    for (; j + 8 <= total; j += 8) {
+        __m256 p[8];
+        for (int k = 0; k < 8; k++) {
+            p[k] = _mm256_mul_ps(frame, _mm256_loadu_ps(matrix + o * stride));
+            if (++o == outChannels) {
+                o = 0;
+                if (++f < frames) frame = _mm256_maskload_ps(in + f * inChannels, mask);
+            }
+        }
+        _mm256_storeu_ps(out + j, ReduceEight(p));
+    }
+
+    for (; j < total; j++) {
+        f = j / outChannels;
+        o = (uint32_t)(j % outChannels);
+        const float* src = in + f * inChannels;
+        const float* row = matrix + o * stride;
+        float acc = 0.0f;
+        for (uint32_t c = 0; c < inChannels; c++) acc += row[c] * src[c];
+        out[j] = acc;
+    }
+}
+
+}  // namespace
+
+const MixKernels* GetAvx2MixKernels() {
+    static const MixKernels kernels = { "avx2", MixAvx2 };
+    return &kernels;
+}
+
+#else
+
+const MixKernels* GetAvx2MixKernels() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include "channel_mixer.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_NEON)
+#include <arm_neon.h>
+#include <cstring>
+
+namespace {
+
+void MixNeon(const float* in, float* out, size_t frames,
+             const float* matrix, uint32_t inChannels, uint32_t outChannels) {
+    const uint32_t stride = ChannelMixer::kMatrixStride;
+    alignas(16) float buf[8] = {};
+
+    for (size_t f = 0; f < frames; f++) {
+        float32x4_t lo;
+        float32x4_t hi;
+        if (inChannels == 8) {
+            lo = vld1q_f32(in + f * 8);
+            hi = vld1q_f32(in + f * 8 + 4);
+        } else {
+            memcpy(buf, in + f * inChannels, inChannels * sizeof(float));
+            lo = vld1q_f32(buf);
+            hi = vld1q_f32(buf + 4);
+        }
+        float* dst = out + f * outChannels;
+        for (uint32_t o = 0; o < outChannels; o++) {
+            const float* row = matrix + o * stride;
+            float32x4_t acc = vmulq_f32(lo, vld1q_f32(row));
+            acc = vmlaq_f32(acc, hi, vld1q_f32(row + 4));
+            dst[o] = vaddvq_f32(acc);
+        }
+    }
+}
+
+}  // namespace
+
+const MixKernels* GetNeonMixKernels() {
+    static const MixKernels kernels = { "neon", MixNeon };
+    return &kernels;
+}
+
+#else
+
+const MixKernels* GetNeonMixKernels() {
+    return nullptr;
+}
+
+#endif
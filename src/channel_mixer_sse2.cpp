@@ -0,0 +1,76 @@
+#include "channel_mixer.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_X86)
+#include <emmintrin.h>
+#include <cstring>
+
+namespace {
+
+inline void LoadFrame(const float* src, uint32_t inChannels, __m128& lo, __m128& hi) {
+    if (inChannels == 8) {
+        lo = _mm_loadu_ps(src);
+        hi = _mm_loadu_ps(src + 4);
+    } else {
+        alignas(16) float buf[8] = {};
+        memcpy(buf, src, inChannels * sizeof(float));
+        lo = _mm_load_ps(buf);
+        hi = _mm_load_ps(buf + 4);
+    }
+}
+
+// Four consecutive output samples per iteration, each a dot product of one
+// zero padded input frame with one matrix row, reduced by a 4x4 transpose.
+void MixSse2(const float* in, float* out, size_t frames,
+             const float* matrix, uint32_t inChannels, uint32_t outChannels) {
+    const uint32_t stride = ChannelMixer::kMatrixStride;
+    const bool wide = inChannels > 4;
+
+    size_t total = frames * outChannels;
+    size_t j = 0;
+    size_t f = 0;
+    uint32_t o = 0;
+    __m128 lo = _mm_setzero_ps();
+    __m128 hi = _mm_setzero_ps();
+    if (frames) LoadFrame(in, inChannels, lo, hi);
+
+    for (; j + 4 <= total; j += 4) {
+        __m128 p[4];
+        for (int k = 0; k < 4; k++) {
+            const float* row = matrix + o * stride;
+            p[k] = _mm_mul_ps(lo, _mm_loadu_ps(row));
+            if (wide) p[k] = _mm_add_ps(p[k], _mm_mul_ps(hi, _mm_loadu_ps(row + 4)));
+            if (++o == outChannels) {
+                o = 0;
+                if (++f < frames) LoadFrame(in + f * inChannels, inChannels, lo, hi);
+            }
+        }
+        _MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+        _mm_storeu_ps(out + j, _mm_add_ps(_mm_add_ps(p[0], p[1]), _mm_add_ps(p[2], p[3])));
+    }
+
+    for (; j < total; j++) {
+        f = j / outChannels;
+        o = (uint32_t)(j % outChannels);
+        const float* src = in + f * inChannels;
+        const float* row = matrix + o * stride;
+        float acc = 0.0f;
+        for (uint32_t c = 0; c < inChannels; c++) acc += row[c] * src[c];
+        out[j] = acc;
+    }
+}
+
+}  // namespace
+
+const MixKernels* GetSse2MixKernels() {
+    static const MixKernels kernels = { "sse2", MixSse2 };
+    return &kernels;
+}
+
+#else
+
+const MixKernels* GetSse2MixKernels() {
+    return nullptr;
+}
+
+#endif
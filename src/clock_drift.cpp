@@ -0,0 +1,70 @@
+#include "clock_drift.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ClockDriftEstimator::Reset(uint32_t sampleRate, uint64_t timestampFrequency) {
+    ticksPerSecond = (double)timestampFrequency;
+    nominalPeriod = sampleRate > 0 ? ticksPerSecond / sampleRate : 0.0;
+    period = nominalPeriod;
+    runningSeconds = 0.0;
+    started = false;
+    resyncs = 0;
+}
+
+void ClockDriftEstimator::Restart(uint64_t devicePosition, uint64_t timestamp, uint32_t frames) {
+    // Times are kept relative to the latest restart so doubles stay exact
+    origin = timestamp;
+    predicted = frames * period;
+    nextPosition = devicePosition + frames;
+    started = true;
+}
+
+void ClockDriftEstimator::Update(uint64_t devicePosition, uint64_t timestamp, uint32_t frames, bool reliable) {
+    if (nominalPeriod <= 0.0 || frames == 0) return;
+    if (!started) {
+        Restart(devicePosition, timestamp, frames);
+        return;
+    }
+    if (devicePosition != nextPosition || timestamp < origin) {
+        resyncs++;
+        Restart(devicePosition, timestamp, frames);
+        return;
+    }
+
+    double now = (double)(timestamp - origin);
+    double error = now - predicted;
+    double seconds = frames * period / ticksPerSecond;
+    if (!reliable) {
+        // Coast on the current estimate
+        error = 0.0;
+    } else if (std::fabs(error) > kMaxErrorSeconds * ticksPerSecond) {
+        resyncs++;
+        Restart(devicePosition, timestamp, frames);
+        return;
+    }
+
+    // Second-order loop, coefficients for one update per packet
+    double bandwidth = std::max(kBandwidthHz, kStartBandwidthHz / (1.0 + runningSeconds));
+    double omega = std::min(2.0 * 3.14159265358979323846 * bandwidth * seconds, 0.5);
+    double filtered = predicted + std::sqrt(2.0) * omega * error;
+    period += omega * omega * error / frames;
+    const double limit = nominalPeriod * kMaxDriftPpm * 1e-6 * 2.0;
+    period = std::min(std::max(period, nominalPeriod - limit), nominalPeriod + limit);
+
+    predicted = filtered + frames * period;
+    nextPosition = devicePosition + frames;
+    runningSeconds += seconds;
+}
+
+double ClockDriftEstimator::DriftPpm() const {
+    if (period <= 0.0) return 0.0;
+    return (nominalPeriod / period - 1.0) * 1e6;
+}
+
+double ClockDriftEstimator::RateScale() const {
+    if (period <= 0.0) return 1.0;
+    // Device rate / nominal rate is nominalPeriod / period
+    double drift = std::min(std::max(nominalPeriod / period - 1.0, -kMaxDriftPpm * 1e-6), kMaxDriftPpm * 1e-6);
+    return 1.0 / (1.0 + drift);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Estimates how fast the device clock really runs against the host clock.
+//
+// Every packet pairs a device frame position with the QPC time it was
+// captured at. A second-order delay-locked loop (as in F. Adriaensen, "Using
+// a DLL to filter time") smooths the timestamp jitter and tracks the device's
+// frame period in host time. The loop starts wide so the first estimate
+// settles within seconds, then narrows to follow slow thermal drift without
+// passing on jitter.
+//
+// RateScale() is the factor the resampler's ratio is multiplied by so the
+// output keeps its nominal rate against the host clock: a device running
+// 50 ppm fast yields 0.99995, i.e. fewer output frames per device frame.
+// Jumps in the device position, flagged timestamps and implausible timing
+// errors restart the time reference but keep the rate estimate.
+
+#include <cstdint>
+
+class ClockDriftEstimator {
+public:
+    // Larger deviations are treated as a wrong nominal rate, not drift
+    static constexpr double kMaxDriftPpm = 1000.0;
+
+    // Start over for a device with nominal rate `sampleRate`; timestamps
+    // are in `timestampFrequency` ticks per second
+    void Reset(uint32_t sampleRate, uint64_t timestampFrequency);
+
+    // One captured packet; `reliable` is false when the device flagged
+    // its timestamp
+    void Update(uint64_t devicePosition, uint64_t timestamp, uint32_t frames, bool reliable);
+
+    // Device rate over its nominal rate, minus one, in parts per million
+    double DriftPpm() const;
+
+    // Nominal over estimated device rate, limited to kMaxDriftPpm
+    double RateScale() const;
+
+    // Times the time reference was restarted after a gap or glitch
+    uint64_t Resyncs() const { return resyncs; }
+
+private:
+    // Loop bandwidth: wide at the start, kBandwidthHz once settled
+    static constexpr double kStartBandwidthHz = 1.0;
+    static constexpr double kBandwidthHz = 0.05;
+    // A timing error beyond this is a stall or a clock jump, not jitter
+    static constexpr double kMaxErrorSeconds = 0.02;
+
+    double ticksPerSecond = 1.0;
+    double nominalPeriod = 0.0;  // ticks per frame at the nominal rate
+    double period = 0.0;         // estimated ticks per frame
+    uint64_t origin = 0;         // timestamp times are measured from
+    double predicted = 0.0;      // expected time of the next packet, after origin
+    uint64_t nextPosition = 0;
+    double runningSeconds = 0.0;
+    bool started = false;
+    uint64_t resyncs = 0;
+
+    void Restart(uint64_t devicePosition, uint64_t timestamp, uint32_t frames);
+};
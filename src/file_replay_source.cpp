@@ -0,0 +1,194 @@
+#include "file_replay_source.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+uint16_t Get16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t Get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint64_t Get64(const uint8_t* p) {
+    return (uint64_t)Get32(p) | ((uint64_t)Get32(p + 4) << 32);
+}
+
+bool ReadExact(FILE* file, void* data, size_t size) {
+    return fread(data, 1, size, file) == size;
+}
+
+uint64_t Tell(FILE* file) {
+#ifdef _WIN32
+    return (uint64_t)_ftelli64(file);
+#else
+    return (uint64_t)ftello(file);
+#endif
+}
+
+}  // namespace
+
+FileReplaySource::~FileReplaySource() {
+    Close();
+}
+
+void FileReplaySource::Close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool FileReplaySource::Seek(uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+bool FileReplaySource::Open(const Config& config, std::string* error) {
+    Close();
+    if (config.packetMs <= 0.0) {
+        if (error) *error = "packet length must be positive";
+        return false;
+    }
+
+    file = fopen(config.path.c_str(), "rb");
+    if (!file) {
+        if (error) *error = "cannot open '" + config.path + "': " + strerror(errno);
+        return false;
+    }
+
+    uint8_t magic[4] = {};
+    wav = ReadExact(file, magic, sizeof(magic)) &&
+          (memcmp(magic, "RIFF", 4) == 0 || memcmp(magic, "RF64", 4) == 0);
+    if (wav) {
+        std::string reason = "cannot read header";
+        if (!Seek(0) || !ParseWav(&reason)) {
+            if (error) *error = "'" + config.path + "': " + reason;
+            Close();
+            return false;
+        }
+    } else {
+        format = config.rawFormat;
+        if (format.sampleRate == 0 || format.channels == 0) {
+            if (error) *error = "'" + config.path + "' has no WAV header; its raw format must be given";
+            Close();
+            return false;
+        }
+        dataStart = 0;
+        dataBytes = UINT64_MAX;
+    }
+
+    packetFrames = (uint32_t)(format.sampleRate * config.packetMs / 1000.0);
+    if (packetFrames == 0) packetFrames = 1;
+    realtime = config.realtime;
+    loop = config.loop;
+    dataRead = 0;
+    buffer.assign((size_t)packetFrames * format.BlockAlign(), 0);
+    return Seek(dataStart);
+}
+
+bool FileReplaySource::ParseWav(std::string* error) {
+    uint8_t header[12];
+    if (!ReadExact(file, header, sizeof(header)) || memcmp(header + 8, "WAVE", 4) != 0) {
+        *error = "not a WAVE file";
+        return false;
+    }
+    bool rf64 = memcmp(header, "RF64", 4) == 0;
+    dataStart = 0;
+
+    uint64_t ds64DataBytes = 0;
+    bool haveFormat = false;
+    uint16_t tag = 0;
+    uint16_t blockAlign = 0;
+    uint16_t bits = 0;
+    for (;;) {
+        uint8_t chunk[8];
+        if (!ReadExact(file, chunk, sizeof(chunk))) {
+            *error = "no data chunk";
+            return false;
+        }
+        uint32_t size = Get32(chunk + 4);
+        uint64_t next = Tell(file) + size + (size & 1);
+
+        if (memcmp(chunk, "ds64", 4) == 0 && size >= 16) {
+            uint8_t body[16];
+            if (!ReadExact(file, body, sizeof(body))) break;
+            ds64DataBytes = Get64(body + 8);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t body[40] = {};
+            if (!ReadExact(file, body, size < sizeof(body) ? size : sizeof(body))) break;
+            tag = Get16(body);
+            format.channels = Get16(body + 2);
+            format.sampleRate = Get32(body + 4);
+            blockAlign = Get16(body + 12);
+            bits = Get16(body + 14);
+            format.channelMask = 0;
+            if (tag == 0xFFFE && size >= 40) {
+                format.channelMask = Get32(body + 20);
+                tag = Get16(body + 24);  // first bytes of the SubFormat GUID
+            }
+            haveFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                *error = "data chunk before fmt chunk";
+                return false;
+            }
+            dataStart = Tell(file);
+            if (size == 0xFFFFFFFFu) {
+                // RF64 keeps the real size in ds64; otherwise a streamed file
+                dataBytes = rf64 ? ds64DataBytes : UINT64_MAX;
+            } else {
+                dataBytes = size;
+            }
+            break;
+        }
+        if (!Seek(next)) break;
+    }
+    if (!haveFormat || dataStart == 0) {
+        *error = "truncated WAV header";
+        return false;
+    }
+
+    if (tag == 3 && bits == 32) {
+        format.type = SampleType::Float32;
+    } else if (tag == 1 && bits == 16) {
+        format.type = SampleType::Int16;
+    } else if (tag == 1 && bits == 24) {
+        format.type = SampleType::Int24;
+    } else if (tag == 1 && bits == 32) {
+        format.type = SampleType::Int32;
+    } else {
+        *error = "unsupported WAV encoding (format " + std::to_string(tag) + ", " + std::to_string(bits) + " bits)";
+        return false;
+    }
+    if (format.sampleRate == 0 || format.channels == 0 || blockAlign != format.BlockAlign()) {
+        *error = "unsupported WAV layout";
+        return false;
+    }
+    return true;
+}
+
+bool FileReplaySource::Produce(CapturePacket& packet) {
+    const uint32_t blockAlign = format.BlockAlign();
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint64_t remaining = dataBytes - dataRead;
+        size_t bytes = buffer.size() < remaining ? buffer.size() : (size_t)remaining;
+        size_t got = bytes > 0 ? fread(buffer.data(), 1, bytes, file) : 0;
+        got -= got % blockAlign;
+        if (got > 0) {
+            dataRead += got;
+            packet.data = buffer.data();
+            packet.frames = (uint32_t)(got / blockAlign);
+            return true;
+        }
+        if (!loop || dataRead == 0 || !Seek(dataStart)) return false;
+        dataRead = 0;
+    }
+    return false;
+}
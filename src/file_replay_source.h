@@ -0,0 +1,57 @@
+#pragma once
+
+// Capture source that replays a recording.
+//
+// Reads WAV (including WAVE_FORMAT_EXTENSIBLE and RF64, as written by
+// --output) or headerless PCM in a caller-supplied format, and hands it out
+// in device-sized packets, either paced in real time or as fast as the
+// pipeline accepts them.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "capture_source.h"
+
+class FileReplaySource : public PacedSource {
+public:
+    struct Config {
+        std::string path;
+        AudioFormat rawFormat;      // layout of headerless files; ignored for WAV
+        double packetMs = 10.0;     // packet length; frames follow the file's rate
+        bool realtime = true;
+        bool loop = false;          // restart at the end instead of finishing
+    };
+
+    FileReplaySource() {}
+    ~FileReplaySource();
+
+    FileReplaySource(const FileReplaySource&) = delete;
+    FileReplaySource& operator=(const FileReplaySource&) = delete;
+
+    bool Open(const Config& config, std::string* error);
+
+    const char* Name() const override { return "file"; }
+    const AudioFormat& Format() const override { return format; }
+
+    bool IsWav() const { return wav; }
+    uint64_t DataBytes() const { return dataBytes; }  // UINT64_MAX when read to end of file
+
+protected:
+    bool Produce(CapturePacket& packet) override;
+
+private:
+    FILE* file = nullptr;
+    AudioFormat format;
+    bool wav = false;
+    bool loop = false;
+    uint64_t dataStart = 0;
+    uint64_t dataBytes = 0;
+    uint64_t dataRead = 0;
+    std::vector<uint8_t> buffer;
+
+    bool ParseWav(std::string* error);
+    bool Seek(uint64_t offset);
+    void Close();
+};
@@ -0,0 +1,720 @@
+#include "flac_encoder.h"
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// MSB-first bit packer appending to a byte vector
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& output) : out(output) {}
+
+    void Put(uint32_t value, uint32_t bits) {
+        if (bits == 0) return;
+        uint64_t masked = bits == 32 ? value : (value & ((1u << bits) - 1));
+        accumulator = (accumulator << bits) | masked;
+        pending += bits;
+        while (pending >= 8) {
+            pending -= 8;
+            out.push_back((uint8_t)(accumulator >> pending));
+        }
+    }
+
+    void PutSigned(int32_t value, uint32_t bits) { Put((uint32_t)value, bits); }
+
+    // Unary quotient (zeros then a one) followed by the k low bits
+    void PutRice(uint32_t value, uint32_t k) {
+        uint32_t quotient = value >> k;
+        uint32_t low = k == 0 ? 0 : (value & ((1u << k) - 1));
+        if (quotient + 1 + k <= 32) {
+            Put((1u << k) | low, quotient + 1 + k);
+            return;
+        }
+        while (quotient >= 32) {
+            Put(0, 32);
+            quotient -= 32;
+        }
+        Put(1, quotient + 1);
+        Put(low, k);
+    }
+
+    void Align() {
+        if (pending) Put(0, 8 - pending);
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t accumulator = 0;
+    uint32_t pending = 0;
+};
+
+struct CrcTables {
+    uint8_t crc8[256];
+    uint16_t crc16[256];
+
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c8 = i;
+            uint32_t c16 = i << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                c8 = (c8 & 0x80) ? ((c8 << 1) ^ 0x07) : (c8 << 1);
+                c16 = (c16 & 0x8000) ? ((c16 << 1) ^ 0x8005) : (c16 << 1);
+            }
+            crc8[i] = (uint8_t)c8;
+            crc16[i] = (uint16_t)c16;
+        }
+    }
+};
+
+const CrcTables& Crc() {
+    static const CrcTables tables;
+    return tables;
+}
+
+uint8_t Crc8(const uint8_t* data, size_t size) {
+    const CrcTables& t = Crc();
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) crc = t.crc8[crc ^ data[i]];
+    return crc;
+}
+
+uint16_t Crc16(const uint8_t* data, size_t size) {
+    const CrcTables& t = Crc();
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++) crc = (uint16_t)((crc << 8) ^ t.crc16[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+inline uint32_t Fold(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// Frame header code for a block size; 6/7 mean "explicit 8/16-bit size follows"
+uint32_t BlockSizeCode(uint32_t n) {
+    switch (n) {
+        case 192: return 1;
+        case 576: return 2;
+        case 1152: return 3;
+        case 2304: return 4;
+        case 4608: return 5;
+        case 256: return 8;
+        case 512: return 9;
+        case 1024: return 10;
+        case 2048: return 11;
+        case 4096: return 12;
+        case 8192: return 13;
+        case 16384: return 14;
+        case 32768: return 15;
+    }
+    return n <= 256 ? 6 : 7;
+}
+
+// 0 = "take it from STREAMINFO"
+uint32_t SampleRateCode(uint32_t rate) {
+    switch (rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+    }
+    return 0;
+}
+
+uint32_t SampleSizeCode(uint32_t bits) {
+    switch (bits) {
+        case 8: return 1;
+        case 12: return 2;
+        case 16: return 4;
+        case 20: return 5;
+        case 24: return 6;
+    }
+    return 0;
+}
+
+// Coefficient precision used by the reference encoder for each block size
+uint32_t LpcPrecision(uint32_t n) {
+    if (n <= 192) return 7;
+    if (n <= 384) return 8;
+    if (n <= 576) return 9;
+    if (n <= 1152) return 10;
+    if (n <= 2304) return 11;
+    if (n <= 4608) return 12;
+    return 13;
+}
+
+void PutFrameNumber(BitWriter& bits, uint32_t v) {
+    // UTF-8 style variable length coding
+    if (v < 0x80) {
+        bits.Put(v, 8);
+        return;
+    }
+    int continuation = v < 0x800 ? 1 : v < 0x10000 ? 2 : v < 0x200000 ? 3 : v < 0x4000000 ? 4 : 5;
+    static const uint32_t kLead[6] = {0, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC};
+    bits.Put(kLead[continuation] | (v >> (6 * continuation)), 8);
+    for (int i = continuation - 1; i >= 0; i--) {
+        bits.Put(0x80 | ((v >> (6 * i)) & 0x3F), 8);
+    }
+}
+
+// Tukey(0.5) window, as used by the reference encoder
+void BuildWindow(std::vector<double>& window, uint32_t n) {
+    window.assign(n, 1.0);
+    int taper = (int)(0.25 * n) - 1;
+    if (taper <= 0) return;
+    for (int i = 0; i <= taper; i++) {
+        double w = 0.5 - 0.5 * std::cos(kPi * i / taper);
+        window[i] = w;
+        window[n - 1 - i] = w;
+    }
+}
+
+void WriteSubframe(BitWriter& bits, const FlacEncoder::Subframe& sub, const int32_t* samples, uint32_t n) {
+    using Type = FlacEncoder::Subframe::Type;
+    bits.Put(0, 1);  // zero padding bit
+
+    switch (sub.type) {
+        case Type::Constant:
+            bits.Put(0x00, 6);
+            bits.Put(0, 1);  // no wasted bits
+            bits.PutSigned(samples[0], sub.bitsPerSample);
+            return;
+        case Type::Verbatim:
+            bits.Put(0x01, 6);
+            bits.Put(0, 1);
+            for (uint32_t i = 0; i < n; i++) bits.PutSigned(samples[i], sub.bitsPerSample);
+            return;
+        case Type::Fixed:
+            bits.Put(0x08 | sub.order, 6);
+            bits.Put(0, 1);
+            for (uint32_t i = 0; i < sub.order; i++) bits.PutSigned(samples[i], sub.bitsPerSample);
+            break;
+        case Type::Lpc:
+            bits.Put(0x20 | (sub.order - 1), 6);
+            bits.Put(0, 1);
+            for (uint32_t i = 0; i < sub.order; i++) bits.PutSigned(samples[i], sub.bitsPerSample);
+            bits.Put(sub.precision - 1, 4);
+            bits.PutSigned(sub.shift, 5);
+            for (uint32_t i = 0; i < sub.order; i++) bits.PutSigned(sub.coefficients[i], sub.precision);
+            break;
+    }
+
+    // Partitioned Rice residual
+    bits.Put(sub.rice2 ? 1 : 0, 2);
+    bits.Put(sub.partitionOrder, 4);
+    uint32_t partitions = 1u << sub.partitionOrder;
+    uint32_t partitionSize = n >> sub.partitionOrder;
+    uint32_t parameterBits = sub.rice2 ? 5 : 4;
+    const int32_t* residual = sub.residual.data();
+    uint32_t i = sub.order;
+    for (uint32_t p = 0; p < partitions; p++) {
+        uint32_t k = sub.riceParameters[p];
+        bits.Put(k, parameterBits);
+        uint32_t end = (p + 1) * partitionSize;
+        for (; i < end; i++) bits.PutRice(Fold(residual[i]), k);
+    }
+}
+
+}  // namespace
+
+bool FlacEncoder::Initialize(const Config& newConfig, std::string* error) {
+    // maxLpcOrder, maxPartitionOrder, stereoDecorrelation, exhaustiveLpcOrder
+    static const LevelSettings kLevels[9] = {
+        {0, 3, false, false},
+        {0, 3, true, false},
+        {0, 4, true, false},
+        {6, 4, false, false},
+        {8, 4, true, false},
+        {8, 5, true, false},
+        {8, 6, true, false},
+        {12, 6, true, false},
+        {12, 6, true, true},
+    };
+
+    initialized = false;
+    if (newConfig.channels == 0 || newConfig.channels > kMaxChannels) {
+        if (error) *error = "FLAC supports 1 to " + std::to_string(kMaxChannels) + " channels";
+        return false;
+    }
+    if (newConfig.bitsPerSample != 16 && newConfig.bitsPerSample != 24) {
+        if (error) *error = "FLAC output needs 16 or 24-bit integer samples";
+        return false;
+    }
+    if (newConfig.sampleRate == 0 || newConfig.sampleRate >= (1u << 20)) {
+        if (error) *error = "sample rate out of range for FLAC";
+        return false;
+    }
+    if (newConfig.blockSize < kMinBlockSize || newConfig.blockSize > kMaxBlockSize) {
+        if (error) *error = "block size must be between " + std::to_string(kMinBlockSize) + " and " +
+                            std::to_string(kMaxBlockSize);
+        return false;
+    }
+    if (newConfig.level < 0 || newConfig.level > 8) {
+        if (error) *error = "compression level must be between 0 and 8";
+        return false;
+    }
+
+    config = newConfig;
+    settings = kLevels[config.level];
+    bytesPerSample = config.bitsPerSample / 8;
+    frameBytes = config.channels * bytesPerSample;
+
+    uint32_t n = config.blockSize;
+    channelSamples.assign(config.channels, std::vector<int32_t>(n));
+    midSamples.assign(n, 0);
+    sideSamples.assign(n, 0);
+    BuildWindow(window, n);
+    windowed.assign(n, 0.0);
+    folded.assign(n, 0);
+    size_t maxPartitions = (size_t)1 << settings.maxPartitionOrder;
+    candidate.residual.assign(n, 0);
+    candidate.riceParameters.reserve(maxPartitions);
+    for (Subframe& sub : best) {
+        sub.residual.assign(n, 0);
+        sub.riceParameters.reserve(maxPartitions);
+    }
+
+    blockFill = 0;
+    partialBytes = 0;
+    frameNumber = 0;
+    samplesEncoded = 0;
+    bytesProduced = 0;
+    headerWritten = false;
+    initialized = true;
+    return true;
+}
+
+void FlacEncoder::WriteStreamHeader(std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    BitWriter bits(out);
+    bits.Put('f', 8);
+    bits.Put('L', 8);
+    bits.Put('a', 8);
+    bits.Put('C', 8);
+
+    // STREAMINFO, the only (and therefore last) metadata block
+    bits.Put(1, 1);
+    bits.Put(0, 7);
+    bits.Put(34, 24);
+    bits.Put(config.blockSize, 16);  // min block size
+    bits.Put(config.blockSize, 16);  // max block size
+    bits.Put(0, 24);                 // min frame size: unknown
+    bits.Put(0, 24);                 // max frame size: unknown
+    bits.Put(config.sampleRate, 20);
+    bits.Put(config.channels - 1, 3);
+    bits.Put(config.bitsPerSample - 1, 5);
+    bits.Put(0, 4);                  // total samples: unknown (36 bits)
+    bits.Put(0, 32);
+    for (int i = 0; i < 4; i++) bits.Put(0, 32);  // MD5: not computed
+
+    headerWritten = true;
+    bytesProduced += out.size() - start;
+}
+
+void FlacEncoder::Encode(const uint8_t* pcm, size_t bytes, std::vector<uint8_t>& out) {
+    if (!initialized) return;
+    if (!headerWritten) WriteStreamHeader(out);
+
+    auto readFrames = [this](const uint8_t* p, uint32_t frames) {
+        for (uint32_t f = 0; f < frames; f++) {
+            for (uint32_t c = 0; c < config.channels; c++) {
+                int32_t v;
+                if (bytesPerSample == 2) {
+                    v = (int16_t)(p[0] | (p[1] << 8));
+                } else {
+                    v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+                }
+                channelSamples[c][blockFill] = v;
+                p += bytesPerSample;
+            }
+            blockFill++;
+        }
+    };
+
+    while (bytes > 0) {
+        if (partialBytes > 0 || bytes < frameBytes) {
+            // Complete a frame split across calls
+            size_t take = frameBytes - partialBytes;
+            if (take > bytes) take = bytes;
+            memcpy(partial + partialBytes, pcm, take);
+            partialBytes += (uint32_t)take;
+            pcm += take;
+            bytes -= take;
+            if (partialBytes < frameBytes) break;
+            readFrames(partial, 1);
+            partialBytes = 0;
+        } else {
+            size_t frames = bytes / frameBytes;
+            size_t room = config.blockSize - blockFill;
+            if (frames > room) frames = room;
+            readFrames(pcm, (uint32_t)frames);
+            pcm += frames * frameBytes;
+            bytes -= frames * frameBytes;
+        }
+
+        if (blockFill == config.blockSize) {
+            EncodeFrame(config.blockSize, out);
+            blockFill = 0;
+        }
+    }
+}
+
+void FlacEncoder::Finish(std::vector<uint8_t>& out) {
+    if (!initialized) return;
+    if (!headerWritten) WriteStreamHeader(out);
+    if (blockFill > 0) {
+        EncodeFrame(blockFill, out);
+        blockFill = 0;
+    }
+    partialBytes = 0;
+}
+
+void FlacEncoder::EncodeFrame(uint32_t n, std::vector<uint8_t>& out) {
+    uint32_t bps = config.bitsPerSample;
+    uint32_t assignment = config.channels - 1;
+    const int32_t* sources[2] = {nullptr, nullptr};
+    const Subframe* chosen[2] = {nullptr, nullptr};
+
+    if (config.channels == 2 && settings.stereoDecorrelation) {
+        const int32_t* left = channelSamples[0].data();
+        const int32_t* right = channelSamples[1].data();
+        for (uint32_t i = 0; i < n; i++) {
+            midSamples[i] = (left[i] + right[i]) >> 1;
+            sideSamples[i] = left[i] - right[i];
+        }
+        AnalyzeChannel(left, n, bps, best[0]);
+        AnalyzeChannel(right, n, bps, best[1]);
+        AnalyzeChannel(sideSamples.data(), n, bps + 1, best[2]);
+        AnalyzeChannel(midSamples.data(), n, bps, best[3]);
+
+        uint64_t independent = best[0].bits + best[1].bits;
+        uint64_t leftSide = best[0].bits + best[2].bits;
+        uint64_t rightSide = best[2].bits + best[1].bits;
+        uint64_t midSide = best[3].bits + best[2].bits;
+
+        sources[0] = left;
+        sources[1] = right;
+        chosen[0] = &best[0];
+        chosen[1] = &best[1];
+        uint64_t smallest = independent;
+        if (leftSide < smallest) {
+            smallest = leftSide;
+            assignment = 8;
+            sources[1] = sideSamples.data();
+            chosen[1] = &best[2];
+        }
+        if (rightSide < smallest) {
+            smallest = rightSide;
+            assignment = 9;
+            sources[0] = sideSamples.data();
+            sources[1] = right;
+            chosen[0] = &best[2];
+            chosen[1] = &best[1];
+        }
+        if (midSide < smallest) {
+            assignment = 10;
+            sources[0] = midSamples.data();
+            sources[1] = sideSamples.data();
+            chosen[0] = &best[3];
+            chosen[1] = &best[2];
+        }
+    }
+
+    size_t start = out.size();
+    BitWriter bits(out);
+
+    // Frame header
+    uint32_t blockCode = BlockSizeCode(n);
+    bits.Put(0x3FFE, 14);  // sync code
+    bits.Put(0, 1);
+    bits.Put(0, 1);        // fixed block size stream
+    bits.Put(blockCode, 4);
+    bits.Put(SampleRateCode(config.sampleRate), 4);
+    bits.Put(assignment, 4);
+    bits.Put(SampleSizeCode(bps), 3);
+    bits.Put(0, 1);
+    PutFrameNumber(bits, (uint32_t)frameNumber);
+    if (blockCode == 6) bits.Put(n - 1, 8);
+    if (blockCode == 7) bits.Put(n - 1, 16);
+    bits.Put(Crc8(out.data() + start, out.size() - start), 8);
+
+    if (assignment >= 8) {
+        for (int c = 0; c < 2; c++) WriteSubframe(bits, *chosen[c], sources[c], n);
+    } else {
+        for (uint32_t c = 0; c < config.channels; c++) {
+            const int32_t* samples = channelSamples[c].data();
+            AnalyzeChannel(samples, n, bps, best[0]);
+            WriteSubframe(bits, best[0], samples, n);
+        }
+    }
+
+    bits.Align();
+    uint16_t crc = Crc16(out.data() + start, out.size() - start);
+    bits.Put(crc, 16);
+
+    frameNumber++;
+    samplesEncoded += n;
+    bytesProduced += out.size() - start;
+}
+
+void FlacEncoder::AnalyzeChannel(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result) {
+    result.bitsPerSample = bitsPerSample;
+
+    bool constant = true;
+    for (uint32_t i = 1; i < n && constant; i++) constant = samples[i] == samples[0];
+    if (constant) {
+        result.type = Subframe::Type::Constant;
+        result.order = 0;
+        result.bits = 8 + bitsPerSample;
+        return;
+    }
+
+    result.type = Subframe::Type::Verbatim;
+    result.order = 0;
+    result.bits = 8 + (uint64_t)n * bitsPerSample;
+
+    TryFixed(samples, n, bitsPerSample, result);
+    if (settings.maxLpcOrder > 0 && n > 2 * settings.maxLpcOrder) {
+        TryLpc(samples, n, bitsPerSample, result);
+    }
+}
+
+void FlacEncoder::TryFixed(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result) {
+    const uint32_t maxOrder = n > 4 ? 4 : n - 1;
+
+    // Pick the order with the smallest total absolute residual
+    uint64_t totals[5] = {};
+    for (uint32_t i = maxOrder; i < n; i++) {
+        int64_t e0 = samples[i];
+        int64_t e1 = e0 - samples[i - 1];
+        int64_t e2 = maxOrder >= 2 ? e1 - (samples[i - 1] - samples[i - 2]) : 0;
+        int64_t e3 = maxOrder >= 3 ? e2 - (samples[i - 1] - 2 * (int64_t)samples[i - 2] + samples[i - 3]) : 0;
+        int64_t e4 = maxOrder >= 4 ? e3 - (samples[i - 1] - 3 * (int64_t)samples[i - 2] +
+                                           3 * (int64_t)samples[i - 3] - samples[i - 4]) : 0;
+        totals[0] += (uint64_t)(e0 < 0 ? -e0 : e0);
+        totals[1] += (uint64_t)(e1 < 0 ? -e1 : e1);
+        totals[2] += (uint64_t)(e2 < 0 ? -e2 : e2);
+        totals[3] += (uint64_t)(e3 < 0 ? -e3 : e3);
+        totals[4] += (uint64_t)(e4 < 0 ? -e4 : e4);
+    }
+    uint32_t order = 0;
+    for (uint32_t o = 1; o <= maxOrder; o++) {
+        if (totals[o] < totals[order]) order = o;
+    }
+
+    int32_t* residual = candidate.residual.data();
+    for (uint32_t i = order; i < n; i++) {
+        const int32_t* x = samples + i;
+        switch (order) {
+            case 0: residual[i] = x[0]; break;
+            case 1: residual[i] = x[0] - x[-1]; break;
+            case 2: residual[i] = x[0] - 2 * x[-1] + x[-2]; break;
+            case 3: residual[i] = x[0] - 3 * x[-1] + 3 * x[-2] - x[-3]; break;
+            default: residual[i] = x[0] - 4 * x[-1] + 6 * x[-2] - 4 * x[-3] + x[-4]; break;
+        }
+    }
+
+    candidate.type = Subframe::Type::Fixed;
+    candidate.order = order;
+    candidate.bitsPerSample = bitsPerSample;
+    candidate.bits = 8 + (uint64_t)order * bitsPerSample + ChooseRiceParameters(residual, n, order, n, candidate);
+    if (candidate.bits < result.bits) std::swap(candidate, result);
+}
+
+void FlacEncoder::TryLpc(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result) {
+    uint32_t maxOrder = settings.maxLpcOrder;
+
+    if (window.size() != n) BuildWindow(window, n);
+    for (uint32_t i = 0; i < n; i++) windowed[i] = samples[i] * window[i];
+
+    double autoc[kMaxLpcOrder + 1];
+    for (uint32_t lag = 0; lag <= maxOrder; lag++) {
+        double sum = 0.0;
+        for (uint32_t i = lag; i < n; i++) sum += windowed[i] * windowed[i - lag];
+        autoc[lag] = sum;
+    }
+    if (window.size() != config.blockSize) BuildWindow(window, config.blockSize);
+    if (autoc[0] == 0.0) return;
+
+    // Levinson-Durbin recursion, keeping the predictor of every order
+    double lpc[kMaxLpcOrder][kMaxLpcOrder];
+    double errors[kMaxLpcOrder];
+    double a[kMaxLpcOrder];
+    double err = autoc[0];
+    uint32_t orders = maxOrder;
+    for (uint32_t i = 0; i < maxOrder; i++) {
+        double r = -autoc[i + 1];
+        for (uint32_t j = 0; j < i; j++) r -= a[j] * autoc[i - j];
+        r /= err;
+
+        a[i] = r;
+        uint32_t j = 0;
+        for (; j < (i >> 1); j++) {
+            double tmp = a[j];
+            a[j] += r * a[i - 1 - j];
+            a[i - 1 - j] += r * tmp;
+        }
+        if (i & 1) a[j] += a[j] * r;
+        err *= (1.0 - r * r);
+
+        for (j = 0; j <= i; j++) lpc[i][j] = -a[j];
+        errors[i] = err;
+        if (err <= 0.0) {
+            orders = i + 1;
+            break;
+        }
+    }
+
+    if (settings.exhaustiveLpcOrder) {
+        for (uint32_t order = 1; order <= orders; order++) {
+            EvaluateLpcOrder(samples, n, bitsPerSample, lpc[order - 1], order, result);
+        }
+        return;
+    }
+
+    // Estimate the cost of each order from its prediction error
+    uint32_t precision = LpcPrecision(n);
+    uint32_t bestOrder = 1;
+    double bestBits = 0.0;
+    for (uint32_t order = 1; order <= orders; order++) {
+        double scaled = 0.5 * errors[order - 1] / n;
+        double perSample = scaled > 1.0 ? 0.5 * std::log2(scaled) : 0.0;
+        double estimate = perSample * (n - order) + (double)order * (bitsPerSample + precision);
+        if (order == 1 || estimate < bestBits) {
+            bestBits = estimate;
+            bestOrder = order;
+        }
+    }
+    EvaluateLpcOrder(samples, n, bitsPerSample, lpc[bestOrder - 1], bestOrder, result);
+    // The estimate ignores coefficient quantization; the full order is a
+    // cheap second opinion that often wins on tonal material
+    if (bestOrder != orders) EvaluateLpcOrder(samples, n, bitsPerSample, lpc[orders - 1], orders, result);
+}
+
+bool FlacEncoder::EvaluateLpcOrder(const int32_t* samples, uint32_t n, uint32_t bitsPerSample,
+                                   const double* lpc, uint32_t order, Subframe& result) {
+    uint32_t precision = LpcPrecision(n);
+
+    // Quantize with error feedback, as the reference encoder does
+    double cmax = 0.0;
+    for (uint32_t i = 0; i < order; i++) cmax = std::fmax(cmax, std::fabs(lpc[i]));
+    if (cmax <= 0.0) return false;
+    int log2cmax;
+    std::frexp(cmax, &log2cmax);
+    log2cmax--;
+    int shift = (int)precision - 2 - log2cmax;
+    if (shift > 15) shift = 15;
+    if (shift < 0) return false;  // negative shifts are not allowed in the bitstream
+
+    const int32_t qmax = (1 << (precision - 1)) - 1;
+    const int32_t qmin = -qmax - 1;
+    double carry = 0.0;
+    for (uint32_t i = 0; i < order; i++) {
+        carry += lpc[i] * (double)(1 << shift);
+        long q = std::lround(carry);
+        if (q > qmax) q = qmax;
+        if (q < qmin) q = qmin;
+        carry -= (double)q;
+        candidate.coefficients[i] = (int32_t)q;
+    }
+
+    int32_t* residual = candidate.residual.data();
+    const int32_t* q = candidate.coefficients;
+    for (uint32_t i = order; i < n; i++) {
+        int64_t sum = 0;
+        for (uint32_t j = 0; j < order; j++) sum += (int64_t)q[j] * samples[i - 1 - j];
+        int64_t r = (int64_t)samples[i] - (sum >> shift);
+        // Keep the residual (and its Rice folding) inside 32 bits
+        if (r > 0x3FFFFFFF || r < -0x40000000) return false;
+        residual[i] = (int32_t)r;
+    }
+
+    candidate.type = Subframe::Type::Lpc;
+    candidate.order = order;
+    candidate.bitsPerSample = bitsPerSample;
+    candidate.precision = precision;
+    candidate.shift = shift;
+    candidate.bits = 8 + (uint64_t)order * bitsPerSample + 4 + 5 + (uint64_t)order * precision +
+                     ChooseRiceParameters(residual, n, order, n, candidate);
+    if (candidate.bits < result.bits) {
+        std::swap(candidate, result);
+        return true;
+    }
+    return false;
+}
+
+uint64_t FlacEncoder::ChooseRiceParameters(const int32_t* residual, uint32_t n, uint32_t predictorOrder,
+                                           uint32_t blockSize, Subframe& subframe) {
+    uint32_t maxOrder = settings.maxPartitionOrder;
+    while (maxOrder > 0 && ((blockSize & ((1u << maxOrder) - 1)) != 0 || (blockSize >> maxOrder) <= predictorOrder)) {
+        maxOrder--;
+    }
+
+    for (uint32_t i = predictorOrder; i < n; i++) folded[i] = Fold(residual[i]);
+
+    // Partition sums at the finest order, merged pairwise for coarser ones
+    uint64_t sums[1u << 8];
+    uint32_t partitions = 1u << maxOrder;
+    uint32_t partitionSize = blockSize >> maxOrder;
+    for (uint32_t p = 0; p < partitions; p++) {
+        uint32_t begin = p == 0 ? predictorOrder : p * partitionSize;
+        uint32_t end = (p + 1) * partitionSize;
+        uint64_t sum = 0;
+        for (uint32_t i = begin; i < end; i++) sum += folded[i];
+        sums[p] = sum;
+    }
+
+    uint64_t bestBits = UINT64_MAX;
+    uint8_t parameters[1u << 8];
+    for (int order = (int)maxOrder; order >= 0; order--) {
+        partitions = 1u << order;
+        partitionSize = blockSize >> order;
+
+        uint64_t bits = 0;
+        uint32_t largest = 0;
+        for (uint32_t p = 0; p < partitions; p++) {
+            uint64_t count = partitionSize - (p == 0 ? predictorOrder : 0);
+            uint32_t k = 0;
+            if (count > 0) {
+                // Start near log2(mean) and refine against the estimate
+                uint64_t mean = sums[p] / count;
+                uint32_t guess = 0;
+                while (guess < 30 && (mean >> (guess + 1)) > 0) guess++;
+                uint64_t kBits = UINT64_MAX;
+                for (uint32_t candidateK = guess > 0 ? guess - 1 : 0; candidateK <= guess + 1 && candidateK <= 30;
+                     candidateK++) {
+                    uint64_t cost = count * (candidateK + 1) + (sums[p] >> candidateK);
+                    if (cost < kBits) {
+                        kBits = cost;
+                        k = candidateK;
+                    }
+                }
+                bits += kBits;
+            }
+            parameters[p] = (uint8_t)k;
+            if (k > largest) largest = k;
+        }
+        bool rice2 = largest > 14;
+        bits += 6 + (uint64_t)partitions * (rice2 ? 5 : 4);
+
+        if (bits < bestBits) {
+            bestBits = bits;
+            subframe.partitionOrder = (uint32_t)order;
+            subframe.rice2 = rice2;
+            subframe.riceParameters.assign(parameters, parameters + partitions);
+        }
+
+        for (uint32_t p = 0; p < partitions / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return bestBits;
+}
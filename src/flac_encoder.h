@@ -0,0 +1,110 @@
+#pragma once
+
+// Streaming lossless encoder producing a standard FLAC bitstream.
+//
+// Interleaved little-endian integer PCM goes in, complete FLAC frames come
+// out. Each channel picks the cheapest of constant, verbatim, fixed
+// (orders 0-4) and LPC subframes, residuals are Rice coded with an adaptive
+// partition order, and stereo input additionally tries left/side,
+// right/side and mid/side decorrelation. Compression levels 0-8 follow the
+// spirit of the reference encoder's presets.
+//
+// The STREAMINFO block is written up front with unknown totals and MD5
+// (both permitted by the format), so the output can go straight to a pipe.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class FlacEncoder {
+public:
+    static constexpr uint32_t kMaxChannels = 8;
+    static constexpr uint32_t kMaxLpcOrder = 12;
+    static constexpr uint32_t kMinBlockSize = 16;
+    static constexpr uint32_t kMaxBlockSize = 65535;
+    static constexpr uint32_t kDefaultBlockSize = 4096;
+    static constexpr int kDefaultLevel = 5;
+
+    struct Config {
+        uint32_t sampleRate = 0;
+        uint32_t channels = 0;
+        uint32_t bitsPerSample = 0;  // 16 or 24
+        uint32_t blockSize = kDefaultBlockSize;
+        int level = kDefaultLevel;   // 0 (fastest) - 8 (smallest)
+    };
+
+    FlacEncoder() {}
+
+    bool Initialize(const Config& config, std::string* error);
+
+    // Append interleaved PCM (any length, frames may straddle calls);
+    // finished frames, preceded by the stream header on the first call,
+    // are appended to `out`
+    void Encode(const uint8_t* pcm, size_t bytes, std::vector<uint8_t>& out);
+
+    // Encode the final partial block
+    void Finish(std::vector<uint8_t>& out);
+
+    uint64_t SamplesEncoded() const { return samplesEncoded; }  // per channel
+    uint64_t BytesProduced() const { return bytesProduced; }
+    const Config& GetConfig() const { return config; }
+
+    // One candidate encoding of a channel; public only for the helpers in
+    // the implementation file
+    struct Subframe {
+        enum class Type { Constant, Verbatim, Fixed, Lpc } type = Type::Verbatim;
+        uint32_t order = 0;
+        uint32_t bitsPerSample = 0;
+        uint32_t precision = 0;  // LPC coefficient bits
+        int shift = 0;           // LPC quantization shift
+        int32_t coefficients[kMaxLpcOrder] = {};
+        uint32_t partitionOrder = 0;
+        bool rice2 = false;      // 5-bit Rice parameters
+        std::vector<uint8_t> riceParameters;
+        std::vector<int32_t> residual;
+        uint64_t bits = 0;
+    };
+
+private:
+    struct LevelSettings {
+        uint32_t maxLpcOrder;
+        uint32_t maxPartitionOrder;
+        bool stereoDecorrelation;
+        bool exhaustiveLpcOrder;
+    };
+
+    Config config;
+    LevelSettings settings = {};
+    bool initialized = false;
+    bool headerWritten = false;
+    uint32_t bytesPerSample = 0;
+    uint32_t frameBytes = 0;
+
+    std::vector<std::vector<int32_t>> channelSamples;  // current block
+    std::vector<int32_t> midSamples;
+    std::vector<int32_t> sideSamples;
+    uint32_t blockFill = 0;
+    uint8_t partial[kMaxChannels * 4] = {};  // bytes of a frame split across calls
+    uint32_t partialBytes = 0;
+
+    std::vector<double> window;
+    std::vector<double> windowed;
+    std::vector<uint32_t> folded;  // zigzag residuals for cost estimates
+    Subframe candidate;
+    Subframe best[4];
+
+    uint64_t frameNumber = 0;
+    uint64_t samplesEncoded = 0;
+    uint64_t bytesProduced = 0;
+
+    void WriteStreamHeader(std::vector<uint8_t>& out);
+    void EncodeFrame(uint32_t blockSize, std::vector<uint8_t>& out);
+    void AnalyzeChannel(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result);
+    void TryFixed(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result);
+    void TryLpc(const int32_t* samples, uint32_t n, uint32_t bitsPerSample, Subframe& result);
+    bool EvaluateLpcOrder(const int32_t* samples, uint32_t n, uint32_t bitsPerSample,
+                          const double* lpc, uint32_t order, Subframe& result);
+    uint64_t ChooseRiceParameters(const int32_t* residual, uint32_t n, uint32_t predictorOrder,
+                                  uint32_t blockSize, Subframe& subframe);
+};
@@ -0,0 +1,192 @@
+#include "frame_blocker.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "stream_records.h"
+
+bool FrameBlocker::ParseFrameSize(const std::string& text, uint32_t& frames, double& ms) {
+    frames = 0;
+    ms = 0.0;
+    if (text.empty() || text[0] == '-' || text[0] == '+') return false;
+    char* end = nullptr;
+    if (text.size() > 2 && text.compare(text.size() - 2, 2, "ms") == 0) {
+        double value = strtod(text.c_str(), &end);
+        if (end != text.c_str() + text.size() - 2 || !(value > 0.0) || value > kMaxFrameSeconds * 1000.0) {
+            return false;
+        }
+        ms = value;
+        return true;
+    }
+    unsigned long value = strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || value < 1 || value > 0x7FFFFFFFul) return false;
+    frames = (uint32_t)value;
+    return true;
+}
+
+bool FrameBlocker::Initialize(const Config& newConfig, std::string* error) {
+    config = newConfig;
+    blockAlign = config.output.BlockAlign();
+    if (config.frameFrames == 0 || blockAlign == 0 || config.output.sampleRate == 0) {
+        *error = "frame size and output format must be set";
+        return false;
+    }
+    if (config.frameFrames > config.output.sampleRate * kMaxFrameSeconds) {
+        *error = "frame size of " + std::to_string(config.frameFrames) + " frames is longer than " +
+                 std::to_string((int)kMaxFrameSeconds) + " s";
+        return false;
+    }
+    if (config.deviceRate == 0) config.deviceRate = config.output.sampleRate;
+    deviceFramesPerFrame = (double)config.deviceRate / config.output.sampleRate;
+
+    staging.assign((size_t)config.frameFrames * blockAlign, 0);
+    staged = 0;
+    stagedAudible = false;
+    frameStart = CapturePacket();
+    input = CapturePacket();
+    view = AudioView();
+    consumed = 0;
+    endPosition = 0.0;
+    endTimestamp = 0.0;
+    pendingAlign = false;
+    nextDevicePosition = 0;
+    started = false;
+    paddedFrames = 0;
+    return true;
+}
+
+void FrameBlocker::Push(const CapturePacket& packet, const AudioView& newView) {
+    const double ticksPerFrame = (double)records::kTimestampFrequency / config.output.sampleRate;
+    // The resampler tail repeats the last packet's metadata; it continues
+    // the stream where the last view ended
+    if (packet.flags & records::kFlagFlush) {
+        endPosition += newView.frames * deviceFramesPerFrame;
+        endTimestamp += newView.frames * ticksPerFrame;
+    } else {
+        bool gap = started &&
+                   (packet.devicePosition != nextDevicePosition || (packet.flags & records::kFlagDiscontinuity));
+        if (config.alignToDevice && (!started || gap)) pendingAlign = true;
+        nextDevicePosition = packet.devicePosition + packet.frames;
+        endPosition = (double)nextDevicePosition;
+        endTimestamp = packet.timestamp + (double)packet.frames * records::kTimestampFrequency / config.deviceRate;
+        started = true;
+    }
+
+    input = packet;
+    view = newView;
+    consumed = 0;
+}
+
+bool FrameBlocker::Next(CapturePacket& packet, AudioView& frame) {
+    if (pendingAlign) {
+        // A frame cut short by the gap goes out first, completed with silence
+        if (staged > 0) {
+            Pad(config.frameFrames - staged);
+            return TakeStaged(packet, frame);
+        }
+        pendingAlign = false;
+        PadToBoundary();
+    }
+
+    size_t left = view.frames - consumed;
+    if (staged == 0 && left >= config.frameFrames) {
+        // A whole frame inside the view goes out without a copy
+        packet = PacketAt(consumed);
+        frame.data = view.IsSilent() ? nullptr : view.data + consumed * blockAlign;
+        frame.frames = config.frameFrames;
+        if (frame.IsSilent()) {
+            packet.flags |= records::kFlagSilent;
+        } else {
+            packet.flags &= ~records::kFlagSilent;
+        }
+        consumed += config.frameFrames;
+        return true;
+    }
+    if (left == 0) return false;
+
+    size_t count = config.frameFrames - staged;
+    if (count > left) count = left;
+    Stage(view.IsSilent() ? nullptr : view.data + consumed * blockAlign, count);
+    consumed += count;
+    if (staged < config.frameFrames) return false;
+    return TakeStaged(packet, frame);
+}
+
+bool FrameBlocker::Flush(CapturePacket& packet, AudioView& frame) {
+    if (staged == 0) return false;
+    Pad(config.frameFrames - staged);
+    return TakeStaged(packet, frame);
+}
+
+// Metadata for the output frame `offset` frames into the pushed view
+CapturePacket FrameBlocker::PacketAt(size_t offset) const {
+    const double back = (double)(view.frames - offset);
+    double position = endPosition - back * deviceFramesPerFrame;
+    double timestamp = endTimestamp - back * records::kTimestampFrequency / config.output.sampleRate;
+
+    CapturePacket packet = input;
+    packet.data = nullptr;
+    // Only the frame holding the packet's first frame follows the glitch
+    if (offset > 0) packet.flags &= ~records::kFlagDiscontinuity;
+    packet.frames = (uint32_t)std::lround(config.frameFrames * deviceFramesPerFrame);
+    packet.devicePosition = position > 0.0 ? (uint64_t)std::llround(position) : 0;
+    packet.timestamp = timestamp > 0.0 ? (uint64_t)std::llround(timestamp) : 0;
+    return packet;
+}
+
+void FrameBlocker::Stage(const uint8_t* data, size_t frames) {
+    if (staged == 0) {
+        frameStart = PacketAt(consumed);
+    } else {
+        frameStart.flags |= input.flags;
+    }
+    uint8_t* out = staging.data() + (size_t)staged * blockAlign;
+    if (data) {
+        memcpy(out, data, frames * blockAlign);
+        stagedAudible = true;
+    } else {
+        memset(out, 0, frames * blockAlign);
+    }
+    staged += (uint32_t)frames;
+}
+
+void FrameBlocker::Pad(uint32_t frames) {
+    memset(staging.data() + (size_t)staged * blockAlign, 0, (size_t)frames * blockAlign);
+    staged += frames;
+    paddedFrames += frames;
+    frameStart.flags |= records::kFlagPadded;
+}
+
+bool FrameBlocker::TakeStaged(CapturePacket& packet, AudioView& frame) {
+    packet = frameStart;
+    frame.frames = staged;
+    if (stagedAudible) {
+        frame.data = staging.data();
+        packet.flags &= ~records::kFlagSilent;
+    } else {
+        frame.data = nullptr;
+        packet.flags |= records::kFlagSilent;
+    }
+    staged = 0;
+    stagedAudible = false;
+    return true;
+}
+
+// Start the first frame at the boundary before the pushed view, so frames
+// cover device positions [k * length, (k + 1) * length)
+void FrameBlocker::PadToBoundary() {
+    frameStart = PacketAt(0);
+    // In units of 1 / (deviceRate * outputRate) s, so the arithmetic is exact
+    const uint64_t position = frameStart.devicePosition * config.output.sampleRate;
+    const uint64_t length = (uint64_t)config.frameFrames * config.deviceRate;
+    const uint64_t boundary = position / length * length;
+    uint32_t frames = (uint32_t)std::llround((double)(position - boundary) / config.deviceRate);
+    if (frames == 0 || frames >= config.frameFrames) return;
+
+    frameStart.devicePosition = (uint64_t)std::llround((double)boundary / config.output.sampleRate);
+    uint64_t ticks = (uint64_t)std::llround((double)frames * records::kTimestampFrequency /
+                                            config.output.sampleRate);
+    frameStart.timestamp = frameStart.timestamp > ticks ? frameStart.timestamp - ticks : 0;
+    Pad(frames);
+}
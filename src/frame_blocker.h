@@ -0,0 +1,101 @@
+#pragma once
+
+// Re-blocks converted audio into packets of exactly one frame size
+// (--frame-size), e.g. 320 frames = 20 ms at 16 kHz for speech models.
+//
+// Device packets vary in size and the resampler's output varies further, so
+// frame boundaries rarely line up with packet boundaries. Push() takes the
+// converted view of one packet; Next() then hands out every complete frame.
+// Frames that lie wholly inside the view are returned as views into it, so
+// the bulk of the audio is never copied. Only a frame that straddles two
+// packets is assembled in the single staging buffer, which holds one frame
+// and is allocated by Initialize().
+//
+// Each frame gets its own packet metadata: the device position and
+// timestamp of its first frame and the flags of every packet that
+// contributed to it. Positions are counted back from the end of each view,
+// which lines up with the end of its packet: the stages hold back a fixed
+// delay, so the start of the first view after a (re)start is the one that
+// is short. Like every --framed header, they then run latencyFrames ahead
+// of the audio. A frame made only of silence comes out as a silent view so
+// silence stays cheap downstream.
+//
+// With alignment, frame boundaries fall on device positions that are
+// multiples of the frame length (in device frames), so every stream cut
+// from the same device agrees on them. The first frame, and the first after
+// a gap in the device position, is padded at the front with silence to
+// reach the previous boundary; a frame cut short by a gap is completed with
+// silence. Padded frames carry records::kFlagPadded.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "audio_format.h"
+#include "audio_stages.h"
+#include "capture_source.h"
+
+class FrameBlocker {
+public:
+    struct Config {
+        uint32_t frameFrames = 0;  // output frames per packet
+        AudioFormat output;        // format of the views pushed in
+        uint32_t deviceRate = 0;   // rate of the packets' device positions
+        bool alignToDevice = false;
+    };
+
+    // Largest --frame-size accepted, in seconds of output
+    static constexpr double kMaxFrameSeconds = 10.0;
+
+    // Parse "<frames>" or "<ms>ms"; exactly one of `frames` and `ms` is set
+    static bool ParseFrameSize(const std::string& text, uint32_t& frames, double& ms);
+
+    bool Initialize(const Config& config, std::string* error);
+
+    uint32_t FrameFrames() const { return config.frameFrames; }
+
+    // Start handing out frames from `view`, the converted audio of `packet`.
+    // The view must stay valid until Next() returns false.
+    void Push(const CapturePacket& packet, const AudioView& view);
+
+    // The next complete frame; false once the pushed view is used up
+    bool Next(CapturePacket& packet, AudioView& frame);
+
+    // Complete a partial frame with silence at the end of the stream; false
+    // if nothing was pending
+    bool Flush(CapturePacket& packet, AudioView& frame);
+
+    // Frames held back waiting for the rest of their packet
+    uint32_t PendingFrames() const { return staged; }
+    uint64_t PaddedFrames() const { return paddedFrames; }
+
+private:
+    Config config;
+    uint32_t blockAlign = 0;
+    double deviceFramesPerFrame = 1.0;  // device frames per output frame
+
+    // The frame being assembled
+    std::vector<uint8_t> staging;
+    uint32_t staged = 0;
+    bool stagedAudible = false;
+    CapturePacket frameStart;           // metadata of the frame being assembled
+
+    // The pushed view
+    CapturePacket input;
+    AudioView view;
+    size_t consumed = 0;
+    double endPosition = 0.0;           // device position at the end of the view
+    double endTimestamp = 0.0;          // and its timestamp
+    bool pendingAlign = false;          // pad the next frame to a boundary first
+
+    uint64_t nextDevicePosition = 0;
+    bool started = false;
+    uint64_t paddedFrames = 0;
+
+    CapturePacket PacketAt(size_t offset) const;
+    void Stage(const uint8_t* data, size_t frames);
+    void Pad(uint32_t frames);
+    bool TakeStaged(CapturePacket& packet, AudioView& frame);
+    void PadToBoundary();
+};
@@ -0,0 +1,191 @@
+#include "latency_stats.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+int HighestBit(uint64_t value) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+std::string FormatDuration(uint64_t ns) {
+    char text[32];
+    if (ns < 1000) {
+        snprintf(text, sizeof(text), "%u ns", (unsigned)ns);
+    } else if (ns < 1000000) {
+        snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    } else {
+        snprintf(text, sizeof(text), "%.2f s", ns / 1e9);
+    }
+    return text;
+}
+
+std::string JsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+}  // namespace
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) return (size_t)value;
+    int shift = HighestBit(value) - kSubBucketBits;
+    if (shift > kMaxShift) return kBuckets - 1;
+    // (value >> shift) is in [kSubBuckets, 2 * kSubBuckets)
+    return (size_t)shift * kSubBuckets + (size_t)(value >> shift);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+    if (index < kSubBuckets) return index;
+    int shift = (int)(index / kSubBuckets) - 1;
+    uint64_t mantissa = index - (uint64_t)shift * kSubBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Snapshot(uint64_t* out) const {
+    for (size_t i = 0; i < kBuckets; i++) {
+        out[i] = counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram* LatencyStats::Add(const std::string& name) {
+    Step step;
+    step.name = name;
+    step.histogram = std::make_unique<LatencyHistogram>();
+    step.previous.assign(LatencyHistogram::kBuckets, 0);
+    steps.push_back(std::move(step));
+    return steps.back().histogram.get();
+}
+
+bool LatencyStats::Start(std::chrono::milliseconds newInterval, Format newFormat) {
+    if (reporter.joinable() || newInterval.count() <= 0) return false;
+    interval = newInterval;
+    format = newFormat;
+    current.assign(LatencyHistogram::kBuckets, 0);
+    startTime = std::chrono::steady_clock::now();
+    lastReport = startTime;
+    stopping = false;
+    reporter = std::thread(&LatencyStats::Run, this);
+    return true;
+}
+
+void LatencyStats::Stop() {
+    if (!reporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    reporter.join();
+    Report(true);
+}
+
+void LatencyStats::Run() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    auto next = startTime + interval;
+    while (!stopping) {
+        if (wakeup.wait_until(lock, next, [this] { return stopping; })) break;
+        lock.unlock();
+        Report(false);
+        lock.lock();
+        // Skip reports missed while the process was suspended
+        next += interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now + interval;
+    }
+}
+
+LatencyStats::Summary LatencyStats::Summarize(const uint64_t* counts) {
+    Summary summary;
+    for (size_t i = 0; i < LatencyHistogram::kBuckets; i++) {
+        summary.count += counts[i];
+    }
+    if (summary.count == 0) return summary;
+
+    // Nearest rank, reported as the top of the bucket it falls in
+    uint64_t rank50 = (summary.count + 1) / 2;
+    uint64_t rank99 = summary.count - summary.count / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::kBuckets; i++) {
+        if (counts[i] == 0) continue;
+        uint64_t upper = LatencyHistogram::BucketUpperBound(i);
+        if (seen < rank50 && seen + counts[i] >= rank50) summary.p50 = upper;
+        if (seen < rank99 && seen + counts[i] >= rank99) summary.p99 = upper;
+        seen += counts[i];
+        summary.max = upper;
+    }
+    return summary;
+}
+
+void LatencyStats::Report(bool final) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - startTime).count();
+    double span = final ? elapsed : std::chrono::duration<double>(now - lastReport).count();
+    lastReport = now;
+
+    std::ostringstream text;
+    bool any = false;
+    char seconds[32];
+    if (format == Format::Json) {
+        snprintf(seconds, sizeof(seconds), "%.3f", elapsed);
+        text << "{\"elapsed_s\":" << seconds;
+        snprintf(seconds, sizeof(seconds), "%.3f", span);
+        text << ",\"interval_s\":" << seconds << ",\"final\":" << (final ? "true" : "false") << ",\"steps\":[";
+    } else {
+        snprintf(seconds, sizeof(seconds), "%.1f", span);
+        text << "Latency, " << (final ? "whole run" : "last") << " " << seconds << " s (count, p50 / p99 / max):\n";
+    }
+
+    for (Step& step : steps) {
+        step.histogram->Snapshot(current.data());
+        for (size_t i = 0; !final && i < LatencyHistogram::kBuckets; i++) {
+            uint64_t total = current[i];
+            current[i] -= step.previous[i];
+            step.previous[i] = total;
+        }
+        Summary summary = Summarize(current.data());
+        if (summary.count == 0) continue;
+
+        if (format == Format::Json) {
+            char values[96];
+            snprintf(values, sizeof(values), "\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f", summary.p50 / 1e3,
+                     summary.p99 / 1e3, summary.max / 1e3);
+            text << (any ? "," : "") << "{\"name\":" << JsonString(step.name) << ",\"count\":" << summary.count
+                 << "," << values << "}";
+        } else {
+            char line[160];
+            snprintf(line, sizeof(line), "  %-24s %8llu  %10s / %10s / %10s\n", step.name.c_str(),
+                     (unsigned long long)summary.count, FormatDuration(summary.p50).c_str(),
+                     FormatDuration(summary.p99).c_str(), FormatDuration(summary.max).c_str());
+            text << line;
+        }
+        any = true;
+    }
+    if (!any) return;
+
+    if (format == Format::Json) text << "]}\n";
+    std::cerr << text.str() << std::flush;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// Where the time goes on the capture path.
+//
+// Each measured step records its duration into a LatencyHistogram: fixed
+// log-linear buckets (16 per power of two, so about 6% resolution) covering
+// 1 ns to over a minute. Recording is one clock read and one counter bump
+// with no allocation or locking; every histogram has a single writer thread
+// and is read by the reporter at any time.
+//
+// LatencyStats owns the histograms and a reporter thread that periodically
+// prints p50/p99/max of each step over the last interval, as text or as
+// JSON lines on stderr, plus a whole-run summary when it stops.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Monotonic time for latency measurements
+inline uint64_t LatencyClockNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    // Values from 2^(kMaxShift + kSubBucketBits) ns (about 68 s) share the top bucket
+    static constexpr int kMaxShift = 32;
+    static constexpr size_t kBuckets = (kMaxShift + 2) * kSubBuckets;
+
+    // Writer thread only
+    void Record(uint64_t nanoseconds) {
+        std::atomic<uint64_t>& count = counts[BucketIndex(nanoseconds)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Any thread: copy the counts into `out` (kBuckets entries)
+    void Snapshot(uint64_t* out) const;
+
+    static size_t BucketIndex(uint64_t value);
+    // Largest value that lands in bucket `index`
+    static uint64_t BucketUpperBound(size_t index);
+
+private:
+    std::atomic<uint64_t> counts[kBuckets] = {};
+};
+
+class LatencyStats {
+public:
+    enum class Format { Text, Json };
+
+    LatencyStats() {}
+    ~LatencyStats() { Stop(); }
+
+    LatencyStats(const LatencyStats&) = delete;
+    LatencyStats& operator=(const LatencyStats&) = delete;
+
+    // Register a measured step before Start(); the histogram lives as long
+    // as this object. Steps are reported in the order they were added.
+    LatencyHistogram* Add(const std::string& name);
+
+    bool Start(std::chrono::milliseconds interval, Format format);
+
+    // Stop the reporter and print the whole-run summary
+    void Stop();
+
+private:
+    struct Step {
+        std::string name;
+        std::unique_ptr<LatencyHistogram> histogram;
+        std::vector<uint64_t> previous;  // counts at the last report
+    };
+
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t p50 = 0;
+        uint64_t p99 = 0;
+        uint64_t max = 0;
+    };
+
+    std::vector<Step> steps;
+    std::vector<uint64_t> current;
+    std::chrono::milliseconds interval{0};
+    Format format = Format::Text;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point lastReport;
+
+    std::thread reporter;
+    std::mutex wakeMutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    void Run();
+    void Report(bool final);
+    static Summary Summarize(const uint64_t* counts);
+};
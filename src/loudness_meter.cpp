@@ -0,0 +1,425 @@
+#include "loudness_meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "channel_mixer.h"
+#include "sample_converter.h"
+#include "simd_arch.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+void WeightScalar(const float* in, size_t frames, uint32_t channels, const double* k, double* state,
+                  double* sums) {
+    const uint32_t stride = LoudnessMeter::kMaxChannels;
+    for (uint32_t c = 0; c < channels; c++) {
+        double z1 = state[c], z2 = state[stride + c];
+        double w1 = state[2 * stride + c], w2 = state[3 * stride + c];
+        double sum = sums[c];
+        const float* p = in + c;
+        for (size_t f = 0; f < frames; f++, p += channels) {
+            // Transposed direct form II: the high shelf, then the high pass
+            double x = *p;
+            double y = k[0] * x + z1;
+            z1 = k[1] * x - k[3] * y + z2;
+            z2 = k[2] * x - k[4] * y;
+            double out = k[5] * y + w1;
+            w1 = k[6] * y - k[8] * out + w2;
+            w2 = k[7] * y - k[9] * out;
+            sum += out * out;
+        }
+        state[c] = z1;
+        state[stride + c] = z2;
+        state[2 * stride + c] = w1;
+        state[3 * stride + c] = w2;
+        sums[c] = sum;
+    }
+}
+
+float PeakScalar(const float* in, size_t count, float peak) {
+    for (size_t i = 0; i < count; i++) peak = std::max(peak, std::fabs(in[i]));
+    return peak;
+}
+
+float TruePeakScalar(const float* x, size_t frames, const float* phases, uint32_t factor, uint32_t taps,
+                     float peak) {
+    for (size_t n = 0; n < frames; n++) {
+        for (uint32_t p = 0; p < factor; p++) {
+            const float* row = phases + p * taps;
+            float acc = 0.0f;
+            for (uint32_t k = 0; k < taps; k++) acc += row[k] * x[(ptrdiff_t)n - (ptrdiff_t)k];
+            peak = std::max(peak, std::fabs(acc));
+        }
+    }
+    return peak;
+}
+
+double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; k++) {
+        term *= (x / 2.0 / k) * (x / 2.0 / k);
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+double Loudness(double meanSquare) {
+    return meanSquare > 0.0 ? -0.691 + 10.0 * std::log10(meanSquare) : -std::numeric_limits<double>::infinity();
+}
+
+double Decibels(float peak) {
+    return peak > 0.0f ? 20.0 * std::log10((double)peak) : -std::numeric_limits<double>::infinity();
+}
+
+// Single writer against a reader that resets it
+void RaisePeak(std::atomic<float>& peak, float value) {
+    float current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void RaiseMax(std::atomic<double>& max, double value) {
+    if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+}
+
+std::string TextValue(double value) {
+    if (!std::isfinite(value)) return "-inf";
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", value);
+    return text;
+}
+
+std::string JsonValue(double value) {
+    if (!std::isfinite(value)) return "null";
+    char text[32];
+    snprintf(text, sizeof(text), "%.2f", value);
+    return text;
+}
+
+}  // namespace
+
+const MeterKernels& GetScalarMeterKernels() {
+    static const MeterKernels kernels = { "scalar", WeightScalar, PeakScalar, TruePeakScalar };
+    return kernels;
+}
+
+std::vector<const MeterKernels*> GetAvailableMeterKernels() {
+    std::vector<const MeterKernels*> result;
+    if (CpuSupportsAvx2() && GetAvx2MeterKernels()) result.push_back(GetAvx2MeterKernels());
+    if (CpuSupportsSse2() && GetSse2MeterKernels()) result.push_back(GetSse2MeterKernels());
+    if (CpuSupportsNeon() && GetNeonMeterKernels()) result.push_back(GetNeonMeterKernels());
+    result.push_back(&GetScalarMeterKernels());
+    return result;
+}
+
+const MeterKernels& GetMeterKernels() {
+    static const MeterKernels* selected = GetAvailableMeterKernels().front();
+    return *selected;
+}
+
+bool LoudnessMeter::Initialize(const AudioFormat& newFormat, const MeterKernels* kernelSet, std::string* error) {
+    if (newFormat.channels == 0 || newFormat.channels > kMaxChannels || newFormat.sampleRate == 0) {
+        *error = "loudness metering needs 1 to " + std::to_string(kMaxChannels) + " channels";
+        return false;
+    }
+    format = newFormat;
+    channels = format.channels;
+    kernels = kernelSet ? kernelSet : &GetMeterKernels();
+
+    // K-weighting for this rate (BS.1770-4, generalised from the 48 kHz
+    // coefficients): a +4 dB high shelf around 1.7 kHz, then a high pass at
+    // 38 Hz
+    const double rate = format.sampleRate;
+    double k = std::tan(kPi * 1681.974450955533 / rate);
+    double q = 0.7071752369554196;
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    coefficients[0] = (vh + vb * k / q + k * k) / a0;
+    coefficients[1] = 2.0 * (k * k - vh) / a0;
+    coefficients[2] = (vh - vb * k / q + k * k) / a0;
+    coefficients[3] = 2.0 * (k * k - 1.0) / a0;
+    coefficients[4] = (1.0 - k / q + k * k) / a0;
+    k = std::tan(kPi * 38.13547087602444 / rate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    coefficients[5] = 1.0;
+    coefficients[6] = -2.0;
+    coefficients[7] = 1.0;
+    coefficients[8] = 2.0 * (k * k - 1.0) / a0;
+    coefficients[9] = (1.0 - k / q + k * k) / a0;
+
+    // Channel weights by speaker position: surrounds count 1.41, the LFE
+    // not at all
+    uint32_t mask = format.channelMask ? format.channelMask : ChannelMixer::DefaultChannelMask(channels);
+    uint32_t c = 0;
+    for (uint32_t bit = 0; bit < 32 && c < channels; bit++) {
+        uint32_t position = 1u << bit;
+        if (!(mask & position)) continue;
+        gains[c++] = position == speaker::LowFrequency ? 0.0
+                     : (position & (speaker::BackLeft | speaker::BackRight | speaker::SideLeft |
+                                    speaker::SideRight))
+                         ? 1.41
+                         : 1.0;
+    }
+    for (; c < kMaxChannels; c++) gains[c] = c < channels ? 1.0 : 0.0;
+
+    // Kaiser-windowed sinc interpolator, each phase normalised to unity
+    // gain; phase 0 passes the samples through
+    factor = format.sampleRate < 96000 ? 4 : format.sampleRate < 192000 ? 2 : 1;
+    phases.assign((size_t)factor * kTruePeakTaps, 0.0f);
+    const double beta = 5.0;
+    const double half = kTruePeakTaps / 2.0;
+    for (uint32_t p = 0; p < factor; p++) {
+        double values[kTruePeakTaps];
+        double sum = 0.0;
+        for (uint32_t t = 0; t < kTruePeakTaps; t++) {
+            double x = (half - 1.0 - t) + (double)p / factor;
+            double sinc = std::fabs(x) < 1e-12 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            double r = x / half;
+            double window = std::fabs(r) >= 1.0 ? 0.0 : BesselI0(beta * std::sqrt(1.0 - r * r)) / BesselI0(beta);
+            values[t] = sinc * window;
+            sum += values[t];
+        }
+        for (uint32_t t = 0; t < kTruePeakTaps; t++) phases[p * kTruePeakTaps + t] = (float)(values[t] / sum);
+    }
+
+    state.assign(4 * kMaxChannels, 0.0);
+    sums.assign(kMaxChannels, 0.0);
+    decoded.assign(kBlockFrames * channels, 0.0f);
+    history.assign((size_t)channels * (kTruePeakTaps - 1 + kBlockFrames), 0.0f);
+    stepFrames = (format.sampleRate + 5) / 10;
+    stepFilled = 0;
+    std::fill(std::begin(steps), std::end(steps), 0.0);
+    stepCount = 0;
+    quietFrames = 0;
+    settled = false;
+
+    const double none = -std::numeric_limits<double>::infinity();
+    frames.store(0, std::memory_order_relaxed);
+    momentary.store(none, std::memory_order_relaxed);
+    shortTerm.store(none, std::memory_order_relaxed);
+    maxMomentary.store(none, std::memory_order_relaxed);
+    maxShortTerm.store(none, std::memory_order_relaxed);
+    samplePeak.store(0.0f, std::memory_order_relaxed);
+    truePeak.store(0.0f, std::memory_order_relaxed);
+    intervalSamplePeak.store(0.0f, std::memory_order_relaxed);
+    intervalTruePeak.store(0.0f, std::memory_order_relaxed);
+    for (size_t i = 0; i < kHistogramBins; i++) {
+        blockCounts[i].store(0, std::memory_order_relaxed);
+        blockEnergy[i].store(0.0, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void LoudnessMeter::Process(const AudioView& view) {
+    const ConversionKernels& convert = GetConversionKernels();
+    const uint32_t blockAlign = format.BlockAlign();
+    size_t done = 0;
+    while (done < view.frames) {
+        // Never across the end of a 100 ms step
+        size_t count = std::min(view.frames - done, kBlockFrames);
+        count = std::min(count, (size_t)(stepFrames - stepFilled));
+        const float* samples = nullptr;
+        if (!view.IsSilent()) {
+            const uint8_t* data = view.data + done * blockAlign;
+            const size_t total = count * channels;
+            switch (format.type) {
+                case SampleType::Float32: samples = (const float*)data; break;
+                case SampleType::Int16: convert.Int16ToFloat((const int16_t*)data, decoded.data(), total); break;
+                case SampleType::Int24: convert.Int24ToFloat(data, decoded.data(), total); break;
+                case SampleType::Int32: convert.Int32ToFloat((const int32_t*)data, decoded.data(), total); break;
+            }
+            if (!samples) samples = decoded.data();
+        }
+        Meter(samples, count);
+        done += count;
+    }
+    frames.store(frames.load(std::memory_order_relaxed) + view.frames, std::memory_order_relaxed);
+}
+
+// `count` frames within one step; null samples are silence
+void LoudnessMeter::Meter(const float* samples, size_t count) {
+    if (samples) {
+        quietFrames = 0;
+        settled = false;
+    } else if (quietFrames >= format.sampleRate) {
+        // A second of silence has rung the filters out; from here on
+        // silence costs nothing until audio returns
+        if (!settled) {
+            std::fill(state.begin(), state.end(), 0.0);
+            std::fill(history.begin(), history.end(), 0.0f);
+            settled = true;
+        }
+    } else {
+        std::fill(decoded.begin(), decoded.begin() + count * channels, 0.0f);
+        samples = decoded.data();
+        quietFrames += count;
+    }
+
+    if (samples) {
+        kernels->Weight(samples, count, channels, coefficients, state.data(), sums.data());
+        // Long fades would otherwise leave the filters in denormals
+        for (double& value : state) {
+            if (std::fabs(value) < 1e-30) value = 0.0;
+        }
+
+        float peak = kernels->Peak(samples, count * channels, 0.0f);
+        float oversampled = peak;
+        if (factor > 1) {
+            const size_t keep = kTruePeakTaps - 1;
+            for (uint32_t c = 0; c < channels; c++) {
+                float* x = history.data() + c * (keep + kBlockFrames);
+                for (size_t f = 0; f < count; f++) x[keep + f] = samples[f * channels + c];
+                oversampled = kernels->TruePeak(x + keep, count, phases.data(), factor, kTruePeakTaps, oversampled);
+                memmove(x, x + count, keep * sizeof(float));
+            }
+        }
+        if (peak > samplePeak.load(std::memory_order_relaxed)) samplePeak.store(peak, std::memory_order_relaxed);
+        if (oversampled > truePeak.load(std::memory_order_relaxed)) {
+            truePeak.store(oversampled, std::memory_order_relaxed);
+        }
+        RaisePeak(intervalSamplePeak, peak);
+        RaisePeak(intervalTruePeak, oversampled);
+    }
+
+    stepFilled += (uint32_t)count;
+    if (stepFilled == stepFrames) EndStep();
+}
+
+void LoudnessMeter::EndStep() {
+    double energy = 0.0;
+    for (uint32_t c = 0; c < channels; c++) {
+        energy += gains[c] * sums[c];
+        sums[c] = 0.0;
+    }
+    steps[stepCount % kShortTermSteps] = energy / stepFrames;
+    stepCount++;
+    stepFilled = 0;
+
+    if (stepCount >= kMomentarySteps) {
+        double sum = 0.0;
+        for (uint32_t i = 1; i <= kMomentarySteps; i++) sum += steps[(stepCount - i) % kShortTermSteps];
+        double block = sum / kMomentarySteps;
+        double lufs = Loudness(block);
+        momentary.store(lufs, std::memory_order_relaxed);
+        RaiseMax(maxMomentary, lufs);
+        // Every momentary block is a gating block for the integrated loudness
+        if (lufs >= kAbsoluteGateLufs) {
+            size_t bin = std::min((size_t)((lufs - kAbsoluteGateLufs) * 10.0), kHistogramBins - 1);
+            blockCounts[bin].store(blockCounts[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            blockEnergy[bin].store(blockEnergy[bin].load(std::memory_order_relaxed) + block,
+                                   std::memory_order_relaxed);
+        }
+    }
+    if (stepCount >= kShortTermSteps) {
+        double sum = 0.0;
+        for (double step : steps) sum += step;
+        double lufs = Loudness(sum / kShortTermSteps);
+        shortTerm.store(lufs, std::memory_order_relaxed);
+        RaiseMax(maxShortTerm, lufs);
+    }
+}
+
+double LoudnessMeter::IntegratedLufs() const {
+    uint64_t count = 0;
+    double energy = 0.0;
+    for (size_t i = 0; i < kHistogramBins; i++) {
+        count += blockCounts[i].load(std::memory_order_relaxed);
+        energy += blockEnergy[i].load(std::memory_order_relaxed);
+    }
+    if (count == 0) return -std::numeric_limits<double>::infinity();
+
+    // Relative gate, to the resolution of the bins
+    double gate = Loudness(energy / count) + kRelativeGateLu;
+    size_t first = gate > kAbsoluteGateLufs ? (size_t)((gate - kAbsoluteGateLufs) * 10.0) : 0;
+    count = 0;
+    energy = 0.0;
+    for (size_t i = first; i < kHistogramBins; i++) {
+        count += blockCounts[i].load(std::memory_order_relaxed);
+        energy += blockEnergy[i].load(std::memory_order_relaxed);
+    }
+    return count ? Loudness(energy / count) : -std::numeric_limits<double>::infinity();
+}
+
+double LoudnessMeter::SamplePeakDb() const { return Decibels(samplePeak.load(std::memory_order_relaxed)); }
+double LoudnessMeter::TruePeakDb() const { return Decibels(truePeak.load(std::memory_order_relaxed)); }
+
+bool LoudnessMeter::Start(std::chrono::milliseconds newInterval, Format newFormat) {
+    if (reporter.joinable() || newInterval.count() <= 0) return false;
+    interval = newInterval;
+    reportFormat = newFormat;
+    reportedFrames = 0;
+    stopping = false;
+    reporter = std::thread(&LoudnessMeter::Run, this);
+    return true;
+}
+
+void LoudnessMeter::Stop() {
+    if (!reporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    reporter.join();
+    Report(true);
+}
+
+void LoudnessMeter::Run() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (!stopping) {
+        if (wakeup.wait_until(lock, next, [this] { return stopping; })) break;
+        lock.unlock();
+        Report(false);
+        lock.lock();
+        next += interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now + interval;
+    }
+}
+
+// Interval reports give the current momentary and short-term loudness and
+// the peaks since the last report; the summary the maxima of the whole run
+void LoudnessMeter::Report(bool final) {
+    uint64_t metered = frames.load(std::memory_order_relaxed);
+    if (metered == reportedFrames) return;
+    reportedFrames = metered;
+
+    double seconds = (double)metered / format.sampleRate;
+    float intervalPeak = intervalSamplePeak.exchange(0.0f, std::memory_order_relaxed);
+    float intervalOversampled = intervalTruePeak.exchange(0.0f, std::memory_order_relaxed);
+    double momentaryLufs = final ? maxMomentary.load(std::memory_order_relaxed) : MomentaryLufs();
+    double shortTermLufs = final ? maxShortTerm.load(std::memory_order_relaxed) : ShortTermLufs();
+    double peak = final ? SamplePeakDb() : Decibels(intervalPeak);
+    double oversampled = final ? TruePeakDb() : Decibels(intervalOversampled);
+
+    std::ostringstream text;
+    char audio[32];
+    if (reportFormat == Format::Json) {
+        snprintf(audio, sizeof(audio), "%.3f", seconds);
+        text << "{\"audio_s\":" << audio << ",\"final\":" << (final ? "true" : "false") << ",\""
+             << (final ? "max_momentary_lufs" : "momentary_lufs") << "\":" << JsonValue(momentaryLufs) << ",\""
+             << (final ? "max_short_term_lufs" : "short_term_lufs") << "\":" << JsonValue(shortTermLufs)
+             << ",\"integrated_lufs\":" << JsonValue(IntegratedLufs())
+             << ",\"sample_peak_dbfs\":" << JsonValue(peak) << ",\"true_peak_dbtp\":" << JsonValue(oversampled)
+             << "}\n";
+    } else {
+        snprintf(audio, sizeof(audio), "%.1f", seconds);
+        text << "Loudness" << (final ? ", whole run " : " at ") << audio << " s: " << (final ? "max M " : "M ")
+             << TextValue(momentaryLufs) << (final ? ", max S " : ", S ") << TextValue(shortTermLufs) << ", I "
+             << TextValue(IntegratedLufs()) << " LUFS, peak " << TextValue(peak) << " dBFS, true peak "
+             << TextValue(oversampled) << " dBTP\n";
+    }
+    std::cerr << text.str() << std::flush;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+// Loudness and peak metering of the output stream (--loudness-interval),
+// after ITU-R BS.1770-4 and EBU R128.
+//
+// Process() runs on the capture thread over every converted packet and
+// leaves the audio untouched. Each channel goes through the K-weighting
+// filter (a high-shelf and a high-pass biquad, designed for the stream's
+// rate); its mean square is summed over 100 ms steps, with the surround
+// channels weighted by 1.41 and the LFE left out. Momentary loudness covers
+// the last 400 ms, short-term the last 3 s. Every 400 ms block (overlapping
+// by 75%) also goes into a fixed histogram of 0.1 LU bins, from which the
+// integrated loudness is gated (-70 LUFS absolute, -10 LU relative) at any
+// time without keeping the blocks themselves. The sample peak is the
+// largest sample; the true peak is the largest value of the signal
+// oversampled by a polyphase interpolation filter, 4x below 96 kHz and 2x
+// below 192 kHz.
+//
+// The filters, the peak scan and the interpolation run in SIMD kernels
+// selected at startup like the converter's and mixer's: the K-weighting
+// carries several channels per vector in double precision, the
+// interpolation several consecutive output instants per vector. Every
+// buffer is allocated by Initialize(), so metering never allocates.
+//
+// A reporter thread prints the readings on stderr every interval, as text
+// or JSON lines, and a whole-run summary when it stops; the capture thread
+// publishes them through atomics and never waits for it.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_format.h"
+#include "audio_stages.h"
+
+// Metering kernel table
+struct MeterKernels {
+    const char* name;
+    // K-weight `frames` interleaved frames of `channels` and add each
+    // channel's sum of squares to `sums`. `coefficients` holds the two
+    // biquads as b0, b1, b2, a1, a2; `state` is [4][LoudnessMeter::kMaxChannels]
+    // and `sums` [LoudnessMeter::kMaxChannels], zero past `channels`.
+    void (*Weight)(const float* in, size_t frames, uint32_t channels, const double* coefficients, double* state,
+                   double* sums);
+    // Largest magnitude of `count` samples, at least `peak`
+    float (*Peak)(const float* in, size_t count, float peak);
+    // Largest magnitude of `frames` samples of one channel interpolated by
+    // `factor`, at least `peak`. Row p of `phases` ([factor][taps]), applied
+    // to x[n] .. x[n + 1 - taps], gives the instant p / factor after
+    // x[n + 1 - taps / 2]; x[-1] .. x[1 - taps] must be valid history.
+    float (*TruePeak)(const float* x, size_t frames, const float* phases, uint32_t factor, uint32_t taps,
+                      float peak);
+};
+
+const MeterKernels& GetMeterKernels();
+std::vector<const MeterKernels*> GetAvailableMeterKernels();
+const MeterKernels& GetScalarMeterKernels();
+const MeterKernels* GetSse2MeterKernels();
+const MeterKernels* GetAvx2MeterKernels();
+const MeterKernels* GetNeonMeterKernels();
+
+class LoudnessMeter {
+public:
+    enum class Format { Text, Json };
+
+    static constexpr uint32_t kMaxChannels = 32;
+    // Frames decoded and filtered at a time
+    static constexpr size_t kBlockFrames = 1024;
+    // Interpolation filter length per phase
+    static constexpr uint32_t kTruePeakTaps = 12;
+    // 100 ms steps per momentary / short-term window
+    static constexpr uint32_t kMomentarySteps = 4;
+    static constexpr uint32_t kShortTermSteps = 30;
+    static constexpr double kAbsoluteGateLufs = -70.0;
+    static constexpr double kRelativeGateLu = -10.0;
+    // Integrated loudness histogram: 0.1 LU bins from the absolute gate up
+    static constexpr size_t kHistogramBins = 1000;
+
+    LoudnessMeter() {}
+    ~LoudnessMeter() { Stop(); }
+
+    LoudnessMeter(const LoudnessMeter&) = delete;
+    LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+
+    // Set up for `format` and reset every reading
+    bool Initialize(const AudioFormat& format, const MeterKernels* kernels, std::string* error);
+
+    // Capture thread: meter the next stretch of the stream
+    void Process(const AudioView& view);
+
+    // Report every `interval` from a thread of its own
+    bool Start(std::chrono::milliseconds interval, Format format);
+
+    // Stop the reporter and print the whole-run summary
+    void Stop();
+
+    // Oversampling of the true peak; 1 when it equals the sample peak
+    uint32_t TruePeakFactor() const { return factor; }
+    const char* KernelName() const { return kernels ? kernels->name : "none"; }
+
+    // Readings so far; -infinity until there is enough audio
+    double MomentaryLufs() const { return momentary.load(std::memory_order_relaxed); }
+    double ShortTermLufs() const { return shortTerm.load(std::memory_order_relaxed); }
+    double IntegratedLufs() const;
+    double SamplePeakDb() const;
+    double TruePeakDb() const;
+
+private:
+    const MeterKernels* kernels = nullptr;
+    AudioFormat format;
+    uint32_t channels = 0;
+    double coefficients[10] = {};
+    double gains[kMaxChannels] = {};
+    uint32_t factor = 1;
+    std::vector<float> phases;  // [factor][kTruePeakTaps]
+
+    // Capture thread
+    std::vector<double> state;    // [4][kMaxChannels]
+    std::vector<double> sums;     // [kMaxChannels], this step so far
+    std::vector<float> decoded;   // kBlockFrames interleaved frames
+    std::vector<float> history;   // per channel: kTruePeakTaps - 1 frames of history, then kBlockFrames
+    uint32_t stepFrames = 0;      // frames per 100 ms step
+    uint32_t stepFilled = 0;
+    double steps[kShortTermSteps] = {};  // weighted mean squares of the last steps, a ring
+    uint64_t stepCount = 0;
+    uint64_t quietFrames = 0;     // silent frames since the filters last held audio
+    bool settled = false;         // filters and history cleared after a long silence
+
+    // Written by the capture thread, read by the reporter
+    std::atomic<uint64_t> frames{0};
+    std::atomic<double> momentary{0.0};
+    std::atomic<double> shortTerm{0.0};
+    std::atomic<double> maxMomentary{0.0};
+    std::atomic<double> maxShortTerm{0.0};
+    std::atomic<float> samplePeak{0.0f};
+    std::atomic<float> truePeak{0.0f};
+    std::atomic<float> intervalSamplePeak{0.0f};  // reset by every report
+    std::atomic<float> intervalTruePeak{0.0f};
+    std::atomic<uint32_t> blockCounts[kHistogramBins] = {};
+    std::atomic<double> blockEnergy[kHistogramBins] = {};
+
+    // Reporter
+    std::chrono::milliseconds interval{0};
+    Format reportFormat = Format::Text;
+    std::thread reporter;
+    std::mutex wakeMutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    uint64_t reportedFrames = 0;
+
+    void Meter(const float* samples, size_t count);
+    void EndStep();
+    void Run();
+    void Report(bool final);
+};
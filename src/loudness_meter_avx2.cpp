@@ -0,0 +1,108 @@
+#include "loudness_meter.h"
+#include "simd_arch.h"
+
+// Built with AVX2 code generation enabled (see CMakeLists.txt); only called
+// after CpuSupportsAvx2() confirms the instructions are available.
+
+#if defined(AUDIO_ARCH_X86)
+#include <immintrin.h>
+
+namespace {
+
+// Four channels per vector in double precision; lanes past the last
+// channel are masked off the loads and stay zero
+void WeightAvx2(const float* in, size_t frames, uint32_t channels, const double* k, double* state, double* sums) {
+    const uint32_t stride = LoudnessMeter::kMaxChannels;
+    const __m256d b0 = _mm256_set1_pd(k[0]), b1 = _mm256_set1_pd(k[1]), b2 = _mm256_set1_pd(k[2]);
+    const __m256d a1 = _mm256_set1_pd(k[3]), a2 = _mm256_set1_pd(k[4]);
+    const __m256d c0 = _mm256_set1_pd(k[5]), c1 = _mm256_set1_pd(k[6]), c2 = _mm256_set1_pd(k[7]);
+    const __m256d d1 = _mm256_set1_pd(k[8]), d2 = _mm256_set1_pd(k[9]);
+
+    for (uint32_t c = 0; c < channels; c += 4) {
+        alignas(16) int32_t laneMask[4];
+        for (uint32_t i = 0; i < 4; i++) laneMask[i] = c + i < channels ? -1 : 0;
+        const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(laneMask));
+
+        __m256d z1 = _mm256_loadu_pd(state + c), z2 = _mm256_loadu_pd(state + stride + c);
+        __m256d w1 = _mm256_loadu_pd(state + 2 * stride + c), w2 = _mm256_loadu_pd(state + 3 * stride + c);
+        __m256d sum = _mm256_loadu_pd(sums + c);
+        const float* p = in + c;
+        for (size_t f = 0; f < frames; f++, p += channels) {
+            __m256d x = _mm256_cvtps_pd(_mm_maskload_ps(p, mask));
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(b0, x), z1);
+            z1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, x), _mm256_mul_pd(a1, y)), z2);
+            z2 = _mm256_sub_pd(_mm256_mul_pd(b2, x), _mm256_mul_pd(a2, y));
+            __m256d out = _mm256_add_pd(_mm256_mul_pd(c0, y), w1);
+            w1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(c1, y), _mm256_mul_pd(d1, out)), w2);
+            w2 = _mm256_sub_pd(_mm256_mul_pd(c2, y), _mm256_mul_pd(d2, out));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(out, out));
+        }
+        _mm256_storeu_pd(state + c, z1);
+        _mm256_storeu_pd(state + stride + c, z2);
+        _mm256_storeu_pd(state + 2 * stride + c, w1);
+        _mm256_storeu_pd(state + 3 * stride + c, w2);
+        _mm256_storeu_pd(sums + c, sum);
+    }
+}
+
+float Max(__m256 v) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+float PeakAvx2(const float* in, size_t count, float peak) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 m0 = _mm256_set1_ps(peak);
+    __m256 m1 = m0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        m0 = _mm256_max_ps(m0, _mm256_and_ps(_mm256_loadu_ps(in + i), absMask));
+        m1 = _mm256_max_ps(m1, _mm256_and_ps(_mm256_loadu_ps(in + i + 8), absMask));
+    }
+    peak = Max(_mm256_max_ps(m0, m1));
+    for (; i < count; i++) {
+        float v = in[i] < 0.0f ? -in[i] : in[i];
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+// Eight consecutive instants of one phase per vector, read straight from
+// the channel's history
+float TruePeakAvx2(const float* x, size_t frames, const float* phases, uint32_t factor, uint32_t taps,
+                   float peak) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 max = _mm256_set1_ps(peak);
+    size_t n = 0;
+    for (; n + 8 <= frames; n += 8) {
+        for (uint32_t p = 0; p < factor; p++) {
+            const float* row = phases + p * taps;
+            __m256 acc = _mm256_setzero_ps();
+            for (uint32_t k = 0; k < taps; k++) {
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(row[k]),
+                                                       _mm256_loadu_ps(x + (ptrdiff_t)n - (ptrdiff_t)k)));
+            }
+            max = _mm256_max_ps(max, _mm256_and_ps(acc, absMask));
+        }
+    }
+    peak = Max(max);
+    if (n < frames) peak = GetScalarMeterKernels().TruePeak(x + n, frames - n, phases, factor, taps, peak);
+    return peak;
+}
+
+}  // namespace
+
+const MeterKernels* GetAvx2MeterKernels() {
+    static const MeterKernels kernels = { "avx2", WeightAvx2, PeakAvx2, TruePeakAvx2 };
+    return &kernels;
+}
+
+#else
+
+const MeterKernels* GetAvx2MeterKernels() {
+    return nullptr;
+}
+
+#endif
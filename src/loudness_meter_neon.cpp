@@ -0,0 +1,98 @@
+#include "loudness_meter.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_NEON)
+#include <arm_neon.h>
+
+namespace {
+
+// Two channels per vector in double precision; an odd last channel runs in
+// the low lane with the high lane fed zeros
+template <bool Pair>
+void WeightChannels(const float* p, size_t frames, uint32_t channels, const double* k, double* state,
+                    double* sums) {
+    const uint32_t stride = LoudnessMeter::kMaxChannels;
+    const float64x2_t b0 = vdupq_n_f64(k[0]), b1 = vdupq_n_f64(k[1]), b2 = vdupq_n_f64(k[2]);
+    const float64x2_t a1 = vdupq_n_f64(k[3]), a2 = vdupq_n_f64(k[4]);
+    const float64x2_t c0 = vdupq_n_f64(k[5]), c1 = vdupq_n_f64(k[6]), c2 = vdupq_n_f64(k[7]);
+    const float64x2_t d1 = vdupq_n_f64(k[8]), d2 = vdupq_n_f64(k[9]);
+    float64x2_t z1 = vld1q_f64(state), z2 = vld1q_f64(state + stride);
+    float64x2_t w1 = vld1q_f64(state + 2 * stride), w2 = vld1q_f64(state + 3 * stride);
+    float64x2_t sum = vld1q_f64(sums);
+    const float32x2_t zero = vdup_n_f32(0.0f);
+
+    for (size_t f = 0; f < frames; f++, p += channels) {
+        float64x2_t x = vcvt_f64_f32(Pair ? vld1_f32(p) : vld1_lane_f32(p, zero, 0));
+        float64x2_t y = vfmaq_f64(z1, b0, x);
+        z1 = vfmsq_f64(vfmaq_f64(z2, b1, x), a1, y);
+        z2 = vfmsq_f64(vmulq_f64(b2, x), a2, y);
+        float64x2_t out = vfmaq_f64(w1, c0, y);
+        w1 = vfmsq_f64(vfmaq_f64(w2, c1, y), d1, out);
+        w2 = vfmsq_f64(vmulq_f64(c2, y), d2, out);
+        sum = vfmaq_f64(sum, out, out);
+    }
+
+    vst1q_f64(state, z1);
+    vst1q_f64(state + stride, z2);
+    vst1q_f64(state + 2 * stride, w1);
+    vst1q_f64(state + 3 * stride, w2);
+    vst1q_f64(sums, sum);
+}
+
+void WeightNeon(const float* in, size_t frames, uint32_t channels, const double* k, double* state, double* sums) {
+    uint32_t c = 0;
+    for (; c + 2 <= channels; c += 2) WeightChannels<true>(in + c, frames, channels, k, state + c, sums + c);
+    if (c < channels) WeightChannels<false>(in + c, frames, channels, k, state + c, sums + c);
+}
+
+float PeakNeon(const float* in, size_t count, float peak) {
+    float32x4_t m0 = vdupq_n_f32(peak);
+    float32x4_t m1 = m0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        m0 = vmaxq_f32(m0, vabsq_f32(vld1q_f32(in + i)));
+        m1 = vmaxq_f32(m1, vabsq_f32(vld1q_f32(in + i + 4)));
+    }
+    peak = vmaxvq_f32(vmaxq_f32(m0, m1));
+    for (; i < count; i++) {
+        float v = in[i] < 0.0f ? -in[i] : in[i];
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+// Four consecutive instants of one phase per vector, read straight from
+// the channel's history
+float TruePeakNeon(const float* x, size_t frames, const float* phases, uint32_t factor, uint32_t taps,
+                   float peak) {
+    float32x4_t max = vdupq_n_f32(peak);
+    size_t n = 0;
+    for (; n + 4 <= frames; n += 4) {
+        for (uint32_t p = 0; p < factor; p++) {
+            const float* row = phases + p * taps;
+            float32x4_t acc = vdupq_n_f32(0.0f);
+            for (uint32_t k = 0; k < taps; k++) {
+                acc = vmlaq_n_f32(acc, vld1q_f32(x + (ptrdiff_t)n - (ptrdiff_t)k), row[k]);
+            }
+            max = vmaxq_f32(max, vabsq_f32(acc));
+        }
+    }
+    peak = vmaxvq_f32(max);
+    if (n < frames) peak = GetScalarMeterKernels().TruePeak(x + n, frames - n, phases, factor, taps, peak);
+    return peak;
+}
+
+}  // namespace
+
+const MeterKernels* GetNeonMeterKernels() {
+    static const MeterKernels kernels = { "neon", WeightNeon, PeakNeon, TruePeakNeon };
+    return &kernels;
+}
+
+#else
+
+const MeterKernels* GetNeonMeterKernels() {
+    return nullptr;
+}
+
+#endif
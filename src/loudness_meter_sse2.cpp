@@ -0,0 +1,106 @@
+#include "loudness_meter.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_X86)
+#include <emmintrin.h>
+
+namespace {
+
+// Two channels per vector in double precision; an odd last channel runs in
+// the low lane with the high lane fed zeros
+template <bool Pair>
+void WeightChannels(const float* p, size_t frames, uint32_t channels, const double* k, double* state,
+                    double* sums) {
+    const uint32_t stride = LoudnessMeter::kMaxChannels;
+    const __m128d b0 = _mm_set1_pd(k[0]), b1 = _mm_set1_pd(k[1]), b2 = _mm_set1_pd(k[2]);
+    const __m128d a1 = _mm_set1_pd(k[3]), a2 = _mm_set1_pd(k[4]);
+    const __m128d c0 = _mm_set1_pd(k[5]), c1 = _mm_set1_pd(k[6]), c2 = _mm_set1_pd(k[7]);
+    const __m128d d1 = _mm_set1_pd(k[8]), d2 = _mm_set1_pd(k[9]);
+    __m128d z1 = _mm_loadu_pd(state), z2 = _mm_loadu_pd(state + stride);
+    __m128d w1 = _mm_loadu_pd(state + 2 * stride), w2 = _mm_loadu_pd(state + 3 * stride);
+    __m128d sum = _mm_loadu_pd(sums);
+
+    for (size_t f = 0; f < frames; f++, p += channels) {
+        __m128 in = Pair ? _mm_castpd_ps(_mm_load_sd((const double*)p)) : _mm_load_ss(p);
+        __m128d x = _mm_cvtps_pd(in);
+        __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+        z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+        z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+        __m128d out = _mm_add_pd(_mm_mul_pd(c0, y), w1);
+        w1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(c1, y), _mm_mul_pd(d1, out)), w2);
+        w2 = _mm_sub_pd(_mm_mul_pd(c2, y), _mm_mul_pd(d2, out));
+        sum = _mm_add_pd(sum, _mm_mul_pd(out, out));
+    }
+
+    _mm_storeu_pd(state, z1);
+    _mm_storeu_pd(state + stride, z2);
+    _mm_storeu_pd(state + 2 * stride, w1);
+    _mm_storeu_pd(state + 3 * stride, w2);
+    _mm_storeu_pd(sums, sum);
+}
+
+void WeightSse2(const float* in, size_t frames, uint32_t channels, const double* k, double* state, double* sums) {
+    uint32_t c = 0;
+    for (; c + 2 <= channels; c += 2) WeightChannels<true>(in + c, frames, channels, k, state + c, sums + c);
+    if (c < channels) WeightChannels<false>(in + c, frames, channels, k, state + c, sums + c);
+}
+
+float Max(__m128 v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+float PeakSse2(const float* in, size_t count, float peak) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 m0 = _mm_set1_ps(peak);
+    __m128 m1 = m0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        m0 = _mm_max_ps(m0, _mm_and_ps(_mm_loadu_ps(in + i), absMask));
+        m1 = _mm_max_ps(m1, _mm_and_ps(_mm_loadu_ps(in + i + 4), absMask));
+    }
+    peak = Max(_mm_max_ps(m0, m1));
+    for (; i < count; i++) {
+        float v = in[i] < 0.0f ? -in[i] : in[i];
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+// Four consecutive instants of one phase per vector, read straight from
+// the channel's history
+float TruePeakSse2(const float* x, size_t frames, const float* phases, uint32_t factor, uint32_t taps,
+                   float peak) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 max = _mm_set1_ps(peak);
+    size_t n = 0;
+    for (; n + 4 <= frames; n += 4) {
+        for (uint32_t p = 0; p < factor; p++) {
+            const float* row = phases + p * taps;
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = 0; k < taps; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(row[k]), _mm_loadu_ps(x + (ptrdiff_t)n - (ptrdiff_t)k)));
+            }
+            max = _mm_max_ps(max, _mm_and_ps(acc, absMask));
+        }
+    }
+    peak = Max(max);
+    if (n < frames) peak = GetScalarMeterKernels().TruePeak(x + n, frames - n, phases, factor, taps, peak);
+    return peak;
+}
+
+}  // namespace
+
+const MeterKernels* GetSse2MeterKernels() {
+    static const MeterKernels kernels = { "sse2", WeightSse2, PeakSse2, TruePeakSse2 };
+    return &kernels;
+}
+
+#else
+
+const MeterKernels* GetSse2MeterKernels() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include "metrics_exporter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "socket_platform.h"
+
+using namespace net;
+
+namespace {
+
+// Send all of `data` on a non-blocking socket, giving up at `deadline`
+bool SendAll(Socket s, const std::string& data, std::chrono::steady_clock::time_point deadline) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int count = (int)send(s, data.data() + sent, (int)(data.size() - sent), MSG_NOSIGNAL);
+        if (count > 0) {
+            sent += (size_t)count;
+            continue;
+        }
+        if (count < 0 && !WouldBlock()) return false;
+        int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       deadline - std::chrono::steady_clock::now())
+                       .count();
+        if (left <= 0) return false;
+        PollFd fd = {};
+        fd.fd = s;
+        fd.events = POLLOUT;
+        PollSockets(&fd, 1, left);
+    }
+    return true;
+}
+
+}  // namespace
+
+void MetricsText::Family(const char* name, const char* type, const char* help) {
+    text += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+void MetricsText::Sample(const char* name, uint64_t value, const std::string& labels) {
+    Line(name, labels, std::to_string(value).c_str());
+}
+
+void MetricsText::Sample(const char* name, double value, const std::string& labels) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.15g", value);
+    Line(name, labels, number);
+}
+
+std::string MetricsText::Label(const char* key, const std::string& value) {
+    std::string label = std::string(key) + "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            label += '\\';
+            label += c;
+        } else if (c == '\n') {
+            label += "\\n";
+        } else {
+            label += c;
+        }
+    }
+    return label + "\"";
+}
+
+void MetricsText::Line(const char* name, const std::string& labels, const char* value) {
+    text += name;
+    if (!labels.empty()) text += "{" + labels + "}";
+    text += " ";
+    text += value;
+    text += "\n";
+}
+
+bool MetricsExporter::Start(const std::string& path, const std::string& listenAddress, RenderFunction function,
+                            std::string* error) {
+    if (worker.joinable() || !function) return false;
+    filePath = path;
+    render = std::move(function);
+    fileErrorReported = false;
+
+    if (!listenAddress.empty()) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            if (error) *error = "Failed to initialize Winsock";
+            return false;
+        }
+        socketsStarted = true;
+#endif
+        std::string host, port, reason;
+        if (!ParseTcpAddress(listenAddress, host, port)) {
+            if (error) *error = "Invalid metrics address '" + listenAddress + "'; expected [host:]port";
+            CloseListener();
+            return false;
+        }
+        Socket s = BindTcp(host, port, reason);
+        if (s != (Socket)-1) listenSocket = (intptr_t)s;
+        if (listenSocket == -1 || listen(s, 8) != 0 || !SetNonBlocking(s)) {
+            if (reason.empty()) reason = LastSocketError();
+            if (error) *error = "Failed to listen for metrics on " + listenAddress + ": " + reason;
+            CloseListener();
+            return false;
+        }
+        std::cerr << "Serving metrics on http://" << LocalAddress(s) << "/metrics" << std::endl;
+    }
+    if (!filePath.empty()) {
+        std::cerr << "Writing metrics to " << filePath << " every " << kFileIntervalMs << " ms" << std::endl;
+        WriteFile();
+    }
+
+    stopping = false;
+    worker = std::thread(&MetricsExporter::Run, this);
+    return true;
+}
+
+void MetricsExporter::Stop() {
+    if (!worker.joinable()) return;
+    stopping = true;
+    worker.join();
+    CloseListener();
+    if (!filePath.empty()) WriteFile();
+}
+
+void MetricsExporter::CloseListener() {
+    if (listenSocket != -1) {
+        CloseSocket(ToSocket(listenSocket));
+        listenSocket = -1;
+    }
+#ifdef _WIN32
+    if (socketsStarted) WSACleanup();
+#endif
+    socketsStarted = false;
+}
+
+void MetricsExporter::Run() {
+    auto nextFileWrite = std::chrono::steady_clock::now() + std::chrono::milliseconds(kFileIntervalMs);
+    while (!stopping) {
+        if (listenSocket != -1) {
+            PollFd fd = {};
+            fd.fd = ToSocket(listenSocket);
+            fd.events = POLLIN;
+            if (PollSockets(&fd, 1, kPollMs) > 0) {
+                Socket client = accept(ToSocket(listenSocket), nullptr, nullptr);
+                if (client != (Socket)-1) {
+                    ServeRequest((intptr_t)client);
+                    CloseSocket(client);
+                }
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollMs));
+        }
+
+        if (!filePath.empty() && std::chrono::steady_clock::now() >= nextFileWrite) {
+            WriteFile();
+            nextFileWrite += std::chrono::milliseconds(kFileIntervalMs);
+        }
+    }
+}
+
+// One request per connection; scrapers are local and infrequent, so they
+// are served one at a time
+void MetricsExporter::ServeRequest(intptr_t handle) {
+    Socket client = ToSocket(handle);
+    if (!SetNonBlocking(client)) return;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kRequestTimeoutMs);
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        int count = (int)recv(client, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            request.append(buffer, (size_t)count);
+            continue;
+        }
+        if (count == 0 || !WouldBlock()) return;
+        int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       deadline - std::chrono::steady_clock::now())
+                       .count();
+        if (left <= 0) return;
+        PollFd fd = {};
+        fd.fd = client;
+        fd.events = POLLIN;
+        PollSockets(&fd, 1, left);
+    }
+
+    std::string line = request.substr(0, request.find("\r\n"));
+    std::string status = "200 OK";
+    std::string body;
+    if (line.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else if (line.compare(4, 9, "/metrics ") != 0 && line.compare(4, 2, "/ ") != 0) {
+        status = "404 Not Found";
+    } else {
+        body = render();
+    }
+    std::string response = "HTTP/1.1 " + status +
+                           "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    SendAll(client, response, deadline);
+}
+
+void MetricsExporter::WriteFile() {
+    std::string text = render();
+    std::string temporary = filePath + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    bool ok = file && fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (file && fclose(file) != 0) ok = false;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temporary.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && std::rename(temporary.c_str(), filePath.c_str()) == 0;
+#endif
+    if (!ok && !fileErrorReported) {
+        std::cerr << "Warning: Cannot write metrics file " << filePath << std::endl;
+        fileErrorReported = true;
+    }
+}
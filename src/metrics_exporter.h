@@ -0,0 +1,76 @@
+#pragma once
+
+// Publishes capture metrics in the Prometheus text format.
+//
+// The exporter thread asks its render function for a fresh snapshot and
+// either rewrites a file with it every second (written to a temporary file
+// and renamed over the old one, so a collector such as node_exporter's
+// textfile collector never reads half a file) or serves it on a local HTTP
+// port at /metrics, or both. The render function runs on the exporter
+// thread and must only read state that is safe to read concurrently.
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Builds a Prometheus text exposition
+class MetricsText {
+public:
+    // Start a metric family; its samples follow
+    void Family(const char* name, const char* type, const char* help);
+
+    void Sample(const char* name, uint64_t value, const std::string& labels = std::string());
+    void Sample(const char* name, double value, const std::string& labels = std::string());
+
+    // `key="value"` with the value escaped; join several with ','
+    static std::string Label(const char* key, const std::string& value);
+
+    const std::string& Text() const { return text; }
+
+private:
+    std::string text;
+
+    void Line(const char* name, const std::string& labels, const char* value);
+};
+
+class MetricsExporter {
+public:
+    using RenderFunction = std::function<std::string()>;
+
+    static constexpr int kFileIntervalMs = 1000;
+
+    MetricsExporter() {}
+    ~MetricsExporter() { Stop(); }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // `filePath` and `listenAddress` ("[host:]port", host defaults to
+    // 127.0.0.1) may each be empty
+    bool Start(const std::string& filePath, const std::string& listenAddress, RenderFunction render,
+               std::string* error);
+
+    // Stop serving and write the file one last time
+    void Stop();
+
+private:
+    // How long a scrape may take to send its request
+    static constexpr int kRequestTimeoutMs = 1000;
+    static constexpr int kPollMs = 200;
+
+    std::string filePath;
+    RenderFunction render;
+    bool socketsStarted = false;
+    intptr_t listenSocket = -1;
+    bool fileErrorReported = false;
+
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+
+    void Run();
+    void WriteFile();
+    void ServeRequest(intptr_t client);
+    void CloseListener();
+};
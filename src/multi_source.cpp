@@ -0,0 +1,443 @@
+#include "multi_source.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "allocation_counter.h"
+#include "stream_records.h"
+
+namespace {
+
+// Weight of each packet's timing error in the smoothed offset
+const double kOffsetSmoothing = 0.05;
+
+}  // namespace
+
+MultiSource::~MultiSource() {
+    Stop();
+}
+
+void MultiSource::AddSource(std::unique_ptr<CaptureSource> source) {
+    auto input = std::make_unique<Input>();
+    input->source = std::move(source);
+    inputs.push_back(std::move(input));
+}
+
+bool MultiSource::Initialize(const Config& newConfig, std::string* error) {
+    if (inputs.empty() || inputs.size() > kMaxSources) {
+        if (error) *error = "between 1 and " + std::to_string(kMaxSources) + " sources are supported";
+        return false;
+    }
+    config = newConfig;
+
+    const AudioFormat& first = inputs[0]->source->Format();
+    realtime = inputs[0]->source->IsRealtime();
+    uint32_t totalChannels = 0;
+    for (const auto& input : inputs) {
+        if (input->source->IsRealtime() != realtime) {
+            if (error) *error = "real-time and non-real-time sources cannot be combined";
+            return false;
+        }
+        totalChannels += input->source->Format().channels;
+    }
+
+    format = AudioFormat();
+    format.sampleRate = config.sampleRate > 0 ? config.sampleRate : first.sampleRate;
+    format.type = SampleType::Float32;
+    if (config.layout == Layout::Mix) {
+        format.channels = first.channels;
+        format.channelMask = first.channelMask;
+    } else {
+        format.channels = totalChannels;
+        format.channelMask = 0;
+    }
+    if (format.channels > PolyphaseResampler::kMaxChannels) {
+        if (error) {
+            *error = "the sources have " + std::to_string(format.channels) + " channels together, at most " +
+                     std::to_string(PolyphaseResampler::kMaxChannels) + " are supported";
+        }
+        return false;
+    }
+
+    packetFrames = std::max<uint32_t>(1, format.sampleRate * config.packetMs / 1000);
+    ringFrames = (int64_t)format.sampleRate * (config.maxWaitMs + kRingSlackMs) / 1000 + packetFrames;
+
+    StageChain::Options options;
+    options.quality = config.quality;
+    options.variableRate = true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Input& input = *inputs[i];
+        const AudioFormat& sourceFormat = input.source->Format();
+        AudioFormat target = format;
+        if (config.layout == Layout::Separate) {
+            target.channels = sourceFormat.channels;
+            target.channelMask = sourceFormat.channelMask;
+        }
+        std::string stageError;
+        if (!input.chain.Build(sourceFormat, target, options, &stageError)) {
+            if (error) *error = "source " + std::to_string(i + 1) + ": " + stageError;
+            return false;
+        }
+        input.chain.Reserve(input.source->BufferFrames());
+        input.channels = target.channels;
+        input.outputPerInput = (double)format.sampleRate / sourceFormat.sampleRate;
+        // A whole source burst must fit on top of the wait budget
+        int64_t burst = (int64_t)std::ceil(input.source->BufferFrames() * input.outputPerInput);
+        ringFrames = std::max(ringFrames, (int64_t)format.sampleRate * config.maxWaitMs / 1000 + burst * 2);
+    }
+    for (auto& input : inputs) {
+        input->ring.assign((size_t)ringFrames * input->channels, 0.0f);
+    }
+    packetBuffer.assign((size_t)packetFrames * format.channels, 0.0f);
+    return true;
+}
+
+bool MultiSource::Start(std::string* error) {
+    if (packetFrames == 0) {
+        if (error) *error = "multi-source is not initialized";
+        return false;
+    }
+    stopping = false;
+    originSet = false;
+    readFrame = 0;
+    deliveredSinceWait = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Input& input = *inputs[i];
+        const AudioFormat& sourceFormat = input.source->Format();
+        input.drift.Reset(sourceFormat.sampleRate, records::kTimestampFrequency);
+        input.placed = false;
+        input.streamPosition = 0.0;
+        input.smoothedOffset = 0.0;
+        input.nextDevicePosition = 0;
+        std::fill(input.ring.begin(), input.ring.end(), 0.0f);
+        input.writeFrame = 0;
+        input.audibleEnd = 0;
+        input.started = false;
+        input.ended = false;
+        input.startOffsetMs = 0.0;
+        input.driftPpm = 0.0;
+        input.resyncs = 0;
+        input.lateFrames = 0;
+        input.missingFrames = 0;
+
+        std::string sourceError;
+        if (!input.source->Start(&sourceError)) {
+            if (error) *error = "source " + std::to_string(i + 1) + " (" + input.source->Name() + "): " + sourceError;
+            for (size_t j = 0; j < i; j++) inputs[j]->source->Stop();
+            return false;
+        }
+    }
+    for (auto& input : inputs) {
+        Input* target = input.get();
+        input->thread = std::thread([this, target] { RunInput(*target); });
+    }
+    return true;
+}
+
+void MultiSource::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    dataReady.notify_all();
+    spaceReady.notify_all();
+    for (auto& input : inputs) {
+        if (!input->thread.joinable()) continue;
+        input->thread.join();
+        input->source->Stop();
+    }
+}
+
+void MultiSource::RunInput(Input& input) {
+    CaptureSource& source = *input.source;
+    RealtimeThread scheduling;
+    if (config.lowLatency) {
+        std::string error;
+        if (!scheduling.Enter(RealtimeThread::Role::Capture, &error)) {
+            std::cerr << "Warning: " << source.Name() << " thread stays at normal priority: " << error << std::endl;
+        }
+    }
+    // Allocation check, as in CapturePipeline
+    const uint64_t warmupFrames = (uint64_t)(source.Format().sampleRate * kWarmupSeconds);
+    uint64_t frames = 0;
+    bool steady = false;
+    uint64_t steadyBase = 0;
+    uint64_t allocations = 0;  // up to the last packet; the final flush does not count
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) break;
+        }
+        WaitResult result = source.Wait(kInputWaitMs);
+        if (result == WaitResult::Timeout) continue;
+        if (result == WaitResult::EndOfStream) {
+            // Let the resampler ring out so the input ends where its audio does
+            input.chain.Flush([&](const AudioView& view) { WriteFrames(input, view); });
+            break;
+        }
+        if (result == WaitResult::Failed) {
+            std::cerr << "Warning: " << source.Name() << " source failed, continuing without it" << std::endl;
+            break;
+        }
+
+        CapturePacket packet;
+        while (source.NextPacket(packet)) {
+            PlacePacket(input, packet);
+            source.ReleasePacket();
+            frames += packet.frames;
+        }
+        if (steady) {
+            allocations = ThreadHeapAllocations() - steadyBase;
+        } else if (AllocationCountingEnabled() && frames >= warmupFrames) {
+            steady = true;
+            steadyBase = ThreadHeapAllocations();
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        input.ended = true;
+        input.steadyAllocations = allocations;
+    }
+    dataReady.notify_all();
+}
+
+void MultiSource::PlacePacket(Input& input, const CapturePacket& packet) {
+    const double rate = format.sampleRate;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!originSet) {
+            originSet = true;
+            originTimestamp = packet.timestamp;
+            // The packet's first frame was captured one packet length ago
+            std::chrono::duration<double> length((double)packet.frames / input.source->Format().sampleRate);
+            originTime = Clock::now() - std::chrono::duration_cast<Clock::duration>(length);
+        }
+    }
+
+    // Where the timestamps put this packet on the timeline
+    double expected = (double)(int64_t)(packet.timestamp - originTimestamp) * rate / records::kTimestampFrequency;
+    bool reliable = !(packet.flags & records::kFlagTimestampError);
+    bool resync = !input.placed;
+    if (input.placed) {
+        bool gap = packet.devicePosition != input.nextDevicePosition ||
+                   (packet.flags & records::kFlagDiscontinuity);
+        double offset = expected - input.streamPosition;
+        if (gap || (reliable && std::fabs(offset) > kResyncMs * rate / 1000.0)) {
+            resync = true;
+        } else if (reliable) {
+            input.smoothedOffset += (offset - input.smoothedOffset) * kOffsetSmoothing;
+        }
+    }
+    input.nextDevicePosition = packet.devicePosition + packet.frames;
+
+    if (resync) {
+        if (input.placed) {
+            // The audio before the gap rings out where it was, then the
+            // input starts over where its timestamps say
+            input.chain.Flush([&](const AudioView& view) { WriteFrames(input, view); });
+        }
+        input.streamPosition = expected;
+        input.smoothedOffset = 0.0;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (input.placed) {
+            input.resyncs++;
+        } else {
+            input.startOffsetMs = expected * 1000.0 / rate;
+            input.started = true;
+        }
+        input.writeFrame = std::llround(expected);
+        input.placed = true;
+    }
+
+    // Follow the device clock, and pull any remaining offset in slowly
+    input.drift.Update(packet.devicePosition, packet.timestamp, packet.frames, reliable);
+    double steer = input.smoothedOffset / (rate * kSettleSeconds);
+    steer = std::min(std::max(steer, -kMaxSteerPpm * 1e-6), kMaxSteerPpm * 1e-6);
+    double scale = input.drift.RateScale() * (1.0 + steer);
+    input.chain.AdjustRate(scale);
+
+    AudioView view;
+    view.frames = packet.frames;
+    if (!(packet.flags & records::kFlagSilent)) view.data = packet.data;
+    WriteFrames(input, input.chain.Process(view));
+    input.streamPosition += packet.frames * input.outputPerInput * scale;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    input.driftPpm = input.drift.DriftPpm();
+}
+
+void MultiSource::WriteFrames(Input& input, const AudioView& view) {
+    const uint32_t channels = input.channels;
+    const float* samples = reinterpret_cast<const float*>(view.data);
+    size_t done = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (done < view.frames) {
+        size_t remaining = view.frames - done;
+        // Frames whose span has already been handed out are lost
+        if (input.writeFrame < readFrame) {
+            size_t late = (size_t)std::min<int64_t>(readFrame - input.writeFrame, (int64_t)remaining);
+            input.lateFrames += late;
+            input.writeFrame += late;
+            done += late;
+            continue;
+        }
+        // The ring holds [readFrame, readFrame + ringFrames)
+        if (input.writeFrame >= readFrame + ringFrames) {
+            spaceReady.wait(lock, [&] { return stopping || input.writeFrame < readFrame + ringFrames; });
+            if (stopping) return;
+            continue;
+        }
+
+        size_t room = (size_t)(readFrame + ringFrames - input.writeFrame);
+        size_t slot = (size_t)(input.writeFrame % ringFrames);
+        size_t chunk = std::min({remaining, room, (size_t)ringFrames - slot});
+        float* target = &input.ring[slot * channels];
+        if (samples) {
+            memcpy(target, samples + done * channels, chunk * channels * sizeof(float));
+            input.audibleEnd = std::max(input.audibleEnd, input.writeFrame + (int64_t)chunk);
+        } else {
+            memset(target, 0, chunk * channels * sizeof(float));
+        }
+        input.writeFrame += chunk;
+        done += chunk;
+        dataReady.notify_all();
+    }
+}
+
+bool MultiSource::SpanReady(int64_t end) const {
+    if (!originSet) return false;
+    for (const auto& input : inputs) {
+        if (!input->ended && input->writeFrame < end) return false;
+    }
+    return true;
+}
+
+bool MultiSource::Drained() const {
+    for (const auto& input : inputs) {
+        if (!input->ended || input->writeFrame > readFrame) return false;
+    }
+    return true;
+}
+
+MultiSource::Clock::time_point MultiSource::SpanDeadline(int64_t end) const {
+    std::chrono::duration<double> due((double)end / format.sampleRate + config.maxWaitMs / 1000.0);
+    return originTime + std::chrono::duration_cast<Clock::duration>(due);
+}
+
+CaptureSource::WaitResult MultiSource::Wait(uint32_t timeoutMs) {
+    deliveredSinceWait = 0;
+    Clock::time_point limit = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        if (Drained()) return WaitResult::EndOfStream;
+        int64_t end = readFrame + packetFrames;
+        if (SpanReady(end)) return WaitResult::Ready;
+
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = limit;
+        if (realtime && originSet) {
+            // A late input is not waited for beyond the budget
+            Clock::time_point deadline = SpanDeadline(end);
+            if (now >= deadline) return WaitResult::Ready;
+            wake = std::min(wake, deadline);
+        }
+        if (now >= limit) return WaitResult::Timeout;
+        dataReady.wait_until(lock, wake);
+    }
+}
+
+bool MultiSource::NextPacket(CapturePacket& packet) {
+    if (deliveredSinceWait >= kMaxPacketsPerWait) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!originSet) return false;
+
+    int64_t end = readFrame + packetFrames;
+    bool allEnded = true;
+    int64_t lastFrame = readFrame;
+    for (const auto& input : inputs) {
+        allEnded = allEnded && input->ended;
+        lastFrame = std::max(lastFrame, input->writeFrame);
+    }
+    if (allEnded) {
+        // The last packet stops where the longest input does
+        if (lastFrame <= readFrame) return false;
+        end = std::min(end, lastFrame);
+    } else if (!SpanReady(end) && !(realtime && Clock::now() >= SpanDeadline(end))) {
+        return false;
+    }
+    const size_t frames = (size_t)(end - readFrame);
+    const size_t slot = (size_t)(readFrame % ringFrames);
+    const size_t firstPart = std::min(frames, (size_t)ringFrames - slot);
+
+    uint32_t flags = 0;
+    bool audible = false;
+    std::fill(packetBuffer.begin(), packetBuffer.begin() + frames * format.channels, 0.0f);
+    uint32_t firstChannel = 0;
+    for (auto& inputPointer : inputs) {
+        Input& input = *inputPointer;
+        const uint32_t channels = input.channels;
+        if (input.started && !input.ended && input.writeFrame < end) {
+            // Late beyond the budget: this span goes out without it
+            input.missingFrames += (uint64_t)(end - std::max(input.writeFrame, readFrame));
+            flags |= records::kFlagDiscontinuity;
+        }
+        if (input.audibleEnd > readFrame) {
+            audible = true;
+            for (size_t i = 0; i < frames; i++) {
+                size_t index = i < firstPart ? slot + i : i - firstPart;
+                const float* in = &input.ring[index * channels];
+                float* out = &packetBuffer[i * format.channels];
+                if (config.layout == Layout::Mix) {
+                    for (uint32_t c = 0; c < channels; c++) out[c] += in[c];
+                } else {
+                    memcpy(out + firstChannel, in, channels * sizeof(float));
+                }
+            }
+        }
+        // Frames that were never written must read as silence next time round
+        std::fill(input.ring.begin() + slot * channels, input.ring.begin() + (slot + firstPart) * channels, 0.0f);
+        std::fill(input.ring.begin(), input.ring.begin() + (frames - firstPart) * channels, 0.0f);
+        firstChannel += channels;
+    }
+
+    packet = CapturePacket();
+    packet.data = audible ? reinterpret_cast<const uint8_t*>(packetBuffer.data()) : nullptr;
+    packet.frames = (uint32_t)frames;
+    packet.flags = flags | (audible ? 0 : records::kFlagSilent);
+    packet.devicePosition = (uint64_t)readFrame;
+    packet.timestamp = originTimestamp +
+                       (uint64_t)std::llround((double)readFrame * records::kTimestampFrequency / format.sampleRate);
+    readFrame = end;
+    deliveredSinceWait++;
+    spaceReady.notify_all();
+    return true;
+}
+
+void MultiSource::PrintSummary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const double msPerFrame = 1000.0 / format.sampleRate;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const Input& input = *inputs[i];
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "Source %zu (%s): placed at %+.1f ms, clock %+.2f ppm, %llu resyncs, %.0f ms late, %.0f ms missing",
+                 i + 1, input.source->Name(), input.startOffsetMs, input.driftPpm,
+                 (unsigned long long)input.resyncs, input.lateFrames * msPerFrame, input.missingFrames * msPerFrame);
+        std::cerr << line;
+        if (AllocationCountingEnabled()) {
+            std::cerr << ", " << input.steadyAllocations << " allocations after warm-up";
+        }
+        std::cerr << std::endl;
+    }
+}
+
+uint64_t MultiSource::SteadyStateAllocations() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t total = 0;
+    for (const auto& input : inputs) total += input->steadyAllocations;
+    return total;
+}
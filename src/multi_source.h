@@ -0,0 +1,161 @@
+#pragma once
+
+// Capture source that combines several sources into one aligned stream.
+//
+// Each input runs on its own thread: it waits on its source, converts every
+// packet to float at the common rate and writes it into a per-input ring
+// indexed by a shared timeline. Timeline frame 0 is the timestamp of the
+// first packet any input delivers, so each input lands where its QPC
+// timestamps say it belongs, whatever order the devices were opened in.
+// A drift estimator per input steers its resampler (see clock_drift.h) so
+// devices on independent clocks stay in step; a residual offset is pulled in
+// over a few seconds, and a gap or an offset beyond kResyncMs places the
+// input afresh.
+//
+// The consumer side hands out fixed-size packets of the timeline, either
+// with the inputs summed (Layout::Mix, in the first input's channel layout)
+// or side by side as separate channels (Layout::Separate). A span is
+// released once every input has covered it. In real time an input that is
+// late by more than Config::maxWaitMs is filled with silence for that span
+// so one stalled device cannot hold up the others; non-real-time inputs
+// are simply waited for, and the fastest one blocks when its ring is full.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_stages.h"
+#include "capture_source.h"
+#include "clock_drift.h"
+#include "polyphase_resampler.h"
+#include "realtime_thread.h"
+
+class MultiSource : public CaptureSource {
+public:
+    static constexpr size_t kMaxSources = 8;
+
+    enum class Layout {
+        Mix,       // sum every input into the first input's channel layout
+        Separate   // input channels side by side, in the order the sources were added
+    };
+
+    struct Config {
+        Layout layout = Layout::Separate;
+        uint32_t sampleRate = 0;        // common rate; 0 takes the first input's
+        uint32_t packetMs = 10;         // size of the packets handed out
+        uint32_t maxWaitMs = 100;       // real time: how long a late input holds up the stream
+        PolyphaseResampler::Quality quality = PolyphaseResampler::Quality::High;
+        bool lowLatency = false;        // input threads get real-time priority (realtime_thread.h)
+    };
+
+    MultiSource() {}
+    ~MultiSource();
+
+    MultiSource(const MultiSource&) = delete;
+    MultiSource& operator=(const MultiSource&) = delete;
+
+    // Take ownership of an initialized source; call before Initialize()
+    void AddSource(std::unique_ptr<CaptureSource> source);
+
+    // Choose the combined format and build each input's conversion
+    bool Initialize(const Config& config, std::string* error);
+
+    const char* Name() const override { return "multi-source"; }
+    const AudioFormat& Format() const override { return format; }
+    uint32_t BufferFrames() const override { return packetFrames * kMaxPacketsPerWait; }
+    bool IsRealtime() const override { return realtime; }
+
+    bool Start(std::string* error) override;
+    void Stop() override;
+    WaitResult Wait(uint32_t timeoutMs) override;
+    bool NextPacket(CapturePacket& packet) override;
+    void ReleasePacket() override {}
+
+    size_t SourceCount() const { return inputs.size(); }
+
+    // One line per input: placement, drift, resyncs and lost audio
+    void PrintSummary() const;
+
+    // After Stop(), in builds that count allocations: heap allocations on
+    // the input threads after warm-up (allocation_counter.h)
+    uint64_t SteadyStateAllocations() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Packets handed out per Wait(), so the pipeline keeps checking its outputs
+    static constexpr uint32_t kMaxPacketsPerWait = 16;
+    // An input further than this from where its timestamps put it is placed
+    // afresh instead of being steered back
+    static constexpr double kResyncMs = 20.0;
+    // Time constant for pulling a smaller offset in through the resampler,
+    // and the largest rate change that may be used for it
+    static constexpr double kSettleSeconds = 5.0;
+    static constexpr double kMaxSteerPpm = 200.0;
+    // Ring length beyond the wait budget, for bursts from the sources
+    static constexpr uint32_t kRingSlackMs = 1000;
+    // How long an input thread blocks in its source's Wait()
+    static constexpr uint32_t kInputWaitMs = 100;
+    // Source audio after which an input thread must not allocate
+    static constexpr double kWarmupSeconds = 2.0;
+
+    struct Input {
+        std::unique_ptr<CaptureSource> source;
+        StageChain chain;
+        ClockDriftEstimator drift;
+        uint32_t channels = 0;          // after conversion
+        double outputPerInput = 1.0;    // common rate over source rate
+        std::thread thread;
+
+        // Input thread only
+        bool placed = false;
+        double streamPosition = 0.0;    // timeline frame the next source frame lands on
+        double smoothedOffset = 0.0;    // frames, timestamps minus streamPosition
+        uint64_t nextDevicePosition = 0;
+
+        // Guarded by MultiSource::mutex
+        std::vector<float> ring;        // ringFrames frames, indexed by timeline frame
+        int64_t writeFrame = 0;         // next timeline frame this input writes
+        int64_t audibleEnd = 0;         // end of the last audio that was not silence
+        bool started = false;           // has delivered audio; silence before that is not a loss
+        bool ended = false;
+        double startOffsetMs = 0.0;     // where it was first placed
+        double driftPpm = 0.0;
+        uint64_t resyncs = 0;
+        uint64_t lateFrames = 0;        // arrived after their span was handed out
+        uint64_t missingFrames = 0;     // handed out as silence because the input was late
+        uint64_t steadyAllocations = 0; // after warm-up, when allocations are counted
+    };
+
+    std::vector<std::unique_ptr<Input>> inputs;
+    Config config;
+    AudioFormat format;
+    bool realtime = true;
+    uint32_t packetFrames = 0;
+    int64_t ringFrames = 0;
+
+    mutable std::mutex mutex;
+    std::condition_variable dataReady;   // consumer waits for inputs
+    std::condition_variable spaceReady;  // inputs wait for the consumer
+    bool stopping = false;
+    bool originSet = false;
+    uint64_t originTimestamp = 0;        // timestamp of timeline frame 0
+    Clock::time_point originTime;        // when timeline frame 0 was captured
+    int64_t readFrame = 0;               // first timeline frame not yet handed out
+
+    // Consumer side
+    std::vector<float> packetBuffer;
+    uint32_t deliveredSinceWait = 0;
+
+    void RunInput(Input& input);
+    void PlacePacket(Input& input, const CapturePacket& packet);
+    void WriteFrames(Input& input, const AudioView& view);
+    bool SpanReady(int64_t end) const;
+    bool Drained() const;
+    Clock::time_point SpanDeadline(int64_t end) const;
+};
@@ -0,0 +1,165 @@
+#include "output_sink.h"
+
+#include <cstring>
+#include <iostream>
+
+bool StdoutSink::Open(const AudioFormat&, std::string* error) {
+    // Write straight to the OS handle; std::cout would add a copy and a
+    // flush per packet
+    if (!output.OpenStdout()) {
+        if (error) *error = "Failed to open stdout handle for writing";
+        return false;
+    }
+    return true;
+}
+
+bool StdoutSink::Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) {
+    return output.WriteVectored(first, firstSize, second, secondSize);
+}
+
+void StdoutSink::Close() {
+    std::cerr << "stdout: " << output.BytesWritten() << " bytes in " << output.WriteCalls() << " write calls"
+              << std::endl;
+}
+
+bool WavSink::Open(const AudioFormat& format, std::string* error) {
+    WavFormat wavFormat;
+    wavFormat.sampleRate = format.sampleRate;
+    wavFormat.channels = (uint16_t)format.channels;
+    wavFormat.bitsPerSample = (uint16_t)format.BitsPerSample();
+    wavFormat.blockAlign = (uint16_t)format.BlockAlign();
+    wavFormat.isFloat = format.type == SampleType::Float32;
+    wavFormat.channelMask = format.channelMask;
+
+    std::string reason;
+    if (!file.Open(path, wavFormat, &reason)) {
+        if (error) *error = "Failed to open output file: " + reason;
+        return false;
+    }
+    std::cerr << "Writing WAV file: " << path << std::endl;
+    return true;
+}
+
+bool WavSink::Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) {
+    return file.Write(first, firstSize) && file.Write(second, secondSize);
+}
+
+void WavSink::Close() {
+    if (!file.IsOpen()) return;
+    uint64_t dataBytes = file.DataBytes();
+    bool rf64 = file.IsRf64();
+    if (file.Close()) {
+        std::cerr << "WAV file closed: " << dataBytes << " bytes of audio" << (rf64 ? " (RF64)" : "") << std::endl;
+    } else {
+        std::cerr << "Warning: Failed to finalize WAV file " << path << std::endl;
+    }
+}
+
+bool FlacSink::Open(const AudioFormat& format, std::string* error) {
+    if (format.type == SampleType::Float32) {
+        if (error) *error = "FLAC output needs integer samples; use --bit-depth 16 or 24";
+        return false;
+    }
+
+    FlacEncoder::Config config;
+    config.sampleRate = format.sampleRate;
+    config.channels = format.channels;
+    config.bitsPerSample = format.BitsPerSample();
+    config.blockSize = (uint32_t)blockSize;
+    config.level = level;
+
+    std::string reason;
+    if (!encoder.Initialize(config, &reason)) {
+        if (error) *error = "Failed to initialize FLAC encoder: " + reason;
+        return false;
+    }
+    if (!output.OpenStdout()) {
+        if (error) *error = "Failed to open stdout handle for writing";
+        return false;
+    }
+    blockAlign = format.BlockAlign();
+    // A frame is at most a little larger than its PCM, and Encode() drains
+    // the buffer once it holds two, so it never reallocates on the writer
+    // thread
+    encoded.reserve((size_t)config.blockSize * blockAlign * 4);
+    std::cerr << "FLAC output enabled: level " << config.level << ", block size " << config.blockSize
+              << " frames" << std::endl;
+    return true;
+}
+
+bool FlacSink::Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) {
+    return Encode(first, firstSize) && Encode(second, secondSize) && Drain();
+}
+
+// One block of PCM at a time, so each step completes at most one frame
+bool FlacSink::Encode(const uint8_t* data, size_t size) {
+    const size_t sliceBytes = (size_t)blockSize * blockAlign;
+    while (size > 0) {
+        size_t slice = size < sliceBytes ? size : sliceBytes;
+        encoder.Encode(data, slice, encoded);
+        data += slice;
+        size -= slice;
+        if (encoded.size() * 2 >= encoded.capacity() && !Drain()) return false;
+    }
+    return true;
+}
+
+bool FlacSink::Drain() {
+    bool ok = encoded.empty() || output.Write(encoded.data(), encoded.size());
+    encoded.clear();
+    return ok;
+}
+
+void FlacSink::Close() {
+    // The writer thread has exited, so the encoder is ours now
+    encoded.clear();
+    encoder.Finish(encoded);
+    if (!encoded.empty()) output.Write(encoded.data(), encoded.size());
+
+    uint64_t pcmBytes = encoder.SamplesEncoded() * blockAlign;
+    std::cerr << "FLAC: " << encoder.SamplesEncoded() << " frames encoded to " << encoder.BytesProduced()
+              << " bytes";
+    if (pcmBytes > 0) {
+        std::cerr << " (" << (int)(100.0 * encoder.BytesProduced() / pcmBytes + 0.5) << "% of PCM)";
+    }
+    std::cerr << std::endl;
+}
+
+bool SharedMemorySink::Open(const AudioFormat& format, std::string* error) {
+    std::string reason;
+    if (!ring.Create(name, capacity, format, container, &reason)) {
+        if (error) *error = "Failed to create shared memory ring: " + reason;
+        return false;
+    }
+    std::cerr << "Publishing to shared memory ring '" << name << "' (" << ring.Capacity() / 1024 << " KB)"
+              << std::endl;
+    return true;
+}
+
+bool SharedMemorySink::Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) {
+    WriteRecord(first, firstSize, second, secondSize, 0);
+    return true;
+}
+
+void SharedMemorySink::WriteRecord(const void* header, size_t headerSize, const void* data, size_t size,
+                                   size_t padding) {
+    // The framed stream header lives in the ring header, where readers
+    // attaching at any time can find it
+    if (container == shmring::kContainerFramed && !streamHeaderSet) {
+        if (headerSize == sizeof(records::StreamHeader) && size == 0) {
+            records::StreamHeader streamHeader;
+            memcpy(&streamHeader, header, sizeof(streamHeader));
+            ring.SetStreamHeader(streamHeader);
+            streamHeaderSet = true;
+        }
+        return;
+    }
+    ring.Write(header, headerSize, data, size, padding);
+}
+
+void SharedMemorySink::Close() {
+    if (!ring.IsOpen()) return;
+    uint64_t written = ring.BytesWritten();
+    ring.Close();
+    std::cerr << "shm:" << name << ": " << written << " bytes published" << std::endl;
+}
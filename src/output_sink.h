@@ -0,0 +1,130 @@
+#pragma once
+
+// Final stage of the pipeline: where the output writer thread puts the
+// queued byte stream.
+//
+// A sink is opened on the capture thread before the writer starts, written
+// only from the writer thread, and closed on the capture thread after the
+// writer has drained and exited. Encoding containers that need the whole
+// stream (WAV headers, FLAC frames) therefore never run on the capture path.
+//
+// Inline sinks are the exception: they never block, so the pipeline hands
+// them each record directly on the capture thread and they get no queue or
+// writer thread at all.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_format.h"
+#include "flac_encoder.h"
+#include "raw_output.h"
+#include "shared_memory_ring.h"
+#include "wav_file_writer.h"
+
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+
+    // For log messages, e.g. "stdout" or the file path
+    virtual std::string Name() const = 0;
+
+    // Prepare for `format` audio; problems are reported through `error`
+    virtual bool Open(const AudioFormat& format, std::string* error) = 0;
+
+    // Writer thread: consume both segments in order (second may be empty);
+    // false on a fatal error
+    virtual bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) = 0;
+
+    // Finalize the destination and report totals on stderr
+    virtual void Close() = 0;
+
+    // True for sinks written with WriteRecord() on the capture thread
+    virtual bool IsInline() const { return false; }
+
+    // Inline sinks: take one record (header, payload, `padding` zero bytes)
+    // and make it visible as a whole
+    virtual void WriteRecord(const void* header, size_t headerSize, const void* data, size_t size,
+                             size_t padding) {
+        (void)header, (void)headerSize, (void)data, (void)size, (void)padding;
+    }
+};
+
+// Byte stream on stdout, exactly as queued
+class StdoutSink : public OutputSink {
+public:
+    std::string Name() const override { return "stdout"; }
+    bool Open(const AudioFormat& format, std::string* error) override;
+    bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) override;
+    void Close() override;
+
+private:
+    RawOutput output;
+};
+
+// Memory-mapped WAV file, RF64 past 4 GB
+class WavSink : public OutputSink {
+public:
+    explicit WavSink(const std::string& path) : path(path) {}
+
+    std::string Name() const override { return path; }
+
+    bool Open(const AudioFormat& format, std::string* error) override;
+    bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) override;
+    void Close() override;
+
+private:
+    std::string path;
+    WavFileWriter file;
+};
+
+// FLAC stream on stdout, encoded on the writer thread so a slow frame only
+// backs up the ring instead of stalling capture
+class FlacSink : public OutputSink {
+public:
+    FlacSink(int level, int blockSize) : level(level), blockSize(blockSize) {}
+
+    std::string Name() const override { return "stdout (FLAC)"; }
+
+    bool Open(const AudioFormat& format, std::string* error) override;
+    bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) override;
+    void Close() override;
+
+private:
+    int level;
+    int blockSize;
+    uint32_t blockAlign = 0;
+    FlacEncoder encoder;
+    RawOutput output;
+    std::vector<uint8_t> encoded;  // reused across writes
+
+    bool Encode(const uint8_t* data, size_t size);
+    bool Drain();
+};
+
+// Named shared-memory ring for readers on the same machine, filled straight
+// from the capture thread (see shared_memory_ring.h)
+class SharedMemorySink : public OutputSink {
+public:
+    SharedMemorySink(const std::string& name, uint32_t container, size_t capacity)
+        : name(name), container(container), capacity(capacity) {}
+
+    std::string Name() const override { return "shm:" + name; }
+
+    bool Open(const AudioFormat& format, std::string* error) override;
+    bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) override;
+    void Close() override;
+
+    bool IsInline() const override { return true; }
+    void WriteRecord(const void* header, size_t headerSize, const void* data, size_t size,
+                     size_t padding) override;
+
+private:
+    std::string name;
+    uint32_t container;
+    size_t capacity;
+    bool streamHeaderSet = false;
+    SharedMemoryRingWriter ring;
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+// Portable windowed-sinc polyphase resampler.
+//
+// Operates on interleaved 32-bit float frames supplied by the caller. Works
+// for any integer rate pair: the input/output ratio is reduced to L/M and the
+// filter position is tracked exactly in units of 1/L input samples. When L is
+// small enough the per-phase coefficients are tabulated exactly, otherwise a
+// fixed phase table is linearly interpolated.
+//
+// In variable-ratio mode the nominal L/M ratio can be scaled by a factor
+// close to 1 at any time (clock drift compensation). The position is then
+// kept in 32.32 fixed point and the interpolated phase table is always used,
+// so ratio changes take effect on the next output frame without a click.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class PolyphaseResampler {
+public:
+    enum class Quality {
+        // Taps per output period (times M/L when decimating), stopband
+        Fast,    // 16 taps, ~60 dB stopband
+        Medium,  // 32 taps, ~80 dB stopband
+        High,    // 64 taps, ~100 dB stopband
+        Best     // 128 taps, ~120 dB stopband
+    };
+
+    static constexpr uint32_t kMaxChannels = 32;
+    static constexpr uint32_t kMaxExactPhases = 1024;
+    static constexpr uint32_t kInterpolatedPhases = 512;
+    // Largest deviation SetRatioScale() accepts
+    static constexpr double kMaxRatioAdjustment = 0.01;
+
+    PolyphaseResampler() {}
+
+    bool Initialize(uint32_t inputRate, uint32_t outputRate, uint32_t numChannels,
+                    Quality q = Quality::High, bool variableRatio = false) {
+        if (inputRate == 0 || outputRate == 0 || numChannels == 0 || numChannels > kMaxChannels) {
+            return false;
+        }
+
+        uint32_t g = Gcd(inputRate, outputRate);
+        upFactor = outputRate / g;
+        downFactor = inputRate / g;
+        channels = numChannels;
+        quality = q;
+
+        switch (quality) {
+            case Quality::Fast:   taps = 16;  beta = 6.0;  rolloff = 0.85; break;
+            case Quality::Medium: taps = 32;  beta = 8.0;  rolloff = 0.90; break;
+            case Quality::High:   taps = 64;  beta = 10.0; rolloff = 0.94; break;
+            case Quality::Best:   taps = 128; beta = 12.0; rolloff = 0.96; break;
+        }
+        // Taps are per output period: when decimating, the filter spans M/L
+        // times as many input frames so the transition band keeps its width
+        if (downFactor > upFactor) {
+            taps = static_cast<uint32_t>(std::ceil(static_cast<double>(taps) * downFactor / upFactor));
+            taps += taps & 1;
+        }
+
+        variable = variableRatio;
+        exactPhases = !variable && upFactor <= kMaxExactPhases;
+        numPhases = exactPhases ? upFactor : kInterpolatedPhases;
+        BuildCoefficients();
+        flushZeros.assign(static_cast<size_t>(taps) * channels, 0.0f);
+        ratioScale = 1.0;
+        SetStep();
+        Reset();
+        return true;
+    }
+
+    // Variable-ratio mode: produce `scale` times as many output frames per
+    // input frame as the nominal ratio, clamped to kMaxRatioAdjustment
+    void SetRatioScale(double scale) {
+        if (!variable) return;
+        ratioScale = std::min(std::max(scale, 1.0 - kMaxRatioAdjustment), 1.0 + kMaxRatioAdjustment);
+        SetStep();
+    }
+
+    // Clear history and restart the output timeline at input frame 0.
+    void Reset() {
+        history.assign(static_cast<size_t>(taps - 1) * channels, 0.0f);
+        historyFrames = taps - 1;
+        // Position of the newest input frame needed by the next output and the
+        // sub-sample phase (in 1/L units). Starting at taps/2 centers output 0
+        // on input 0 so the filter delay is compensated.
+        inputPos = (taps - 1) + taps / 2;
+        phase = 0;
+        fraction = 0;
+        historyStart = -static_cast<int64_t>(taps - 1);
+        inputFramesTotal = 0;
+        outputFramesTotal = 0;
+    }
+
+    // Upper bound on frames produced by one Process() call for inputFrames.
+    size_t MaxOutputFrames(size_t inputFrames) const {
+        uint64_t frames = (static_cast<uint64_t>(inputFrames + taps) * upFactor) / downFactor + 2;
+        if (variable) frames += static_cast<uint64_t>(frames * kMaxRatioAdjustment) + 1;
+        return static_cast<size_t>(frames);
+    }
+
+    // Feed inputFrames interleaved frames and write up to outputCapacity frames.
+    // Returns the number of frames written. Input is always fully consumed;
+    // if the output capacity is too small the remaining outputs are produced
+    // by the next call.
+    size_t Process(const float* input, size_t inputFrames, float* output, size_t outputCapacity) {
+        if (!coefficients.size()) return 0;
+        if (input && inputFrames > 0) {
+            Append(input, inputFrames);
+            inputFramesTotal += inputFrames;
+        }
+        return Produce(output, outputCapacity, UINT64_MAX);
+    }
+
+    // Drain the filter tail. Produces output up to the duration of all input
+    // fed so far and leaves the resampler ready for a new stream.
+    size_t Flush(float* output, size_t outputCapacity) {
+        if (!coefficients.size()) return 0;
+        // Output frame n is centered on input time n*M/L; stop at the end of input.
+        uint64_t target = (inputFramesTotal * upFactor + downFactor - 1) / downFactor;
+        if (variable) {
+            // The ratio has varied, so count from where the next output is centered
+            double center = static_cast<double>(historyStart) + inputPos - taps / 2 + fraction / 4294967296.0;
+            double remaining = static_cast<double>(inputFramesTotal) - center;
+            target = outputFramesTotal +
+                     (remaining > 0.0 ? static_cast<uint64_t>(std::ceil(remaining / stepInputFrames)) : 0);
+        }
+        size_t written = 0;
+        while (outputFramesTotal < target && written < outputCapacity) {
+            Append(flushZeros.data(), taps);
+            written += Produce(output + written * channels, outputCapacity - written, target);
+        }
+        Reset();
+        return written;
+    }
+
+    uint32_t Channels() const { return channels; }
+    uint32_t Taps() const { return taps; }
+    uint32_t UpFactor() const { return upFactor; }
+    uint32_t DownFactor() const { return downFactor; }
+    bool IsPassthroughRatio() const { return upFactor == downFactor && !variable; }
+    bool IsVariableRatio() const { return variable; }
+    double RatioScale() const { return ratioScale; }
+
+    // Group delay of the filter in input frames.
+    double LatencyFrames() const { return taps / 2.0; }
+
+private:
+    uint32_t upFactor = 1;
+    uint32_t downFactor = 1;
+    uint32_t channels = 0;
+    uint32_t taps = 0;
+    double beta = 0.0;
+    double rolloff = 0.0;
+    Quality quality = Quality::High;
+
+    bool exactPhases = true;
+    bool variable = false;
+    double ratioScale = 1.0;
+    double stepInputFrames = 1.0;  // input frames per output frame
+    uint64_t stepFixed = 0;        // the same in 32.32 fixed point (variable ratio)
+    uint32_t numPhases = 0;
+    // numPhases + 1 rows of `taps` coefficients, stored in reverse order so the
+    // dot product walks the history forward in memory.
+    std::vector<float> coefficients;
+    std::vector<float> interpolated;
+    std::vector<float> flushZeros;  // `taps` silent frames fed by Flush()
+
+    std::vector<float> history;
+    size_t historyFrames = 0;
+    size_t inputPos = 0;
+    uint32_t phase = 0;
+    uint32_t fraction = 0;     // sub-sample position in 2^-32 input frames (variable ratio)
+    int64_t historyStart = 0;  // input frame index of history[0]
+    uint64_t inputFramesTotal = 0;
+    uint64_t outputFramesTotal = 0;
+
+    static uint32_t Gcd(uint32_t a, uint32_t b) {
+        while (b) {
+            uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    static double BesselI0(double x) {
+        double sum = 1.0;
+        double term = 1.0;
+        double halfX = x / 2.0;
+        for (int k = 1; k < 64; k++) {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+            if (term < sum * 1e-12) break;
+        }
+        return sum;
+    }
+
+    void SetStep() {
+        stepInputFrames = static_cast<double>(downFactor) / upFactor / ratioScale;
+        stepFixed = static_cast<uint64_t>(std::llround(stepInputFrames * 4294967296.0));
+    }
+
+    void BuildCoefficients() {
+        const double pi = 3.14159265358979323846;
+        double cutoff = std::min(1.0, static_cast<double>(upFactor) / downFactor) * rolloff;
+        double halfLength = taps / 2.0;
+        double i0Beta = BesselI0(beta);
+
+        coefficients.assign(static_cast<size_t>(numPhases + 1) * taps, 0.0f);
+        interpolated.assign(taps, 0.0f);
+        std::vector<double> values(taps);
+
+        for (uint32_t p = 0; p <= numPhases; p++) {
+            double frac = static_cast<double>(p) / numPhases;
+            float* row = &coefficients[static_cast<size_t>(p) * taps];
+            double sum = 0.0;
+            for (uint32_t k = 0; k < taps; k++) {
+                // Distance from the output instant to history frame k.
+                double t = (halfLength - 1.0 - k) + frac;
+                double x = cutoff * t;
+                double sinc = (std::fabs(x) < 1e-12) ? 1.0 : std::sin(pi * x) / (pi * x);
+                double r = t / halfLength;
+                double window = (std::fabs(r) >= 1.0) ? 0.0 : BesselI0(beta * std::sqrt(1.0 - r * r)) / i0Beta;
+                values[k] = cutoff * sinc * window;
+                sum += values[k];
+            }
+            // Normalize every phase to unity DC gain
+            for (uint32_t k = 0; k < taps; k++) {
+                row[k] = static_cast<float>(sum != 0.0 ? values[k] / sum : 0.0);
+            }
+        }
+    }
+
+    void Append(const float* input, size_t frames) {
+        size_t needed = (historyFrames + frames) * channels;
+        if (history.size() < needed) {
+            history.resize(needed);
+        }
+        memcpy(&history[historyFrames * channels], input, frames * channels * sizeof(float));
+        historyFrames += frames;
+    }
+
+    const float* PhaseCoefficients() {
+        if (exactPhases) {
+            return &coefficients[static_cast<size_t>(phase) * taps];
+        }
+        // Interpolate between the two nearest tabulated phases
+        uint32_t index;
+        float frac;
+        if (variable) {
+            uint64_t scaled = static_cast<uint64_t>(fraction) * numPhases;
+            index = static_cast<uint32_t>(scaled >> 32);
+            frac = static_cast<float>(static_cast<uint32_t>(scaled)) * (1.0f / 4294967296.0f);
+        } else {
+            uint64_t scaled = static_cast<uint64_t>(phase) * numPhases;
+            index = static_cast<uint32_t>(scaled / upFactor);
+            frac = static_cast<float>(scaled % upFactor) / upFactor;
+        }
+        const float* a = &coefficients[static_cast<size_t>(index) * taps];
+        const float* b = a + taps;
+        for (uint32_t k = 0; k < taps; k++) {
+            interpolated[k] = a[k] + (b[k] - a[k]) * frac;
+        }
+        return interpolated.data();
+    }
+
+    size_t Produce(float* output, size_t outputCapacity, uint64_t outputLimit) {
+        size_t written = 0;
+        const uint32_t stepFrames = downFactor / upFactor;
+        const uint32_t stepPhase = downFactor % upFactor;
+
+        while (inputPos < historyFrames && written < outputCapacity &&
+               outputFramesTotal < outputLimit) {
+            const float* coeffs = PhaseCoefficients();
+            const float* frame = &history[(inputPos + 1 - taps) * channels];
+            float* out = output + written * channels;
+
+            if (channels == 1) {
+                float acc = 0.0f;
+                for (uint32_t k = 0; k < taps; k++) {
+                    acc += coeffs[k] * frame[k];
+                }
+                out[0] = acc;
+            } else if (channels == 2) {
+                float accL = 0.0f;
+                float accR = 0.0f;
+                for (uint32_t k = 0; k < taps; k++) {
+                    accL += coeffs[k] * frame[2 * k];
+                    accR += coeffs[k] * frame[2 * k + 1];
+                }
+                out[0] = accL;
+                out[1] = accR;
+            } else {
+                float acc[kMaxChannels] = {};
+                for (uint32_t k = 0; k < taps; k++) {
+                    const float* f = frame + k * channels;
+                    for (uint32_t ch = 0; ch < channels; ch++) {
+                        acc[ch] += coeffs[k] * f[ch];
+                    }
+                }
+                memcpy(out, acc, channels * sizeof(float));
+            }
+
+            written++;
+            outputFramesTotal++;
+
+            if (variable) {
+                uint64_t position = static_cast<uint64_t>(fraction) + stepFixed;
+                inputPos += static_cast<size_t>(position >> 32);
+                fraction = static_cast<uint32_t>(position);
+                continue;
+            }
+            inputPos += stepFrames;
+            phase += stepPhase;
+            if (phase >= upFactor) {
+                phase -= upFactor;
+                inputPos++;
+            }
+        }
+
+        // Drop history that no future output can reach
+        size_t oldest = std::min(historyFrames, inputPos + 1 - taps);
+        if (oldest > 0) {
+            size_t remaining = historyFrames - oldest;
+            memmove(history.data(), &history[oldest * channels], remaining * channels * sizeof(float));
+            historyFrames = remaining;
+            inputPos -= oldest;
+            historyStart += static_cast<int64_t>(oldest);
+        }
+        return written;
+    }
+};
@@ -0,0 +1,89 @@
+#include "raw_output.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <cstdio>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+bool RawOutput::OpenStdout() {
+#ifdef _WIN32
+    return OpenDescriptor(_fileno(stdout));
+#else
+    return OpenDescriptor(fileno(stdout));
+#endif
+}
+
+bool RawOutput::OpenDescriptor(int descriptor) {
+    if (descriptor < 0) return false;
+    fd = descriptor;
+#ifdef _WIN32
+    handle = _get_osfhandle(descriptor);
+    if (handle == -1) return false;
+#endif
+    return true;
+}
+
+bool RawOutput::WriteAll(const uint8_t* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+        DWORD written = 0;
+        writeCalls++;
+        if (!WriteFile(reinterpret_cast<HANDLE>(handle), data, chunk, &written, nullptr)) {
+            return false;
+        }
+#else
+        writeCalls++;
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+#endif
+        data += written;
+        size -= (size_t)written;
+        bytesWritten += (uint64_t)written;
+    }
+    return true;
+}
+
+bool RawOutput::WriteVectored(const uint8_t* first, size_t firstSize,
+                              const uint8_t* second, size_t secondSize) {
+    if (fd < 0) return false;
+#ifdef _WIN32
+    // Pipes and files have no gather write on Windows
+    return WriteAll(first, firstSize) && WriteAll(second, secondSize);
+#else
+    while (firstSize > 0 && secondSize > 0) {
+        struct iovec iov[2];
+        iov[0].iov_base = const_cast<uint8_t*>(first);
+        iov[0].iov_len = firstSize;
+        iov[1].iov_base = const_cast<uint8_t*>(second);
+        iov[1].iov_len = secondSize;
+        writeCalls++;
+        ssize_t written = ::writev(fd, iov, 2);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytesWritten += (uint64_t)written;
+        size_t n = (size_t)written;
+        if (n >= firstSize) {
+            n -= firstSize;
+            first = second + n;
+            firstSize = secondSize - n;
+            secondSize = 0;
+        } else {
+            first += n;
+            firstSize -= n;
+        }
+    }
+    return WriteAll(first, firstSize) && WriteAll(second, secondSize);
+#endif
+}
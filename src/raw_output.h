@@ -0,0 +1,37 @@
+#pragma once
+
+// Unbuffered writer for a raw file descriptor (stdout by default).
+//
+// Bypasses iostreams entirely: each call hands the data to the OS in as few
+// system calls as possible, using writev() for the two-segment case on POSIX
+// and WriteFile() on Windows. Partial writes and EINTR are retried.
+
+#include <cstddef>
+#include <cstdint>
+
+class RawOutput {
+public:
+    RawOutput() {}
+
+    bool OpenStdout();
+    bool OpenDescriptor(int fd);
+
+    // Write both segments completely (second may be empty); false on error
+    bool WriteVectored(const uint8_t* first, size_t firstSize,
+                       const uint8_t* second, size_t secondSize);
+
+    bool Write(const void* data, size_t size) {
+        return WriteVectored(static_cast<const uint8_t*>(data), size, nullptr, 0);
+    }
+
+    uint64_t WriteCalls() const { return writeCalls; }
+    uint64_t BytesWritten() const { return bytesWritten; }
+
+private:
+    int fd = -1;
+    intptr_t handle = -1;  // Windows HANDLE for fd
+    uint64_t writeCalls = 0;
+    uint64_t bytesWritten = 0;
+
+    bool WriteAll(const uint8_t* data, size_t size);
+};
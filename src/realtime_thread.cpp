@@ -0,0 +1,111 @@
+#include "realtime_thread.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace {
+
+#ifndef _WIN32
+// Below the kernel's own threaded interrupts (50) is too low to matter and
+// the top of the range is best left to the system; writers stay below the
+// capture thread so a slow sink never delays the next packet
+constexpr int kCapturePriority = 70;
+constexpr int kWriterPriority = 60;
+#endif
+
+}  // namespace
+
+bool RealtimeThread::Enter(Role role, std::string* error) {
+    Leave();
+#ifdef _WIN32
+    DWORD taskIndex = 0;
+    HANDLE handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+    if (!handle) {
+        if (error) *error = "MMCSS registration failed (error " + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    AVRT_PRIORITY priority = role == Role::Capture ? AVRT_PRIORITY_CRITICAL : AVRT_PRIORITY_HIGH;
+    if (!AvSetMmThreadPriority(handle, priority)) {
+        // Still in the Pro Audio class, just at its default priority
+        description = "MMCSS Pro Audio";
+    } else {
+        description = role == Role::Capture ? "MMCSS Pro Audio, critical" : "MMCSS Pro Audio, high";
+    }
+    task = handle;
+#else
+    sched_param old = {};
+    if (pthread_getschedparam(pthread_self(), &oldPolicy, &old) != 0) {
+        oldPolicy = SCHED_OTHER;
+        old.sched_priority = 0;
+    }
+    oldPriority = old.sched_priority;
+
+    int wanted = role == Role::Capture ? kCapturePriority : kWriterPriority;
+    int highest = sched_get_priority_max(SCHED_FIFO);
+    int lowest = sched_get_priority_min(SCHED_FIFO);
+    sched_param param = {};
+    param.sched_priority = wanted > highest ? highest : wanted < lowest ? lowest : wanted;
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (result != 0) {
+        if (error) {
+            *error = std::string("SCHED_FIFO unavailable: ") + std::strerror(result);
+            if (result == EPERM) *error += " (needs CAP_SYS_NICE or an rtprio limit, see ulimit -r)";
+        }
+        return false;
+    }
+    description = "SCHED_FIFO " + std::to_string(param.sched_priority);
+#endif
+    active = true;
+    return true;
+}
+
+void RealtimeThread::Leave() {
+    if (!active) return;
+#ifdef _WIN32
+    AvRevertMmThreadCharacteristics((HANDLE)task);
+    task = nullptr;
+#else
+    sched_param param = {};
+    param.sched_priority = oldPriority;
+    pthread_setschedparam(pthread_self(), oldPolicy, &param);
+#endif
+    active = false;
+    description.clear();
+}
+
+bool RealtimeThread::LockMemory(std::string* error) {
+#if defined(__linux__)
+    // Locking future pages too is only safe when the limit cannot make a
+    // later allocation fail
+    rlimit limit = {};
+    bool unlimited = geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+    if (mlockall(unlimited ? MCL_CURRENT | MCL_FUTURE : MCL_CURRENT) != 0) {
+        if (error) {
+            *error = std::string("mlockall failed: ") + std::strerror(errno);
+            if (errno == ENOMEM || errno == EPERM) *error += " (needs CAP_IPC_LOCK or a larger ulimit -l)";
+        }
+        return false;
+    }
+    return true;
+#elif defined(_WIN32)
+    // Nothing to lock: the buffers are allocated and touched before capture
+    (void)error;
+    return true;
+#else
+    if (error) *error = "memory locking is not supported on this platform";
+    return false;
+#endif
+}
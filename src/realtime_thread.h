@@ -0,0 +1,58 @@
+#pragma once
+
+// Real-time scheduling for the threads on the capture path (--low-latency).
+//
+// On Windows a thread joins the MMCSS "Pro Audio" task, the class the audio
+// engine itself runs in: the capture thread at critical priority, output
+// writers one step below. Elsewhere the thread switches to SCHED_FIFO at a
+// fixed priority, again with writers below capture, which needs
+// CAP_SYS_NICE or an rtprio limit (ulimit -r) on Linux.
+//
+// LockMemory() keeps every current and future page of the process resident
+// (mlockall on Linux) so a page fault never stalls a real-time thread; it
+// needs CAP_IPC_LOCK or a large enough memlock limit (ulimit -l). Windows
+// has no equivalent, so there it does nothing and MMCSS threads rely on the
+// buffers being allocated and touched before capture starts.
+//
+// Both are best effort: a failure is reported and the capture carries on at
+// normal priority.
+
+#include <string>
+
+class RealtimeThread {
+public:
+    enum class Role {
+        Capture,  // waits on the source and runs the conversion stages
+        Writer    // drains an output queue into its sink
+    };
+
+    RealtimeThread() {}
+    ~RealtimeThread() { Leave(); }
+
+    RealtimeThread(const RealtimeThread&) = delete;
+    RealtimeThread& operator=(const RealtimeThread&) = delete;
+
+    // Give the calling thread real-time priority for `role`
+    bool Enter(Role role, std::string* error);
+
+    // Back to normal scheduling; must run on the thread that entered
+    void Leave();
+
+    bool Active() const { return active; }
+
+    // Short description for the log, e.g. "MMCSS Pro Audio, critical"
+    const std::string& Description() const { return description; }
+
+    // Lock the process's memory into RAM
+    static bool LockMemory(std::string* error);
+
+private:
+    bool active = false;
+    std::string description;
+#ifdef _WIN32
+    void* task = nullptr;  // MMCSS task handle
+#else
+    int oldPolicy = 0;
+    int oldPriority = 0;
+#endif
+};
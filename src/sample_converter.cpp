@@ -0,0 +1,206 @@
+#include "sample_converter.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "simd_arch.h"
+
+namespace scalar_convert {
+
+void Int16ToFloat(const int16_t* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = in[i] * (1.0f / 32768.0f);
+    }
+}
+
+void Int24ToFloat(const uint8_t* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* p = in + i * 3;
+        int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+        out[i] = v * (1.0f / 8388608.0f);
+    }
+}
+
+void Int32ToFloat(const int32_t* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = in[i] * (1.0f / 2147483648.0f);
+    }
+}
+
+void FloatToInt16(const float* in, int16_t* out, size_t count, const float* dither) {
+    for (size_t i = 0; i < count; i++) {
+        float v = in[i] * 32768.0f;
+        if (dither) v += dither[i];
+        if (v > 32767.0f) v = 32767.0f;
+        if (v < -32768.0f) v = -32768.0f;
+        out[i] = (int16_t)std::lrintf(v);
+    }
+}
+
+void FloatToInt24(const float* in, uint8_t* out, size_t count, const float* dither) {
+    for (size_t i = 0; i < count; i++) {
+        float v = in[i] * 8388608.0f;
+        if (dither) v += dither[i];
+        if (v > 8388607.0f) v = 8388607.0f;
+        if (v < -8388608.0f) v = -8388608.0f;
+        int32_t s = (int32_t)std::lrintf(v);
+        out[i * 3] = (uint8_t)(s & 0xFF);
+        out[i * 3 + 1] = (uint8_t)((s >> 8) & 0xFF);
+        out[i * 3 + 2] = (uint8_t)((s >> 16) & 0xFF);
+    }
+}
+
+void FloatToInt32(const float* in, int32_t* out, size_t count, const float* dither) {
+    for (size_t i = 0; i < count; i++) {
+        float v = in[i] * 2147483648.0f;
+        if (dither) v += dither[i];
+        // Any float below 2^31 rounds into range; 2^31 itself is INT32_MAX + 1
+        if (v >= 2147483648.0f) {
+            out[i] = INT32_MAX;
+        } else if (v < -2147483648.0f) {
+            out[i] = INT32_MIN;
+        } else {
+            out[i] = (int32_t)std::lrintf(v);
+        }
+    }
+}
+
+}  // namespace scalar_convert
+
+const ConversionKernels& GetScalarConversionKernels() {
+    static const ConversionKernels kernels = {
+        "scalar",
+        scalar_convert::Int16ToFloat,
+        scalar_convert::Int24ToFloat,
+        scalar_convert::Int32ToFloat,
+        scalar_convert::FloatToInt16,
+        scalar_convert::FloatToInt24,
+        scalar_convert::FloatToInt32,
+    };
+    return kernels;
+}
+
+std::vector<const ConversionKernels*> GetAvailableConversionKernels() {
+    std::vector<const ConversionKernels*> result;
+    if (CpuSupportsAvx2() && GetAvx2ConversionKernels()) {
+        result.push_back(GetAvx2ConversionKernels());
+    }
+    if (CpuSupportsSse2() && GetSse2ConversionKernels()) {
+        result.push_back(GetSse2ConversionKernels());
+    }
+    if (CpuSupportsNeon() && GetNeonConversionKernels()) {
+        result.push_back(GetNeonConversionKernels());
+    }
+    result.push_back(&GetScalarConversionKernels());
+    return result;
+}
+
+const ConversionKernels& GetConversionKernels() {
+    static const ConversionKernels* selected = GetAvailableConversionKernels().front();
+    return *selected;
+}
+
+SampleConverter::SampleConverter() {
+    memset(scratch, 0, sizeof(scratch));
+    memset(noise, 0, sizeof(noise));
+}
+
+bool SampleConverter::Initialize(SampleType input, SampleType output, bool dither,
+                                 const ConversionKernels* kernelSet) {
+    inputType = input;
+    outputType = output;
+    kernels = kernelSet ? kernelSet : &GetConversionKernels();
+    // Dither only makes sense when quantizing to 16 or 24 bits
+    ditherEnabled = dither && (output == SampleType::Int16 || output == SampleType::Int24);
+    return true;
+}
+
+const float* SampleConverter::GenerateDither(size_t samples) {
+    if (!ditherEnabled) return nullptr;
+
+    // TPDF: sum of two independent uniform values, +/-1 LSB peak
+    uint32_t s = rngState;
+    for (size_t i = 0; i < samples; i++) {
+        s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+        float a = (s >> 8) * (1.0f / 16777216.0f);
+        s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+        float b = (s >> 8) * (1.0f / 16777216.0f);
+        noise[i] = a - b;
+    }
+    rngState = s;
+    return noise;
+}
+
+void SampleConverter::ToFloat(const void* input, float* output, size_t samples) const {
+    switch (inputType) {
+        case SampleType::Int16:
+            kernels->Int16ToFloat(static_cast<const int16_t*>(input), output, samples);
+            break;
+        case SampleType::Int24:
+            kernels->Int24ToFloat(static_cast<const uint8_t*>(input), output, samples);
+            break;
+        case SampleType::Int32:
+            kernels->Int32ToFloat(static_cast<const int32_t*>(input), output, samples);
+            break;
+        case SampleType::Float32:
+            if (output != input) memcpy(output, input, samples * sizeof(float));
+            break;
+    }
+}
+
+void SampleConverter::FromFloat(const float* input, void* output, size_t samples) {
+    uint8_t* out = static_cast<uint8_t*>(output);
+    size_t outBytes = BytesPerSample(outputType);
+
+    for (size_t done = 0; done < samples;) {
+        size_t n = samples - done;
+        if (n > kBlockSamples) n = kBlockSamples;
+        const float* dither = GenerateDither(n);
+
+        switch (outputType) {
+            case SampleType::Int16:
+                kernels->FloatToInt16(input + done, reinterpret_cast<int16_t*>(out + done * outBytes), n, dither);
+                break;
+            case SampleType::Int24:
+                kernels->FloatToInt24(input + done, out + done * outBytes, n, dither);
+                break;
+            case SampleType::Int32:
+                kernels->FloatToInt32(input + done, reinterpret_cast<int32_t*>(out + done * outBytes), n, dither);
+                break;
+            case SampleType::Float32:
+                memcpy(out + done * outBytes, input + done, n * sizeof(float));
+                break;
+        }
+        done += n;
+    }
+}
+
+void SampleConverter::Convert(const void* input, void* output, size_t samples) {
+    if (inputType == outputType) {
+        if (output != input) memcpy(output, input, samples * BytesPerSample(inputType));
+        return;
+    }
+
+    if (inputType == SampleType::Float32) {
+        FromFloat(static_cast<const float*>(input), output, samples);
+        return;
+    }
+
+    // Integer input goes through float in cache-sized blocks
+    const uint8_t* in = static_cast<const uint8_t*>(input);
+    uint8_t* out = static_cast<uint8_t*>(output);
+    size_t inBytes = BytesPerSample(inputType);
+    size_t outBytes = BytesPerSample(outputType);
+
+    for (size_t done = 0; done < samples;) {
+        size_t n = samples - done;
+        if (n > kBlockSamples) n = kBlockSamples;
+        ToFloat(in + done * inBytes, scratch, n);
+        if (outputType == SampleType::Float32) {
+            memcpy(out + done * outBytes, scratch, n * sizeof(float));
+        } else {
+            FromFloat(scratch, out + done * outBytes, n);
+        }
+        done += n;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// Sample format conversion between float32 and int16/int24/int32.
+//
+// Kernels are selected once at startup from the best instruction set the CPU
+// supports (AVX2, SSE2, NEON, or portable scalar). Float to integer
+// conversion rounds to nearest and saturates out-of-range values at the
+// integer type's limits (full scale in int32 gives INT32_MAX); every kernel
+// set produces the same samples as the scalar one. int16 and int24 outputs
+// can optionally be TPDF dithered.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audio_format.h"
+
+// Conversion kernel table. `dither`, when non-null, holds one noise value per
+// sample in output LSB units that is added before quantization.
+struct ConversionKernels {
+    const char* name;
+    void (*Int16ToFloat)(const int16_t* in, float* out, size_t count);
+    void (*Int24ToFloat)(const uint8_t* in, float* out, size_t count);
+    void (*Int32ToFloat)(const int32_t* in, float* out, size_t count);
+    void (*FloatToInt16)(const float* in, int16_t* out, size_t count, const float* dither);
+    void (*FloatToInt24)(const float* in, uint8_t* out, size_t count, const float* dither);
+    void (*FloatToInt32)(const float* in, int32_t* out, size_t count, const float* dither);
+};
+
+// Kernels chosen for this CPU (selected on first use)
+const ConversionKernels& GetConversionKernels();
+
+// Every kernel set supported by this build and CPU, best first
+std::vector<const ConversionKernels*> GetAvailableConversionKernels();
+
+// Architecture specific kernel sets; return nullptr when not compiled in
+const ConversionKernels& GetScalarConversionKernels();
+const ConversionKernels* GetSse2ConversionKernels();
+const ConversionKernels* GetAvx2ConversionKernels();
+const ConversionKernels* GetNeonConversionKernels();
+
+// Scalar helpers shared by the SIMD kernels for loop tails
+namespace scalar_convert {
+void Int16ToFloat(const int16_t* in, float* out, size_t count);
+void Int24ToFloat(const uint8_t* in, float* out, size_t count);
+void Int32ToFloat(const int32_t* in, float* out, size_t count);
+void FloatToInt16(const float* in, int16_t* out, size_t count, const float* dither);
+void FloatToInt24(const float* in, uint8_t* out, size_t count, const float* dither);
+void FloatToInt32(const float* in, int32_t* out, size_t count, const float* dither);
+}
+
+// Converts interleaved samples between two sample types. Works in fixed-size
+// blocks through internal scratch space, so Convert() never allocates.
+class SampleConverter {
+public:
+    static constexpr size_t kBlockSamples = 2048;
+
+    SampleConverter();
+
+    bool Initialize(SampleType input, SampleType output, bool dither = false,
+                    const ConversionKernels* kernels = nullptr);
+
+    // Convert `samples` samples; output must hold samples * BytesPerSample(output) bytes
+    void Convert(const void* input, void* output, size_t samples);
+
+    // Decode input-type samples to float / encode float to output-type samples
+    void ToFloat(const void* input, float* output, size_t samples) const;
+    void FromFloat(const float* input, void* output, size_t samples);
+
+    SampleType InputType() const { return inputType; }
+    SampleType OutputType() const { return outputType; }
+    const char* KernelName() const { return kernels ? kernels->name : "none"; }
+
+private:
+    const ConversionKernels* kernels = nullptr;
+    SampleType inputType = SampleType::Float32;
+    SampleType outputType = SampleType::Float32;
+    bool ditherEnabled = false;
+    uint32_t rngState = 0x9E3779B9u;
+
+    float scratch[kBlockSamples];
+    float noise[kBlockSamples];
+
+    const float* GenerateDither(size_t samples);
+};
@@ -0,0 +1,132 @@
+#include "sample_converter.h"
+#include "simd_arch.h"
+
+// Built with AVX2 code generation enabled (see CMakeLists.txt); only called
+// after CpuSupportsAvx2() confirms the instructions are available.
+
+#if defined(AUDIO_ARCH_X86)
+#include <immintrin.h>
+#include <cstring>
+
+namespace {
+
+void Int16ToFloatAvx2(const int16_t* in, float* out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), scale));
+    }
+    scalar_convert::Int16ToFloat(in + i, out + i, count - i);
+}
+
+void Int24ToFloatAvx2(const uint8_t* in, float* out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    // Place the three bytes of each sample in the top of a 32-bit lane
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    size_t i = 0;
+    // Each 16-byte load covers 4 samples plus 4 bytes of slack, so keep
+    // 16 readable bytes past the second load
+    for (; i + 10 <= count; i += 8) {
+        const uint8_t* p = in + i * 3;
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), shuffle);
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    scalar_convert::Int24ToFloat(in + i * 3, out + i, count - i);
+}
+
+void Int32ToFloatAvx2(const int32_t* in, float* out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    scalar_convert::Int32ToFloat(in + i, out + i, count - i);
+}
+
+inline __m256i QuantizeAvx2(const float* in, const float* dither, size_t i,
+                            __m256 scale, __m256 lo, __m256 hi) {
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+    if (dither) v = _mm256_add_ps(v, _mm256_loadu_ps(dither + i));
+    v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    return _mm256_cvtps_epi32(v);
+}
+
+void FloatToInt16Avx2(const float* in, int16_t* out, size_t count, const float* dither) {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = QuantizeAvx2(in, dither, i, scale, lo, hi);
+        __m256i b = QuantizeAvx2(in, dither, i + 8, scale, lo, hi);
+        // packs works per 128-bit lane; restore sample order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    scalar_convert::FloatToInt16(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt24Avx2(const float* in, uint8_t* out, size_t count, const float* dither) {
+    const __m256 scale = _mm256_set1_ps(8388608.0f);
+    const __m256 lo = _mm256_set1_ps(-8388608.0f);
+    const __m256 hi = _mm256_set1_ps(8388607.0f);
+    // Keep the low three bytes of each 32-bit lane, packed into 12 bytes
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    alignas(16) uint8_t block[16];
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = QuantizeAvx2(in, dither, i, scale, lo, hi);
+        __m128i a = _mm_shuffle_epi8(_mm256_castsi256_si128(v), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm256_extracti128_si256(v, 1), shuffle);
+        uint8_t* p = out + i * 3;
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), a);
+        memcpy(p, block, 12);
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), b);
+        memcpy(p + 12, block, 12);
+    }
+    scalar_convert::FloatToInt24(in + i, out + i * 3, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt32Avx2(const float* in, int32_t* out, size_t count, const float* dither) {
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 lo = _mm256_set1_ps(-2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        if (dither) v = _mm256_add_ps(v, _mm256_loadu_ps(dither + i));
+        // 2^31 and up convert to INT_MIN; flip those lanes to INT_MAX (see SSE2)
+        __m256i q = _mm256_cvtps_epi32(_mm256_max_ps(v, lo));
+        q = _mm256_xor_si256(q, _mm256_castps_si256(_mm256_cmp_ps(v, scale, _CMP_GE_OQ)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), q);
+    }
+    scalar_convert::FloatToInt32(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+}  // namespace
+
+const ConversionKernels* GetAvx2ConversionKernels() {
+    static const ConversionKernels kernels = {
+        "avx2",
+        Int16ToFloatAvx2,
+        Int24ToFloatAvx2,
+        Int32ToFloatAvx2,
+        FloatToInt16Avx2,
+        FloatToInt24Avx2,
+        FloatToInt32Avx2,
+    };
+    return &kernels;
+}
+
+#else
+
+const ConversionKernels* GetAvx2ConversionKernels() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "sample_converter.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_NEON)
+#include <arm_neon.h>
+
+namespace {
+
+void Int16ToFloatNeon(const int16_t* in, float* out, size_t count) {
+    const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+    scalar_convert::Int16ToFloat(in + i, out + i, count - i);
+}
+
+void Int24ToFloatNeon(const uint8_t* in, float* out, size_t count) {
+    const float32x4_t scale = vdupq_n_f32(1.0f / 8388608.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // De-interleave the three byte planes of 8 samples
+        uint8x8x3_t b = vld3_u8(in + i * 3);
+        uint16x8_t lo = vorrq_u16(vmovl_u8(b.val[0]), vshlq_n_u16(vmovl_u8(b.val[1]), 8));
+        int16x8_t hi = vreinterpretq_s16_u16(vmovl_u8(b.val[2]));
+        // Sign-extend the top byte, then merge with the low 16 bits
+        hi = vshrq_n_s16(vshlq_n_s16(hi, 8), 8);
+        int32x4_t v0 = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_low_s16(hi)), 16),
+                                 vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo))));
+        int32x4_t v1 = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_high_s16(hi)), 16),
+                                 vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo))));
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(v0), scale));
+        vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(v1), scale));
+    }
+    scalar_convert::Int24ToFloat(in + i * 3, out + i, count - i);
+}
+
+void Int32ToFloatNeon(const int32_t* in, float* out, size_t count) {
+    const float32x4_t scale = vdupq_n_f32(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(in + i)), scale));
+    }
+    scalar_convert::Int32ToFloat(in + i, out + i, count - i);
+}
+
+inline int32x4_t QuantizeNeon(const float* in, const float* dither, size_t i,
+                              float32x4_t scale, float32x4_t lo, float32x4_t hi) {
+    float32x4_t v = vmulq_f32(vld1q_f32(in + i), scale);
+    if (dither) v = vaddq_f32(v, vld1q_f32(dither + i));
+    v = vminq_f32(vmaxq_f32(v, lo), hi);
+    return vcvtnq_s32_f32(v);  // round to nearest even
+}
+
+void FloatToInt16Neon(const float* in, int16_t* out, size_t count, const float* dither) {
+    const float32x4_t scale = vdupq_n_f32(32768.0f);
+    const float32x4_t lo = vdupq_n_f32(-32768.0f);
+    const float32x4_t hi = vdupq_n_f32(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t a = QuantizeNeon(in, dither, i, scale, lo, hi);
+        int32x4_t b = QuantizeNeon(in, dither, i + 4, scale, lo, hi);
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    scalar_convert::FloatToInt16(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt24Neon(const float* in, uint8_t* out, size_t count, const float* dither) {
+    const float32x4_t scale = vdupq_n_f32(8388608.0f);
+    const float32x4_t lo = vdupq_n_f32(-8388608.0f);
+    const float32x4_t hi = vdupq_n_f32(8388607.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t a = QuantizeNeon(in, dither, i, scale, lo, hi);
+        int32x4_t b = QuantizeNeon(in, dither, i + 4, scale, lo, hi);
+        // Split into byte planes and interleave them back as 3-byte samples
+        uint16x8_t low16 = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(a)),
+                                        vmovn_u32(vreinterpretq_u32_s32(b)));
+        uint16x8_t high16 = vcombine_u16(vshrn_n_u32(vreinterpretq_u32_s32(a), 16),
+                                         vshrn_n_u32(vreinterpretq_u32_s32(b), 16));
+        uint8x8x3_t planes;
+        planes.val[0] = vmovn_u16(low16);
+        planes.val[1] = vshrn_n_u16(low16, 8);
+        planes.val[2] = vmovn_u16(high16);
+        vst3_u8(out + i * 3, planes);
+    }
+    scalar_convert::FloatToInt24(in + i, out + i * 3, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt32Neon(const float* in, int32_t* out, size_t count, const float* dither) {
+    const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t v = vmulq_f32(vld1q_f32(in + i), scale);
+        if (dither) v = vaddq_f32(v, vld1q_f32(dither + i));
+        // The conversion itself saturates at INT_MIN and INT_MAX, like the
+        // scalar kernel
+        vst1q_s32(out + i, vcvtnq_s32_f32(v));
+    }
+    scalar_convert::FloatToInt32(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+}  // namespace
+
+const ConversionKernels* GetNeonConversionKernels() {
+    static const ConversionKernels kernels = {
+        "neon",
+        Int16ToFloatNeon,
+        Int24ToFloatNeon,
+        Int32ToFloatNeon,
+        FloatToInt16Neon,
+        FloatToInt24Neon,
+        FloatToInt32Neon,
+    };
+    return &kernels;
+}
+
+#else
+
+const ConversionKernels* GetNeonConversionKernels() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "sample_converter.h"
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_X86)
+#include <emmintrin.h>
+
+namespace {
+
+void Int16ToFloatSse2(const int16_t* in, float* out, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // Sign-extend by placing each int16 in the high half and shifting back
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    scalar_convert::Int16ToFloat(in + i, out + i, count - i);
+}
+
+void Int32ToFloatSse2(const int32_t* in, float* out, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    scalar_convert::Int32ToFloat(in + i, out + i, count - i);
+}
+
+inline __m128i QuantizeSse2(const float* in, const float* dither, size_t i,
+                            __m128 scale, __m128 lo, __m128 hi) {
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+    if (dither) v = _mm_add_ps(v, _mm_loadu_ps(dither + i));
+    v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+    return _mm_cvtps_epi32(v);
+}
+
+void FloatToInt16Sse2(const float* in, int16_t* out, size_t count, const float* dither) {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = QuantizeSse2(in, dither, i, scale, lo, hi);
+        __m128i b = QuantizeSse2(in, dither, i + 4, scale, lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+    }
+    scalar_convert::FloatToInt16(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt24Sse2(const float* in, uint8_t* out, size_t count, const float* dither) {
+    const __m128 scale = _mm_set1_ps(8388608.0f);
+    const __m128 lo = _mm_set1_ps(-8388608.0f);
+    const __m128 hi = _mm_set1_ps(8388607.0f);
+    alignas(16) int32_t block[4];
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), QuantizeSse2(in, dither, i, scale, lo, hi));
+        uint8_t* p = out + i * 3;
+        for (int k = 0; k < 4; k++) {
+            p[k * 3] = (uint8_t)(block[k] & 0xFF);
+            p[k * 3 + 1] = (uint8_t)((block[k] >> 8) & 0xFF);
+            p[k * 3 + 2] = (uint8_t)((block[k] >> 16) & 0xFF);
+        }
+    }
+    scalar_convert::FloatToInt24(in + i, out + i * 3, count - i, dither ? dither + i : nullptr);
+}
+
+void FloatToInt32Sse2(const float* in, int32_t* out, size_t count, const float* dither) {
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 lo = _mm_set1_ps(-2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        if (dither) v = _mm_add_ps(v, _mm_loadu_ps(dither + i));
+        // 2^31 and up convert to INT_MIN; flipping every bit of those lanes
+        // gives INT_MAX, where the scalar kernel saturates
+        __m128i q = _mm_cvtps_epi32(_mm_max_ps(v, lo));
+        q = _mm_xor_si128(q, _mm_castps_si128(_mm_cmpge_ps(v, scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), q);
+    }
+    scalar_convert::FloatToInt32(in + i, out + i, count - i, dither ? dither + i : nullptr);
+}
+
+}  // namespace
+
+const ConversionKernels* GetSse2ConversionKernels() {
+    static const ConversionKernels kernels = {
+        "sse2",
+        Int16ToFloatSse2,
+        scalar_convert::Int24ToFloat,  // needs a byte shuffle, see AVX2
+        Int32ToFloatSse2,
+        FloatToInt16Sse2,
+        FloatToInt24Sse2,
+        FloatToInt32Sse2,
+    };
+    return &kernels;
+}
+
+#else
+
+const ConversionKernels* GetSse2ConversionKernels() {
+    return nullptr;
+}
+
+#endif
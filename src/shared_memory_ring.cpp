@@ -0,0 +1,406 @@
+#include "shared_memory_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ctime>
+#endif
+#endif
+
+namespace shmring {
+
+bool IsValidName(const std::string& name) {
+    if (name.empty() || name.size() > 200) return false;
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' ||
+               c == '-' || c == '_';
+    });
+}
+
+}  // namespace shmring
+
+namespace {
+
+#ifdef _WIN32
+// Session-local names need no extra privileges
+std::string MappingName(const std::string& name) {
+    return "Local\\" + name;
+}
+
+std::string SemaphoreName(const std::string& name) {
+    return "Local\\" + name + ".wake";
+}
+
+std::string LastError() {
+    return "error " + std::to_string(GetLastError());
+}
+#else
+std::string MappingName(const std::string& name) {
+    return "/" + name;
+}
+
+std::string LastError() {
+    return std::strerror(errno);
+}
+#endif
+
+uint32_t CurrentProcessId() {
+#ifdef _WIN32
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+}  // namespace
+
+bool SharedMemoryMapping::Create(const std::string& mappingName, size_t size, std::string* error) {
+    Close();
+    name = mappingName;
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                        (DWORD)size, MappingName(name).c_str());
+    if (!mapping) {
+        if (error) *error = "CreateFileMapping failed: " + LastError();
+        return false;
+    }
+    // Windows keeps a mapping alive while any handle is open, so an
+    // existing one means another writer (or a reader of an old one) has it
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(mapping);
+        if (error) *error = "shared memory '" + name + "' is already in use";
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    HANDLE semaphore = CreateSemaphoreA(nullptr, 0, 0x7fffffff, SemaphoreName(name).c_str());
+    if (!view || !semaphore) {
+        if (error) *error = "Failed to map shared memory: " + LastError();
+        if (view) UnmapViewOfFile(view);
+        if (semaphore) CloseHandle(semaphore);
+        CloseHandle(mapping);
+        return false;
+    }
+    mappingHandle = reinterpret_cast<intptr_t>(mapping);
+    semaphoreHandle = reinterpret_cast<intptr_t>(semaphore);
+#else
+    // A ring left behind by a crashed writer is replaced; readers still
+    // attached to it keep their mapping until they detach
+    shm_unlink(MappingName(name).c_str());
+    int fd = shm_open(MappingName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        if (error) *error = "shm_open failed: " + LastError();
+        return false;
+    }
+    void* view = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    std::string reason = LastError();
+    close(fd);
+    if (view == MAP_FAILED) {
+        shm_unlink(MappingName(name).c_str());
+        if (error) *error = "Failed to map shared memory: " + reason;
+        return false;
+    }
+#endif
+    // Fresh pages are zero; constructing the header makes its atomics
+    // formally live
+    header = new (view) shmring::Header();
+    mappedSize = size;
+    owner = true;
+    return true;
+}
+
+bool SharedMemoryMapping::Open(const std::string& mappingName, std::string* error) {
+    Close();
+    name = mappingName;
+    void* view = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, MappingName(name).c_str());
+    if (!mapping) {
+        if (error) *error = "no shared memory named '" + name + "'";
+        return false;
+    }
+    view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info = {};
+    if (view) VirtualQuery(view, &info, sizeof(info));
+    size = info.RegionSize;
+    HANDLE semaphore = OpenSemaphoreA(SYNCHRONIZE | SEMAPHORE_MODIFY_STATE, FALSE, SemaphoreName(name).c_str());
+    if (!view || !semaphore) {
+        if (error) *error = "Failed to map shared memory: " + LastError();
+        if (view) UnmapViewOfFile(view);
+        if (semaphore) CloseHandle(semaphore);
+        CloseHandle(mapping);
+        return false;
+    }
+    mappingHandle = reinterpret_cast<intptr_t>(mapping);
+    semaphoreHandle = reinterpret_cast<intptr_t>(semaphore);
+#else
+    int fd = shm_open(MappingName(name).c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        if (error) *error = "no shared memory named '" + name + "'";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = (size_t)info.st_size;
+        view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) view = nullptr;
+    }
+    close(fd);
+    if (!view) {
+        if (error) *error = "Failed to map shared memory '" + name + "'";
+        return false;
+    }
+#endif
+    header = static_cast<shmring::Header*>(view);
+    mappedSize = size;
+    owner = false;
+
+    if (size < sizeof(shmring::Header) || header->magic != shmring::kMagic ||
+        header->version != shmring::kVersion || header->headerSize < sizeof(shmring::Header) ||
+        header->headerSize + header->capacity > size) {
+        if (error) *error = "'" + name + "' is not a compatible audio ring";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SharedMemoryMapping::Close() {
+    if (!header) return;
+#ifdef _WIN32
+    UnmapViewOfFile(header);
+    CloseHandle(reinterpret_cast<HANDLE>(mappingHandle));
+    CloseHandle(reinterpret_cast<HANDLE>(semaphoreHandle));
+    mappingHandle = 0;
+    semaphoreHandle = 0;
+#else
+    munmap(header, mappedSize);
+    if (owner) shm_unlink(MappingName(name).c_str());
+#endif
+    header = nullptr;
+    mappedSize = 0;
+    owner = false;
+}
+
+void SharedMemoryMapping::WaitForPublish(uint32_t sequence, uint32_t timeoutMs) {
+#if defined(_WIN32)
+    (void)sequence;
+    WaitForSingleObject(reinterpret_cast<HANDLE>(semaphoreHandle), timeoutMs);
+#elif defined(__linux__)
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+    // Returns at once if the sequence has already moved on
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->wakeSequence), FUTEX_WAIT, sequence, &timeout,
+            nullptr, 0);
+#else
+    (void)sequence;
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min<uint32_t>(timeoutMs, 1)));
+#endif
+}
+
+void SharedMemoryMapping::WakeReaders() {
+#if defined(_WIN32)
+    // One release per sleeper; a count left over by a reader that gave up
+    // only causes a spurious wake-up later
+    LONG sleepers = (LONG)header->waiters.load();
+    if (sleepers > 0) ReleaseSemaphore(reinterpret_cast<HANDLE>(semaphoreHandle), sleepers, nullptr);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->wakeSequence), FUTEX_WAKE, 0x7fffffff, nullptr,
+            nullptr, 0);
+#endif
+}
+
+bool SharedMemoryRingWriter::Create(const std::string& name, size_t minimumCapacity, const AudioFormat& format,
+                                    uint32_t container, std::string* error) {
+    if (!shmring::IsValidName(name)) {
+        if (error) *error = "Invalid shared memory name '" + name + "'; use letters, digits, '.', '-' and '_'";
+        return false;
+    }
+    capacity = 64 * 1024;
+    while (capacity < minimumCapacity) capacity *= 2;
+
+    // Data starts on its own page
+    size_t headerSize = 4096;
+    if (!mapping.Create(name, headerSize + capacity, error)) return false;
+
+    shmring::Header* header = mapping.Header();
+    header->magic = shmring::kMagic;
+    header->version = shmring::kVersion;
+    header->headerSize = (uint16_t)headerSize;
+    header->capacity = capacity;
+    header->container = container;
+    header->sampleRate = format.sampleRate;
+    header->channels = (uint16_t)format.channels;
+    header->bitsPerSample = (uint16_t)format.BitsPerSample();
+    header->blockAlign = (uint16_t)format.BlockAlign();
+    header->sampleFormat = format.type == SampleType::Float32 ? records::kSampleFormatFloat
+                                                              : records::kSampleFormatPcm;
+    header->channelMask = format.channelMask;
+    header->writerProcessId = CurrentProcessId();
+    data = mapping.Data();
+    cursor = 0;
+
+    if (container != shmring::kContainerFramed) {
+        header->state.store(shmring::kStateLive, std::memory_order_release);
+    }
+    return true;
+}
+
+void SharedMemoryRingWriter::SetStreamHeader(const records::StreamHeader& streamHeader) {
+    shmring::Header* header = mapping.Header();
+    memcpy(header->streamHeader, &streamHeader, sizeof(streamHeader));
+    header->state.store(shmring::kStateLive, std::memory_order_release);
+}
+
+void SharedMemoryRingWriter::Write(const void* recordHeader, size_t headerSize, const void* payload, size_t size,
+                                   size_t padding) {
+    static const uint8_t kZeros[8] = {};
+    size_t total = headerSize + size + padding;
+    if (total == 0) return;
+
+    shmring::Header* header = mapping.Header();
+    // Claim the span before touching it, so readers can tell afterwards
+    // whether what they read was overwritten meanwhile
+    header->writeReserve.store(cursor + total, std::memory_order_seq_cst);
+    Copy(recordHeader, headerSize);
+    Copy(payload, size);
+    Copy(kZeros, padding);
+    header->writeCursor.store(cursor, std::memory_order_release);
+    Publish();
+}
+
+void SharedMemoryRingWriter::Copy(const void* source, size_t size) {
+    if (size == 0) return;
+    const size_t mask = capacity - 1;
+    size_t offset = (size_t)(cursor & mask);
+    size_t firstPart = std::min(size, capacity - offset);
+    memcpy(data + offset, source, firstPart);
+    memcpy(data, static_cast<const uint8_t*>(source) + firstPart, size - firstPart);
+    cursor += size;
+}
+
+void SharedMemoryRingWriter::Publish() {
+    shmring::Header* header = mapping.Header();
+    header->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+    // Pairs with the reader registering before it rechecks the cursor, so
+    // the system call is only paid while somebody sleeps
+    if (header->waiters.load(std::memory_order_seq_cst) > 0) {
+        mapping.WakeReaders();
+    }
+}
+
+void SharedMemoryRingWriter::Close() {
+    shmring::Header* header = mapping.Header();
+    if (!header) return;
+    header->state.store(shmring::kStateClosed, std::memory_order_release);
+    header->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+    mapping.WakeReaders();
+    mapping.Close();
+    data = nullptr;
+}
+
+bool SharedMemoryRingReader::Attach(const std::string& name, std::string* error) {
+    Detach();
+    if (!shmring::IsValidName(name)) {
+        if (error) *error = "Invalid shared memory name '" + name + "'";
+        return false;
+    }
+    if (!mapping.Open(name, error)) return false;
+
+    const shmring::Header* header = mapping.Header();
+    uint32_t state = header->state.load(std::memory_order_acquire);
+    if (state != shmring::kStateLive) {
+        if (error) *error = state == shmring::kStateClosed ? "the stream has ended" : "the stream has not started yet";
+        mapping.Close();
+        return false;
+    }
+    data = mapping.Data();
+    capacity = (size_t)header->capacity;
+    cursor = header->writeCursor.load(std::memory_order_acquire);
+    bytesRead = 0;
+    lostBytes = 0;
+    overruns = 0;
+    return true;
+}
+
+void SharedMemoryRingReader::Detach() {
+    mapping.Close();
+    data = nullptr;
+}
+
+SharedMemoryRingReader::WaitResult SharedMemoryRingReader::Wait(uint32_t timeoutMs) {
+    shmring::Header* header = mapping.Header();
+    for (;;) {
+        if (header->writeCursor.load(std::memory_order_acquire) != cursor) return WaitResult::Ready;
+        if (header->state.load(std::memory_order_acquire) == shmring::kStateClosed) return WaitResult::Closed;
+
+        // Register first, then recheck: the writer either sees the waiter
+        // or this reader sees the new data
+        header->waiters.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t sequence = header->wakeSequence.load(std::memory_order_seq_cst);
+        bool idle = header->writeCursor.load(std::memory_order_seq_cst) == cursor &&
+                    header->state.load(std::memory_order_seq_cst) != shmring::kStateClosed;
+        if (idle) mapping.WaitForPublish(sequence, timeoutMs);
+        header->waiters.fetch_sub(1, std::memory_order_seq_cst);
+        if (idle && header->writeCursor.load(std::memory_order_acquire) == cursor &&
+            header->state.load(std::memory_order_acquire) != shmring::kStateClosed) {
+            return WaitResult::Timeout;
+        }
+    }
+}
+
+size_t SharedMemoryRingReader::Peek(const uint8_t** first, size_t* firstSize, const uint8_t** second,
+                                    size_t* secondSize) {
+    const shmring::Header* header = mapping.Header();
+    uint64_t write = header->writeCursor.load(std::memory_order_acquire);
+    if (cursor + capacity < header->writeReserve.load(std::memory_order_acquire)) {
+        SkipToLiveEdge();
+        write = cursor;
+    }
+    size_t available = (size_t)(write - cursor);
+    const size_t mask = capacity - 1;
+    size_t offset = (size_t)(cursor & mask);
+    size_t firstPart = std::min(available, capacity - offset);
+    *first = data + offset;
+    *firstSize = firstPart;
+    *second = data;
+    *secondSize = available - firstPart;
+    return available;
+}
+
+bool SharedMemoryRingReader::Consume(size_t size) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (cursor + capacity < mapping.Header()->writeReserve.load(std::memory_order_acquire)) {
+        SkipToLiveEdge();
+        return false;
+    }
+    cursor += size;
+    bytesRead += size;
+    return true;
+}
+
+void SharedMemoryRingReader::SkipToLiveEdge() {
+    uint64_t live = mapping.Header()->writeCursor.load(std::memory_order_acquire);
+    lostBytes += live - cursor;
+    overruns++;
+    cursor = live;
+}
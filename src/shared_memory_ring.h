@@ -0,0 +1,169 @@
+#pragma once
+
+// Named shared-memory ring carrying the output stream to co-located readers.
+//
+// The mapping (a file mapping on Windows, POSIX shm elsewhere) starts with a
+// Header describing the stream, followed by a power-of-two data area used as
+// a byte ring. There is one writer and any number of readers; readers keep
+// their own cursors and never hold the writer back, so they can attach and
+// detach at any time. A reader that falls a whole ring behind loses data and
+// resumes at the live edge.
+//
+// The writer publishes writeCursor only at record boundaries (whole frames,
+// whole silence records or whole framed packets), so a reader attaching or
+// resuming at writeCursor always starts on one. Before copying into the
+// ring it advances writeReserve; a reader that finds its span below
+// writeReserve - capacity after reading knows the span was overwritten.
+//
+// Readers sleep on a futex on Linux and a named semaphore on Windows, which
+// the writer only signals while somebody is waiting; other systems poll.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "audio_format.h"
+#include "stream_records.h"
+
+namespace shmring {
+
+constexpr uint32_t kMagic = records::MakeTag('W', 'A', 'S', 'R');
+constexpr uint16_t kVersion = 1;
+
+// What the ring carries; the same byte stream stdout would get
+constexpr uint32_t kContainerRaw = 0;      // bare PCM
+constexpr uint32_t kContainerRecords = 1;  // 'PCM '/'SILN' records (--silence-markers)
+constexpr uint32_t kContainerFramed = 2;   // framed packets (--framed)
+
+constexpr uint32_t kStateCreating = 0;
+constexpr uint32_t kStateLive = 1;
+constexpr uint32_t kStateClosed = 2;  // the writer has finished; drain and stop
+
+struct Header {
+    // Fixed once the state turns live
+    uint32_t magic;        // kMagic
+    uint16_t version;      // kVersion
+    uint16_t headerSize;   // offset of the data area
+    uint64_t capacity;     // data area bytes, a power of two
+    uint32_t container;    // kContainer*
+    uint32_t sampleRate;   // output format
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    uint16_t blockAlign;
+    uint16_t sampleFormat;  // records::kSampleFormatPcm / kSampleFormatFloat
+    uint32_t channelMask;
+    uint32_t writerProcessId;
+    uint8_t streamHeader[sizeof(records::StreamHeader)];  // kContainerFramed only; not in the ring
+
+    alignas(64) std::atomic<uint32_t> state;
+    alignas(64) std::atomic<uint64_t> writeReserve;  // bytes the writer may have started to write
+    std::atomic<uint64_t> writeCursor;               // bytes readable, always at a record boundary
+    alignas(64) std::atomic<uint32_t> wakeSequence;  // futex word, bumped on every publish
+    std::atomic<uint32_t> waiters;                   // readers asleep or about to be
+};
+
+static_assert(sizeof(Header) == 320, "Header layout is part of the protocol");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring cursors must be lock-free across processes");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring cursors must be lock-free across processes");
+
+// Letters, digits, '.', '-' and '_'
+bool IsValidName(const std::string& name);
+
+}  // namespace shmring
+
+// Platform mapping shared by the writer and the readers
+class SharedMemoryMapping {
+public:
+    SharedMemoryMapping() {}
+    ~SharedMemoryMapping() { Close(); }
+
+    SharedMemoryMapping(const SharedMemoryMapping&) = delete;
+    SharedMemoryMapping& operator=(const SharedMemoryMapping&) = delete;
+
+    bool Create(const std::string& name, size_t size, std::string* error);
+    bool Open(const std::string& name, std::string* error);
+    void Close();
+
+    shmring::Header* Header() const { return header; }
+    uint8_t* Data() const { return reinterpret_cast<uint8_t*>(header) + header->headerSize; }
+
+    // Reader side: sleep until wakeSequence moves on from `sequence`
+    void WaitForPublish(uint32_t sequence, uint32_t timeoutMs);
+    // Writer side: wake every sleeping reader
+    void WakeReaders();
+
+private:
+    std::string name;
+    bool owner = false;
+    shmring::Header* header = nullptr;
+    size_t mappedSize = 0;
+    intptr_t mappingHandle = 0;    // Windows file mapping
+    intptr_t semaphoreHandle = 0;  // Windows wake-up semaphore
+};
+
+class SharedMemoryRingWriter {
+public:
+    // Create (or replace) the named ring with at least `capacity` data bytes.
+    // Framed rings only go live once SetStreamHeader() has been called.
+    bool Create(const std::string& name, size_t capacity, const AudioFormat& format, uint32_t container,
+                std::string* error);
+
+    void SetStreamHeader(const records::StreamHeader& streamHeader);
+
+    // Append one record and publish it; never blocks
+    void Write(const void* header, size_t headerSize, const void* data, size_t size, size_t padding);
+
+    // Mark the stream finished, wake readers and remove the name
+    void Close();
+
+    bool IsOpen() const { return mapping.Header() != nullptr; }
+    size_t Capacity() const { return capacity; }
+    uint64_t BytesWritten() const { return cursor; }
+
+private:
+    SharedMemoryMapping mapping;
+    uint8_t* data = nullptr;
+    size_t capacity = 0;
+    uint64_t cursor = 0;
+
+    void Copy(const void* source, size_t size);
+    void Publish();
+};
+
+class SharedMemoryRingReader {
+public:
+    enum class WaitResult { Ready, Timeout, Closed };
+
+    // Attach at the live edge; fails until the writer has gone live
+    bool Attach(const std::string& name, std::string* error);
+    void Detach();
+
+    const shmring::Header& Header() const { return *mapping.Header(); }
+
+    // Block until unread data is available or the writer has closed
+    WaitResult Wait(uint32_t timeoutMs);
+
+    // Unread bytes in place (second may be empty). A reader found to be
+    // overrun first skips to the live edge.
+    size_t Peek(const uint8_t** first, size_t* firstSize, const uint8_t** second, size_t* secondSize);
+
+    // Done with `size` peeked bytes. False if the writer overwrote them
+    // while they were in use; the reader has then moved to the live edge.
+    bool Consume(size_t size);
+
+    uint64_t BytesRead() const { return bytesRead; }
+    uint64_t LostBytes() const { return lostBytes; }
+    uint64_t Overruns() const { return overruns; }
+
+private:
+    SharedMemoryMapping mapping;
+    const uint8_t* data = nullptr;
+    size_t capacity = 0;
+    uint64_t cursor = 0;
+    uint64_t bytesRead = 0;
+    uint64_t lostBytes = 0;
+    uint64_t overruns = 0;
+
+    void SkipToLiveEdge();
+};
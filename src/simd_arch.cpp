@@ -0,0 +1,76 @@
+#include "simd_arch.h"
+
+#if defined(AUDIO_ARCH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(AUDIO_ARCH_X86)
+namespace {
+
+#if defined(_MSC_VER)
+void Cpuid(int leaf, int subleaf, int regs[4]) {
+    __cpuidex(regs, leaf, subleaf);
+}
+
+unsigned long long ReadXcr0() {
+    return _xgetbv(0);
+}
+#else
+void Cpuid(int leaf, int subleaf, int regs[4]) {
+    unsigned int a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf));
+    regs[0] = (int)a;
+    regs[1] = (int)b;
+    regs[2] = (int)c;
+    regs[3] = (int)d;
+}
+
+unsigned long long ReadXcr0() {
+    unsigned int lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+}
+#endif
+
+}  // namespace
+#endif
+
+bool CpuSupportsSse2() {
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;
+#elif defined(AUDIO_ARCH_X86)
+    int regs[4];
+    Cpuid(1, 0, regs);
+    return (regs[3] & (1 << 26)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool CpuSupportsAvx2() {
+#if defined(AUDIO_ARCH_X86)
+    int regs[4];
+    Cpuid(0, 0, regs);
+    if (regs[0] < 7) return false;
+
+    // AVX state must be enabled by the OS (OSXSAVE + XCR0 bits 1 and 2)
+    Cpuid(1, 0, regs);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((ReadXcr0() & 0x6) != 0x6) return false;
+
+    Cpuid(7, 0, regs);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool CpuSupportsNeon() {
+#if defined(AUDIO_ARCH_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Target architecture detection shared by the SIMD kernel translation units.
+// Each kernel file compiles to an empty stub on architectures it does not
+// support, so every source can be listed unconditionally in the build.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUDIO_ARCH_X86 1
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define AUDIO_ARCH_NEON 1
+#endif
+
+// Runtime CPU feature queries (always false on other architectures)
+bool CpuSupportsSse2();
+bool CpuSupportsAvx2();
+bool CpuSupportsNeon();
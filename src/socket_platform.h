@@ -0,0 +1,165 @@
+#pragma once
+
+// Winsock / BSD socket differences for the local servers (the framed stream
+// server and the metrics endpoint). Include from .cpp files only: it pulls
+// in the platform socket headers.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace net {
+
+#ifdef _WIN32
+using Socket = SOCKET;
+using PollFd = WSAPOLLFD;
+
+inline int PollSockets(PollFd* fds, size_t count, int timeoutMs) {
+    return WSAPoll(fds, (ULONG)count, timeoutMs);
+}
+
+inline void CloseSocket(Socket s) {
+    closesocket(s);
+}
+
+inline bool SetNonBlocking(Socket s) {
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+}
+
+inline bool WouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+inline std::string LastSocketError() {
+    return "socket error " + std::to_string(WSAGetLastError());
+}
+#else
+using Socket = int;
+using PollFd = pollfd;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+inline int PollSockets(PollFd* fds, size_t count, int timeoutMs) {
+    return ::poll(fds, (nfds_t)count, timeoutMs);
+}
+
+inline void CloseSocket(Socket s) {
+    ::close(s);
+}
+
+inline bool SetNonBlocking(Socket s) {
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+inline bool WouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+inline std::string LastSocketError() {
+    return std::strerror(errno);
+}
+#endif
+
+inline Socket ToSocket(intptr_t handle) {
+    return (Socket)handle;
+}
+
+inline std::string FormatAddress(const sockaddr* address) {
+    char text[INET6_ADDRSTRLEN] = "?";
+    if (address->sa_family == AF_INET) {
+        const sockaddr_in* in = reinterpret_cast<const sockaddr_in*>(address);
+        inet_ntop(AF_INET, &in->sin_addr, text, sizeof(text));
+        return std::string(text) + ":" + std::to_string(ntohs(in->sin_port));
+    }
+    if (address->sa_family == AF_INET6) {
+        const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(address);
+        inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text));
+        return "[" + std::string(text) + "]:" + std::to_string(ntohs(in6->sin6_port));
+    }
+    return "local";
+}
+
+// Split "[host:]port"; the host defaults to loopback so a server stays on
+// this machine unless an address is given explicitly
+inline bool ParseTcpAddress(const std::string& spec, std::string& host, std::string& port) {
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos) {
+        host = "127.0.0.1";
+        port = spec;
+    } else {
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+    }
+    return !host.empty() && !port.empty() && port.size() <= 5 &&
+           std::all_of(port.begin(), port.end(), [](char c) { return c >= '0' && c <= '9'; }) &&
+           std::stoul(port) <= 65535;
+}
+
+// Bind a TCP socket to the first address `host` resolves to that works.
+// Returns -1 with `reason` set on failure.
+inline Socket BindTcp(const std::string& host, const std::string& port, std::string& reason) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0 || !addresses) {
+        reason = "cannot resolve listen address '" + host + "'";
+        return (Socket)-1;
+    }
+    Socket bound = (Socket)-1;
+    for (addrinfo* address = addresses; address && bound == (Socket)-1; address = address->ai_next) {
+        Socket s = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (s == (Socket)-1) continue;
+#ifndef _WIN32
+        // Restarting the capture must not wait out TIME_WAIT on the port
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#endif
+        if (bind(s, address->ai_addr, (int)address->ai_addrlen) != 0) {
+            reason = LastSocketError();
+            CloseSocket(s);
+            continue;
+        }
+        bound = s;
+    }
+    freeaddrinfo(addresses);
+    return bound;
+}
+
+// Local address of a bound socket as "host:port"
+inline std::string LocalAddress(Socket s) {
+    sockaddr_storage local = {};
+    socklen_t localSize = sizeof(local);
+    getsockname(s, reinterpret_cast<sockaddr*>(&local), &localSize);
+    return FormatAddress(reinterpret_cast<const sockaddr*>(&local));
+}
+
+}  // namespace net
@@ -0,0 +1,180 @@
+#pragma once
+
+// Lock-free single-producer / single-consumer byte ring.
+//
+// The producer and consumer indices live on separate cache lines. The
+// producer, which writes once per packet, keeps a private cached copy of the
+// consumer's index for the space check, so it only synchronizes with the
+// consumer when the ring looks full (the high-water statistic takes a
+// relaxed look at the live index after each write); the consumer reads the producer index once per Peek(), i.e. once per batch,
+// so it always sees everything queued so far. Writes are
+// all-or-nothing: a write that does not fit is rejected and counted as an
+// overrun rather than splitting a packet.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+class SpscByteRing {
+public:
+    static constexpr size_t kCacheLine = 64;
+
+    SpscByteRing() {}
+
+    SpscByteRing(const SpscByteRing&) = delete;
+    SpscByteRing& operator=(const SpscByteRing&) = delete;
+
+    // Capacity is rounded up to a power of two. Not thread safe; call before
+    // the producer and consumer start.
+    bool Initialize(size_t capacityBytes) {
+        if (capacityBytes == 0) return false;
+        size_t capacity = 1;
+        while (capacity < capacityBytes) capacity <<= 1;
+        buffer.reset(new uint8_t[capacity]);
+        mask = capacity - 1;
+        size = capacity;
+        producer.head.store(0, std::memory_order_relaxed);
+        producer.cachedTail = 0;
+        consumer.tail.store(0, std::memory_order_relaxed);
+        stats.overruns.store(0, std::memory_order_relaxed);
+        stats.droppedBytes.store(0, std::memory_order_relaxed);
+        stats.writtenBytes.store(0, std::memory_order_relaxed);
+        stats.highWater.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Capacity() const { return size; }
+
+    // Producer side -------------------------------------------------------
+
+    bool Write(const void* data, size_t length) {
+        return Write(data, length, nullptr, 0);
+    }
+
+    // Gather write: both parts (plus `padding` zero bytes) are queued back to
+    // back, or nothing is
+    bool Write(const void* data, size_t length, const void* extra, size_t extraLength,
+               size_t padding = 0) {
+        size_t total = length + extraLength + padding;
+        uint64_t head = producer.head.load(std::memory_order_relaxed);
+        if (size - (head - producer.cachedTail) < total) {
+            producer.cachedTail = consumer.tail.load(std::memory_order_acquire);
+            if (size - (head - producer.cachedTail) < total) {
+                stats.overruns.fetch_add(1, std::memory_order_relaxed);
+                stats.droppedBytes.fetch_add(total, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        Copy(head, data, length);
+        Copy(head + length, extra, extraLength);
+        Fill(head + length + extraLength, padding);
+        producer.head.store(head + total, std::memory_order_release);
+
+        // The cached tail can be far behind a consumer that keeps up, so
+        // measure against the live one
+        uint64_t used = head + total - consumer.tail.load(std::memory_order_relaxed);
+        if (used > stats.highWater.load(std::memory_order_relaxed)) {
+            stats.highWater.store(used, std::memory_order_relaxed);
+        }
+        stats.writtenBytes.fetch_add(total, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer side -------------------------------------------------------
+
+    // Expose readable bytes in place as up to two contiguous segments.
+    // Returns the total readable; release them with Consume().
+    size_t Peek(const uint8_t** first, size_t* firstLength,
+                const uint8_t** second, size_t* secondLength) {
+        uint64_t tail = consumer.tail.load(std::memory_order_relaxed);
+        uint64_t head = producer.head.load(std::memory_order_acquire);
+        size_t available = static_cast<size_t>(head - tail);
+        size_t offset = static_cast<size_t>(tail & mask);
+        size_t firstPart = available < size - offset ? available : size - offset;
+
+        *first = buffer.get() + offset;
+        *firstLength = firstPart;
+        *second = buffer.get();
+        *secondLength = available - firstPart;
+        return available;
+    }
+
+    void Consume(size_t length) {
+        uint64_t tail = consumer.tail.load(std::memory_order_relaxed);
+        consumer.tail.store(tail + length, std::memory_order_release);
+    }
+
+    // Copying read; returns bytes read
+    size_t Read(void* data, size_t maxLength) {
+        const uint8_t* a;
+        const uint8_t* b;
+        size_t aLength;
+        size_t bLength;
+        size_t available = Peek(&a, &aLength, &b, &bLength);
+        size_t n = available < maxLength ? available : maxLength;
+        size_t fromA = n < aLength ? n : aLength;
+        memcpy(data, a, fromA);
+        memcpy(static_cast<uint8_t*>(data) + fromA, b, n - fromA);
+        Consume(n);
+        return n;
+    }
+
+    // Either side -----------------------------------------------------------
+
+    size_t Used() const {
+        return static_cast<size_t>(producer.head.load(std::memory_order_acquire) -
+                                   consumer.tail.load(std::memory_order_acquire));
+    }
+
+    bool Empty() const { return Used() == 0; }
+
+    uint64_t Overruns() const { return stats.overruns.load(std::memory_order_relaxed); }
+    uint64_t DroppedBytes() const { return stats.droppedBytes.load(std::memory_order_relaxed); }
+    uint64_t WrittenBytes() const { return stats.writtenBytes.load(std::memory_order_relaxed); }
+    uint64_t HighWaterBytes() const { return stats.highWater.load(std::memory_order_relaxed); }
+
+private:
+    void Copy(uint64_t position, const void* data, size_t length) {
+        if (length == 0) return;
+        size_t offset = static_cast<size_t>(position & mask);
+        size_t first = length < size - offset ? length : size - offset;
+        memcpy(buffer.get() + offset, data, first);
+        memcpy(buffer.get(), static_cast<const uint8_t*>(data) + first, length - first);
+    }
+
+    void Fill(uint64_t position, size_t length) {
+        if (length == 0) return;
+        size_t offset = static_cast<size_t>(position & mask);
+        size_t first = length < size - offset ? length : size - offset;
+        memset(buffer.get() + offset, 0, first);
+        memset(buffer.get(), 0, length - first);
+    }
+
+    struct alignas(kCacheLine) ProducerState {
+        std::atomic<uint64_t> head{0};
+        uint64_t cachedTail = 0;
+    };
+
+    struct alignas(kCacheLine) ConsumerState {
+        std::atomic<uint64_t> tail{0};
+    };
+
+    // Written by the producer only, read by anyone
+    struct alignas(kCacheLine) Stats {
+        std::atomic<uint64_t> overruns{0};
+        std::atomic<uint64_t> droppedBytes{0};
+        std::atomic<uint64_t> writtenBytes{0};
+        std::atomic<uint64_t> highWater{0};
+    };
+
+    ProducerState producer;
+    ConsumerState consumer;
+    Stats stats;
+
+    alignas(kCacheLine) std::unique_ptr<uint8_t[]> buffer;
+    size_t mask = 0;
+    size_t size = 0;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+// Stdout framings other than bare PCM.
+//
+// Silence records (--silence-markers)
+// -----------------------------------
+// Instead of a bare PCM stream, stdout carries a sequence of records, each
+// an 8-byte little-endian header followed by an optional payload:
+//
+//   tag   'PCM ' (0x204D4350)  value = payload size in bytes; PCM follows
+//   tag   'SILN' (0x4E4C4953)  value = number of silent frames; no payload
+//
+// Frame counts are in the output format, so a consumer can expand a
+// silence record into value * blockAlign zero bytes and recover exactly the
+// stream the plain mode would have produced.
+//
+// Timestamped frames (--framed)
+// -----------------------------
+// One StreamHeader, then per packet a PacketHeader followed by its payload,
+// zero padded to a multiple of 8 bytes. Every header therefore starts on an
+// 8-byte boundary of the stream and can be read in place (fields are
+// little-endian and naturally aligned). With --silence-markers, silent
+// spans become packets with kFlagSilent and no payload.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace records {
+
+constexpr uint32_t MakeTag(char a, char b, char c, char d) {
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) |
+           ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+constexpr uint32_t kAudioTag = MakeTag('P', 'C', 'M', ' ');
+constexpr uint32_t kSilenceTag = MakeTag('S', 'I', 'L', 'N');
+
+constexpr size_t kHeaderSize = 8;
+
+// Serialize a header in little-endian byte order
+inline void WriteHeader(uint8_t* out, uint32_t tag, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(tag >> (8 * i));
+        out[4 + i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// Packet flags. The low bits mirror AUDCLNT_BUFFERFLAGS_* from GetBuffer().
+constexpr uint32_t kFlagDiscontinuity = 0x1;    // device reported a glitch before this packet
+constexpr uint32_t kFlagSilent = 0x2;           // device flagged the packet as silent
+constexpr uint32_t kFlagTimestampError = 0x4;   // device timestamps are unreliable
+constexpr uint32_t kFlagOutputDropped = 0x100;  // earlier packets were dropped on a full output buffer
+constexpr uint32_t kFlagFlush = 0x200;          // resampler tail at shutdown; timestamps repeat the last packet
+constexpr uint32_t kFlagPadded = 0x400;         // --frame-size: part of the frame is silence added to fill it
+
+constexpr uint32_t kStreamMagic = MakeTag('W', 'A', 'C', 'F');
+constexpr uint32_t kPacketMagic = MakeTag('P', 'K', 'T', '0');
+constexpr uint16_t kStreamVersion = 1;
+
+// Ticks per second of PacketHeader::timestamp (WASAPI reports 100 ns units)
+constexpr uint64_t kTimestampFrequency = 10000000;
+
+constexpr uint16_t kSampleFormatPcm = 1;    // WAVE_FORMAT_PCM
+constexpr uint16_t kSampleFormatFloat = 3;  // WAVE_FORMAT_IEEE_FLOAT
+
+struct StreamHeader {
+    uint32_t magic;               // kStreamMagic
+    uint16_t version;             // kStreamVersion
+    uint16_t headerSize;          // sizeof(StreamHeader)
+    uint32_t sampleRate;          // output format
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    uint16_t blockAlign;
+    uint16_t sampleFormat;        // kSampleFormatPcm / kSampleFormatFloat
+    uint32_t channelMask;         // SPEAKER_* bits, 0 if unknown
+    uint32_t deviceSampleRate;    // unit of PacketHeader::devicePosition
+    uint32_t latencyFrames;       // fixed processing delay, in output frames
+    uint32_t packetHeaderSize;    // sizeof(PacketHeader)
+    uint32_t packetFrames;        // frames in every packet (--frame-size), 0 if packets vary
+    uint64_t timestampFrequency;  // kTimestampFrequency
+};
+
+struct PacketHeader {
+    uint32_t magic;           // kPacketMagic
+    uint32_t flags;           // kFlag*
+    uint64_t devicePosition;  // device frame position of the captured packet
+    uint64_t timestamp;       // QPC time of the captured packet, timestampFrequency units
+    uint64_t streamPosition;  // output frames emitted before this packet
+    uint32_t frames;          // output frames this packet covers
+    uint32_t payloadBytes;    // PCM bytes that follow (0 for a silence marker)
+};
+
+static_assert(sizeof(StreamHeader) == 48, "StreamHeader layout is part of the protocol");
+static_assert(sizeof(PacketHeader) == 40, "PacketHeader layout is part of the protocol");
+
+// Zero bytes appended after a payload to keep the next header aligned
+inline size_t PaddingFor(size_t payloadBytes) {
+    return (8 - (payloadBytes & 7)) & 7;
+}
+
+inline bool IsAllZero(const uint8_t* data, size_t size) {
+    // Word-at-a-time scan; silent output is the common case we expect here
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word != 0) return false;
+    }
+    for (; i < size; i++) {
+        if (data[i] != 0) return false;
+    }
+    return true;
+}
+
+}  // namespace records
@@ -0,0 +1,513 @@
+#include "stream_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "socket_platform.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+using namespace net;
+
+namespace {
+
+// Gather-send up to three blocks without blocking. Returns the bytes sent,
+// 0 when the socket buffer is full and -1 once the peer is gone.
+int64_t SendBlocks(Socket s, const uint8_t* const* blocks, const size_t* sizes, int count) {
+#ifdef _WIN32
+    WSABUF buffers[3];
+    for (int i = 0; i < count; i++) {
+        buffers[i].buf = reinterpret_cast<CHAR*>(const_cast<uint8_t*>(blocks[i]));
+        buffers[i].len = (ULONG)sizes[i];
+    }
+    DWORD sent = 0;
+    if (WSASend(s, buffers, (DWORD)count, &sent, 0, nullptr, nullptr) != 0) {
+        return WouldBlock() ? 0 : -1;
+    }
+    return (int64_t)sent;
+#else
+    struct iovec iov[3];
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<uint8_t*>(blocks[i]);
+        iov[i].iov_len = sizes[i];
+    }
+    struct msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = (size_t)count;
+    ssize_t sent = ::sendmsg(s, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+        return WouldBlock() ? 0 : -1;
+    }
+    return (int64_t)sent;
+#endif
+}
+
+}  // namespace
+
+bool StreamServerSink::IsSocketTarget(const std::string& target) {
+    return target.compare(0, 4, "tcp:") == 0 || target.compare(0, 5, "unix:") == 0;
+}
+
+StreamServerSink::~StreamServerSink() {
+    Shutdown();
+}
+
+bool StreamServerSink::Open(const AudioFormat& format, std::string* error) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        if (error) *error = "Failed to initialize Winsock";
+        return false;
+    }
+    socketsStarted = true;
+#endif
+
+    std::string reason;
+    std::string bound;
+    if (target.compare(0, 4, "tcp:") == 0) {
+        std::string host, port;
+        if (!ParseTcpAddress(target.substr(4), host, port)) {
+            if (error) *error = "Invalid socket output '" + target + "'; expected tcp:[host:]port";
+            return false;
+        }
+        Socket s = BindTcp(host, port, reason);
+        if (s != (Socket)-1) {
+            listenSocket = (intptr_t)s;
+            bound = "tcp:" + LocalAddress(s);
+        }
+    } else {
+#ifdef _WIN32
+        if (error) *error = "Unix domain socket outputs are not supported on Windows; use tcp:[host:]port";
+        return false;
+#else
+        std::string path = target.substr(5);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            if (error) *error = "Invalid socket output '" + target + "'; expected unix:path";
+            return false;
+        }
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        // A socket left behind by an earlier run would make bind() fail;
+        // anything other than a socket is left alone
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(path.c_str());
+        }
+        Socket s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s >= 0 && bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            listenSocket = s;
+            unixPath = path;
+            bound = target;
+        } else {
+            reason = LastSocketError();
+            if (s >= 0) CloseSocket(s);
+        }
+#endif
+    }
+
+    if (listenSocket == -1 || listen(ToSocket(listenSocket), 16) != 0 || !SetNonBlocking(ToSocket(listenSocket))) {
+        if (reason.empty()) reason = LastSocketError();
+        if (error) *error = "Failed to listen on " + target + ": " + reason;
+        Shutdown();
+        return false;
+    }
+
+    // The server thread sleeps in poll(); a datagram to this socket wakes it
+    // when new audio is published. It works the same with Winsock, unlike a
+    // pipe.
+    Socket wake = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in loopback = {};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t loopbackSize = sizeof(loopback);
+    if (wake == (Socket)-1 || bind(wake, reinterpret_cast<sockaddr*>(&loopback), sizeof(loopback)) != 0 ||
+        getsockname(wake, reinterpret_cast<sockaddr*>(&loopback), &loopbackSize) != 0 ||
+        connect(wake, reinterpret_cast<sockaddr*>(&loopback), sizeof(loopback)) != 0 || !SetNonBlocking(wake)) {
+        if (error) *error = "Failed to create wake-up socket: " + LastSocketError();
+        if (wake != (Socket)-1) CloseSocket(wake);
+        Shutdown();
+        return false;
+    }
+    wakeSocket = (intptr_t)wake;
+
+    // Twice the lag window, so a client is judged by the threshold well
+    // before the buffer wraps under it; packet headers fit in the margin
+    uint64_t lagBytes = (uint64_t)format.BytesPerSecond() * (uint64_t)options.maxLagMs / 1000;
+    size_t capacity = kMinHistoryBytes;
+    while (capacity < lagBytes * 2 + kMinHistoryBytes / 4) capacity *= 2;
+    history.assign(capacity, 0);
+    packets.assign(kMaxPackets, PacketEntry());
+    // Room for a whole index of packets per write, so bursts do not reallocate
+    newPackets.reserve(kMaxPackets);
+    sampleRate = format.sampleRate;
+    sendBufferBytes = std::max<size_t>(format.BytesPerSecond() / 10, kMinSendBufferBytes);
+
+    server = std::thread(&StreamServerSink::Serve, this);
+
+    std::cerr << "Serving framed stream on " << bound << " (" << capacity / 1024 << " KB history, "
+              << (options.skipLagging ? "skipping" : "disconnecting") << " clients more than "
+              << options.maxLagMs << " ms behind)" << std::endl;
+    return true;
+}
+
+bool StreamServerSink::Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) {
+    bool hadHeader = headerReady.load(std::memory_order_relaxed);
+    TakeStreamHeader(first, firstSize);
+    TakeStreamHeader(second, secondSize);
+
+    size_t total = firstSize + secondSize;
+    if (total > 0) {
+        // Mark the bytes about to be overwritten before touching them, so a
+        // send that races with the copy can tell afterwards
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            reserved = head + total;
+        }
+        Append(first, firstSize);
+        Append(second, secondSize);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            head += total;
+            for (const PacketEntry& entry : newPackets) {
+                packets[packetCount % kMaxPackets] = entry;
+                packetCount++;
+            }
+        }
+        newPackets.clear();
+    }
+    if (total > 0 || headerReady.load(std::memory_order_relaxed) != hadHeader) {
+        Wake();
+    }
+    return true;
+}
+
+// The stream header is kept aside and sent to every client as it joins
+void StreamServerSink::TakeStreamHeader(const uint8_t*& data, size_t& size) {
+    if (streamHeaderFill == sizeof(streamHeader) || size == 0) return;
+    size_t take = std::min(sizeof(streamHeader) - streamHeaderFill, size);
+    memcpy(streamHeader + streamHeaderFill, data, take);
+    streamHeaderFill += take;
+    data += take;
+    size -= take;
+    if (streamHeaderFill == sizeof(streamHeader)) {
+        headerReady.store(true, std::memory_order_release);
+    }
+}
+
+// Copy into the history buffer and note every packet header that completes
+void StreamServerSink::Append(const uint8_t* data, size_t size) {
+    const size_t mask = history.size() - 1;
+    size_t offset = (size_t)(writePosition & mask);
+    size_t firstPart = std::min(size, history.size() - offset);
+    memcpy(history.data() + offset, data, firstPart);
+    memcpy(history.data(), data + firstPart, size - firstPart);
+
+    // The output queue only drops whole packets, so headers stay where the
+    // previous one said they would be
+    size_t pos = 0;
+    while (pos < size) {
+        uint64_t at = writePosition + pos;
+        if (packetHeaderFill == 0 && at < nextPacketOffset) {
+            pos += (size_t)std::min<uint64_t>(nextPacketOffset - at, size - pos);
+            continue;
+        }
+        size_t take = std::min(sizeof(packetHeader) - packetHeaderFill, size - pos);
+        memcpy(packetHeader + packetHeaderFill, data + pos, take);
+        packetHeaderFill += take;
+        pos += take;
+        if (packetHeaderFill == sizeof(packetHeader)) {
+            records::PacketHeader header;
+            memcpy(&header, packetHeader, sizeof(header));
+            PacketEntry entry;
+            entry.offset = nextPacketOffset;
+            entry.streamPosition = header.streamPosition;
+            entry.frames = header.frames;
+            entry.bytes = (uint32_t)(sizeof(header) + header.payloadBytes + records::PaddingFor(header.payloadBytes));
+            newPackets.push_back(entry);
+            nextPacketOffset += entry.bytes;
+            packetHeaderFill = 0;
+        }
+    }
+    writePosition += size;
+}
+
+void StreamServerSink::Wake() {
+    const uint8_t byte = 0;
+    // A full socket buffer already holds a wake-up
+    send(ToSocket(wakeSocket), reinterpret_cast<const char*>(&byte), 1, 0);
+}
+
+void StreamServerSink::Serve() {
+    std::vector<PollFd> fds;
+    std::chrono::steady_clock::time_point deadline;
+    bool draining = false;
+
+    while (true) {
+        if (!draining && stopping.load(std::memory_order_acquire)) {
+            draining = true;
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kDrainTimeoutMs);
+        }
+
+        for (Client& client : clients) {
+            ServiceClient(client);
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.closed; }),
+                      clients.end());
+
+        int timeoutMs = 1000;
+        if (draining) {
+            bool pending = false;
+            for (const Client& client : clients) {
+                pending = pending || HasPending(client);
+            }
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline -
+                                                                              std::chrono::steady_clock::now());
+            if (!pending || left.count() <= 0) break;
+            timeoutMs = (int)left.count();
+        }
+
+        fds.clear();
+        PollFd fd = {};
+        fd.fd = ToSocket(wakeSocket);
+        fd.events = POLLIN;
+        fds.push_back(fd);
+        fd.fd = ToSocket(listenSocket);
+        fds.push_back(fd);
+        for (const Client& client : clients) {
+            fd.fd = ToSocket(client.socket);
+            fd.events = (short)(POLLIN | (HasPending(client) ? POLLOUT : 0));
+            fds.push_back(fd);
+        }
+        if (PollSockets(fds.data(), fds.size(), timeoutMs) < 0) {
+            if (WouldBlock()) continue;
+            std::cerr << "Warning: " << target << ": poll failed: " << LastSocketError() << std::endl;
+            break;
+        }
+
+        if (fds[0].revents) {
+            char buffer[64];
+            while (recv(ToSocket(wakeSocket), buffer, sizeof(buffer), 0) > 0) {
+            }
+        }
+        // Clients only listen; anything they send is discarded, and a read
+        // of zero bytes is how a departure shows up
+        for (size_t i = 0; i < clients.size(); i++) {
+            short events = fds[i + 2].revents;
+            if (!(events & (POLLIN | POLLERR | POLLHUP))) continue;
+            char buffer[256];
+            int received = (int)recv(ToSocket(clients[i].socket), buffer, sizeof(buffer), 0);
+            if (received == 0 || (received < 0 && !WouldBlock())) {
+                DropClient(clients[i], "connection closed");
+            }
+        }
+        if (fds[1].revents && !draining) {
+            AcceptClients();
+        }
+    }
+
+    for (Client& client : clients) {
+        CloseSocket(ToSocket(client.socket));
+    }
+    clients.clear();
+}
+
+void StreamServerSink::AcceptClients() {
+    while (true) {
+        sockaddr_storage address = {};
+        socklen_t addressSize = sizeof(address);
+        Socket s = accept(ToSocket(listenSocket), reinterpret_cast<sockaddr*>(&address), &addressSize);
+        if (s == (Socket)-1) return;
+        if (!SetNonBlocking(s)) {
+            CloseSocket(s);
+            continue;
+        }
+        if (address.ss_family != AF_UNIX) {
+            // Packets are small and latency matters more than segment count
+            int on = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+        }
+        // Keep the kernel's send buffer small: audio parked there is lag the
+        // threshold cannot see
+        int sendBuffer = (int)sendBufferBytes;
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&sendBuffer), sizeof(sendBuffer));
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        Client client;
+        client.socket = (intptr_t)s;
+        client.id = nextClientId++;
+        client.peer = FormatAddress(reinterpret_cast<const sockaddr*>(&address));
+        clientsServed++;
+        std::cerr << target << ": client " << client.id << " connected (" << client.peer << ")" << std::endl;
+        clients.push_back(client);
+        ServiceClient(clients.back());
+    }
+}
+
+void StreamServerSink::ServiceClient(Client& client) {
+    if (client.closed || !headerReady.load(std::memory_order_acquire)) return;
+
+    const size_t capacity = history.size();
+    const size_t mask = capacity - 1;
+    std::string dropReason;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = [&](uint64_t index) -> const PacketEntry& { return packets[index % kMaxPackets]; };
+
+        if (!client.joined) {
+            // Live from the newest packet on
+            memcpy(client.prefix, streamHeader, sizeof(streamHeader));
+            client.prefixSize = sizeof(streamHeader);
+            client.prefixSent = 0;
+            client.packet = packetCount > 0 ? packetCount - 1 : 0;
+            client.cursor = packetCount > 0 ? entry(client.packet).offset : 0;
+            client.joined = true;
+        }
+
+        uint64_t limit = head;
+        if (client.cursor + capacity < reserved || (packetCount > 0 && client.packet + kMaxPackets < packetCount)) {
+            dropReason = "fell out of the history buffer";
+        } else if (packetCount > 0) {
+            while (client.packet + 1 < packetCount && entry(client.packet + 1).offset <= client.cursor) {
+                client.packet++;
+            }
+            const PacketEntry& current = entry(client.packet);
+            const PacketEntry& newest = entry(packetCount - 1);
+            uint64_t lagFrames = newest.streamPosition - current.streamPosition;
+            if (lagFrames * 1000 > (uint64_t)options.maxLagMs * sampleRate) {
+                bool atBoundary = client.prefixSent == client.prefixSize && client.cursor == current.offset;
+                if (!options.skipLagging) {
+                    dropReason = "more than " + std::to_string(options.maxLagMs) + " ms behind";
+                } else if (atBoundary) {
+                    // Resume at the newest packet with its own header copy
+                    // flagged, so the client knows audio is missing
+                    for (size_t i = 0; i < sizeof(records::PacketHeader); i++) {
+                        client.prefix[i] = history[(size_t)((newest.offset + i) & mask)];
+                    }
+                    records::PacketHeader header;
+                    memcpy(&header, client.prefix, sizeof(header));
+                    header.flags |= records::kFlagOutputDropped;
+                    memcpy(client.prefix, &header, sizeof(header));
+                    client.prefixSize = sizeof(header);
+                    client.prefixSent = 0;
+                    client.cursor = newest.offset + sizeof(header);
+                    client.packet = packetCount - 1;
+                    clientSkips++;
+                } else {
+                    // Finish the packet in progress so the framing holds
+                    limit = std::min(limit, current.offset + current.bytes);
+                }
+            }
+        }
+        start = client.cursor;
+        end = std::max(start, limit);
+    }
+    if (!dropReason.empty()) {
+        clientsDropped++;
+        DropClient(client, dropReason);
+        return;
+    }
+
+    const uint8_t* blocks[3];
+    size_t sizes[3];
+    int count = 0;
+    if (client.prefixSent < client.prefixSize) {
+        blocks[count] = client.prefix + client.prefixSent;
+        sizes[count++] = client.prefixSize - client.prefixSent;
+    }
+    if (end > start) {
+        size_t offset = (size_t)(start & mask);
+        size_t size = (size_t)(end - start);
+        size_t firstPart = std::min(size, capacity - offset);
+        blocks[count] = history.data() + offset;
+        sizes[count++] = firstPart;
+        if (size > firstPart) {
+            blocks[count] = history.data();
+            sizes[count++] = size - firstPart;
+        }
+    }
+    if (count == 0) return;
+
+    int64_t sent = SendBlocks(ToSocket(client.socket), blocks, sizes, count);
+    if (sent < 0) {
+        DropClient(client, "connection closed");
+        return;
+    }
+    size_t fromPrefix = std::min((size_t)sent, client.prefixSize - client.prefixSent);
+    client.prefixSent += fromPrefix;
+    client.cursor += (uint64_t)sent - fromPrefix;
+    bytesSent += (uint64_t)sent;
+
+    if ((uint64_t)sent > fromPrefix) {
+        // The writer may have wrapped over these bytes while they were
+        // being sent; the client cannot resynchronize after that
+        std::lock_guard<std::mutex> guard(lock);
+        if (start + capacity < reserved) {
+            dropReason = "fell out of the history buffer";
+        }
+    }
+    if (!dropReason.empty()) {
+        clientsDropped++;
+        DropClient(client, dropReason);
+    }
+}
+
+bool StreamServerSink::HasPending(const Client& client) {
+    if (client.closed || !headerReady.load(std::memory_order_acquire)) return false;
+    if (!client.joined || client.prefixSent < client.prefixSize) return true;
+    std::lock_guard<std::mutex> guard(lock);
+    return client.cursor < head;
+}
+
+void StreamServerSink::DropClient(Client& client, const std::string& reason) {
+    if (client.closed) return;
+    std::cerr << target << ": client " << client.id << " (" << client.peer << ") disconnected: " << reason
+              << std::endl;
+    CloseSocket(ToSocket(client.socket));
+    client.closed = true;
+}
+
+void StreamServerSink::Close() {
+    Shutdown();
+    std::cerr << target << ": " << clientsServed << " clients served, " << clientsDropped
+              << " disconnected for lag, " << clientSkips << " skips, " << bytesSent << " bytes sent" << std::endl;
+}
+
+void StreamServerSink::Shutdown() {
+    if (server.joinable()) {
+        // The writer thread has exited, so everything is published; give
+        // clients a moment to receive the tail
+        stopping.store(true, std::memory_order_release);
+        Wake();
+        server.join();
+    }
+    if (listenSocket != -1) {
+        CloseSocket(ToSocket(listenSocket));
+        listenSocket = -1;
+    }
+    if (wakeSocket != -1) {
+        CloseSocket(ToSocket(wakeSocket));
+        wakeSocket = -1;
+    }
+#ifndef _WIN32
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+        unixPath.clear();
+    }
+#endif
+#ifdef _WIN32
+    if (socketsStarted) {
+        WSACleanup();
+        socketsStarted = false;
+    }
+#endif
+}
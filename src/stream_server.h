@@ -0,0 +1,125 @@
+#pragma once
+
+// Serves the --framed stream to any number of local subscribers over TCP or
+// a Unix domain socket.
+//
+// The server is one more sink behind its own output queue. Its writer thread
+// copies each batch once into a history buffer shared by all clients and
+// notes where every packet starts; a server thread accepts connections and
+// sends to each client straight out of that buffer with non-blocking gather
+// writes, so another subscriber costs no copy, conversion or encoding. A new
+// client first receives the stream header, then joins at the newest packet.
+//
+// A client more than the lag threshold behind the live edge is disconnected,
+// or with skipping enabled moved to the newest packet once it finishes the
+// current one; that packet then carries kFlagOutputDropped. A client that
+// falls out of the history buffer altogether is always disconnected.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "output_sink.h"
+#include "stream_records.h"
+
+class StreamServerSink : public OutputSink {
+public:
+    struct Options {
+        int maxLagMs = 1000;       // a client further behind is dropped or skipped
+        bool skipLagging = false;  // skip lagging clients ahead instead of disconnecting them
+    };
+
+    // "tcp:[host:]port" (host defaults to 127.0.0.1) or "unix:path"
+    static bool IsSocketTarget(const std::string& target);
+
+    StreamServerSink(const std::string& target, const Options& options) : target(target), options(options) {}
+    ~StreamServerSink() override;
+
+    std::string Name() const override { return target; }
+
+    bool Open(const AudioFormat& format, std::string* error) override;
+    bool Write(const uint8_t* first, size_t firstSize, const uint8_t* second, size_t secondSize) override;
+    void Close() override;
+
+private:
+    // Packets older than this many are forgotten even if their bytes are
+    // still in the history buffer
+    static constexpr size_t kMaxPackets = 8192;
+    static constexpr size_t kMinHistoryBytes = 256 * 1024;
+    // Socket send buffers hold about 100 ms of audio, but no less than this
+    static constexpr size_t kMinSendBufferBytes = 16 * 1024;
+    // How long Close() keeps sending to clients that are still catching up
+    static constexpr int kDrainTimeoutMs = 1000;
+
+    struct PacketEntry {
+        uint64_t offset;          // history position of the packet header
+        uint64_t streamPosition;  // from the header
+        uint32_t frames;
+        uint32_t bytes;           // header, payload and padding
+    };
+
+    struct Client {
+        intptr_t socket = -1;
+        uint64_t id = 0;
+        std::string peer;
+        bool joined = false;                        // has a stream position
+        uint8_t prefix[sizeof(records::StreamHeader)];  // sent before the history bytes at `cursor`
+        size_t prefixSize = 0;
+        size_t prefixSent = 0;
+        uint64_t cursor = 0;                        // next history byte to send
+        uint64_t packet = 0;                        // index of the packet holding `cursor`
+        bool closed = false;
+    };
+
+    std::string target;
+    Options options;
+    std::string unixPath;  // removed again on Close()
+    bool socketsStarted = false;
+    intptr_t listenSocket = -1;
+    intptr_t wakeSocket = -1;  // UDP socket connected to itself
+    uint32_t sampleRate = 0;
+    size_t sendBufferBytes = 0;
+
+    // Writer thread only
+    uint8_t streamHeader[sizeof(records::StreamHeader)];
+    size_t streamHeaderFill = 0;
+    uint64_t writePosition = 0;
+    uint64_t nextPacketOffset = 0;
+    uint8_t packetHeader[sizeof(records::PacketHeader)];
+    size_t packetHeaderFill = 0;
+    std::vector<PacketEntry> newPackets;
+
+    // Shared by the writer and server threads
+    std::vector<uint8_t> history;
+    std::mutex lock;
+    uint64_t head = 0;      // bytes published to clients
+    uint64_t reserved = 0;  // bytes that may have been overwritten so far, head included
+    std::vector<PacketEntry> packets;  // ring of kMaxPackets entries
+    uint64_t packetCount = 0;
+    std::atomic<bool> headerReady{false};
+
+    // Server thread
+    std::thread server;
+    std::atomic<bool> stopping{false};
+    std::vector<Client> clients;
+    uint64_t nextClientId = 1;
+    uint64_t clientsServed = 0;
+    uint64_t clientsDropped = 0;
+    uint64_t clientSkips = 0;
+    uint64_t bytesSent = 0;
+
+    void TakeStreamHeader(const uint8_t*& data, size_t& size);
+    void Append(const uint8_t* data, size_t size);
+    void Wake();
+
+    void Serve();
+    void AcceptClients();
+    void ServiceClient(Client& client);
+    bool HasPending(const Client& client);
+    void DropClient(Client& client, const std::string& reason);
+    void Shutdown();
+};
@@ -0,0 +1,141 @@
+#include "synthetic_source.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "stream_records.h"
+
+namespace {
+
+const double kTwoPi = 6.28318530717958647692;
+
+}  // namespace
+
+bool SyntheticSource::ParseSignal(const std::string& text, Config& config, std::string* error) {
+    std::string name = text;
+    std::string argument;
+    size_t colon = text.find(':');
+    if (colon != std::string::npos) {
+        name = text.substr(0, colon);
+        argument = text.substr(colon + 1);
+    }
+
+    if (name == "sine") {
+        config.signal = Signal::Sine;
+        if (!argument.empty()) {
+            char* end = nullptr;
+            double frequency = strtod(argument.c_str(), &end);
+            if (*end != '\0' || frequency <= 0.0) {
+                if (error) *error = "invalid tone frequency '" + argument + "'";
+                return false;
+            }
+            config.frequency = frequency;
+        }
+        return true;
+    }
+    if (!argument.empty()) {
+        if (error) *error = "'" + name + "' takes no argument";
+        return false;
+    }
+    if (name == "noise") {
+        config.signal = Signal::Noise;
+        return true;
+    }
+    if (name == "silence") {
+        config.signal = Signal::Silence;
+        return true;
+    }
+    if (error) *error = "unknown signal '" + text + "' (expected sine[:Hz], noise or silence)";
+    return false;
+}
+
+bool SyntheticSource::Initialize(const Config& newConfig, std::string* error) {
+    if (newConfig.format.sampleRate == 0 || newConfig.format.channels == 0 ||
+        newConfig.format.channels > kMaxChannels) {
+        if (error) *error = "unsupported synthetic format";
+        return false;
+    }
+    if (newConfig.packetFrames == 0) {
+        if (error) *error = "packet size must be at least one frame";
+        return false;
+    }
+
+    config = newConfig;
+    packetFrames = config.packetFrames;
+    realtime = config.realtime;
+    clockSkewPpm = config.clockSkewPpm;
+    startOffsetSeconds = config.startOffsetMs / 1000.0;
+    totalFrames = (uint64_t)(config.durationSeconds * config.format.sampleRate);
+    packetIndex = 0;
+
+    converter.Initialize(SampleType::Float32, config.format.type);
+    samples.assign((size_t)packetFrames * config.format.channels, 0.0f);
+    data.assign((size_t)packetFrames * config.format.BlockAlign(), 0);
+    for (uint32_t c = 0; c < config.format.channels; c++) {
+        phaseStep[c] = kTwoPi * config.frequency * (c + 1) / config.format.sampleRate;
+        phase[c] = std::fmod(phaseStep[c] * startOffsetSeconds * config.format.sampleRate, kTwoPi);
+    }
+    return true;
+}
+
+// Keep the tone running through frames that were never delivered
+void SyntheticSource::Advance(uint32_t frames) {
+    for (uint32_t c = 0; c < config.format.channels; c++) {
+        phase[c] = std::fmod(phase[c] + phaseStep[c] * frames, kTwoPi);
+    }
+}
+
+bool SyntheticSource::Produce(CapturePacket& packet) {
+    uint64_t index = packetIndex++;
+    if (config.discontinuityEvery > 0 && index > 0 && index % config.discontinuityEvery == 0) {
+        // Model a packet lost between the device and us
+        position += packetFrames;
+        Advance(packetFrames);
+        packet.flags |= records::kFlagDiscontinuity;
+    }
+    if (config.timestampErrorEvery > 0 && index > 0 && index % config.timestampErrorEvery == 0) {
+        packet.flags |= records::kFlagTimestampError;
+    }
+
+    uint32_t frames = packetFrames;
+    if (totalFrames > 0) {
+        if (position >= totalFrames) return false;
+        if (totalFrames - position < frames) frames = (uint32_t)(totalFrames - position);
+    }
+
+    const uint32_t channels = config.format.channels;
+    size_t bytes = (size_t)frames * config.format.BlockAlign();
+    bool silent = config.signal == Signal::Silence ||
+                  (config.silentEvery > 0 && index % config.silentEvery < config.silentPackets);
+
+    if (silent) {
+        // Like WASAPI, a silent packet still points at (zeroed) data
+        memset(data.data(), 0, bytes);
+        packet.flags |= records::kFlagSilent;
+        Advance(frames);
+    } else if (config.signal == Signal::Sine) {
+        float* out = samples.data();
+        for (uint32_t i = 0; i < frames; i++) {
+            for (uint32_t c = 0; c < channels; c++) {
+                *out++ = (float)(config.amplitude * std::sin(phase[c]));
+                phase[c] += phaseStep[c];
+                if (phase[c] >= kTwoPi) phase[c] -= kTwoPi;
+            }
+        }
+        converter.FromFloat(samples.data(), data.data(), (size_t)frames * channels);
+    } else {
+        const float scale = (float)(config.amplitude / 2147483648.0);
+        for (size_t i = 0; i < (size_t)frames * channels; i++) {
+            noiseState ^= noiseState << 13;
+            noiseState ^= noiseState >> 17;
+            noiseState ^= noiseState << 5;
+            samples[i] = (float)(int32_t)noiseState * scale;
+        }
+        converter.FromFloat(samples.data(), data.data(), (size_t)frames * channels);
+    }
+
+    packet.data = data.data();
+    packet.frames = frames;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Capture source that generates test signals.
+//
+// Produces tones, white noise or digital silence in any supported format,
+// and can inject the irregularities a real device produces: packets flagged
+// silent, lost packets (a position gap plus the discontinuity flag) and
+// timestamp errors. Its clock can also run a few ppm off the host clock, as
+// a real device's does, and it can start late. The tone is a function of
+// time since the clock origin, so generators started at different times
+// agree once their packets are aligned on the timestamps. Useful for load tests and for checking how the
+// pipeline reacts to each flag and to drift without a Windows audio device.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "capture_source.h"
+#include "sample_converter.h"
+
+class SyntheticSource : public PacedSource {
+public:
+    static constexpr uint32_t kMaxChannels = 32;
+
+    enum class Signal { Sine, Noise, Silence };
+
+    struct Config {
+        AudioFormat format;                  // defaults to a typical shared-mode mix format
+        Signal signal = Signal::Sine;
+        double frequency = 440.0;            // Hz; channel n plays (n + 1) times this
+        double amplitude = 0.5;              // linear peak, 1.0 = full scale
+        uint32_t packetFrames = 480;
+        double durationSeconds = 0.0;        // 0 runs until stopped
+        bool realtime = true;
+        uint32_t silentEvery = 0;            // every Nth packet starts a silent run...
+        uint32_t silentPackets = 1;          // ...this many packets long
+        uint32_t discontinuityEvery = 0;     // every Nth packet follows a lost one
+        uint32_t timestampErrorEvery = 0;    // every Nth packet has an unreliable timestamp
+        double clockSkewPpm = 0.0;           // device clock runs this much fast (+) or slow (-)
+        double startOffsetMs = 0.0;          // first frame is captured this long after Start()
+
+        Config() {
+            format.sampleRate = 48000;
+            format.channels = 2;
+            format.type = SampleType::Float32;
+        }
+    };
+
+    // "sine", "sine:<Hz>", "noise" or "silence"
+    static bool ParseSignal(const std::string& text, Config& config, std::string* error);
+
+    bool Initialize(const Config& config, std::string* error);
+
+    const char* Name() const override { return "synthetic"; }
+    const AudioFormat& Format() const override { return config.format; }
+
+protected:
+    bool Produce(CapturePacket& packet) override;
+
+private:
+    Config config;
+    SampleConverter converter;
+    std::vector<float> samples;
+    std::vector<uint8_t> data;
+    double phase[kMaxChannels] = {};
+    double phaseStep[kMaxChannels] = {};
+    uint64_t totalFrames = 0;  // 0 = unlimited
+    uint64_t packetIndex = 0;
+    uint32_t noiseState = 0x12345678u;
+
+    void Advance(uint32_t frames);
+};
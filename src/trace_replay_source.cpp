@@ -0,0 +1,194 @@
+#include "trace_replay_source.h"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+bool ReadExact(FILE* file, void* data, size_t size) {
+    return fread(data, 1, size, file) == size;
+}
+
+}  // namespace
+
+TraceReplaySource::~TraceReplaySource() {
+    Close();
+}
+
+void TraceReplaySource::Close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool TraceReplaySource::Seek(uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+uint64_t TraceReplaySource::Tell() {
+#ifdef _WIN32
+    return (uint64_t)_ftelli64(file);
+#else
+    return (uint64_t)ftello(file);
+#endif
+}
+
+bool TraceReplaySource::Open(const Config& config, std::string* error) {
+    Close();
+    file = fopen(config.path.c_str(), "rb");
+    if (!file) {
+        if (error) *error = "cannot open '" + config.path + "': " + strerror(errno);
+        return false;
+    }
+    auto fail = [&](const std::string& reason) {
+        if (error) *error = "'" + config.path + "': " + reason;
+        Close();
+        return false;
+    };
+
+    trace::TraceHeader header = {};
+    if (!ReadExact(file, &header, sizeof(header)) || header.magic != trace::kFileMagic) {
+        return fail("not a capture trace");
+    }
+    if (header.version != trace::kVersion || header.headerSize < sizeof(header) ||
+        header.packetHeaderSize < sizeof(trace::TracePacket)) {
+        return fail("unsupported trace version " + std::to_string(header.version));
+    }
+    if (header.sampleFormat == records::kSampleFormatFloat && header.bitsPerSample == 32) {
+        format.type = SampleType::Float32;
+    } else if (header.sampleFormat == records::kSampleFormatPcm && header.bitsPerSample == 16) {
+        format.type = SampleType::Int16;
+    } else if (header.sampleFormat == records::kSampleFormatPcm && header.bitsPerSample == 24) {
+        format.type = SampleType::Int24;
+    } else if (header.sampleFormat == records::kSampleFormatPcm && header.bitsPerSample == 32) {
+        format.type = SampleType::Int32;
+    } else {
+        return fail("unsupported sample format");
+    }
+    format.sampleRate = header.sampleRate;
+    format.channels = header.channels;
+    format.channelMask = header.channelMask;
+    if (format.sampleRate == 0 || format.channels == 0 || header.blockAlign != format.BlockAlign()) {
+        return fail("unsupported trace layout");
+    }
+    packetHeaderSize = header.packetHeaderSize;
+
+    // Walk the records once: validates the file, sizes the packet buffer
+    // and finds where a crashed recording stops
+    if (fseek(file, 0, SEEK_END) != 0) return fail("cannot read trace");
+    const uint64_t fileSize = Tell();
+    dataStart = header.headerSize;
+    dataEnd = dataStart;
+    packetCount = 0;
+    frameCount = 0;
+    lastArrivalNs = 0;
+    traceGaps = 0;
+    uint32_t maxFrames = 0;
+    for (uint64_t offset = dataStart; offset + packetHeaderSize <= fileSize;) {
+        trace::TracePacket record;
+        if (!Seek(offset) || !ReadExact(file, &record, sizeof(record))) break;
+        if (record.magic != trace::kPacketMagic) {
+            return fail("corrupt packet record at offset " + std::to_string(offset));
+        }
+        if (record.payloadBytes != 0 && record.payloadBytes != (uint64_t)record.frames * format.BlockAlign()) {
+            return fail("packet at offset " + std::to_string(offset) + " has an invalid size");
+        }
+        uint64_t end = offset + packetHeaderSize + record.payloadBytes + records::PaddingFor(record.payloadBytes);
+        if (end > fileSize) break;
+        offset = end;
+        dataEnd = end;
+        packetCount++;
+        frameCount += record.frames;
+        lastArrivalNs = record.arrivalNs;
+        if (record.flags & trace::kFlagTraceDropped) traceGaps++;
+        if (record.frames > maxFrames) maxFrames = record.frames;
+    }
+    if (packetCount == 0) return fail("trace holds no packets");
+
+    realtime = config.realtime;
+    bufferFrames = header.bufferFrames > maxFrames ? header.bufferFrames : maxFrames;
+    // Payload plus its padding, read in one call
+    buffer.assign((size_t)maxFrames * format.BlockAlign() + 8, 0);
+    return Seek(dataStart) || fail("cannot read trace");
+}
+
+bool TraceReplaySource::Start(std::string* error) {
+    if (!file || !Seek(dataStart)) {
+        if (error) *error = "trace is not open";
+        return false;
+    }
+    readPosition = dataStart;
+    haveNext = false;
+    finished = false;
+    deliveredSinceWait = 0;
+    startTime = Clock::now();
+    return true;
+}
+
+bool TraceReplaySource::LoadNext() {
+    // Records are read in order, so the file only seeks over header fields
+    // added by later versions
+    if (readPosition + packetHeaderSize > dataEnd || !ReadExact(file, &next, sizeof(next))) return false;
+    readPosition += packetHeaderSize;
+    if (packetHeaderSize > sizeof(next) && !Seek(readPosition)) return false;
+    haveNext = true;
+    return true;
+}
+
+TraceReplaySource::Clock::time_point TraceReplaySource::DueTime(const trace::TracePacket& record) const {
+    return startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(record.arrivalNs));
+}
+
+CaptureSource::WaitResult TraceReplaySource::Wait(uint32_t timeoutMs) {
+    if (finished) return WaitResult::EndOfStream;
+    deliveredSinceWait = 0;
+    if (!haveNext && !LoadNext()) {
+        finished = true;
+        return WaitResult::EndOfStream;
+    }
+    if (!realtime) return WaitResult::Ready;
+
+    Clock::time_point due = DueTime(next);
+    Clock::time_point limit = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    if (due > limit) {
+        std::this_thread::sleep_until(limit);
+        return WaitResult::Timeout;
+    }
+    std::this_thread::sleep_until(due);
+    return WaitResult::Ready;
+}
+
+bool TraceReplaySource::NextPacket(CapturePacket& packet) {
+    if (finished || (!realtime && deliveredSinceWait >= kMaxPacketsPerWait)) return false;
+    if (!haveNext && !LoadNext()) {
+        finished = true;
+        return false;
+    }
+    if (realtime && DueTime(next) > Clock::now()) return false;
+
+    size_t bytes = next.payloadBytes + records::PaddingFor(next.payloadBytes);
+    if (bytes > 0 && !ReadExact(file, buffer.data(), bytes)) {
+        finished = true;
+        return false;
+    }
+    readPosition += bytes;
+    haveNext = false;
+    deliveredSinceWait++;
+
+    packet = CapturePacket();
+    packet.data = next.payloadBytes > 0 ? buffer.data() : nullptr;
+    packet.frames = next.frames;
+    // Recorder bookkeeping is not part of what the device reported
+    packet.flags = next.flags & ~trace::kFlagTraceDropped;
+    // A packet without data is silence to the pipeline whatever its flags
+    if (!packet.data) packet.flags |= records::kFlagSilent;
+    packet.devicePosition = next.devicePosition;
+    packet.timestamp = next.timestamp;
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// Capture source that replays a capture trace (see capture_trace.h).
+//
+// Hands out the recorded packets unchanged: same sizes, flags, device
+// positions and QPC timestamps, so the pipeline sees exactly what the
+// original source delivered. In real time each packet becomes available
+// when it arrived in the recording, reproducing bursts and stalls;
+// otherwise packets go out as fast as the pipeline accepts them.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "capture_source.h"
+#include "capture_trace.h"
+
+class TraceReplaySource : public CaptureSource {
+public:
+    struct Config {
+        std::string path;
+        bool realtime = true;
+    };
+
+    TraceReplaySource() {}
+    ~TraceReplaySource();
+
+    TraceReplaySource(const TraceReplaySource&) = delete;
+    TraceReplaySource& operator=(const TraceReplaySource&) = delete;
+
+    // Read and check the whole trace; a record cut off by a crash ends it
+    bool Open(const Config& config, std::string* error);
+
+    const char* Name() const override { return "trace"; }
+    const AudioFormat& Format() const override { return format; }
+    uint32_t BufferFrames() const override { return bufferFrames; }
+    bool IsRealtime() const override { return realtime; }
+
+    bool Start(std::string* error) override;
+    void Stop() override {}
+    WaitResult Wait(uint32_t timeoutMs) override;
+    bool NextPacket(CapturePacket& packet) override;
+    void ReleasePacket() override {}
+
+    uint64_t Packets() const { return packetCount; }
+    uint64_t Frames() const { return frameCount; }
+    double DurationSeconds() const { return lastArrivalNs / 1e9; }
+    uint64_t TraceGaps() const { return traceGaps; }  // places the recorder dropped packets
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Non-real-time replay hands out at most this many packets per wait so
+    // the pipeline keeps checking its outputs
+    static constexpr uint32_t kMaxPacketsPerWait = 16;
+
+    FILE* file = nullptr;
+    AudioFormat format;
+    bool realtime = true;
+    uint32_t bufferFrames = 0;
+    uint64_t dataStart = 0;
+    uint64_t dataEnd = 0;  // end of the last complete record
+    uint64_t readPosition = 0;
+    uint32_t packetHeaderSize = 0;
+    uint64_t packetCount = 0;
+    uint64_t frameCount = 0;
+    uint64_t lastArrivalNs = 0;
+    uint64_t traceGaps = 0;
+
+    trace::TracePacket next = {};
+    bool haveNext = false;
+    bool finished = false;
+    uint32_t deliveredSinceWait = 0;
+    Clock::time_point startTime;
+    std::vector<uint8_t> buffer;
+
+    bool ReadRecordHeader(trace::TracePacket& record);
+    bool LoadNext();
+    Clock::time_point DueTime(const trace::TracePacket& record) const;
+    bool Seek(uint64_t offset);
+    uint64_t Tell();
+    void Close();
+};
@@ -15,18 +15,20 @@
 #include <comdef.h>
 #include <io.h>
 #include <fcntl.h>
-#include <mfapi.h>
-#include <mfidl.h>
-#include <mfreadwrite.h>
-#include <mferror.h>
-#include <wmcodecdsp.h>
+#include <mmreg.h>
+#include <ksmedia.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <cwctype>
+
+#include "capture_pipeline.h"
+#include "capture_source.h"
+#include "multi_source.h"
 
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "psapi.lib")
-#pragma comment(lib, "mf.lib")
-#pragma comment(lib, "mfplat.lib")
-#pragma comment(lib, "mfreadwrite.lib")
-#pragma comment(lib, "wmcodecdspuuid.lib")
 
 // Safe release macro
 template <class T> void SafeRelease(T** ppT) {
@@ -207,322 +209,223 @@ public:
     }
 };
 
-// Audio Resampler class for format conversion
-class AudioResampler {
-private:
-    IMFTransform* pResampler = nullptr;
-    IMFMediaType* pInputType = nullptr;
-    IMFMediaType* pOutputType = nullptr;
-    IMFSample* pInputSample = nullptr;
-    IMFSample* pOutputSample = nullptr;
-    IMFMediaBuffer* pInputBuffer = nullptr;
-    IMFMediaBuffer* pOutputBuffer = nullptr;
-    
-    WAVEFORMATEX* pInputFormat = nullptr;
-    WAVEFORMATEX* pOutputFormat = nullptr;
-    
-    bool initialized = false;
-    
-public:
-    AudioResampler() {}
-    
-    ~AudioResampler() {
-        Cleanup();
+// Map a WASAPI wave format to a portable sample type
+static bool GetSampleType(const WAVEFORMATEX* format, SampleType* type) {
+    bool isFloat = format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* ext = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = IsEqualGUID(ext->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT) != 0;
     }
-    
-    bool Initialize(WAVEFORMATEX* inputFormat, WAVEFORMATEX* outputFormat) {
-        if (!inputFormat || !outputFormat) {
-            std::cerr << "Error: Invalid input or output format pointer" << std::endl;
-            return false;
-        }
-        
-        pInputFormat = inputFormat;
-        pOutputFormat = outputFormat;
-        
-        std::cerr << "Creating audio resampler..." << std::endl;
-        HRESULT hr = CoCreateInstance(CLSID_CResamplerMediaObject, nullptr, 
-                                     CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pResampler));
-        if (FAILED(hr)) {
-            std::cerr << "Failed to create resampler COM object: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        std::cerr << "Resampler COM object created successfully" << std::endl;
-        
-        // Create input media type
-        hr = MFCreateMediaType(&pInputType);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to create input media type: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        
-        // Calculate the correct size for WAVEFORMATEX structure
-        UINT32 waveFormatSize = sizeof(WAVEFORMATEX) + pInputFormat->cbSize;
-        hr = MFInitMediaTypeFromWaveFormatEx(pInputType, pInputFormat, waveFormatSize);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to init input media type from WAVEFORMATEX: 0x" << std::hex << hr << std::dec << std::endl;
-            std::cerr << "  Format tag: " << pInputFormat->wFormatTag << std::endl;
-            std::cerr << "  cbSize: " << pInputFormat->cbSize << std::endl;
-            std::cerr << "  Total size: " << waveFormatSize << std::endl;
-            return false;
-        }
-        std::cerr << "Input media type configured" << std::endl;
-        
-        // Create output media type
-        hr = MFCreateMediaType(&pOutputType);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to create output media type: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        
-        // Output format size (simple PCM format)
-        UINT32 outputWaveFormatSize = sizeof(WAVEFORMATEX) + pOutputFormat->cbSize;
-        hr = MFInitMediaTypeFromWaveFormatEx(pOutputType, pOutputFormat, outputWaveFormatSize);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to init output media type from WAVEFORMATEX: 0x" << std::hex << hr << std::dec << std::endl;
-            std::cerr << "  Format tag: " << pOutputFormat->wFormatTag << std::endl;
-            std::cerr << "  cbSize: " << pOutputFormat->cbSize << std::endl;
-            return false;
-        }
-        std::cerr << "Output media type configured" << std::endl;
-        
-        // Set media types
-        std::cerr << "Setting input type on resampler..." << std::endl;
-        hr = pResampler->SetInputType(0, pInputType, 0);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to set input type: 0x" << std::hex << hr << std::dec << std::endl;
-            std::cerr << "Input format: " << pInputFormat->nSamplesPerSec << "Hz, " 
-                      << pInputFormat->nChannels << "ch, " << pInputFormat->wBitsPerSample << "bit" << std::endl;
-            return false;
-        }
-        
-        std::cerr << "Setting output type on resampler..." << std::endl;
-        hr = pResampler->SetOutputType(0, pOutputType, 0);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to set output type: 0x" << std::hex << hr << std::dec << std::endl;
-            std::cerr << "Output format: " << pOutputFormat->nSamplesPerSec << "Hz, " 
-                      << pOutputFormat->nChannels << "ch, " << pOutputFormat->wBitsPerSample << "bit" << std::endl;
-            return false;
-        }
-        
-        // Process messages
-        std::cerr << "Sending control messages to resampler..." << std::endl;
-        hr = pResampler->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to send FLUSH message: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        
-        hr = pResampler->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to send BEGIN_STREAMING message: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        
-        hr = pResampler->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
-        if (FAILED(hr)) {
-            std::cerr << "Failed to send START_OF_STREAM message: 0x" << std::hex << hr << std::dec << std::endl;
-            return false;
-        }
-        
-        initialized = true;
-        std::cerr << "Audio resampler initialized successfully!" << std::endl;
+
+    if (isFloat) {
+        if (format->wBitsPerSample != 32) return false;
+        *type = SampleType::Float32;
         return true;
     }
-    
-    bool ProcessAudio(const BYTE* inputData, UINT32 inputSize, 
-                     std::vector<BYTE>& outputData) {
-        if (!initialized || !inputData || inputSize == 0) {
-            return false;
-        }
-        
-        HRESULT hr;
-        
-        // First, try to drain all available output
-        std::vector<BYTE> tempOutput;
-        while (TryGetOutput(tempOutput)) {
-            outputData.insert(outputData.end(), tempOutput.begin(), tempOutput.end());
-            tempOutput.clear();
-        }
-        
-        // Now try to feed input
-        IMFSample* pSample = nullptr;
-        IMFMediaBuffer* pBuffer = nullptr;
-        
-        // Create input sample and buffer
-        hr = MFCreateSample(&pSample);
-        if (FAILED(hr)) return !outputData.empty();
-        
-        hr = MFCreateMemoryBuffer(inputSize, &pBuffer);
-        if (FAILED(hr)) {
-            SafeRelease(&pSample);
-            return !outputData.empty();
-        }
-        
-        // Copy input data
-        BYTE* pBufferData = nullptr;
-        hr = pBuffer->Lock(&pBufferData, nullptr, nullptr);
-        if (FAILED(hr)) {
-            SafeRelease(&pBuffer);
-            SafeRelease(&pSample);
-            return !outputData.empty();
-        }
-        
-        memcpy(pBufferData, inputData, inputSize);
-        pBuffer->Unlock();
-        pBuffer->SetCurrentLength(inputSize);
-        
-        // Add buffer to sample
-        pSample->AddBuffer(pBuffer);
-        SafeRelease(&pBuffer);
-        
-        // Try to process input
-        hr = pResampler->ProcessInput(0, pSample, 0);
-        SafeRelease(&pSample);
-        
-        if (FAILED(hr) && hr != MF_E_NOTACCEPTING) {
-            // Unexpected error
-            return !outputData.empty();
-        }
-        
-        // Try to get more output after feeding input
-        while (TryGetOutput(tempOutput)) {
-            outputData.insert(outputData.end(), tempOutput.begin(), tempOutput.end());
-            tempOutput.clear();
+
+    switch (format->wBitsPerSample) {
+        case 16: *type = SampleType::Int16; return true;
+        case 24: *type = SampleType::Int24; return true;
+        case 32: *type = SampleType::Int32; return true;
+    }
+    return false;
+}
+
+// Speaker mask of a wave format (0 when the format does not carry one)
+static DWORD GetChannelMask(const WAVEFORMATEX* format) {
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        return reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format)->dwChannelMask;
+    }
+    return 0;
+}
+
+// Which endpoint a WasapiSource captures: "loopback" or "mic", optionally
+// followed by ":" and an endpoint ID or part of the device name
+struct DeviceSpec {
+    bool loopback = true;  // render endpoint in loopback mode; else a capture endpoint
+    std::wstring match;    // empty selects the default endpoint
+
+    static bool Parse(const std::string& text, DeviceSpec& spec) {
+        std::string kind = text.substr(0, text.find(':'));
+        if (kind != "loopback" && kind != "mic") return false;
+        spec.loopback = kind == "loopback";
+        spec.match.clear();
+        if (kind.size() < text.size()) {
+            std::string rest = text.substr(kind.size() + 1);
+            if (rest.empty()) return false;
+            int length = MultiByteToWideChar(CP_UTF8, 0, rest.c_str(), (int)rest.size(), nullptr, 0);
+            spec.match.resize(length);
+            MultiByteToWideChar(CP_UTF8, 0, rest.c_str(), (int)rest.size(), &spec.match[0], length);
         }
-        
         return true;
     }
-    
-private:
-    bool TryGetOutput(std::vector<BYTE>& outputData) {
-        MFT_OUTPUT_DATA_BUFFER outputBuffer = {};
-        MFT_OUTPUT_STREAM_INFO streamInfo = {};
-        IMFMediaBuffer* pBuffer = nullptr;
-        
-        HRESULT hr = pResampler->GetOutputStreamInfo(0, &streamInfo);
-        if (FAILED(hr)) return false;
-        
-        // Create output sample
-        hr = MFCreateSample(&outputBuffer.pSample);
-        if (FAILED(hr)) return false;
-        
-        DWORD bufferSize = streamInfo.cbSize > 0 ? streamInfo.cbSize : 8192;
-        hr = MFCreateMemoryBuffer(bufferSize, &pBuffer);
-        if (FAILED(hr)) {
-            SafeRelease(&outputBuffer.pSample);
-            return false;
+};
+
+static std::wstring GetDeviceName(IMMDevice* device) {
+    std::wstring name;
+    IPropertyStore* pProps = nullptr;
+    if (SUCCEEDED(device->OpenPropertyStore(STGM_READ, &pProps))) {
+        PROPVARIANT varName;
+        PropVariantInit(&varName);
+        if (SUCCEEDED(pProps->GetValue(PKEY_Device_FriendlyName, &varName)) && varName.pwszVal) {
+            name = varName.pwszVal;
         }
-        
-        outputBuffer.pSample->AddBuffer(pBuffer);
-        SafeRelease(&pBuffer);
-        
-        DWORD status = 0;
-        hr = pResampler->ProcessOutput(0, 1, &outputBuffer, &status);
-        
-        if (SUCCEEDED(hr)) {
-            // Extract output data
-            IMFMediaBuffer* pOutBuffer = nullptr;
-            hr = outputBuffer.pSample->ConvertToContiguousBuffer(&pOutBuffer);
-            if (SUCCEEDED(hr)) {
-                BYTE* pOutData = nullptr;
-                DWORD outSize = 0;
-                
-                hr = pOutBuffer->Lock(&pOutData, nullptr, &outSize);
-                if (SUCCEEDED(hr) && outSize > 0) {
-                    outputData.assign(pOutData, pOutData + outSize);
-                    pOutBuffer->Unlock();
-                }
-                SafeRelease(&pOutBuffer);
-            }
-            SafeRelease(&outputBuffer.pSample);
-            return true;
+        PropVariantClear(&varName);
+        SafeRelease(&pProps);
+    }
+    return name;
+}
+
+static std::wstring GetDeviceId(IMMDevice* device) {
+    std::wstring id;
+    LPWSTR text = nullptr;
+    if (SUCCEEDED(device->GetId(&text)) && text) {
+        id = text;
+        CoTaskMemFree(text);
+    }
+    return id;
+}
+
+static std::wstring Lowercase(std::wstring text) {
+    for (wchar_t& c : text) c = (wchar_t)towlower(c);
+    return text;
+}
+
+// Endpoint whose ID equals `match` or whose name contains it, ignoring case.
+// GetDevice() accepts the ID of any endpoint, so one with the other data
+// flow or not active is refused here, with the reason in `problem`, rather
+// than failing later in IAudioClient::Initialize().
+static IMMDevice* FindDevice(IMMDeviceEnumerator* enumerator, EDataFlow flow, const std::wstring& match,
+                             std::wstring* problem) {
+    IMMDevice* device = nullptr;
+    if (SUCCEEDED(enumerator->GetDevice(match.c_str(), &device))) {
+        EDataFlow deviceFlow = flow;
+        IMMEndpoint* endpoint = nullptr;
+        if (SUCCEEDED(device->QueryInterface(__uuidof(IMMEndpoint), (void**)&endpoint))) {
+            endpoint->GetDataFlow(&deviceFlow);
+            SafeRelease(&endpoint);
+        }
+        DWORD state = 0;
+        if (FAILED(device->GetState(&state))) state = DEVICE_STATE_NOTPRESENT;
+        if (deviceFlow != flow) {
+            *problem = deviceFlow == eRender ? L"is a render endpoint; capture it with --device loopback:<id>"
+                                             : L"is a capture endpoint; record it with --device mic:<id>";
+        } else if (state != DEVICE_STATE_ACTIVE) {
+            *problem = state == DEVICE_STATE_DISABLED ? L"is disabled"
+                     : state == DEVICE_STATE_UNPLUGGED ? L"is unplugged"
+                                                        : L"is not present";
         } else {
-            SafeRelease(&outputBuffer.pSample);
-            return false;
+            return device;
         }
+        SafeRelease(&device);
+        return nullptr;
     }
-    
-public:
-    
-    // Flush remaining data from resampler
-    void Flush(std::vector<BYTE>& outputData) {
-        if (!initialized) return;
-        
-        // Send drain message
-        pResampler->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
-        
-        // Get all remaining output
-        std::vector<BYTE> tempOutput;
-        while (TryGetOutput(tempOutput)) {
-            outputData.insert(outputData.end(), tempOutput.begin(), tempOutput.end());
-            tempOutput.clear();
+
+    IMMDeviceCollection* collection = nullptr;
+    if (FAILED(enumerator->EnumAudioEndpoints(flow, DEVICE_STATE_ACTIVE, &collection))) return nullptr;
+    std::wstring wanted = Lowercase(match);
+    UINT count = 0;
+    collection->GetCount(&count);
+    for (UINT i = 0; i < count && !device; i++) {
+        IMMDevice* candidate = nullptr;
+        if (FAILED(collection->Item(i, &candidate))) continue;
+        if (Lowercase(GetDeviceName(candidate)).find(wanted) != std::wstring::npos) {
+            device = candidate;
+        } else {
+            SafeRelease(&candidate);
         }
     }
-    
-    void Cleanup() {
-        SafeRelease(&pOutputBuffer);
-        SafeRelease(&pInputBuffer);
-        SafeRelease(&pOutputSample);
-        SafeRelease(&pInputSample);
-        SafeRelease(&pOutputType);
-        SafeRelease(&pInputType);
-        SafeRelease(&pResampler);
-        initialized = false;
+    SafeRelease(&collection);
+    return device;
+}
+
+// Print every active endpoint with the --device spec that selects it
+static bool ListDevices() {
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(hr)) {
+        ErrorHandler::PrintDetailedError(hr, "Failed to initialize COM library");
+        return false;
     }
-};
+    IMMDeviceEnumerator* enumerator = nullptr;
+    hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
+                          __uuidof(IMMDeviceEnumerator), (void**)&enumerator);
+    if (FAILED(hr)) {
+        ErrorHandler::PrintDetailedError(hr, "Failed to create audio device enumerator");
+        CoUninitialize();
+        return false;
+    }
+    const struct {
+        EDataFlow flow;
+        const wchar_t* kind;
+        const wchar_t* title;
+    } groups[] = {{eRender, L"loopback", L"Render endpoints (--device loopback:...)"},
+                  {eCapture, L"mic", L"Capture endpoints (--device mic:...)"}};
+    for (const auto& group : groups) {
+        std::wcerr << group.title << std::endl;
+        std::wstring defaultId;
+        IMMDevice* device = nullptr;
+        if (SUCCEEDED(enumerator->GetDefaultAudioEndpoint(group.flow, eConsole, &device))) {
+            defaultId = GetDeviceId(device);
+            SafeRelease(&device);
+        }
+        IMMDeviceCollection* collection = nullptr;
+        UINT count = 0;
+        if (SUCCEEDED(enumerator->EnumAudioEndpoints(group.flow, DEVICE_STATE_ACTIVE, &collection))) {
+            collection->GetCount(&count);
+        }
+        for (UINT i = 0; i < count; i++) {
+            if (FAILED(collection->Item(i, &device))) continue;
+            std::wstring id = GetDeviceId(device);
+            std::wcerr << L"  " << (id == defaultId ? L"* " : L"  ") << GetDeviceName(device) << std::endl;
+            std::wcerr << L"      " << group.kind << L":" << id << std::endl;
+            SafeRelease(&device);
+        }
+        if (count == 0) std::wcerr << L"  (none)" << std::endl;
+        SafeRelease(&collection);
+    }
+    std::wcerr << L"* = default endpoint" << std::endl;
+    SafeRelease(&enumerator);
+    CoUninitialize();
+    return true;
+}
 
-class WASAPICapture {
+// WASAPI capture of one endpoint: a render endpoint in loopback mode (the
+// default render endpoint unless told otherwise) or a microphone. Its
+// methods may be called from any thread of the process's multithreaded
+// apartment, which lets a MultiSource run each device on its own thread.
+class WasapiSource : public CaptureSource {
 private:
     IMMDeviceEnumerator* pEnumerator = nullptr;
     IMMDevice* pDevice = nullptr;
     IAudioClient* pAudioClient = nullptr;
     IAudioCaptureClient* pCaptureClient = nullptr;
     WAVEFORMATEX* pwfx = nullptr;
-    WAVEFORMATEX* pOutputFormat = nullptr;
     UINT32 bufferFrameCount = 0;
+    AudioFormat format;
+    bool comInitialized = false;
+    bool loopback = true;
 
-    int sampleRate = 0;  // 0 means use device default
-    int channels = 0;    // 0 means use device default
-    int bitDepth = 0;    // 0 means use device default
-    double chunkDuration = 0.2;  // seconds
-    bool mute = false;
-    std::vector<DWORD> includeProcesses;
-    std::vector<DWORD> excludeProcesses;
-
-    bool running = false;
-    bool needsResampling = false;
-    std::unique_ptr<AudioResampler> resampler;
+    HANDLE hEvent = nullptr;
+    DWORD sleepTime = 0;      // polling interval when event notifications are unavailable
+    UINT32 pendingFrames = 0;  // frames of the packet currently borrowed
 
 public:
-    WASAPICapture() {}
+    WasapiSource() {}
 
-    ~WASAPICapture() {
+    ~WasapiSource() {
         Cleanup();
     }
 
-    void SetSampleRate(int rate) { sampleRate = rate; }
-    void SetChannels(int ch) { channels = ch; }
-    void SetBitDepth(int bits) { bitDepth = bits; }
-    void SetChunkDuration(double duration) { chunkDuration = duration; }
-    void SetMute(bool m) { mute = m; }
-    void AddIncludeProcess(DWORD pid) { includeProcesses.push_back(pid); }
-    void AddExcludeProcess(DWORD pid) { excludeProcesses.push_back(pid); }
-
-    bool Initialize() {
-        std::cerr << "Initializing WASAPI Audio Capture..." << std::endl;
-
+    // requestedSampleRate is only used to explain format errors. With
+    // lowLatency the engine buffer is as small as the engine allows and
+    // chunkDuration is not used.
+    bool Initialize(const DeviceSpec& device, double chunkDuration, bool lowLatency, int requestedSampleRate) {
         HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
         if (FAILED(hr)) {
             ErrorHandler::PrintDetailedError(hr, "Failed to initialize COM library");
             return false;
         }
-
-        // Initialize Media Foundation
-        hr = MFStartup(MF_VERSION);
-        if (FAILED(hr)) {
-            ErrorHandler::PrintDetailedError(hr, "Failed to initialize Media Foundation");
-            return false;
-        }
+        comInitialized = true;
 
         // Create device enumerator
         hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
@@ -534,8 +437,34 @@ public:
             return false;
         }
 
-        // Get default audio endpoint (loopback for system audio)
-        hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &pDevice);
+        loopback = device.loopback;
+        EDataFlow flow = loopback ? eRender : eCapture;
+        if (!device.match.empty()) {
+            std::wstring problem;
+            pDevice = FindDevice(pEnumerator, flow, device.match, &problem);
+            if (!pDevice && !problem.empty()) {
+                std::wcerr << L"ERROR: --device " << (loopback ? L"loopback:" : L"mic:") << device.match
+                           << L": the endpoint " << problem << std::endl;
+                std::cerr << "Run with --list-devices to see the available endpoints" << std::endl;
+                return false;
+            }
+            if (!pDevice) {
+                std::wcerr << L"ERROR: No active " << (loopback ? L"render" : L"capture")
+                           << L" endpoint matches '" << device.match << L"'" << std::endl;
+                std::cerr << "Run with --list-devices to see the available endpoints" << std::endl;
+                return false;
+            }
+        } else {
+            // Default endpoint: the system audio, or the default microphone
+            hr = pEnumerator->GetDefaultAudioEndpoint(flow, eConsole, &pDevice);
+        }
+        if (FAILED(hr) && !loopback) {
+            ErrorHandler::PrintDetailedError(hr, "Failed to get default microphone");
+            std::cerr << "\nAdditional Info:" << std::endl;
+            std::cerr << "  No recording device found or device is disabled." << std::endl;
+            std::cerr << "  Check Sound settings > Input, or run with --list-devices." << std::endl;
+            return false;
+        }
         if (FAILED(hr)) {
             ErrorHandler::PrintDetailedError(hr, "Failed to get default audio device");
             std::cerr << "\nAdditional Info:" << std::endl;
@@ -549,15 +478,9 @@ public:
         }
 
         // Get device name for logging
-        IPropertyStore* pProps = nullptr;
-        if (SUCCEEDED(pDevice->OpenPropertyStore(STGM_READ, &pProps))) {
-            PROPVARIANT varName;
-            PropVariantInit(&varName);
-            if (SUCCEEDED(pProps->GetValue(PKEY_Device_FriendlyName, &varName))) {
-                std::wcerr << L"Using audio device: " << varName.pwszVal << std::endl;
-                PropVariantClear(&varName);
-            }
-            SafeRelease(&pProps);
+        std::wstring deviceName = GetDeviceName(pDevice);
+        if (!deviceName.empty()) {
+            std::wcerr << L"Using audio device: " << deviceName << (loopback ? L" (loopback)" : L"") << std::endl;
         }
 
         // Activate audio client
@@ -582,70 +505,16 @@ public:
                   << pwfx->nChannels << " channels, "
                   << pwfx->wBitsPerSample << " bits" << std::endl;
 
-        // Check if we need format conversion
-        int targetSampleRate = (sampleRate > 0) ? sampleRate : pwfx->nSamplesPerSec;
-        int targetChannels = (channels > 0) ? channels : pwfx->nChannels;
-        int targetBitDepth = (bitDepth > 0) ? bitDepth : pwfx->wBitsPerSample;
-
-        // Validate parameters
-        if (sampleRate > 0 && (sampleRate < 8000 || sampleRate > 192000)) {
-            std::cerr << "\nERROR: Invalid sample rate: " << sampleRate << std::endl;
-            std::cerr << "Valid range: 8000 - 192000 Hz" << std::endl;
-            std::cerr << "Common values: 44100, 48000" << std::endl;
+        format.sampleRate = pwfx->nSamplesPerSec;
+        format.channels = pwfx->nChannels;
+        format.channelMask = GetChannelMask(pwfx);
+        if (!GetSampleType(pwfx, &format.type) || format.BlockAlign() != pwfx->nBlockAlign) {
+            std::cerr << "Unsupported device sample format" << std::endl;
             return false;
         }
 
-        if (channels > 0 && (channels < 1 || channels > 8)) {
-            std::cerr << "\nERROR: Invalid channel count: " << channels << std::endl;
-            std::cerr << "Valid range: 1 - 8 channels" << std::endl;
-            std::cerr << "Common values: 1 (mono), 2 (stereo)" << std::endl;
-            return false;
-        }
-
-        if (bitDepth > 0 && (bitDepth != 16 && bitDepth != 24 && bitDepth != 32)) {
-            std::cerr << "\nERROR: Invalid bit depth: " << bitDepth << std::endl;
-            std::cerr << "Valid values: 16, 24, 32 bits" << std::endl;
-            return false;
-        }
-
-        // Check if we need resampling
-        needsResampling = (targetSampleRate != pwfx->nSamplesPerSec) ||
-                         (targetChannels != pwfx->nChannels) ||
-                         (targetBitDepth != pwfx->wBitsPerSample);
-
-        if (needsResampling) {
-            std::cerr << "Format conversion required:" << std::endl;
-            std::cerr << "  Input:  " << pwfx->nSamplesPerSec << "Hz, " 
-                      << pwfx->nChannels << " channels, " << pwfx->wBitsPerSample << " bits" << std::endl;
-            std::cerr << "  Output: " << targetSampleRate << "Hz, " 
-                      << targetChannels << " channels, " << targetBitDepth << " bits" << std::endl;
-
-            // Create output format as standard PCM
-            pOutputFormat = (WAVEFORMATEX*)CoTaskMemAlloc(sizeof(WAVEFORMATEX));
-            if (!pOutputFormat) {
-                std::cerr << "Failed to allocate memory for output format" << std::endl;
-                return false;
-            }
-
-            // Set up as standard PCM format (not extensible)
-            ZeroMemory(pOutputFormat, sizeof(WAVEFORMATEX));
-            pOutputFormat->wFormatTag = WAVE_FORMAT_PCM;
-            pOutputFormat->nChannels = targetChannels;
-            pOutputFormat->nSamplesPerSec = targetSampleRate;
-            pOutputFormat->wBitsPerSample = targetBitDepth;
-            pOutputFormat->nBlockAlign = (targetChannels * targetBitDepth) / 8;
-            pOutputFormat->nAvgBytesPerSec = targetSampleRate * pOutputFormat->nBlockAlign;
-            pOutputFormat->cbSize = 0;  // No extra data for standard PCM
-
-            // Initialize resampler
-            resampler = std::make_unique<AudioResampler>();
-            if (!resampler->Initialize(pwfx, pOutputFormat)) {
-                std::cerr << "Failed to initialize audio resampler" << std::endl;
-                return false;
-            }
-            std::cerr << "Audio resampler initialized successfully" << std::endl;
-        } else {
-            std::cerr << "No format conversion needed, using device format" << std::endl;
+        if (lowLatency) {
+            return InitializeLowLatency();
         }
 
         // Validate chunk duration
@@ -656,11 +525,11 @@ public:
             return false;
         }
 
-        // Initialize audio client for loopback capture with event callback
+        // Initialize audio client (loopback for render endpoints) with event callback
         REFERENCE_TIME hnsRequestedDuration = (REFERENCE_TIME)(chunkDuration * 10000000);
         hr = pAudioClient->Initialize(
             AUDCLNT_SHAREMODE_SHARED,
-            AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+            (loopback ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0) | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
             hnsRequestedDuration,
             0,
             pwfx,
@@ -670,9 +539,9 @@ public:
         if (FAILED(hr)) {
             ErrorHandler::PrintDetailedError(hr, "Failed to initialize audio client");
 
-            if (hr == AUDCLNT_E_UNSUPPORTED_FORMAT && sampleRate > 0) {
+            if (hr == AUDCLNT_E_UNSUPPORTED_FORMAT && requestedSampleRate > 0) {
                 std::cerr << "\nAdditional Info:" << std::endl;
-                std::cerr << "  Your requested sample rate (" << sampleRate
+                std::cerr << "  Your requested sample rate (" << requestedSampleRate
                          << " Hz) is not supported by this device." << std::endl;
                 std::cerr << "  Try running without --sample-rate to use device default." << std::endl;
             } else if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
@@ -685,8 +554,62 @@ public:
             return false;
         }
 
+        // Optimized polling: sleep 1/4 of buffer duration to reduce latency
+        sleepTime = static_cast<DWORD>(chunkDuration * 1000 / 4);
+        if (sleepTime < 1) sleepTime = 1;
+        return GetCaptureClient();
+    }
+
+    // --low-latency: a microphone on a driver that supports it runs at the
+    // engine's smallest period through IAudioClient3 (a few ms on many
+    // devices). Loopback streams always follow the render engine's period,
+    // so they, and devices without IAudioClient3, get the smallest buffer
+    // the shared engine allows.
+    bool InitializeLowLatency() {
+        HRESULT hr = E_FAIL;
+        IAudioClient3* client3 = nullptr;
+        if (!loopback && SUCCEEDED(pAudioClient->QueryInterface(__uuidof(IAudioClient3), (void**)&client3))) {
+            UINT32 defaultPeriod = 0, fundamentalPeriod = 0, minPeriod = 0, maxPeriod = 0;
+            hr = client3->GetSharedModeEnginePeriod(pwfx, &defaultPeriod, &fundamentalPeriod, &minPeriod, &maxPeriod);
+            if (SUCCEEDED(hr)) {
+                hr = client3->InitializeSharedAudioStream(AUDCLNT_STREAMFLAGS_EVENTCALLBACK, minPeriod, pwfx, nullptr);
+            }
+            if (SUCCEEDED(hr)) {
+                std::cerr << "Low-latency engine period: " << minPeriod << " frames ("
+                          << (double)minPeriod / pwfx->nSamplesPerSec * 1000 << " ms, default "
+                          << (double)defaultPeriod / pwfx->nSamplesPerSec * 1000 << " ms)" << std::endl;
+            }
+            client3->Release();
+        }
+
+        if (FAILED(hr)) {
+            REFERENCE_TIME defaultPeriod = 0, minimumPeriod = 0;
+            pAudioClient->GetDevicePeriod(&defaultPeriod, &minimumPeriod);
+            // Shared mode rounds a request below its minimum up to it
+            hr = pAudioClient->Initialize(
+                AUDCLNT_SHAREMODE_SHARED,
+                (loopback ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0) | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                minimumPeriod,
+                0,
+                pwfx,
+                nullptr
+            );
+            if (FAILED(hr)) {
+                ErrorHandler::PrintDetailedError(hr, "Failed to initialize low-latency audio client");
+                return false;
+            }
+            std::cerr << "Low-latency engine period: " << defaultPeriod / 10000.0 << " ms"
+                      << (loopback ? " (loopback follows the render engine)" : " (no IAudioClient3 support)")
+                      << std::endl;
+        }
+
+        sleepTime = 1;
+        return GetCaptureClient();
+    }
+
+    bool GetCaptureClient() {
         // Get buffer size
-        hr = pAudioClient->GetBufferSize(&bufferFrameCount);
+        HRESULT hr = pAudioClient->GetBufferSize(&bufferFrameCount);
         if (FAILED(hr)) {
             ErrorHandler::PrintDetailedError(hr, "Failed to get audio buffer size");
             return false;
@@ -702,40 +625,24 @@ public:
             ErrorHandler::PrintDetailedError(hr, "Failed to get capture client service");
             return false;
         }
-
-        // Handle mute
-        if (mute) {
-            std::cerr << "Note: Mute functionality is not yet implemented" << std::endl;
-            // Note: Muting system audio while capturing requires additional implementation
-            // This would typically involve ISimpleAudioVolume interface
-        }
-
-        std::cerr << "\n✓ Initialization successful!" << std::endl;
-        std::cerr << "========================================" << std::endl;
-        std::cerr << "Output Audio Format:" << std::endl;
-        if (needsResampling) {
-            std::cerr << "  Sample Rate: " << pOutputFormat->nSamplesPerSec << " Hz" << std::endl;
-            std::cerr << "  Channels:    " << pOutputFormat->nChannels << std::endl;
-            std::cerr << "  Bit Depth:   " << pOutputFormat->wBitsPerSample << " bits" << std::endl;
-        } else {
-            std::cerr << "  Sample Rate: " << pwfx->nSamplesPerSec << " Hz" << std::endl;
-            std::cerr << "  Channels:    " << pwfx->nChannels << std::endl;
-            std::cerr << "  Bit Depth:   " << pwfx->wBitsPerSample << " bits" << std::endl;
-        }
-        std::cerr << "========================================" << std::endl;
-        std::cerr << std::endl;
-
         return true;
     }
 
-    void StartCapture() {
-        if (!pAudioClient) return;
+    const char* Name() const override { return loopback ? "WASAPI loopback" : "WASAPI microphone"; }
+    const AudioFormat& Format() const override { return format; }
+    uint32_t BufferFrames() const override { return bufferFrameCount; }
+
+    bool Start(std::string* error) override {
+        if (!pAudioClient) {
+            if (error) *error = "Audio client not initialized";
+            return false;
+        }
 
         // Create event for audio buffer ready notification
-        HANDLE hEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        hEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
         if (hEvent == nullptr) {
-            std::cerr << "Failed to create event" << std::endl;
-            return;
+            if (error) *error = "Failed to create event";
+            return false;
         }
 
         // Set event handle for buffer notifications
@@ -743,234 +650,289 @@ public:
         if (FAILED(hr)) {
             std::cerr << "Failed to set event handle, falling back to polling mode" << std::endl;
             CloseHandle(hEvent);
-            StartCapturePolling();
-            return;
+            hEvent = nullptr;
         }
 
         hr = pAudioClient->Start();
         if (FAILED(hr)) {
-            std::cerr << "Failed to start audio client" << std::endl;
-            CloseHandle(hEvent);
-            return;
-        }
-
-        running = true;
-
-        // Set stdout to binary mode
-        _setmode(_fileno(stdout), _O_BINARY);
-
-        std::cerr << "Using event-driven capture mode (no frame drops)" << std::endl;
-
-        // Event-driven capture loop
-        while (running) {
-            // Wait for buffer ready event with timeout
-            DWORD waitResult = WaitForSingleObject(hEvent, 2000);
-
-            if (waitResult != WAIT_OBJECT_0) {
-                if (waitResult == WAIT_TIMEOUT) {
-                    // No audio data for 2 seconds, continue waiting
-                    continue;
-                } else {
-                    std::cerr << "Wait failed" << std::endl;
-                    break;
-                }
+            if (error) *error = "Failed to start audio client";
+            if (hEvent) {
+                CloseHandle(hEvent);
+                hEvent = nullptr;
             }
+            return false;
+        }
 
-            // Process all available packets
-            UINT32 packetLength = 0;
-            hr = pCaptureClient->GetNextPacketSize(&packetLength);
-
-            while (SUCCEEDED(hr) && packetLength != 0) {
-                BYTE* pData = nullptr;
-                UINT32 numFramesAvailable = 0;
-                DWORD flags = 0;
-                UINT64 devicePosition = 0;
-                UINT64 qpcPosition = 0;
+        if (hEvent) {
+            std::cerr << "Using event-driven capture mode (no frame drops)" << std::endl;
+        } else {
+            std::cerr << "Using polling mode (sleep time reduced to minimize frame drops)" << std::endl;
+        }
+        return true;
+    }
 
-                hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags, &devicePosition, &qpcPosition);
+    void Stop() override {
+        if (pAudioClient) {
+            pAudioClient->Stop();
+        }
+        if (hEvent) {
+            CloseHandle(hEvent);
+            hEvent = nullptr;
+        }
+    }
 
-                if (SUCCEEDED(hr)) {
-                    // Check for buffer overrun (data corruption/discontinuity)
-                    if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) {
-                        std::cerr << "Warning: Audio data discontinuity detected (possible frame drop)" << std::endl;
-                    }
+    WaitResult Wait(uint32_t timeoutMs) override {
+        if (!hEvent) {
+            // Fallback polling mode
+            Sleep(sleepTime);
+            return WaitResult::Ready;
+        }
 
-                    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-                        // Silent buffer - write zeros
-                        UINT32 outputSize = numFramesAvailable * (needsResampling ? pOutputFormat->nBlockAlign : pwfx->nBlockAlign);
-                        std::vector<BYTE> silence(outputSize, 0);
-                        std::cout.write(reinterpret_cast<char*>(silence.data()), silence.size());
-                    } else {
-                        // Process audio data
-                        UINT32 inputSize = numFramesAvailable * pwfx->nBlockAlign;
-                        
-                        if (needsResampling && resampler) {
-                            // Use resampler to convert format
-                            std::vector<BYTE> outputData;
-                            if (resampler->ProcessAudio(pData, inputSize, outputData)) {
-                                // Only write if we got output data
-                                if (!outputData.empty()) {
-                                    std::cout.write(reinterpret_cast<char*>(outputData.data()), outputData.size());
-                                }
-                                // If outputData is empty, resampler is buffering - this is normal
-                            } else {
-                                std::cerr << "Warning: Resampler ProcessAudio failed, skipping frame" << std::endl;
-                            }
-                        } else {
-                            // Write original audio data to stdout
-                            std::cout.write(reinterpret_cast<char*>(pData), inputSize);
-                        }
-                    }
+        // Wait for buffer ready event with timeout
+        DWORD waitResult = WaitForSingleObject(hEvent, timeoutMs);
+        if (waitResult == WAIT_OBJECT_0) return WaitResult::Ready;
+        if (waitResult == WAIT_TIMEOUT) return WaitResult::Timeout;
+        return WaitResult::Failed;
+    }
 
-                    std::cout.flush();
+    bool NextPacket(CapturePacket& packet) override {
+        UINT32 packetLength = 0;
+        HRESULT hr = pCaptureClient->GetNextPacketSize(&packetLength);
+        if (FAILED(hr) || packetLength == 0) {
+            return false;
+        }
 
-                    pCaptureClient->ReleaseBuffer(numFramesAvailable);
-                } else {
-                    std::cerr << "GetBuffer failed: 0x" << std::hex << hr << std::endl;
-                }
+        BYTE* pData = nullptr;
+        UINT32 numFramesAvailable = 0;
+        DWORD flags = 0;
+        UINT64 devicePosition = 0;
+        UINT64 qpcPosition = 0;
 
-                hr = pCaptureClient->GetNextPacketSize(&packetLength);
-            }
+        hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags, &devicePosition, &qpcPosition);
+        if (FAILED(hr)) {
+            std::cerr << "GetBuffer failed: 0x" << std::hex << hr << std::dec << std::endl;
+            return false;
         }
 
-        pAudioClient->Stop();
-        
-        // Flush resampler if needed
-        if (needsResampling && resampler) {
-            std::vector<BYTE> finalData;
-            resampler->Flush(finalData);
-            if (!finalData.empty()) {
-                std::cout.write(reinterpret_cast<char*>(finalData.data()), finalData.size());
-                std::cout.flush();
-            }
+        // Check for buffer overrun (data corruption/discontinuity)
+        if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) {
+            std::cerr << "Warning: Audio data discontinuity detected (possible frame drop)" << std::endl;
         }
-        
-        CloseHandle(hEvent);
+
+        pendingFrames = numFramesAvailable;
+        packet.data = pData;
+        packet.frames = numFramesAvailable;
+        packet.flags = flags;
+        packet.devicePosition = devicePosition;
+        packet.timestamp = qpcPosition;
+        return true;
     }
 
-    // Fallback polling mode
-    void StartCapturePolling() {
-        if (!pAudioClient) return;
+    void ReleasePacket() override {
+        pCaptureClient->ReleaseBuffer(pendingFrames);
+        pendingFrames = 0;
+    }
 
-        HRESULT hr = pAudioClient->Start();
-        if (FAILED(hr)) {
-            std::cerr << "Failed to start audio client" << std::endl;
-            return;
-        }
+    void Cleanup() {
+        Stop();
 
-        running = true;
+        if (pwfx) {
+            CoTaskMemFree(pwfx);
+            pwfx = nullptr;
+        }
 
-        // Set stdout to binary mode
-        _setmode(_fileno(stdout), _O_BINARY);
+        SafeRelease(&pCaptureClient);
+        SafeRelease(&pAudioClient);
+        SafeRelease(&pDevice);
+        SafeRelease(&pEnumerator);
 
-        std::cerr << "Using polling mode (sleep time reduced to minimize frame drops)" << std::endl;
+        if (comInitialized) {
+            CoUninitialize();
+            comInitialized = false;
+        }
+    }
+};
 
-        // Optimized polling: sleep 1/4 of buffer duration to reduce latency
-        DWORD sleepTime = static_cast<DWORD>(chunkDuration * 1000 / 4);
-        if (sleepTime < 1) sleepTime = 1;
+class WASAPICapture {
+private:
+    std::unique_ptr<CaptureSource> source;
+    MultiSource* multi = nullptr;  // the source when several devices are captured
+    CapturePipeline pipeline;
+    CapturePipeline::Config config;
+    std::vector<DeviceSpec> devices;  // empty: the default render endpoint
+    MultiSource::Config multiConfig;
 
-        // Capture loop
-        while (running) {
-            Sleep(sleepTime);
+    double chunkDuration = 0.2;  // seconds
+    bool chunkDurationSet = false;
+    bool outputBufferSet = false;
+    bool mute = false;
+    std::vector<DWORD> includeProcesses;
+    std::vector<DWORD> excludeProcesses;
 
-            UINT32 packetLength = 0;
-            hr = pCaptureClient->GetNextPacketSize(&packetLength);
+    std::atomic<bool> running{false};
 
-            while (SUCCEEDED(hr) && packetLength != 0) {
-                BYTE* pData = nullptr;
-                UINT32 numFramesAvailable = 0;
-                DWORD flags = 0;
+public:
+    WASAPICapture() {}
 
-                hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags, nullptr, nullptr);
+    void SetSampleRate(int rate) { config.sampleRate = rate; }
+    void SetChannels(int ch) { config.channels = ch; }
+    void SetBitDepth(int bits) { config.bitDepth = bits; }
+    void SetChunkDuration(double duration) {
+        chunkDuration = duration;
+        chunkDurationSet = true;
+    }
+    bool ChunkDurationSet() const { return chunkDurationSet; }
+    void SetMute(bool m) { mute = m; }
+    void SetResampleQuality(PolyphaseResampler::Quality q) { config.resampleQuality = q; }
+    void SetDither(bool d) { config.dither = d; }
+    void SetMixMatrix(const std::string& text) { config.mixMatrixText = text; }
+    void SetMixNormalize(bool enabled) { config.mixNormalize = enabled; }
+    void SetOutputBufferMs(int ms) {
+        config.outputBufferMs = ms;
+        outputBufferSet = true;
+    }
+    void SetMaxOutputLatencyMs(int ms) { config.maxOutputLatencyMs = ms; }
+    void SetSilenceMarkers(bool enabled) { config.silenceMarkers = enabled; }
+    void SetFramed(bool enabled) { config.framed = enabled; }
+    void AddOutput(const std::string& target) { config.outputs.push_back(target); }
+    size_t OutputCount() const { return config.outputs.size(); }
+    // Format for the output added last
+    void SetLastOutputFormat(const CapturePipeline::FormatSpec& spec) {
+        config.outputFormats.resize(config.outputs.size());
+        config.outputFormats.back() = spec;
+    }
+    void SetMaxClientLagMs(int ms) { config.maxClientLagMs = ms; }
+    void SetSkipLaggingClients(bool enabled) { config.skipLaggingClients = enabled; }
+    void SetFlac(bool enabled) { config.flac = enabled; }
+    void SetFlacLevel(int level) { config.flacLevel = level; }
+    void SetFlacBlockSize(int frames) { config.flacBlockSize = frames; }
+    void SetStatsIntervalMs(int ms) { config.statsIntervalMs = ms; }
+    void SetStatsJson(bool enabled) { config.statsJson = enabled; }
+    void SetLoudnessIntervalMs(int ms) { config.loudnessIntervalMs = ms; }
+    void SetLoudnessJson(bool enabled) { config.loudnessJson = enabled; }
+    void SetMetricsFile(const std::string& path) { config.metricsFile = path; }
+    void SetMetricsListen(const std::string& address) { config.metricsListen = address; }
+    void SetRecordTrace(const std::string& path) { config.traceFile = path; }
+    void SetDriftCorrection(bool enabled) { config.driftCorrection = enabled; }
+    void SetLowLatency(bool enabled) { config.lowLatency = enabled; }
+    void SetFrameSize(uint32_t frames, double ms) {
+        config.frameFrames = frames;
+        config.frameMs = ms;
+    }
+    void SetFrameAlign(bool enabled) { config.frameAlign = enabled; }
+    bool LowLatency() const { return config.lowLatency; }
+    void AddDevice(const DeviceSpec& device) { devices.push_back(device); }
+    size_t DeviceCount() const { return devices.size(); }
+    void SetCombineLayout(MultiSource::Layout layout) { multiConfig.layout = layout; }
+    void SetAlignWaitMs(int ms) { multiConfig.maxWaitMs = (uint32_t)ms; }
+    void AddIncludeProcess(DWORD pid) { includeProcesses.push_back(pid); }
+    void AddExcludeProcess(DWORD pid) { excludeProcesses.push_back(pid); }
 
-                if (SUCCEEDED(hr)) {
-                    // Check for discontinuity
-                    if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) {
-                        std::cerr << "Warning: Audio data discontinuity detected" << std::endl;
-                    }
+    bool ValidateOutputs(std::string* error) const {
+        return CapturePipeline::ValidateOutputs(config, error);
+    }
 
-                    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-                        // Silent buffer - write zeros
-                        UINT32 outputSize = numFramesAvailable * (needsResampling ? pOutputFormat->nBlockAlign : pwfx->nBlockAlign);
-                        std::vector<BYTE> silence(outputSize, 0);
-                        std::cout.write(reinterpret_cast<char*>(silence.data()), silence.size());
-                    } else {
-                        // Process audio data
-                        UINT32 inputSize = numFramesAvailable * pwfx->nBlockAlign;
-                        
-                        if (needsResampling && resampler) {
-                            // Use resampler to convert format
-                            std::vector<BYTE> outputData;
-                            if (resampler->ProcessAudio(pData, inputSize, outputData)) {
-                                // Only write if we got output data
-                                if (!outputData.empty()) {
-                                    std::cout.write(reinterpret_cast<char*>(outputData.data()), outputData.size());
-                                }
-                                // If outputData is empty, resampler is buffering - this is normal
-                            } else {
-                                std::cerr << "Warning: Resampler ProcessAudio failed, skipping frame" << std::endl;
-                            }
-                        } else {
-                            // Write original audio data to stdout
-                            std::cout.write(reinterpret_cast<char*>(pData), inputSize);
-                        }
-                    }
+    bool Initialize() {
+        std::cerr << "Initializing WASAPI Audio Capture..." << std::endl;
 
-                    std::cout.flush();
+        if (config.lowLatency && !outputBufferSet) {
+            config.outputBufferMs = CapturePipeline::kLowLatencyOutputBufferMs;
+        }
 
-                    pCaptureClient->ReleaseBuffer(numFramesAvailable);
+        if (devices.size() <= 1) {
+            auto device = std::make_unique<WasapiSource>();
+            if (!device->Initialize(devices.empty() ? DeviceSpec() : devices[0], chunkDuration, config.lowLatency,
+                                    config.sampleRate)) {
+                return false;
+            }
+            source = std::move(device);
+        } else {
+            // Every device runs on its own thread; the streams are aligned on
+            // their QPC timestamps and resampled straight to the output rate
+            auto combined = std::make_unique<MultiSource>();
+            for (const DeviceSpec& spec : devices) {
+                auto device = std::make_unique<WasapiSource>();
+                if (!device->Initialize(spec, chunkDuration, config.lowLatency, config.sampleRate)) {
+                    return false;
                 }
-
-                hr = pCaptureClient->GetNextPacketSize(&packetLength);
+                combined->AddSource(std::move(device));
+            }
+            multiConfig.sampleRate = (uint32_t)config.sampleRate;
+            multiConfig.quality = config.resampleQuality;
+            multiConfig.lowLatency = config.lowLatency;
+            if (config.lowLatency) {
+                // Hand out spans as soon as the slowest device covers them
+                multiConfig.packetMs = 2;
             }
+            std::string error;
+            if (!combined->Initialize(multiConfig, &error)) {
+                std::cerr << "ERROR: " << error << std::endl;
+                return false;
+            }
+            std::cerr << "Capturing " << devices.size() << " devices, "
+                      << (multiConfig.layout == MultiSource::Layout::Mix ? "mixed" : "as separate channels")
+                      << ": " << combined->Format().sampleRate << "Hz, " << combined->Format().channels
+                      << " channels" << std::endl;
+            multi = combined.get();
+            source = std::move(combined);
+        }
+        if (!pipeline.Initialize(config, source->Format())) {
+            return false;
+        }
+
+        // Handle mute
+        if (mute) {
+            std::cerr << "Note: Mute functionality is not yet implemented" << std::endl;
+            // Note: Muting system audio while capturing requires additional implementation
+            // This would typically involve ISimpleAudioVolume interface
         }
 
-        pAudioClient->Stop();
-        
-        // Flush resampler if needed
-        if (needsResampling && resampler) {
-            std::vector<BYTE> finalData;
-            resampler->Flush(finalData);
-            if (!finalData.empty()) {
-                std::cout.write(reinterpret_cast<char*>(finalData.data()), finalData.size());
-                std::cout.flush();
+        std::cerr << "\n✓ Initialization successful!" << std::endl;
+        std::cerr << "========================================" << std::endl;
+        for (size_t i = 0; i < pipeline.OutputFormatCount(); i++) {
+            const AudioFormat& format = pipeline.OutputFormat(i);
+            if (pipeline.OutputFormatCount() > 1) {
+                std::cerr << "Output Audio Format " << i + 1 << ":" << std::endl;
+            } else {
+                std::cerr << "Output Audio Format:" << std::endl;
             }
+            std::cerr << "  Sample Rate: " << format.sampleRate << " Hz" << std::endl;
+            std::cerr << "  Channels:    " << format.channels << std::endl;
+            std::cerr << "  Bit Depth:   " << format.BitsPerSample() << " bits" << std::endl;
         }
-    }
+        std::cerr << "========================================" << std::endl;
+        std::cerr << std::endl;
 
-    void Stop() {
-        running = false;
+        return true;
     }
 
-    void Cleanup() {
-        if (pAudioClient) {
-            pAudioClient->Stop();
-        }
+    void StartCapture() {
+        running = true;
 
-        // Cleanup resampler
-        if (resampler) {
-            resampler.reset();
-        }
+        // Set stdout to binary mode
+        _setmode(_fileno(stdout), _O_BINARY);
 
-        if (pwfx) {
-            CoTaskMemFree(pwfx);
-            pwfx = nullptr;
+        // The writer runs before the device starts so no early packet is lost
+        if (!pipeline.Start(source->BufferFrames())) {
+            return;
         }
 
-        if (pOutputFormat) {
-            CoTaskMemFree(pOutputFormat);
-            pOutputFormat = nullptr;
+        std::string error;
+        if (!source->Start(&error)) {
+            std::cerr << error << std::endl;
+            pipeline.Finish();
+            return;
         }
 
-        SafeRelease(&pCaptureClient);
-        SafeRelease(&pAudioClient);
-        SafeRelease(&pDevice);
-        SafeRelease(&pEnumerator);
+        pipeline.Run(*source, running);
 
-        // Shutdown Media Foundation
-        MFShutdown();
+        source->Stop();
+        pipeline.Finish();
+        if (multi) multi->PrintSummary();
+    }
 
-        CoUninitialize();
+    void Stop() {
+        running = false;
     }
 };
 
@@ -994,6 +956,49 @@ void PrintUsage() {
               << "  --channels <count>           Number of channels (default: device default)\n"
               << "  --bit-depth <bits>           Bit depth: 16, 24, or 32 (default: device default)\n"
               << "  --chunk-duration <seconds>   Duration of each audio chunk (default: 0.2)\n"
+              << "  --low-latency                Smallest engine buffer, real-time capture and writer threads,\n"
+              << "                               unbatched writes, 100 ms output queues unless --output-buffer-ms\n"
+              << "  --resample-quality <tier>    Resampler quality: fast, medium, high, best (default: high)\n"
+              << "  --dither                     Apply TPDF dither when reducing to 16 or 24 bits\n"
+              << "  --mix-matrix <rows>          Custom channel matrix, e.g. \"0.5,0.5\" (rows ';', coefficients ',')\n"
+              << "  --mix-normalize              Turn the whole standard downmix down so no channel can clip,\n"
+              << "                               instead of clamping the channels that would\n"
+              << "  --output-buffer-ms <ms>      Audio queued for each output writer (default: 2000)\n"
+              << "  --max-output-latency-ms <ms> Coalesce stdout writes for up to this long (default: 0, write immediately)\n"
+              << "  --silence-markers            Send silent spans as compact records instead of zeros (record stream)\n"
+              << "  --framed                     Binary framing with stream header and timestamped packet headers\n"
+              << "  --frame-size <frames|Nms>    Re-block the output into packets of exactly this many frames,\n"
+              << "                               e.g. 320 or 20ms (at the output sample rate)\n"
+              << "  --frame-align                Start frames on multiples of the frame length in device position\n"
+              << "  --output <file.wav|->        Write a WAV file (RF64 past 4 GB) instead of stdout; repeat to\n"
+              << "                               fan out, '-' keeps stdout (each output has its own queue)\n"
+              << "  --output tcp:[host:]port     Serve the --framed stream to any number of clients (host\n"
+              << "                               defaults to 127.0.0.1)\n"
+              << "  --output shm:<name>          Publish the output stream to a named shared-memory ring\n"
+              << "  --output-format <rate[:ch[:bits]]> Own format for the --output given just before; formats\n"
+              << "                               share the conversion work they have in common\n"
+              << "  --max-client-lag-ms <ms>     Disconnect socket clients further behind than this (default: 1000)\n"
+              << "  --skip-lagging-clients       Skip lagging socket clients ahead instead of disconnecting them\n"
+              << "  --flac                       Encode stdout as a lossless FLAC stream (16 or 24-bit output)\n"
+              << "  --flac-level <0-8>           FLAC compression level (default: 5)\n"
+              << "  --flac-block-size <frames>   FLAC block size in frames (default: 4096)\n"
+              << "  --stats-interval <ms>        Report per-step latency (p50/p99/max) on stderr this often\n"
+              << "  --stats-json                 Report the latency statistics as JSON lines\n"
+              << "  --loudness-interval <ms>     Report EBU R128 loudness (LUFS) and sample/true peak of the\n"
+              << "                               output on stderr this often\n"
+              << "  --loudness-json              Report the loudness readings as JSON lines\n"
+              << "  --metrics-file <path>        Rewrite capture metrics (Prometheus text) every second\n"
+              << "  --metrics-listen <[host:]port> Serve the metrics over HTTP at /metrics (host: 127.0.0.1)\n"
+              << "  --record-trace <file>        Also record every device packet, unconverted, for audio_replay\n"
+              << "  --drift-correction           Resample so the output rate is exact against the system clock\n"
+              << "  --device <spec>              Endpoint to capture: loopback or mic, optionally :<name or ID>\n"
+              << "                               (default: loopback of the default render endpoint). Repeat to\n"
+              << "                               capture several devices in one timestamp-aligned stream\n"
+              << "  --list-devices               List the active endpoints and their --device specs\n"
+              << "  --combine <mix|separate>     Several devices: sum them, or keep their channels side by side\n"
+              << "                               in --device order (default: separate)\n"
+              << "  --align-wait-ms <ms>         Several devices: how long a late device holds up the others\n"
+              << "                               before it is filled with silence (default: 100)\n"
               << "  --mute                       Mute system audio while capturing\n"
               << "  --include-processes <pid>... Only capture audio from these process IDs\n"
               << "  --exclude-processes <pid>... Exclude audio from these process IDs\n"
@@ -1002,6 +1007,22 @@ void PrintUsage() {
               << "  wasapi_capture --sample-rate 48000 --channels 2 --bit-depth 16\n"
               << "  wasapi_capture --sample-rate 44100\n"
               << "  wasapi_capture --channels 1 --bit-depth 24\n"
+              << "  wasapi_capture --sample-rate 16000 --channels 1 --output capture.wav\n"
+              << "  wasapi_capture --bit-depth 16 --flac > capture.flac\n"
+              << "  wasapi_capture --bit-depth 16 --output archive.wav --output - | consumer.exe\n"
+              << "  wasapi_capture --framed --output tcp:5000\n"
+              << "  wasapi_capture --framed --output shm:desktop\n"
+              << "  wasapi_capture --stats-interval 5000 > capture.pcm\n"
+              << "  wasapi_capture --output capture.wav --metrics-listen 9464\n"
+              << "  wasapi_capture --output capture.wav --loudness-interval 1000\n"
+              << "  wasapi_capture --record-trace field.trace > capture.pcm\n"
+              << "  wasapi_capture --sample-rate 48000 --drift-correction --output long.wav\n"
+              << "  wasapi_capture --device mic --low-latency --sample-rate 16000 --channels 1 --framed --output tcp:5000\n"
+              << "  wasapi_capture --device mic:USB --sample-rate 16000 --channels 1 > speech.pcm\n"
+              << "  wasapi_capture --device mic --sample-rate 16000 --channels 1 --frame-size 20ms --framed > frames.bin\n"
+              << "  wasapi_capture --device loopback --device mic --sample-rate 48000 --output call.wav\n"
+              << "  wasapi_capture --sample-rate 48000 --channels 2 --bit-depth 16 --output archive.wav\n"
+              << "                 --output - --output-format 16000:1 | recognizer.exe\n"
               << std::endl;
 }
 
@@ -1110,6 +1131,339 @@ int main(int argc, char* argv[]) {
                     return static_cast<int>(ErrorCode::INVALID_PARAMETER);
                 }
             }
+            else if (arg == "--resample-quality") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --resample-quality requires a value" << std::endl;
+                    std::cerr << "Example: --resample-quality high" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                std::string tier = argv[++i];
+                if (tier == "fast") {
+                    capture.SetResampleQuality(PolyphaseResampler::Quality::Fast);
+                } else if (tier == "medium") {
+                    capture.SetResampleQuality(PolyphaseResampler::Quality::Medium);
+                } else if (tier == "high") {
+                    capture.SetResampleQuality(PolyphaseResampler::Quality::High);
+                } else if (tier == "best") {
+                    capture.SetResampleQuality(PolyphaseResampler::Quality::Best);
+                } else {
+                    std::cerr << "ERROR: Invalid resample quality: " << tier << std::endl;
+                    std::cerr << "Valid values: fast, medium, high, best" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--mix-matrix") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --mix-matrix requires a value" << std::endl;
+                    std::cerr << "Example (stereo to mono): --mix-matrix \"0.5,0.5\"" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetMixMatrix(argv[++i]);
+            }
+            else if (arg == "--output-buffer-ms") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --output-buffer-ms requires a value" << std::endl;
+                    std::cerr << "Example: --output-buffer-ms 2000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 10 || ms > 60000) {
+                        std::cerr << "ERROR: Output buffer out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 10 - 60000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetOutputBufferMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid output buffer value: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 10 and 60000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--max-output-latency-ms") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --max-output-latency-ms requires a value" << std::endl;
+                    std::cerr << "Example: --max-output-latency-ms 50" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 0 || ms > 1000) {
+                        std::cerr << "ERROR: Output latency out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 0 - 1000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetMaxOutputLatencyMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid output latency value: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 0 and 1000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--framed") {
+                capture.SetFramed(true);
+            }
+            else if (arg == "--output") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --output requires a file path" << std::endl;
+                    std::cerr << "Example: --output capture.wav" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.AddOutput(argv[++i]);
+            }
+            else if (arg == "--output-format") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --output-format requires a value" << std::endl;
+                    std::cerr << "Example: --output speech.wav --output-format 16000:1:16" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                if (capture.OutputCount() == 0) {
+                    std::cerr << "ERROR: --output-format applies to the --output given just before it" << std::endl;
+                    std::cerr << "Example: --output speech.wav --output-format 16000:1:16" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                CapturePipeline::FormatSpec spec;
+                if (!CapturePipeline::ParseFormatSpec(argv[++i], spec)) {
+                    std::cerr << "ERROR: Invalid output format: " << argv[i] << std::endl;
+                    std::cerr << "Expected <rate>[:<channels>[:<bits>]] with rate 8000 - 192000, 1 - 8 channels and "
+                                 "16, 24 or 32 bits;" << std::endl;
+                    std::cerr << "empty fields keep --sample-rate, --channels and --bit-depth, e.g. :1 for mono"
+                              << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetLastOutputFormat(spec);
+            }
+            else if (arg == "--max-client-lag-ms") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --max-client-lag-ms requires a value" << std::endl;
+                    std::cerr << "Example: --max-client-lag-ms 1000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 10 || ms > 60000) {
+                        std::cerr << "ERROR: Client lag out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 10 - 60000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetMaxClientLagMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid client lag value: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 10 and 60000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--skip-lagging-clients") {
+                capture.SetSkipLaggingClients(true);
+            }
+            else if (arg == "--flac") {
+                capture.SetFlac(true);
+            }
+            else if (arg == "--stats-interval") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --stats-interval requires a value" << std::endl;
+                    std::cerr << "Example: --stats-interval 5000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 100 || ms > 3600000) {
+                        std::cerr << "ERROR: Stats interval out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 100 - 3600000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetStatsIntervalMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid stats interval: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 100 and 3600000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--stats-json") {
+                capture.SetStatsJson(true);
+            }
+            else if (arg == "--loudness-interval") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --loudness-interval requires a value" << std::endl;
+                    std::cerr << "Example: --loudness-interval 1000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 100 || ms > 3600000) {
+                        std::cerr << "ERROR: Loudness interval out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 100 - 3600000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetLoudnessIntervalMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid loudness interval: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 100 and 3600000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--loudness-json") {
+                capture.SetLoudnessJson(true);
+            }
+            else if (arg == "--metrics-file") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --metrics-file requires a path" << std::endl;
+                    std::cerr << "Example: --metrics-file capture.prom" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetMetricsFile(argv[++i]);
+            }
+            else if (arg == "--metrics-listen") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --metrics-listen requires an address" << std::endl;
+                    std::cerr << "Example: --metrics-listen 9464" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetMetricsListen(argv[++i]);
+            }
+            else if (arg == "--drift-correction") {
+                capture.SetDriftCorrection(true);
+            }
+            else if (arg == "--low-latency") {
+                capture.SetLowLatency(true);
+            }
+            else if (arg == "--frame-size") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --frame-size requires a value" << std::endl;
+                    std::cerr << "Example: --frame-size 320 or --frame-size 20ms" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                uint32_t frames = 0;
+                double ms = 0.0;
+                if (!FrameBlocker::ParseFrameSize(argv[++i], frames, ms)) {
+                    std::cerr << "ERROR: Invalid frame size: " << argv[i] << std::endl;
+                    std::cerr << "Expected a frame count or a duration such as 20ms (at most "
+                              << FrameBlocker::kMaxFrameSeconds << " s)" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetFrameSize(frames, ms);
+            }
+            else if (arg == "--frame-align") {
+                capture.SetFrameAlign(true);
+            }
+            else if (arg == "--device") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --device requires a value" << std::endl;
+                    std::cerr << "Example: --device loopback --device mic:USB" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                DeviceSpec device;
+                if (!DeviceSpec::Parse(argv[++i], device)) {
+                    std::cerr << "ERROR: Invalid device: " << argv[i] << std::endl;
+                    std::cerr << "Expected loopback or mic, optionally followed by :<name or endpoint ID>" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                if (capture.DeviceCount() >= MultiSource::kMaxSources) {
+                    std::cerr << "ERROR: At most " << MultiSource::kMaxSources << " devices can be captured" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.AddDevice(device);
+            }
+            else if (arg == "--list-devices") {
+                return ListDevices() ? static_cast<int>(ErrorCode::SUCCESS)
+                                     : static_cast<int>(ErrorCode::UNKNOWN_ERROR);
+            }
+            else if (arg == "--combine") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --combine requires a value" << std::endl;
+                    std::cerr << "Example: --combine mix" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                std::string layout = argv[++i];
+                if (layout == "mix") {
+                    capture.SetCombineLayout(MultiSource::Layout::Mix);
+                } else if (layout == "separate") {
+                    capture.SetCombineLayout(MultiSource::Layout::Separate);
+                } else {
+                    std::cerr << "ERROR: Invalid --combine value: " << layout << std::endl;
+                    std::cerr << "Valid values: mix, separate" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--align-wait-ms") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --align-wait-ms requires a value" << std::endl;
+                    std::cerr << "Example: --align-wait-ms 100" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int ms = std::stoi(argv[++i]);
+                    if (ms < 10 || ms > 10000) {
+                        std::cerr << "ERROR: Alignment wait out of range: " << ms << std::endl;
+                        std::cerr << "Valid range: 10 - 10000 ms" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetAlignWaitMs(ms);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid alignment wait: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 10 and 10000" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--record-trace") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --record-trace requires a path" << std::endl;
+                    std::cerr << "Example: --record-trace field.trace" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                capture.SetRecordTrace(argv[++i]);
+            }
+            else if (arg == "--flac-level") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --flac-level requires a value" << std::endl;
+                    std::cerr << "Example: --flac-level 5" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int level = std::stoi(argv[++i]);
+                    if (level < 0 || level > 8) {
+                        std::cerr << "ERROR: FLAC level out of range: " << level << std::endl;
+                        std::cerr << "Valid range: 0 - 8" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetFlacLevel(level);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid FLAC level: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between 0 and 8" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--flac-block-size") {
+                if (i + 1 >= argc) {
+                    std::cerr << "ERROR: --flac-block-size requires a value" << std::endl;
+                    std::cerr << "Example: --flac-block-size 4096" << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+                try {
+                    int frames = std::stoi(argv[++i]);
+                    if (frames < (int)FlacEncoder::kMinBlockSize || frames > (int)FlacEncoder::kMaxBlockSize) {
+                        std::cerr << "ERROR: FLAC block size out of range: " << frames << std::endl;
+                        std::cerr << "Valid range: " << FlacEncoder::kMinBlockSize << " - "
+                                  << FlacEncoder::kMaxBlockSize << " frames" << std::endl;
+                        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                    }
+                    capture.SetFlacBlockSize(frames);
+                } catch (const std::exception& e) {
+                    std::cerr << "ERROR: Invalid FLAC block size: " << argv[i] << std::endl;
+                    std::cerr << "Must be a number between " << FlacEncoder::kMinBlockSize << " and "
+                              << FlacEncoder::kMaxBlockSize << std::endl;
+                    return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+                }
+            }
+            else if (arg == "--silence-markers") {
+                capture.SetSilenceMarkers(true);
+            }
+            else if (arg == "--dither") {
+                capture.SetDither(true);
+            }
+            else if (arg == "--mix-normalize") {
+                capture.SetMixNormalize(true);
+            }
             else if (arg == "--mute") {
                 capture.SetMute(true);
             }
@@ -1161,6 +1515,19 @@ int main(int argc, char* argv[]) {
         return static_cast<int>(ErrorCode::INVALID_PARAMETER);
     }
 
+    if (capture.LowLatency() && capture.ChunkDurationSet()) {
+        std::cerr << "ERROR: --chunk-duration cannot be combined with --low-latency" << std::endl;
+        std::cerr << "--low-latency always uses the smallest buffer the audio engine allows" << std::endl;
+        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+    }
+
+    // Output options that constrain each other
+    std::string outputError;
+    if (!capture.ValidateOutputs(&outputError)) {
+        std::cerr << "ERROR: " << outputError << std::endl;
+        return static_cast<int>(ErrorCode::INVALID_PARAMETER);
+    }
+
     // Initialize capture
     if (!capture.Initialize()) {
         std::cerr << "\n!!! INITIALIZATION FAILED !!!" << std::endl;
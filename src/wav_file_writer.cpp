@@ -0,0 +1,265 @@
+#include "wav_file_writer.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+const WavFileWriter::FileHandle WavFileWriter::kInvalidFile = INVALID_HANDLE_VALUE;
+#else
+const WavFileWriter::FileHandle WavFileWriter::kInvalidFile = -1;
+#endif
+
+namespace {
+
+constexpr uint32_t kDs64BodyBytes = 28;
+constexpr uint64_t kMaxRiffSize = 0xFFFFFFFFull;
+
+void Put16(uint8_t*& p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p += 2;
+}
+
+void Put32(uint8_t*& p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+    p += 4;
+}
+
+void Put64(uint8_t*& p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+    p += 8;
+}
+
+void PutTag(uint8_t*& p, const char* tag) {
+    memcpy(p, tag, 4);
+    p += 4;
+}
+
+// WAVE_FORMAT_EXTENSIBLE is required for more than two channels or more
+// than 16 bits, and is the only unambiguous way to describe float data
+bool NeedsExtensible(const WavFormat& format) {
+    return format.channels > 2 || format.bitsPerSample > 16 || format.isFloat || format.channelMask != 0;
+}
+
+}  // namespace
+
+WavFileWriter::~WavFileWriter() {
+    Close();
+}
+
+bool WavFileWriter::Open(const std::string& path, const WavFormat& wavFormat, std::string* error) {
+    if (IsOpen()) Close();
+
+    if (wavFormat.sampleRate == 0 || wavFormat.channels == 0 || wavFormat.blockAlign == 0 ||
+        wavFormat.bitsPerSample == 0) {
+        if (error) *error = "invalid output format";
+        return false;
+    }
+
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == kInvalidFile) {
+        if (error) *error = "cannot create '" + path + "' (error " + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+#else
+    file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file == kInvalidFile) {
+        if (error) *error = "cannot create '" + path + "': " + strerror(errno);
+        return false;
+    }
+#endif
+
+    format = wavFormat;
+    uint32_t fmtBytes = NeedsExtensible(format) ? 40 : 16;
+    // RIFF header, JUNK/ds64 chunk, fmt chunk, data chunk header
+    headerBytes = 12 + (8 + kDs64BodyBytes) + (8 + fmtBytes) + 8;
+    dataBytes = 0;
+    rf64 = false;
+    fileBytes = 0;
+    regionStart = 0;
+    // Roughly once per second of audio
+    patchInterval = (uint64_t)format.sampleRate * format.blockAlign;
+    nextPatch = patchInterval;
+
+    if (!WriteHeader()) {
+        if (error) *error = "cannot write WAV header to '" + path + "'";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool WavFileWriter::WriteHeader() {
+    uint64_t padded = dataBytes + (dataBytes & 1);
+    uint64_t riffSize = headerBytes - 8 + padded;
+    // Once RF64, always RF64: readers may already have seen the ds64 chunk
+    if (riffSize > kMaxRiffSize || dataBytes > kMaxRiffSize) rf64 = true;
+
+    uint8_t header[128];
+    uint8_t* p = header;
+
+    PutTag(p, rf64 ? "RF64" : "RIFF");
+    Put32(p, rf64 ? 0xFFFFFFFFu : (uint32_t)riffSize);
+    PutTag(p, "WAVE");
+
+    // Reserved space becomes the ds64 chunk past 4 GB
+    PutTag(p, rf64 ? "ds64" : "JUNK");
+    Put32(p, kDs64BodyBytes);
+    if (rf64) {
+        Put64(p, riffSize);
+        Put64(p, dataBytes);
+        Put64(p, dataBytes / format.blockAlign);
+        Put32(p, 0);  // no table entries
+    } else {
+        memset(p, 0, kDs64BodyBytes);
+        p += kDs64BodyBytes;
+    }
+
+    bool extensible = NeedsExtensible(format);
+    PutTag(p, "fmt ");
+    Put32(p, extensible ? 40 : 16);
+    Put16(p, extensible ? 0xFFFE : (format.isFloat ? 3 : 1));
+    Put16(p, format.channels);
+    Put32(p, format.sampleRate);
+    Put32(p, format.sampleRate * format.blockAlign);
+    Put16(p, format.blockAlign);
+    Put16(p, format.bitsPerSample);
+    if (extensible) {
+        Put16(p, 22);
+        Put16(p, format.bitsPerSample);  // valid bits
+        Put32(p, format.channelMask);
+        // KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT
+        static const uint8_t kGuidTail[12] = {0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                              0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        Put32(p, format.isFloat ? 3 : 1);
+        memcpy(p, kGuidTail, sizeof(kGuidTail));
+        p += sizeof(kGuidTail);
+    }
+
+    PutTag(p, "data");
+    Put32(p, rf64 ? 0xFFFFFFFFu : (uint32_t)dataBytes);
+
+    return WriteAt(0, header, (size_t)(p - header));
+}
+
+bool WavFileWriter::Write(const uint8_t* data, size_t size) {
+    if (!IsOpen()) return false;
+
+    while (size > 0) {
+        uint64_t position = headerBytes + dataBytes;
+        if (!region || position >= regionStart + kRegionBytes) {
+            if (!MapRegion(position - position % kRegionBytes)) return false;
+        }
+        uint64_t room = regionStart + kRegionBytes - position;
+        size_t n = size < room ? size : (size_t)room;
+        memcpy(region + (position - regionStart), data, n);
+        data += n;
+        size -= n;
+        dataBytes += n;
+    }
+
+    if (dataBytes >= nextPatch) {
+        nextPatch = dataBytes + patchInterval;
+        if (!WriteHeader()) return false;
+    }
+    return true;
+}
+
+bool WavFileWriter::Close() {
+    if (!IsOpen()) return true;
+
+    bool ok = WriteHeader();
+    UnmapRegion();
+
+    // Drop the unused preallocation, keeping the RIFF pad byte (already
+    // zero) after an odd-sized data chunk
+    uint64_t length = headerBytes + dataBytes + (dataBytes & 1);
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)length;
+    ok = SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file) && ok;
+    ok = CloseHandle(file) && ok;
+#else
+    ok = ftruncate(file, (off_t)length) == 0 && ok;
+    ok = ::close(file) == 0 && ok;
+#endif
+    file = kInvalidFile;
+    return ok;
+}
+
+bool WavFileWriter::MapRegion(uint64_t start) {
+    UnmapRegion();
+    uint64_t end = start + kRegionBytes;
+
+#ifdef _WIN32
+    // Creating the mapping with a larger maximum size extends the file
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                        (DWORD)(end >> 32), (DWORD)end, nullptr);
+    if (!mapping) return false;
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(start >> 32), (DWORD)start,
+                               (SIZE_T)kRegionBytes);
+    // The view keeps the section alive
+    CloseHandle(mapping);
+    if (!view) return false;
+#else
+    if (end > fileBytes) {
+        bool extended = false;
+#ifdef __linux__
+        // Reserve real blocks so a full disk fails here, not as SIGBUS on a store
+        extended = posix_fallocate(file, (off_t)fileBytes, (off_t)(end - fileBytes)) == 0;
+#endif
+        if (!extended && ftruncate(file, (off_t)end) != 0) return false;
+    }
+    void* view = mmap(nullptr, (size_t)kRegionBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, (off_t)start);
+    if (view == MAP_FAILED) return false;
+#endif
+
+    if (end > fileBytes) fileBytes = end;
+    region = static_cast<uint8_t*>(view);
+    regionStart = start;
+    return true;
+}
+
+void WavFileWriter::UnmapRegion() {
+    if (!region) return;
+#ifdef _WIN32
+    UnmapViewOfFile(region);
+#else
+    munmap(region, (size_t)kRegionBytes);
+#endif
+    region = nullptr;
+}
+
+bool WavFileWriter::WriteAt(uint64_t offset, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        position.Offset = (DWORD)offset;
+        position.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(file, bytes, (DWORD)size, &written, &position) || written == 0) return false;
+#else
+        ssize_t written = pwrite(file, bytes, size, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (written == 0) return false;
+#endif
+        bytes += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
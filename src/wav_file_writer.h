@@ -0,0 +1,75 @@
+#pragma once
+
+// Streaming WAV file sink.
+//
+// The file is grown in large preallocated regions that are memory mapped,
+// so audio is copied straight into the page cache instead of going through
+// small buffered writes. The header always reserves room for an RF64 'ds64'
+// chunk (as a 'JUNK' chunk) and is rewritten in place as RF64 once the data
+// outgrows 4 GB. Sizes are patched about once per second of audio so a
+// crashed capture still leaves a readable file; Close() trims the
+// preallocated tail.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct WavFormat {
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint16_t bitsPerSample = 0;
+    uint16_t blockAlign = 0;
+    bool isFloat = false;
+    uint32_t channelMask = 0;  // SPEAKER_* bits, 0 for the default layout
+};
+
+class WavFileWriter {
+public:
+    // Size of each mapped region; a multiple of every platform's mapping
+    // granularity
+    static constexpr uint64_t kRegionBytes = 64ull * 1024 * 1024;
+
+    WavFileWriter() {}
+    ~WavFileWriter();
+
+    WavFileWriter(const WavFileWriter&) = delete;
+    WavFileWriter& operator=(const WavFileWriter&) = delete;
+
+    bool Open(const std::string& path, const WavFormat& format, std::string* error);
+
+    // Append PCM; false on an I/O or mapping error
+    bool Write(const uint8_t* data, size_t size);
+
+    // Patch the final sizes, trim the preallocated tail and close the file
+    bool Close();
+
+    bool IsOpen() const { return file != kInvalidFile; }
+    bool IsRf64() const { return rf64; }
+    uint64_t DataBytes() const { return dataBytes; }
+
+private:
+#ifdef _WIN32
+    using FileHandle = void*;
+#else
+    using FileHandle = int;
+#endif
+    static const FileHandle kInvalidFile;
+
+    FileHandle file = kInvalidFile;
+    WavFormat format;
+    uint32_t headerBytes = 0;
+    uint64_t dataBytes = 0;
+    uint64_t patchInterval = 0;
+    uint64_t nextPatch = 0;
+    bool rf64 = false;
+
+    // Currently mapped region [regionStart, regionStart + kRegionBytes)
+    uint8_t* region = nullptr;
+    uint64_t regionStart = 0;
+    uint64_t fileBytes = 0;  // allocated file length
+
+    bool MapRegion(uint64_t start);
+    void UnmapRegion();
+    bool WriteAt(uint64_t offset, const void* data, size_t size);
+    bool WriteHeader();
+};
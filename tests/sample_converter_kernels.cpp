@@ -0,0 +1,205 @@
+// Checks that every SIMD conversion kernel set matches the scalar one.
+//
+// Each kernel of each set this build and CPU support (AVX2, SSE2, NEON) is
+// run over the same input as the scalar kernel and its output compared bit
+// for bit: saturation well past full scale and at the int32 limit, ties
+// and near-ties in rounding, int24 packing, dithered quantization, and
+// every length from 0 to past two vector widths at unaligned starts, so the
+// scalar tails meet the vector bodies. A few scalar results are checked
+// against known values first, so a broken reference cannot hide.
+//
+// Usage: sample_converter_kernels
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "sample_converter.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+constexpr size_t kMaxLength = 40;  // past two AVX2 int16 blocks
+constexpr size_t kMaxOffset = 3;   // unaligned starts
+
+struct Random {
+    uint32_t state = 2463534242u;
+
+    uint32_t Next() {
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        return state;
+    }
+    float Uniform(float lo, float hi) { return lo + (hi - lo) * (Next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// Full scale, just past it, far past it, and the ties and near-ties of
+// every output width around zero and the limits
+std::vector<float> FloatInput() {
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> values = {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 0.99999994f, -0.99999994f,
+                                 1.0000001f, -1.0000001f, 1.5f, -1.5f, 1e10f, -1e10f, inf, -inf};
+    for (float scale : {32768.0f, 8388608.0f, 2147483648.0f}) {
+        for (float fraction : {0.5f, -0.5f, 0.25f, 0.75f, 0.49999f, 0.50001f}) {
+            for (float k : {0.0f, 1.0f, 2.0f, -1.0f, -2.0f, 1000.0f, -1001.0f}) {
+                values.push_back((k + fraction) / scale);
+            }
+            // Near the top and bottom codes, where the clamp meets rounding
+            values.push_back((scale - 1.0f + fraction) / scale);
+            values.push_back((-scale + fraction) / scale);
+        }
+    }
+    Random random;
+    while (values.size() < 4096) values.push_back(random.Uniform(-1.25f, 1.25f));
+    return values;
+}
+
+std::vector<float> DitherInput(size_t count) {
+    Random random;
+    random.state = 88172645u;
+    std::vector<float> values(count);
+    for (float& v : values) v = random.Uniform(-1.0f, 1.0f);
+    return values;
+}
+
+std::vector<uint8_t> ByteInput(size_t count) {
+    Random random;
+    random.state = 521288629u;
+    std::vector<uint8_t> values(count);
+    for (uint8_t& v : values) v = (uint8_t)(random.Next() >> 24);
+    // Both ends of every integer type at the start
+    const uint8_t extremes[] = {0x00, 0x80, 0x00, 0x80, 0xFF, 0xFF, 0xFF, 0x7F, 0x00, 0x00, 0x00, 0x00};
+    memcpy(values.data(), extremes, sizeof(extremes));
+    return values;
+}
+
+// Run `kernel` and the scalar `reference` over every length and start
+// offset of `input` and compare the output bytes
+template <typename In, typename Out, typename Kernel>
+void Compare(const char* set, const char* name, const In* input, size_t inputStride, size_t outputStride,
+             Kernel kernel, Kernel reference, size_t window) {
+    std::vector<Out> expected(window * outputStride + 16);
+    std::vector<Out> actual(expected.size());
+    size_t mismatches = 0;
+    for (size_t start = 0; start + window <= 4096; start += window) {
+        for (size_t offset = 0; offset <= kMaxOffset; offset++) {
+            for (size_t length = 0; length + offset <= window && length <= kMaxLength; length++) {
+                memset(expected.data(), 0xAB, expected.size() * sizeof(Out));
+                memset(actual.data(), 0xAB, actual.size() * sizeof(Out));
+                const In* in = input + (start + offset) * inputStride;
+                reference(in, expected.data(), length, start + offset);
+                kernel(in, actual.data(), length, start + offset);
+                if (memcmp(expected.data(), actual.data(), expected.size() * sizeof(Out)) != 0) {
+                    if (mismatches++ == 0) {
+                        std::fprintf(stderr, "%s %s differs from scalar (start %zu, length %zu)\n", set, name,
+                                     start + offset, length);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+void CheckReference() {
+    const ConversionKernels& scalar = GetScalarConversionKernels();
+    const float in[] = {1.0f, -1.0f, 1e10f, -1e10f, 2.5f / 32768.0f, 3.5f / 32768.0f, -2.5f / 32768.0f};
+    int16_t s16[7];
+    scalar.FloatToInt16(in, s16, 7, nullptr);
+    CHECK(s16[0] == 32767 && s16[1] == -32768 && s16[2] == 32767 && s16[3] == -32768);
+    CHECK(s16[4] == 2 && s16[5] == 4 && s16[6] == -2);  // ties to even
+    uint8_t s24[21];
+    scalar.FloatToInt24(in, s24, 7, nullptr);
+    const uint8_t top[] = {0xFF, 0xFF, 0x7F, 0x00, 0x00, 0x80};
+    CHECK(memcmp(s24, top, sizeof(top)) == 0);
+    int32_t s32[7];
+    scalar.FloatToInt32(in, s32, 7, nullptr);
+    CHECK(s32[0] == INT32_MAX && s32[1] == INT32_MIN && s32[2] == INT32_MAX && s32[3] == INT32_MIN);
+    const float below = 0.99999994f;
+    scalar.FloatToInt32(&below, s32, 1, nullptr);
+    CHECK(s32[0] == 2147483520);
+}
+
+void CheckKernels(const ConversionKernels& set) {
+    const ConversionKernels& scalar = GetScalarConversionKernels();
+    const std::vector<float> floats = FloatInput();
+    const std::vector<float> noise = DitherInput(floats.size());
+    const std::vector<uint8_t> bytes = ByteInput(floats.size() * 4);
+    const size_t window = kMaxLength + kMaxOffset;
+
+    using FromFloat16 = void (*)(const float*, int16_t*, size_t, const float*);
+    using FromFloat24 = void (*)(const float*, uint8_t*, size_t, const float*);
+    using FromFloat32 = void (*)(const float*, int32_t*, size_t, const float*);
+    for (bool dither : {false, true}) {
+        const char* suffix = dither ? " (dithered)" : "";
+        std::string name16 = std::string("FloatToInt16") + suffix;
+        std::string name24 = std::string("FloatToInt24") + suffix;
+        std::string name32 = std::string("FloatToInt32") + suffix;
+        auto noiseAt = [&](size_t at) { return dither ? noise.data() + at : nullptr; };
+        auto run16 = [&](FromFloat16 f) {
+            return [&, f](const float* in, int16_t* out, size_t n, size_t at) { f(in, out, n, noiseAt(at)); };
+        };
+        auto run24 = [&](FromFloat24 f) {
+            return [&, f](const float* in, uint8_t* out, size_t n, size_t at) { f(in, out, n, noiseAt(at)); };
+        };
+        auto run32 = [&](FromFloat32 f) {
+            return [&, f](const float* in, int32_t* out, size_t n, size_t at) { f(in, out, n, noiseAt(at)); };
+        };
+        Compare<float, int16_t>(set.name, name16.c_str(), floats.data(), 1, 1, run16(set.FloatToInt16),
+                                run16(scalar.FloatToInt16), window);
+        Compare<float, uint8_t>(set.name, name24.c_str(), floats.data(), 1, 3, run24(set.FloatToInt24),
+                                run24(scalar.FloatToInt24), window);
+        Compare<float, int32_t>(set.name, name32.c_str(), floats.data(), 1, 1, run32(set.FloatToInt32),
+                                run32(scalar.FloatToInt32), window);
+    }
+
+    using ToFloat16 = void (*)(const int16_t*, float*, size_t);
+    using ToFloat24 = void (*)(const uint8_t*, float*, size_t);
+    using ToFloat32 = void (*)(const int32_t*, float*, size_t);
+    auto from16 = [](ToFloat16 f) { return [f](const int16_t* in, float* out, size_t n, size_t) { f(in, out, n); }; };
+    auto from24 = [](ToFloat24 f) { return [f](const uint8_t* in, float* out, size_t n, size_t) { f(in, out, n); }; };
+    auto from32 = [](ToFloat32 f) { return [f](const int32_t* in, float* out, size_t n, size_t) { f(in, out, n); }; };
+    Compare<int16_t, float>(set.name, "Int16ToFloat", reinterpret_cast<const int16_t*>(bytes.data()), 1, 1,
+                            from16(set.Int16ToFloat), from16(scalar.Int16ToFloat), window);
+    Compare<uint8_t, float>(set.name, "Int24ToFloat", bytes.data(), 3, 1, from24(set.Int24ToFloat),
+                            from24(scalar.Int24ToFloat), window);
+    Compare<int32_t, float>(set.name, "Int32ToFloat", reinterpret_cast<const int32_t*>(bytes.data()), 1, 1,
+                            from32(set.Int32ToFloat), from32(scalar.Int32ToFloat), window);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    (void)argv;
+    if (argc > 1) {
+        std::fprintf(stderr, "Usage: sample_converter_kernels\n");
+        return 2;
+    }
+    CheckReference();
+    int checked = 0;
+    for (const ConversionKernels* set : GetAvailableConversionKernels()) {
+        if (set == &GetScalarConversionKernels()) continue;
+        int before = failures;
+        CheckKernels(*set);
+        std::fprintf(stderr, "%s: %s\n", set->name, failures == before ? "matches scalar" : "FAILED");
+        checked++;
+    }
+    if (checked == 0) std::fprintf(stderr, "No SIMD kernels on this CPU; scalar reference only\n");
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
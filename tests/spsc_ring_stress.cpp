@@ -0,0 +1,368 @@
+// Stress test for SpscByteRing and AsyncOutput.
+//
+// A producer and a consumer thread run at full speed over a small ring so
+// it wraps constantly and overruns often. Every record carries its sequence
+// number, length and padding, and a payload derived from the sequence
+// number; the consumer checks each one byte for byte and that records
+// arrive in order with exactly the dropped ones missing. The ring's
+// overrun, dropped-byte, written-byte and high-water counters are checked
+// against what the producer saw.
+//
+// Usage: spsc_ring_stress [--records <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_output.h"
+#include "spsc_ring.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+struct RecordHeader {
+    uint32_t sequence;
+    uint16_t length;   // payload bytes
+    uint16_t padding;  // zero bytes after the payload
+};
+
+constexpr size_t kMaxPayload = 700;
+constexpr size_t kMaxPadding = 16;
+constexpr size_t kMaxRecord = sizeof(RecordHeader) + kMaxPayload + kMaxPadding;
+
+uint8_t PayloadByte(uint32_t sequence, size_t i) {
+    return static_cast<uint8_t>(sequence * 31u + i * 7u + (i >> 8));
+}
+
+// Deterministic record sizes, mostly small with the odd large one
+struct RecordSource {
+    uint32_t state = 12345;
+    uint8_t payload[kMaxPayload];
+
+    RecordHeader Next(uint32_t sequence) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t r = state >> 8;
+        RecordHeader header;
+        header.sequence = sequence;
+        header.length = static_cast<uint16_t>((r & 15) == 0 ? r % kMaxPayload : r % 64);
+        header.padding = static_cast<uint16_t>((r >> 12) % 4 == 0 ? (r >> 16) % kMaxPadding : 0);
+        for (size_t i = 0; i < header.length; i++) payload[i] = PayloadByte(sequence, i);
+        return header;
+    }
+};
+
+// Parses the byte stream back into records, however it is split
+class RecordChecker {
+public:
+    explicit RecordChecker(size_t expectedRecords) { received.reserve(expectedRecords); }
+
+    void Feed(const uint8_t* data, size_t size) {
+        bytes += size;
+        for (size_t i = 0; i < size; i++) FeedByte(data[i]);
+    }
+
+    // A record was cut off at the end of the stream
+    bool Partial() const { return position != 0; }
+
+    std::vector<uint32_t> received;
+    uint64_t bytes = 0;
+    uint64_t corrupt = 0;
+    uint64_t outOfOrder = 0;
+
+private:
+    RecordHeader header{};
+    size_t position = 0;  // within the current record
+
+    void FeedByte(uint8_t b) {
+        if (position < sizeof(RecordHeader)) {
+            reinterpret_cast<uint8_t*>(&header)[position++] = b;
+            if (position == sizeof(RecordHeader)) {
+                if (header.length > kMaxPayload || header.padding > kMaxPadding) corrupt++;
+                if (!received.empty() && header.sequence <= received.back()) outOfOrder++;
+                received.push_back(header.sequence);
+                if (header.length == 0 && header.padding == 0) position = 0;
+            }
+            return;
+        }
+        size_t i = position - sizeof(RecordHeader);
+        uint8_t expected = i < header.length ? PayloadByte(header.sequence, i) : 0;
+        if (b != expected) corrupt++;
+        if (++position == sizeof(RecordHeader) + header.length + header.padding) position = 0;
+    }
+};
+
+struct ProducerLog {
+    std::vector<uint32_t> accepted;
+    uint64_t acceptedBytes = 0;
+    uint64_t rejected = 0;
+    uint64_t rejectedBytes = 0;
+    size_t largestAccepted = 0;
+
+    void Add(uint32_t sequence, size_t size, bool ok) {
+        if (ok) {
+            accepted.push_back(sequence);
+            acceptedBytes += size;
+            largestAccepted = std::max(largestAccepted, size);
+        } else {
+            rejected++;
+            rejectedBytes += size;
+        }
+    }
+};
+
+// Both threads flat out; with `retry` the producer spins on a full ring
+// instead of dropping
+void RingStress(uint32_t records, size_t capacity, bool retry) {
+    SpscByteRing ring;
+    CHECK(ring.Initialize(capacity));
+    ProducerLog log;
+    log.accepted.reserve(records);
+    RecordChecker checker(records);
+    std::atomic<bool> done{false};
+    uint64_t retries = 0;
+
+    std::thread consumer([&] {
+        for (;;) {
+            bool finished = done.load(std::memory_order_acquire);
+            const uint8_t* a;
+            const uint8_t* b;
+            size_t aLength;
+            size_t bLength;
+            size_t available = ring.Peek(&a, &aLength, &b, &bLength);
+            checker.Feed(a, aLength);
+            checker.Feed(b, bLength);
+            ring.Consume(available);
+            if (available == 0) {
+                if (finished) break;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    RecordSource source;
+    for (uint32_t sequence = 0; sequence < records; sequence++) {
+        RecordHeader header = source.Next(sequence);
+        size_t size = sizeof(header) + header.length + header.padding;
+        for (;;) {
+            bool ok = ring.Write(&header, sizeof(header), source.payload, header.length, header.padding);
+            if (ok || !retry) {
+                log.Add(sequence, size, ok);
+                break;
+            }
+            retries++;
+            std::this_thread::yield();
+        }
+    }
+    done.store(true, std::memory_order_release);
+    consumer.join();
+
+    std::printf("ring %s: %u records, %zu bytes ring, %llu dropped, %llu retries, high water %llu\n",
+                retry ? "lossless" : "lossy", records, ring.Capacity(), (unsigned long long)log.rejected,
+                (unsigned long long)retries, (unsigned long long)ring.HighWaterBytes());
+    CHECK(checker.corrupt == 0);
+    CHECK(checker.outOfOrder == 0);
+    CHECK(!checker.Partial());
+    CHECK(checker.received == log.accepted);
+    CHECK(checker.bytes == log.acceptedBytes);
+    CHECK(ring.WrittenBytes() == log.acceptedBytes);
+    CHECK(ring.Overruns() == (retry ? retries : log.rejected));
+    if (!retry) CHECK(ring.DroppedBytes() == log.rejectedBytes);
+    if (retry) CHECK(log.accepted.size() == records);
+    CHECK(ring.HighWaterBytes() >= log.largestAccepted);
+    CHECK(ring.HighWaterBytes() <= ring.Capacity());
+    CHECK(ring.Empty());
+}
+
+// With the consumer stalled the ring fills up to within one record of its
+// capacity, rejects whole records and then drains intact
+void RingFill() {
+    SpscByteRing ring;
+    CHECK(ring.Initialize(3000));
+    CHECK(ring.Capacity() == 4096);
+    RecordSource source;
+    ProducerLog log;
+    uint32_t sequence = 0;
+    while (log.rejected < 10) {
+        RecordHeader header = source.Next(sequence);
+        size_t size = sizeof(header) + header.length + header.padding;
+        log.Add(sequence++, size, ring.Write(&header, sizeof(header), source.payload, header.length, header.padding));
+    }
+    CHECK(ring.Overruns() == 10);
+    CHECK(ring.DroppedBytes() == log.rejectedBytes);
+    CHECK(ring.Used() == log.acceptedBytes);
+    CHECK(ring.HighWaterBytes() == log.acceptedBytes);
+    CHECK(ring.HighWaterBytes() > ring.Capacity() - kMaxRecord);
+
+    RecordChecker checker(sequence);
+    uint8_t buffer[1000];
+    while (size_t n = ring.Read(buffer, sizeof(buffer))) checker.Feed(buffer, n);
+    CHECK(checker.corrupt == 0);
+    CHECK(checker.received == log.accepted);
+    CHECK(ring.Empty());
+}
+
+// A consumer that keeps up: each record is read before the next is
+// written, so the high-water mark is the largest record, not the ring
+void RingKeepsUp(uint32_t records) {
+    SpscByteRing ring;
+    CHECK(ring.Initialize(1 << 16));
+    RecordSource source;
+    ProducerLog log;
+    RecordChecker checker(records);
+    uint8_t buffer[kMaxRecord];
+    for (uint32_t sequence = 0; sequence < records; sequence++) {
+        RecordHeader header = source.Next(sequence);
+        size_t size = sizeof(header) + header.length + header.padding;
+        log.Add(sequence, size, ring.Write(&header, sizeof(header), source.payload, header.length, header.padding));
+        checker.Feed(buffer, ring.Read(buffer, sizeof(buffer)));
+    }
+    CHECK(log.rejected == 0);
+    CHECK(checker.received == log.accepted);
+    CHECK(ring.HighWaterBytes() == log.largestAccepted);
+}
+
+// The same through AsyncOutput's writer thread: the producer waits for the
+// ring to drain before each record
+void AsyncKeepsUp(uint32_t records) {
+    AsyncOutput output;
+    RecordChecker checker(records);
+    CHECK(output.Start(1 << 16, [&](const uint8_t* first, size_t firstSize, const uint8_t* second,
+                                    size_t secondSize) {
+        checker.Feed(first, firstSize);
+        checker.Feed(second, secondSize);
+        return true;
+    }));
+    ProducerLog log;
+    RecordSource source;
+    for (uint32_t sequence = 0; sequence < records; sequence++) {
+        RecordHeader header = source.Next(sequence);
+        size_t size = sizeof(header) + header.length + header.padding;
+        log.Add(sequence, size, output.Write(&header, sizeof(header), source.payload, header.length, header.padding));
+        while (!output.Ring().Empty()) std::this_thread::yield();
+    }
+    output.Stop();
+
+    std::printf("async keeping up: %u records, %zu bytes ring, high water %llu\n", records,
+                output.Ring().Capacity(), (unsigned long long)output.Ring().HighWaterBytes());
+    CHECK(log.rejected == 0);
+    CHECK(checker.received == log.accepted);
+    CHECK(output.Ring().HighWaterBytes() == log.largestAccepted);
+}
+
+// The capture thread's side of AsyncOutput flat out, the writer thread
+// checking every byte it hands to the sink
+void AsyncStress(uint32_t records, size_t capacity, size_t coalesceBytes) {
+    AsyncOutput output;
+    if (coalesceBytes) output.SetCoalescing(coalesceBytes, std::chrono::milliseconds(2));
+    RecordChecker checker(records);
+    uint64_t sinkCalls = 0;
+    CHECK(output.Start(capacity, [&](const uint8_t* first, size_t firstSize, const uint8_t* second,
+                                     size_t secondSize) {
+        checker.Feed(first, firstSize);
+        checker.Feed(second, secondSize);
+        sinkCalls++;
+        return true;
+    }));
+
+    ProducerLog log;
+    log.accepted.reserve(records);
+    RecordSource source;
+    for (uint32_t sequence = 0; sequence < records; sequence++) {
+        RecordHeader header = source.Next(sequence);
+        size_t size = sizeof(header) + header.length + header.padding;
+        log.Add(sequence, size, output.Write(&header, sizeof(header), source.payload, header.length, header.padding));
+    }
+    output.Stop();
+
+    std::printf("async %s: %u records, %zu bytes ring, %llu dropped, %llu sink calls, high water %llu\n",
+                coalesceBytes ? "coalescing" : "immediate", records, output.Ring().Capacity(),
+                (unsigned long long)log.rejected, (unsigned long long)sinkCalls,
+                (unsigned long long)output.Ring().HighWaterBytes());
+    CHECK(!output.Failed());
+    CHECK(checker.corrupt == 0);
+    CHECK(checker.outOfOrder == 0);
+    CHECK(!checker.Partial());
+    CHECK(checker.received == log.accepted);
+    CHECK(checker.bytes == log.acceptedBytes);
+    CHECK(output.Ring().WrittenBytes() == log.acceptedBytes);
+    CHECK(output.Ring().Overruns() == log.rejected);
+    CHECK(output.Ring().DroppedBytes() == log.rejectedBytes);
+    CHECK(output.SinkCalls() == sinkCalls);
+    CHECK(output.Ring().HighWaterBytes() >= log.largestAccepted);
+    CHECK(output.Ring().HighWaterBytes() <= output.Ring().Capacity());
+}
+
+// A failing sink stops further writes without blocking the producer
+void AsyncSinkFailure() {
+    AsyncOutput output;
+    std::atomic<int> calls{0};
+    CHECK(output.Start(4096, [&](const uint8_t*, size_t, const uint8_t*, size_t) {
+        return ++calls < 3;
+    }));
+    RecordSource source;
+    uint64_t accepted = 0;
+    for (uint32_t sequence = 0; sequence < 100000; sequence++) {
+        RecordHeader header = source.Next(sequence);
+        if (output.Write(&header, sizeof(header), source.payload, header.length, header.padding)) accepted++;
+        if (output.Failed()) break;
+    }
+    // Wait for the writer to reach the failing call if the loop outran it
+    for (int i = 0; i < 1000 && !output.Failed(); i++) {
+        RecordHeader header = source.Next(0);
+        output.Write(&header, sizeof(header), source.payload, header.length, header.padding);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(output.Failed());
+    RecordHeader header = source.Next(0);
+    CHECK(!output.Write(&header, sizeof(header)));
+    output.Stop();
+    CHECK(calls.load() == 3);
+    CHECK(accepted > 0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t records = 2000000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--records" && i + 1 < argc) {
+            records = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::fprintf(stderr, "Usage: spsc_ring_stress [--records <n>]\n");
+            return 2;
+        }
+    }
+
+    RingFill();
+    RingKeepsUp(100000);
+    RingStress(records, 4096, false);
+    RingStress(records, 4096, true);
+    RingStress(records, 1 << 16, false);
+    AsyncStress(records, 4096, 0);
+    AsyncStress(records, 1 << 16, 8192);
+    AsyncKeepsUp(20000);
+    AsyncSinkFailure();
+
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
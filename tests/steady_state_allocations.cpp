@@ -0,0 +1,213 @@
+// Checks that the capture path allocates nothing once it has warmed up.
+//
+// Built against audio_core_counted, a copy of audio_core that replaces the
+// global operator new (allocation_counter.h). Each configuration replays a
+// synthetic source through CapturePipeline as fast as the outputs accept,
+// well past CapturePipeline::kWarmupSeconds, and fails if the capture
+// thread or any writer allocated after warm-up. The resampler's flush is
+// checked on its own, since the pipeline only drains it after counting.
+// Audio for stdout goes to the null device.
+//
+// Usage: steady_state_allocations [--duration <s>]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "allocation_counter.h"
+#include "capture_pipeline.h"
+#include "polyphase_resampler.h"
+#include "synthetic_source.h"
+
+namespace {
+
+struct Case {
+    const char* name;
+    CapturePipeline::Config pipeline = {};
+    SyntheticSource::Config source = {};
+};
+
+SyntheticSource::Config Source(double seconds) {
+    SyntheticSource::Config config;
+    config.realtime = false;
+    config.durationSeconds = seconds;
+    return config;
+}
+
+std::vector<Case> Cases(double seconds, const std::string& wavPath) {
+    std::vector<Case> cases;
+
+    Case resample{"resample 48 kHz float -> 44.1 kHz 16-bit"};
+    resample.pipeline.sampleRate = 44100;
+    resample.pipeline.bitDepth = 16;
+    resample.pipeline.dither = true;
+    resample.source = Source(seconds);
+    cases.push_back(resample);
+
+    Case speech{"resample and downmix to 16 kHz mono, framed, 20 ms frames"};
+    speech.pipeline.sampleRate = 16000;
+    speech.pipeline.channels = 1;
+    speech.pipeline.bitDepth = 16;
+    speech.pipeline.framed = true;
+    speech.pipeline.frameMs = 20.0;
+    speech.source = Source(seconds);
+    cases.push_back(speech);
+
+    Case flac{"FLAC on stdout"};
+    flac.pipeline.bitDepth = 16;
+    flac.pipeline.flac = true;
+    flac.source = Source(seconds);
+    flac.source.signal = SyntheticSource::Signal::Noise;
+    cases.push_back(flac);
+
+    Case wav{"WAV file, 24-bit, with stdout at 16 kHz"};
+    wav.pipeline.bitDepth = 24;
+    wav.pipeline.outputs = {wavPath, "-"};
+    wav.pipeline.outputFormats = {CapturePipeline::FormatSpec{}, CapturePipeline::FormatSpec{16000, 1, 16}};
+    wav.source = Source(seconds);
+    cases.push_back(wav);
+
+    Case framed{"framed, silent and lost packets, 441-frame blocks, loudness"};
+    framed.pipeline.sampleRate = 44100;
+    framed.pipeline.bitDepth = 16;
+    framed.pipeline.framed = true;
+    framed.pipeline.frameFrames = 441;
+    framed.pipeline.loudnessIntervalMs = 1000;
+    framed.source = Source(seconds);
+    framed.source.silentEvery = 7;
+    framed.source.silentPackets = 3;
+    framed.source.discontinuityEvery = 11;
+    framed.source.timestampErrorEvery = 13;
+    cases.push_back(framed);
+
+    Case markers{"silence markers, drift correction, statistics"};
+    markers.pipeline.bitDepth = 16;
+    markers.pipeline.silenceMarkers = true;
+    markers.pipeline.driftCorrection = true;
+    markers.pipeline.statsIntervalMs = 1000;
+    markers.source = Source(seconds);
+    markers.source.silentEvery = 5;
+    markers.source.silentPackets = 4;
+    markers.source.clockSkewPpm = 50.0;
+    cases.push_back(markers);
+    return cases;
+}
+
+bool RunCase(const Case& test) {
+    std::fprintf(stderr, "=== %s\n", test.name);
+    std::string error;
+    SyntheticSource source;
+    if (!source.Initialize(test.source, &error)) {
+        std::fprintf(stderr, "FAIL: %s\n", error.c_str());
+        return false;
+    }
+    if (!CapturePipeline::ValidateOutputs(test.pipeline, &error)) {
+        std::fprintf(stderr, "FAIL: %s\n", error.c_str());
+        return false;
+    }
+    CapturePipeline pipeline;
+    if (!pipeline.Initialize(test.pipeline, source.Format()) || !pipeline.Start(source.BufferFrames())) {
+        std::fprintf(stderr, "FAIL: the pipeline did not start\n");
+        return false;
+    }
+    if (!source.Start(&error)) {
+        std::fprintf(stderr, "FAIL: %s\n", error.c_str());
+        pipeline.Finish();
+        return false;
+    }
+    std::atomic<bool> running{true};
+    pipeline.Run(source, running);
+    source.Stop();
+    pipeline.Finish();
+
+    if (pipeline.OutputFailed()) {
+        std::fprintf(stderr, "FAIL: every output failed\n");
+        return false;
+    }
+    if (pipeline.SteadyStateAllocations() > 0) {
+        std::fprintf(stderr, "FAIL: %llu allocations after warm-up\n",
+                     (unsigned long long)pipeline.SteadyStateAllocations());
+        return false;
+    }
+    return true;
+}
+
+// Draining the filter tail reuses the buffers of the first stream
+bool ResamplerFlush() {
+    std::fprintf(stderr, "=== resampler flush\n");
+    PolyphaseResampler resampler;
+    resampler.Initialize(48000, 16000, 2);
+    std::vector<float> input(480 * 2, 0.25f);
+    std::vector<float> output(resampler.MaxOutputFrames(input.size()) * 4);
+    uint64_t allocations = 0;
+    for (int stream = 0; stream < 3; stream++) {
+        uint64_t before = ThreadHeapAllocations();
+        for (int packet = 0; packet < 10; packet++) {
+            resampler.Process(input.data(), 480, output.data(), output.size() / 2);
+        }
+        resampler.Flush(output.data(), output.size() / 2);
+        if (stream > 0) allocations += ThreadHeapAllocations() - before;
+    }
+    if (allocations > 0) {
+        std::fprintf(stderr, "FAIL: %llu allocations in later streams\n", (unsigned long long)allocations);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    double seconds = 6.0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--duration" && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "Usage: steady_state_allocations [--duration <s>]\n");
+            return 2;
+        }
+    }
+    if (!AllocationCountingEnabled()) {
+        std::fprintf(stderr, "FAIL: built without AUDIO_COUNT_ALLOCATIONS\n");
+        return 1;
+    }
+    if (seconds <= CapturePipeline::kWarmupSeconds) {
+        std::fprintf(stderr, "FAIL: --duration must exceed the %.0f s warm-up\n", CapturePipeline::kWarmupSeconds);
+        return 2;
+    }
+
+#ifdef _WIN32
+    int null = _open("NUL", _O_WRONLY);
+    if (null >= 0) _dup2(null, _fileno(stdout));
+#else
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, fileno(stdout));
+#endif
+
+    std::filesystem::path wavPath = std::filesystem::temp_directory_path() / "steady_state_allocations.wav";
+    int failed = 0;
+    for (const Case& test : Cases(seconds, wavPath.string())) {
+        if (!RunCase(test)) failed++;
+    }
+    if (!ResamplerFlush()) failed++;
+    std::error_code ignored;
+    std::filesystem::remove(wavPath, ignored);
+
+    if (failed) {
+        std::fprintf(stderr, "%d configuration(s) allocated after warm-up\n", failed);
+        return 1;
+    }
+    std::fprintf(stderr, "No allocations after warm-up\n");
+    return 0;
+}
@@ -0,0 +1,500 @@
+// Portable front end for the capture pipeline.
+//
+// Feeds a recording or a generated test signal through the same conversion
+// and output stages as wasapi_capture, so the pipeline can be exercised,
+// benchmarked and debugged on machines without a Windows audio device.
+// Several sources given together are aligned on their timestamps and
+// combined like wasapi_capture's multi-device capture (multi_source.h).
+// In builds with AUDIO_COUNT_ALLOCATIONS the exit status is 1 when the
+// capture path allocated after warm-up.
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capture_pipeline.h"
+#include "file_replay_source.h"
+#include "multi_source.h"
+#include "synthetic_source.h"
+#include "trace_replay_source.h"
+
+namespace {
+
+std::atomic<bool> g_running{false};
+
+void HandleSignal(int) {
+    g_running = false;
+}
+
+void PrintUsage() {
+    std::cerr << "Usage: audio_replay (--input <file> | --trace <file> | --synthetic <signal>)... [options]\n"
+              << "Source options:\n"
+              << "  --input <file>                 Replay a WAV/RF64 file or headerless PCM\n"
+              << "  --trace <file>                 Replay a capture trace (--record-trace) packet for packet,\n"
+              << "                                 at its original pacing unless --fast is given\n"
+              << "  --input-format <rate:ch:type>  Raw input layout or generated format, type s16le, s24le,\n"
+              << "                                 s32le or f32le (default for --synthetic: 48000:2:f32le)\n"
+              << "  --synthetic <signal>           Generate sine[:Hz], noise or silence\n"
+              << "  --duration <seconds>           Stop the generator after this long (default: run until Ctrl+C)\n"
+              << "  --packet-ms <ms>               Packet size delivered to the pipeline (default: 10, or 2 with\n"
+              << "                                 --low-latency)\n"
+              << "  --fast                         Run as fast as the output accepts instead of in real time\n"
+              << "  --loop                         Restart the input file at its end\n"
+              << "  --silent-every <n>[:len]       Flag every nth packet (and len-1 more) as silent\n"
+              << "  --discontinuity-every <n>      Drop the packet before every nth and flag a discontinuity\n"
+              << "  --timestamp-error-every <n>    Flag every nth packet with a timestamp error\n"
+              << "  --clock-skew-ppm <ppm>         Run the generator's clock this far off its nominal rate\n"
+              << "  --start-offset-ms <ms>         Start the generator this long after the others\n"
+              << "  --input-format, --clock-skew-ppm and --start-offset-ms apply to the source given just\n"
+              << "  before them, or to every source when given first\n"
+              << "Multiple sources (give --input, --trace or --synthetic more than once):\n"
+              << "  --combine <mix|separate>       Sum the sources, or keep their channels side by side in\n"
+              << "                                 source order (default: separate)\n"
+              << "  --align-wait-ms <ms>           How long a late real-time source holds up the others before\n"
+              << "                                 its span is filled with silence (default: 100)\n"
+              << "Pipeline options (same meaning as in wasapi_capture):\n"
+              << "  --sample-rate, --channels, --bit-depth, --resample-quality, --dither, --mix-matrix,\n"
+              << "  --mix-normalize, --output-buffer-ms, --max-output-latency-ms, --silence-markers, --framed, --output,\n"
+              << "  --output-format, --max-client-lag-ms, --skip-lagging-clients, --flac, --flac-level,\n"
+              << "  --flac-block-size, --stats-interval, --stats-json, --loudness-interval, --loudness-json,\n"
+              << "  --metrics-file, --metrics-listen, --record-trace, --drift-correction, --low-latency,\n"
+              << "  --frame-size, --frame-align\n"
+              << "\nExamples:\n"
+              << "  audio_replay --input capture.wav --fast --sample-rate 16000 --channels 1 > speech.pcm\n"
+              << "  audio_replay --synthetic sine:1000 --duration 10 --framed --silent-every 50:10 > framed.bin\n"
+              << "  audio_replay --input raw.pcm --input-format 48000:2:s16le --flac > raw.flac\n"
+              << "  audio_replay --synthetic sine --framed --output tcp:5000 --output unix:/tmp/audio.sock\n"
+              << "  audio_replay --synthetic sine --silence-markers --output shm:test\n"
+              << "  audio_replay --trace field.trace --fast --framed --stats-interval 1000 > replay.bin\n"
+              << "  audio_replay --synthetic sine --low-latency --framed --stats-interval 1000 > /dev/null\n"
+              << "  audio_replay --synthetic sine --fast --duration 600 --clock-skew-ppm 80 --drift-correction > out.pcm\n"
+              << "  audio_replay --input speech.wav --fast --sample-rate 16000 --channels 1 --frame-size 20ms --framed\n"
+              << "               > frames.bin\n"
+              << "  audio_replay --synthetic sine --duration 10 --sample-rate 48000 --bit-depth 16 --output archive.wav\n"
+              << "               --output speech.wav --output-format 16000:1\n"
+              << "  audio_replay --input program.wav --fast --loudness-interval 1000 --loudness-json > /dev/null\n"
+              << "  audio_replay --synthetic sine:440 --synthetic noise --start-offset-ms 250 --clock-skew-ppm 50\n"
+              << "               --combine mix --duration 10 > mixed.pcm\n"
+              << std::endl;
+}
+
+// One --input, --trace or --synthetic and the options that belong to it
+struct SourceSpec {
+    enum class Kind { File, Trace, Synthetic };
+    Kind kind = Kind::Synthetic;
+    std::string text;      // path or signal
+    AudioFormat format;    // raw input layout or generated format; unset keeps the default
+    double clockSkewPpm = 0.0;
+    double startOffsetMs = 0.0;
+};
+
+// Options shared by every source
+struct SourceOptions {
+    double durationSeconds = 0.0;
+    double packetMs = 10.0;
+    bool fast = false;
+    bool loop = false;
+    double silentEvery = 0;
+    double silentPackets = 1;
+    double discontinuityEvery = 0;
+    double timestampErrorEvery = 0;
+};
+
+bool ParseFormat(const std::string& text, AudioFormat& format) {
+    size_t first = text.find(':');
+    size_t second = first == std::string::npos ? first : text.find(':', first + 1);
+    if (second == std::string::npos) return false;
+
+    char* end = nullptr;
+    unsigned long rate = strtoul(text.c_str(), &end, 10);
+    if (end != text.c_str() + first || rate < 1000 || rate > 768000) return false;
+    unsigned long channels = strtoul(text.c_str() + first + 1, &end, 10);
+    if (end != text.c_str() + second || channels < 1 || channels > SyntheticSource::kMaxChannels) return false;
+
+    std::string type = text.substr(second + 1);
+    if (type == "s16le") {
+        format.type = SampleType::Int16;
+    } else if (type == "s24le") {
+        format.type = SampleType::Int24;
+    } else if (type == "s32le") {
+        format.type = SampleType::Int32;
+    } else if (type == "f32le") {
+        format.type = SampleType::Float32;
+    } else {
+        return false;
+    }
+    format.sampleRate = (uint32_t)rate;
+    format.channels = (uint32_t)channels;
+    format.channelMask = 0;
+    return true;
+}
+
+// Numeric option value in [minimum, maximum]; reports errors itself
+bool ParseNumber(int argc, char* argv[], int& i, double minimum, double maximum, double& value) {
+    const char* name = argv[i];
+    if (i + 1 >= argc) {
+        std::cerr << "ERROR: " << name << " requires a value" << std::endl;
+        return false;
+    }
+    const char* text = argv[++i];
+    char* end = nullptr;
+    value = strtod(text, &end);
+    if (end == text || *end != '\0' || value < minimum || value > maximum) {
+        std::cerr << "ERROR: Invalid " << name << " value: " << text << std::endl;
+        std::cerr << "Valid range: " << minimum << " - " << maximum << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ParseText(int argc, char* argv[], int& i, std::string& value) {
+    if (i + 1 >= argc) {
+        std::cerr << "ERROR: " << argv[i] << " requires a value" << std::endl;
+        return false;
+    }
+    value = argv[++i];
+    return true;
+}
+
+std::unique_ptr<CaptureSource> OpenSource(const SourceSpec& spec, const SourceOptions& options, std::string* error) {
+    if (spec.kind == SourceSpec::Kind::File) {
+        FileReplaySource::Config fileConfig;
+        fileConfig.path = spec.text;
+        fileConfig.rawFormat = spec.format;
+        fileConfig.packetMs = options.packetMs;
+        fileConfig.realtime = !options.fast;
+        fileConfig.loop = options.loop;
+        auto file = std::make_unique<FileReplaySource>();
+        if (!file->Open(fileConfig, error)) return nullptr;
+        std::cerr << "Replaying " << spec.text << (file->IsWav() ? " (WAV)" : " (raw PCM)") << std::endl;
+        return file;
+    }
+    if (spec.kind == SourceSpec::Kind::Trace) {
+        TraceReplaySource::Config traceConfig;
+        traceConfig.path = spec.text;
+        traceConfig.realtime = !options.fast;
+        auto replay = std::make_unique<TraceReplaySource>();
+        if (!replay->Open(traceConfig, error)) return nullptr;
+        std::cerr << "Replaying trace " << spec.text << ": " << replay->Packets() << " packets, "
+                  << replay->Frames() << " frames over " << replay->DurationSeconds() << " s" << std::endl;
+        if (replay->TraceGaps() > 0) {
+            std::cerr << "Warning: The recorder dropped packets in " << replay->TraceGaps() << " places" << std::endl;
+        }
+        return replay;
+    }
+
+    SyntheticSource::Config synthConfig;
+    if (!SyntheticSource::ParseSignal(spec.text, synthConfig, error)) return nullptr;
+    if (spec.format.sampleRate != 0) synthConfig.format = spec.format;
+    synthConfig.packetFrames = (uint32_t)(synthConfig.format.sampleRate * options.packetMs / 1000.0);
+    if (synthConfig.packetFrames == 0) synthConfig.packetFrames = 1;
+    synthConfig.durationSeconds = options.durationSeconds;
+    synthConfig.realtime = !options.fast;
+    synthConfig.silentEvery = (uint32_t)options.silentEvery;
+    synthConfig.silentPackets = (uint32_t)options.silentPackets;
+    synthConfig.discontinuityEvery = (uint32_t)options.discontinuityEvery;
+    synthConfig.timestampErrorEvery = (uint32_t)options.timestampErrorEvery;
+    synthConfig.clockSkewPpm = spec.clockSkewPpm;
+    synthConfig.startOffsetMs = spec.startOffsetMs;
+    auto synthetic = std::make_unique<SyntheticSource>();
+    if (!synthetic->Initialize(synthConfig, error)) return nullptr;
+    return synthetic;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    CapturePipeline::Config config;
+    // Source options given before the first source apply to every source
+    SourceSpec defaults;
+    std::vector<SourceSpec> specs;
+    SourceOptions options;
+    MultiSource::Config multiConfig;
+    bool packetMsSet = false;
+    bool outputBufferSet = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        double number = 0;
+        bool ok = true;
+
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (arg == "--input" || arg == "--trace" || arg == "--synthetic") {
+            SourceSpec spec = defaults;
+            spec.kind = arg == "--input" ? SourceSpec::Kind::File
+                      : arg == "--trace" ? SourceSpec::Kind::Trace : SourceSpec::Kind::Synthetic;
+            ok = ParseText(argc, argv, i, spec.text);
+            specs.push_back(spec);
+        } else if (arg == "--input-format") {
+            std::string text;
+            ok = ParseText(argc, argv, i, text);
+            if (ok && !ParseFormat(text, (specs.empty() ? defaults : specs.back()).format)) {
+                std::cerr << "ERROR: Invalid --input-format: " << text << std::endl;
+                std::cerr << "Expected <rate>:<channels>:<s16le|s24le|s32le|f32le>, e.g. 48000:2:f32le" << std::endl;
+                ok = false;
+            }
+        } else if (arg == "--duration") {
+            ok = ParseNumber(argc, argv, i, 0.0, 1e7, options.durationSeconds);
+        } else if (arg == "--packet-ms") {
+            ok = ParseNumber(argc, argv, i, 0.1, 1000.0, options.packetMs);
+            packetMsSet = true;
+        } else if (arg == "--fast") {
+            options.fast = true;
+        } else if (arg == "--loop") {
+            options.loop = true;
+        } else if (arg == "--silent-every") {
+            std::string text;
+            ok = ParseText(argc, argv, i, text);
+            if (ok) {
+                char* end = nullptr;
+                options.silentEvery = strtoul(text.c_str(), &end, 10);
+                if (*end == ':') options.silentPackets = strtoul(end + 1, &end, 10);
+                if (*end != '\0' || options.silentEvery < 1 || options.silentPackets < 1 ||
+                    options.silentPackets > options.silentEvery) {
+                    std::cerr << "ERROR: Invalid --silent-every: " << text << std::endl;
+                    std::cerr << "Expected <n>[:len] with 1 <= len <= n, e.g. 50:10" << std::endl;
+                    ok = false;
+                }
+            }
+        } else if (arg == "--discontinuity-every") {
+            ok = ParseNumber(argc, argv, i, 1, 1e9, options.discontinuityEvery);
+        } else if (arg == "--timestamp-error-every") {
+            ok = ParseNumber(argc, argv, i, 1, 1e9, options.timestampErrorEvery);
+        } else if (arg == "--clock-skew-ppm") {
+            ok = ParseNumber(argc, argv, i, -ClockDriftEstimator::kMaxDriftPpm, ClockDriftEstimator::kMaxDriftPpm,
+                             (specs.empty() ? defaults : specs.back()).clockSkewPpm);
+        } else if (arg == "--start-offset-ms") {
+            ok = ParseNumber(argc, argv, i, 0, 60000, (specs.empty() ? defaults : specs.back()).startOffsetMs);
+        } else if (arg == "--combine") {
+            std::string layout;
+            ok = ParseText(argc, argv, i, layout);
+            if (layout == "mix") {
+                multiConfig.layout = MultiSource::Layout::Mix;
+            } else if (layout == "separate") {
+                multiConfig.layout = MultiSource::Layout::Separate;
+            } else if (ok) {
+                std::cerr << "ERROR: Invalid --combine value: " << layout << std::endl;
+                std::cerr << "Valid values: mix, separate" << std::endl;
+                ok = false;
+            }
+        } else if (arg == "--align-wait-ms") {
+            ok = ParseNumber(argc, argv, i, 10, 10000, number);
+            multiConfig.maxWaitMs = (uint32_t)number;
+        } else if (arg == "--sample-rate") {
+            ok = ParseNumber(argc, argv, i, 8000, 192000, number);
+            config.sampleRate = (int)number;
+        } else if (arg == "--channels") {
+            ok = ParseNumber(argc, argv, i, 1, 8, number);
+            config.channels = (int)number;
+        } else if (arg == "--bit-depth") {
+            ok = ParseNumber(argc, argv, i, 16, 32, number);
+            config.bitDepth = (int)number;
+        } else if (arg == "--resample-quality") {
+            std::string tier;
+            ok = ParseText(argc, argv, i, tier);
+            if (tier == "fast") {
+                config.resampleQuality = PolyphaseResampler::Quality::Fast;
+            } else if (tier == "medium") {
+                config.resampleQuality = PolyphaseResampler::Quality::Medium;
+            } else if (tier == "high") {
+                config.resampleQuality = PolyphaseResampler::Quality::High;
+            } else if (tier == "best") {
+                config.resampleQuality = PolyphaseResampler::Quality::Best;
+            } else if (ok) {
+                std::cerr << "ERROR: Invalid resample quality: " << tier << std::endl;
+                std::cerr << "Valid values: fast, medium, high, best" << std::endl;
+                ok = false;
+            }
+        } else if (arg == "--dither") {
+            config.dither = true;
+        } else if (arg == "--mix-matrix") {
+            ok = ParseText(argc, argv, i, config.mixMatrixText);
+        } else if (arg == "--mix-normalize") {
+            config.mixNormalize = true;
+        } else if (arg == "--output-buffer-ms") {
+            ok = ParseNumber(argc, argv, i, 10, 60000, number);
+            config.outputBufferMs = (int)number;
+            outputBufferSet = true;
+        } else if (arg == "--max-output-latency-ms") {
+            ok = ParseNumber(argc, argv, i, 0, 10000, number);
+            config.maxOutputLatencyMs = (int)number;
+        } else if (arg == "--silence-markers") {
+            config.silenceMarkers = true;
+        } else if (arg == "--framed") {
+            config.framed = true;
+        } else if (arg == "--output") {
+            std::string target;
+            ok = ParseText(argc, argv, i, target);
+            config.outputs.push_back(target);
+        } else if (arg == "--output-format") {
+            std::string text;
+            ok = ParseText(argc, argv, i, text);
+            CapturePipeline::FormatSpec spec;
+            if (ok && config.outputs.empty()) {
+                std::cerr << "ERROR: --output-format applies to the --output given just before it" << std::endl;
+                ok = false;
+            } else if (ok && !CapturePipeline::ParseFormatSpec(text, spec)) {
+                std::cerr << "ERROR: Invalid --output-format: " << text << std::endl;
+                std::cerr << "Expected <rate>[:<channels>[:<bits>]], empty fields keep the main format, "
+                             "e.g. 16000:1:16" << std::endl;
+                ok = false;
+            }
+            if (ok) {
+                config.outputFormats.resize(config.outputs.size());
+                config.outputFormats.back() = spec;
+            }
+        } else if (arg == "--max-client-lag-ms") {
+            ok = ParseNumber(argc, argv, i, 10, 60000, number);
+            config.maxClientLagMs = (int)number;
+        } else if (arg == "--skip-lagging-clients") {
+            config.skipLaggingClients = true;
+        } else if (arg == "--flac") {
+            config.flac = true;
+        } else if (arg == "--stats-interval") {
+            ok = ParseNumber(argc, argv, i, 100, 3600000, number);
+            config.statsIntervalMs = (int)number;
+        } else if (arg == "--stats-json") {
+            config.statsJson = true;
+        } else if (arg == "--loudness-interval") {
+            ok = ParseNumber(argc, argv, i, 100, 3600000, number);
+            config.loudnessIntervalMs = (int)number;
+        } else if (arg == "--loudness-json") {
+            config.loudnessJson = true;
+        } else if (arg == "--metrics-file") {
+            ok = ParseText(argc, argv, i, config.metricsFile);
+        } else if (arg == "--metrics-listen") {
+            ok = ParseText(argc, argv, i, config.metricsListen);
+        } else if (arg == "--record-trace") {
+            ok = ParseText(argc, argv, i, config.traceFile);
+        } else if (arg == "--drift-correction") {
+            config.driftCorrection = true;
+        } else if (arg == "--low-latency") {
+            config.lowLatency = true;
+        } else if (arg == "--frame-size") {
+            std::string text;
+            ok = ParseText(argc, argv, i, text);
+            if (ok && !FrameBlocker::ParseFrameSize(text, config.frameFrames, config.frameMs)) {
+                std::cerr << "ERROR: Invalid --frame-size: " << text << std::endl;
+                std::cerr << "Expected a frame count or a duration such as 20ms (at most "
+                          << FrameBlocker::kMaxFrameSeconds << " s)" << std::endl;
+                ok = false;
+            }
+        } else if (arg == "--frame-align") {
+            config.frameAlign = true;
+        } else if (arg == "--flac-level") {
+            ok = ParseNumber(argc, argv, i, 0, 8, number);
+            config.flacLevel = (int)number;
+        } else if (arg == "--flac-block-size") {
+            ok = ParseNumber(argc, argv, i, FlacEncoder::kMinBlockSize, FlacEncoder::kMaxBlockSize, number);
+            config.flacBlockSize = (int)number;
+        } else {
+            std::cerr << "ERROR: Unknown argument: " << arg << std::endl;
+            std::cerr << "Use --help to see available options" << std::endl;
+            ok = false;
+        }
+        if (!ok) return 1;
+    }
+
+    if (specs.empty()) {
+        std::cerr << "ERROR: Give at least one of --input, --trace or --synthetic" << std::endl;
+        PrintUsage();
+        return 1;
+    }
+    if (specs.size() > MultiSource::kMaxSources) {
+        std::cerr << "ERROR: At most " << MultiSource::kMaxSources << " sources can be combined" << std::endl;
+        return 1;
+    }
+    if (config.bitDepth != 0 && config.bitDepth != 16 && config.bitDepth != 24 && config.bitDepth != 32) {
+        std::cerr << "ERROR: Invalid bit depth: " << config.bitDepth << std::endl;
+        std::cerr << "Valid values: 16, 24, 32 bits" << std::endl;
+        return 1;
+    }
+    if (config.lowLatency) {
+        // The generator stands in for a device running at a small engine period
+        if (!packetMsSet) options.packetMs = 2.0;
+        if (!outputBufferSet) config.outputBufferMs = CapturePipeline::kLowLatencyOutputBufferMs;
+    }
+    // Same container rules as wasapi_capture
+    std::string error;
+    if (!CapturePipeline::ValidateOutputs(config, &error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<CaptureSource> source;
+    MultiSource* multi = nullptr;
+    if (specs.size() == 1) {
+        source = OpenSource(specs[0], options, &error);
+    } else {
+        auto combined = std::make_unique<MultiSource>();
+        for (const SourceSpec& spec : specs) {
+            std::unique_ptr<CaptureSource> input = OpenSource(spec, options, &error);
+            if (!input) break;
+            const AudioFormat& inputFormat = input->Format();
+            std::cerr << "Source " << combined->SourceCount() + 1 << ": " << input->Name() << ", "
+                      << inputFormat.sampleRate << "Hz, " << inputFormat.channels << " channels, "
+                      << SampleTypeName(inputFormat.type) << std::endl;
+            combined->AddSource(std::move(input));
+        }
+        if (combined->SourceCount() == specs.size()) {
+            // Resample each source straight to the requested rate
+            multiConfig.sampleRate = (uint32_t)config.sampleRate;
+            multiConfig.packetMs = (uint32_t)std::max(1.0, options.packetMs);
+            multiConfig.quality = config.resampleQuality;
+            multiConfig.lowLatency = config.lowLatency;
+            if (combined->Initialize(multiConfig, &error)) {
+                multi = combined.get();
+                source = std::move(combined);
+            }
+        }
+    }
+    if (!source) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    const bool fast = options.fast;
+
+    const AudioFormat& format = source->Format();
+    std::cerr << "Source format: " << format.sampleRate << "Hz, " << format.channels << " channels, "
+              << SampleTypeName(format.type) << (fast ? " (fast)" : " (real time)") << std::endl;
+
+    CapturePipeline pipeline;
+    if (!pipeline.Initialize(config, format)) {
+        return 1;
+    }
+
+    std::signal(SIGINT, HandleSignal);
+#ifdef SIGPIPE
+    // A closed reader shows up as a failed write, which stops the pipeline
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    g_running = true;
+    if (!pipeline.Start(source->BufferFrames())) {
+        return 1;
+    }
+    if (!source->Start(&error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        pipeline.Finish();
+        return 1;
+    }
+
+    pipeline.Run(*source, g_running);
+
+    source->Stop();
+    pipeline.Finish();
+    if (multi) multi->PrintSummary();
+    std::cerr << "Replay stopped." << std::endl;
+
+    // Builds that count allocations fail the run if the capture path
+    // allocated after warm-up, so scripted replays catch regressions
+    uint64_t allocations = pipeline.SteadyStateAllocations() + (multi ? multi->SteadyStateAllocations() : 0);
+    return allocations > 0 ? 1 : 0;
+}
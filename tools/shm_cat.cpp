@@ -0,0 +1,133 @@
+// Reader for the shared-memory ring output (--output shm:<name>).
+//
+// Attaches to the ring at its live edge and copies it to stdout, giving the
+// same byte stream the publisher would have written there; a framed ring is
+// preceded by its stream header. It doubles as the reference for embedding a
+// reader: consumers in-process can use the Peek() views directly instead of
+// copying.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raw_output.h"
+#include "shared_memory_ring.h"
+
+namespace {
+
+std::atomic<bool> g_running{true};
+
+void HandleSignal(int) {
+    g_running = false;
+}
+
+void PrintUsage() {
+    std::cerr << "Usage: shm_cat <name> [--wait-ms <ms>]\n"
+              << "  <name>           Ring given to --output shm:<name>\n"
+              << "  --wait-ms <ms>   How long to wait for the publisher to start (default: 5000)\n"
+              << "\nExample:\n"
+              << "  wasapi_capture --framed --output shm:desktop\n"
+              << "  shm_cat desktop > capture.bin\n"
+              << std::endl;
+}
+
+const char* ContainerName(uint32_t container) {
+    switch (container) {
+        case shmring::kContainerRecords: return "silence records";
+        case shmring::kContainerFramed: return "framed";
+    }
+    return "raw PCM";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string name;
+    long waitMs = 5000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (arg == "--wait-ms" && i + 1 < argc) {
+            waitMs = std::strtol(argv[++i], nullptr, 10);
+        } else if (name.empty() && arg[0] != '-') {
+            name = arg;
+        } else {
+            std::cerr << "ERROR: Unknown argument: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (name.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::signal(SIGINT, HandleSignal);
+#ifdef SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // The publisher may not be up yet; keep trying for a while
+    SharedMemoryRingReader reader;
+    std::string error;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(waitMs);
+    while (!reader.Attach(name, &error)) {
+        if (!g_running || std::chrono::steady_clock::now() >= deadline) {
+            std::cerr << "ERROR: Cannot attach to '" << name << "': " << error << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    const shmring::Header& header = reader.Header();
+    std::cerr << "Attached to '" << name << "': " << header.sampleRate << "Hz, " << header.channels
+              << " channels, " << header.bitsPerSample << " bits, " << ContainerName(header.container) << ", "
+              << header.capacity / 1024 << " KB ring" << std::endl;
+
+    RawOutput output;
+    if (!output.OpenStdout()) {
+        std::cerr << "ERROR: Failed to open stdout handle for writing" << std::endl;
+        return 1;
+    }
+    if (header.container == shmring::kContainerFramed &&
+        !output.Write(header.streamHeader, sizeof(header.streamHeader))) {
+        return 1;
+    }
+
+    // Copy out before writing: a span is only known to be intact once
+    // Consume() has checked it against the writer
+    std::vector<uint8_t> buffer;
+    bool ended = false;
+    while (g_running && !ended) {
+        SharedMemoryRingReader::WaitResult result = reader.Wait(500);
+        if (result == SharedMemoryRingReader::WaitResult::Timeout) continue;
+        ended = result == SharedMemoryRingReader::WaitResult::Closed;
+
+        const uint8_t* first;
+        const uint8_t* second;
+        size_t firstSize;
+        size_t secondSize;
+        size_t available = reader.Peek(&first, &firstSize, &second, &secondSize);
+        if (available == 0) continue;
+        buffer.resize(available);
+        memcpy(buffer.data(), first, firstSize);
+        memcpy(buffer.data() + firstSize, second, secondSize);
+        if (!reader.Consume(available)) {
+            std::cerr << "Warning: reader overrun, skipped to the live edge" << std::endl;
+            continue;
+        }
+        if (!output.Write(buffer.data(), buffer.size())) break;
+    }
+
+    std::cerr << "shm_cat: " << reader.BytesRead() << " bytes read, " << reader.Overruns() << " overruns ("
+              << reader.LostBytes() << " bytes lost)" << std::endl;
+    return 0;
+}